@@ -56,6 +56,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/localimageloader.h"
 #include "storage/file_download.h"
 #include "storage/file_upload.h"
+#include "storage/storage_uploaded_index.h"
 #include "storage/storage_facade.h"
 #include "storage/storage_shared_media.h"
 #include "storage/storage_user_photos.h"
@@ -92,6 +93,7 @@ constexpr auto kSharedMediaLimit = 100;
 //constexpr auto kFeedMessagesLimit = 50; // #feed
 constexpr auto kReadFeaturedSetsTimeout = crl::time(1000);
 constexpr auto kFileLoaderQueueStopTimeout = crl::time(5000);
+constexpr auto kFileLoaderQueueMaxWorkers = 4;
 //constexpr auto kFeedReadTimeout = crl::time(1000); // #feed
 constexpr auto kStickersByEmojiInvalidateTimeout = crl::time(60 * 60 * 1000);
 constexpr auto kNotifySettingSaveTimeout = crl::time(1000);
@@ -160,6 +162,15 @@ MTPVector<MTPDocumentAttribute> ComposeSendingDocumentAttributes(
 	return MTP_vector<MTPDocumentAttribute>(attributes);
 }
 
+int FileLoaderWorkersCount() {
+	// Leave one core for the main thread, each worker may hold
+	// a large decoded image in memory, so don't use too many of them.
+	return std::clamp(
+		QThread::idealThreadCount() - 1,
+		1,
+		kFileLoaderQueueMaxWorkers);
+}
+
 } // namespace
 
 MTPInputPrivacyKey ApiWrap::Privacy::Input(Key key) {
@@ -228,7 +239,9 @@ ApiWrap::ApiWrap(not_null<Main::Session*> session)
 , _draftsSaveTimer([=] { saveDraftsToCloud(); })
 , _featuredSetsReadTimer([=] { readFeaturedSets(); })
 , _dialogsLoadState(std::make_unique<DialogsLoadState>())
-, _fileLoader(std::make_unique<TaskQueue>(kFileLoaderQueueStopTimeout))
+, _fileLoader(std::make_unique<TaskQueue>(
+	kFileLoaderQueueStopTimeout,
+	FileLoaderWorkersCount()))
 //, _feedReadTimer([=] { readFeeds(); }) // #feed
 , _proxyPromotionTimer([=] { refreshProxyPromotion(); })
 , _updateNotifySettingsTimer([=] { sendNotifySettingsUpdates(); }) {
@@ -4672,7 +4685,7 @@ void ApiWrap::sendVoiceMessage(
 		duration,
 		waveform,
 		to,
-		caption));
+		caption), TaskPriority::High);
 }
 
 void ApiWrap::editMedia(
@@ -4749,7 +4762,9 @@ void ApiWrap::sendFiles(
 			album->items.emplace_back(task->id());
 		}
 	}
-	_fileLoader->addTasks(std::move(tasks));
+	_fileLoader->addTasks(
+		std::move(tasks),
+		album ? TaskPriority::High : TaskPriority::Normal);
 }
 
 void ApiWrap::sendFile(
@@ -4818,6 +4833,32 @@ void ApiWrap::sendUploadedDocument(
 	}
 }
 
+void ApiWrap::sendExistingUploadedDocument(
+		FullMsgId localId,
+		const MTPInputDocument &document,
+		Api::SendOptions options) {
+	const auto item = _session->data().message(localId);
+	if (!item) {
+		return;
+	}
+	const auto media = MTP_inputMediaDocument(
+		MTP_flags(MTPDinputMediaDocument::Flags(0)),
+		document,
+		MTPint());
+	const auto randomId = rand_value<uint64>();
+	_session->data().registerMessageRandomId(randomId, localId);
+
+	const auto fallback = [=](const RPCError &error) {
+		if (!Storage::UploadedIndex::IsReferenceError(error)) {
+			return false;
+		}
+		_session->data().unregisterMessageRandomId(randomId);
+		_session->uploader().existingFailed(localId);
+		return true;
+	};
+	sendMediaWithRandomId(item, media, options, randomId, fallback);
+}
+
 void ApiWrap::editUploadedFile(
 		FullMsgId localId,
 		const MTPInputFile &file,
@@ -5272,7 +5313,8 @@ void ApiWrap::sendMediaWithRandomId(
 		not_null<HistoryItem*> item,
 		const MTPInputMedia &media,
 		Api::SendOptions options,
-		uint64 randomId) {
+		uint64 randomId,
+		Fn<bool(const RPCError&)> handleFail) {
 	const auto history = item->history();
 	const auto replyTo = item->replyToId();
 
@@ -5311,7 +5353,9 @@ void ApiWrap::sendMediaWithRandomId(
 	)).done([=](const MTPUpdates &result) {
 		applyUpdates(result);
 	}).fail([=](const RPCError &error) {
-		sendMessageFail(error, peer, randomId, itemId);
+		if (!handleFail || !handleFail(error)) {
+			sendMessageFail(error, peer, randomId, itemId);
+		}
 	}).afterRequest(
 		history->sendRequestId
 	).send();
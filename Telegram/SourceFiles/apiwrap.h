@@ -423,6 +423,10 @@ public:
 		const MTPInputFile &file,
 		const std::optional<MTPInputFile> &thumb,
 		Api::SendOptions options);
+	void sendExistingUploadedDocument(
+		FullMsgId localId,
+		const MTPInputDocument &document,
+		Api::SendOptions options);
 	void editUploadedFile(
 		FullMsgId localId,
 		const MTPInputFile &file,
@@ -655,7 +659,8 @@ private:
 		not_null<HistoryItem*> item,
 		const MTPInputMedia &media,
 		Api::SendOptions options,
-		uint64 randomId);
+		uint64 randomId,
+		Fn<bool(const RPCError&)> handleFail = nullptr);
 	FileLoadTo fileLoadTaskOptions(const SendAction &action) const;
 
 	//void readFeeds(); // #feed
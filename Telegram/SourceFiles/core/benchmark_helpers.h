@@ -0,0 +1,23 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <chrono>
+
+namespace Core {
+
+// Wall clock time of one call, for the benchmark_* test targets.
+template <typename Method>
+[[nodiscard]] double MeasureMilliseconds(Method &&method) {
+	const auto start = std::chrono::steady_clock::now();
+	method();
+	const auto finish = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(finish - start).count();
+}
+
+} // namespace Core
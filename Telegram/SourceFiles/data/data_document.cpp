@@ -959,6 +959,9 @@ void DocumentData::save(
 			_loader = std::make_unique<webFileLoader>(
 				_url,
 				toFile,
+				((saveToCache() || toFile.isEmpty())
+					? LoadToCacheAsWell
+					: LoadToFileOnly),
 				fromCloud,
 				autoLoading,
 				cacheTag());
@@ -26,6 +26,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "inline_bots/inline_bot_layout_item.h"
 #include "storage/localstorage.h"
 #include "storage/storage_encrypted_file.h"
+#include "storage/storage_uploaded_index.h"
 #include "main/main_account.h"
 #include "media/player/media_player_instance.h" // instance()->play()
 #include "media/streaming/media_streaming_loader.h" // unique_ptr<Loader>
@@ -215,7 +216,8 @@ Session::Session(not_null<Main::Session*> session)
 , _unmuteByFinishedTimer([=] { unmuteByFinished(); })
 , _groups(this)
 , _scheduledMessages(std::make_unique<ScheduledMessages>(this))
-, _cloudThemes(std::make_unique<CloudThemes>(session)) {
+, _cloudThemes(std::make_unique<CloudThemes>(session))
+, _uploadedIndex(std::make_unique<Storage::UploadedIndex>(this)) {
 	_cache->open(Local::cacheKey());
 	_bigFileCache->open(Local::cacheBigFileKey());
 
@@ -2523,6 +2525,7 @@ void Session::documentConvert(
 		if (savedGifs().indexOf(original) >= 0) {
 			Local::writeSavedGifs();
 		}
+		_uploadedIndex->documentConverted(original);
 	}
 }
 
@@ -61,6 +61,10 @@ namespace Passport {
 struct SavedCredentials;
 } // namespace Passport
 
+namespace Storage {
+class UploadedIndex;
+} // namespace Storage
+
 namespace Data {
 
 class Folder;
@@ -97,6 +101,9 @@ public:
 	[[nodiscard]] CloudThemes &cloudThemes() const {
 		return *_cloudThemes;
 	}
+	[[nodiscard]] Storage::UploadedIndex &uploadedIndex() const {
+		return *_uploadedIndex;
+	}
 	[[nodiscard]] MsgId nextNonHistoryEntryId() {
 		return ++_nonHistoryEntryId;
 	}
@@ -1001,6 +1008,7 @@ private:
 	Groups _groups;
 	std::unique_ptr<ScheduledMessages> _scheduledMessages;
 	std::unique_ptr<CloudThemes> _cloudThemes;
+	std::unique_ptr<Storage::UploadedIndex> _uploadedIndex;
 	MsgId _nonHistoryEntryId = ServerMaxMsgId;
 
 	rpl::lifetime _lifetime;
@@ -31,6 +31,11 @@ constexpr auto kUrlCacheTag = 0x0000030000000000ULL;
 constexpr auto kUrlCacheMask = 0x000000FFFFFFFFFFULL;
 constexpr auto kGeoPointCacheTag = 0x0000040000000000ULL;
 constexpr auto kGeoPointCacheMask = 0x000000FFFFFFFFFFULL;
+constexpr auto kUploadedFileCacheTag = 0x0000050000000000ULL;
+constexpr auto kUploadedFileCacheMask = 0x000000FFFFFFFFFFULL;
+constexpr auto kPartialDownloadCacheTag = 0x0000060000000000ULL;
+constexpr auto kPartialDownloadCacheMask = 0x000000FFFFFFFFFFULL;
+constexpr auto kPartialDownloadsListCacheTag = 0x0000070000000000ULL;
 
 } // namespace
 
@@ -109,6 +114,37 @@ Storage::Cache::Key GeoPointCacheKey(const GeoPointLocation &location) {
 	};
 }
 
+Storage::Cache::Key UploadedFileCacheKey(bytes::const_span hash) {
+	Expects(hash.size() >= sizeof(uint64) * 2);
+
+	const auto part1 = *reinterpret_cast<const uint64*>(hash.data());
+	const auto part2 = *reinterpret_cast<const uint64*>(
+		hash.subspan(sizeof(uint64)).data());
+	return Storage::Cache::Key{
+		Data::kUploadedFileCacheTag | (part1 & kUploadedFileCacheMask),
+		part2
+	};
+}
+
+Storage::Cache::Key PartialDownloadCacheKey(
+		const Storage::Cache::Key &file,
+		int32 size) {
+	uint64 data[3] = { file.high, file.low, uint64(uint32(size)) };
+	const auto hash = openssl::Sha256(bytes::make_span(data));
+	const auto bytes = bytes::make_span(hash);
+	const auto part1 = *reinterpret_cast<const uint64*>(bytes.data());
+	const auto part2 = *reinterpret_cast<const uint64*>(
+		bytes.subspan(sizeof(uint64)).data());
+	return Storage::Cache::Key{
+		Data::kPartialDownloadCacheTag | (part1 & kPartialDownloadCacheMask),
+		part2
+	};
+}
+
+Storage::Cache::Key PartialDownloadsListCacheKey() {
+	return Storage::Cache::Key{ Data::kPartialDownloadsListCacheTag, 0 };
+}
+
 ReplyPreview::ReplyPreview() = default;
 
 ReplyPreview::ReplyPreview(ReplyPreview &&other) = default;
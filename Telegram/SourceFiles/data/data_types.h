@@ -47,6 +47,11 @@ Storage::Cache::Key DocumentThumbCacheKey(int32 dcId, uint64 id);
 Storage::Cache::Key WebDocumentCacheKey(const WebFileLocation &location);
 Storage::Cache::Key UrlCacheKey(const QString &location);
 Storage::Cache::Key GeoPointCacheKey(const GeoPointLocation &location);
+Storage::Cache::Key UploadedFileCacheKey(bytes::const_span hash);
+Storage::Cache::Key PartialDownloadCacheKey(
+	const Storage::Cache::Key &file,
+	int32 size);
+Storage::Cache::Key PartialDownloadsListCacheKey();
 
 constexpr auto kImageCacheTag = uint8(0x01);
 constexpr auto kStickerCacheTag = uint8(0x02);
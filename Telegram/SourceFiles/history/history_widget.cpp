@@ -2684,6 +2684,8 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 }
 
 void HistoryWidget::onScroll() {
+	// Media painted after the scroll is loaded before the hidden one.
+	session().downloader().clearPriorities();
 	preloadHistoryIfNeeded();
 	visibleAreaUpdated();
 	if (!_synteticScrollEvent) {
@@ -4460,6 +4462,13 @@ void HistoryWidget::subscribeToUploader() {
 			documentUploaded(data.fullId, data.options, data.file);
 		}
 	}, _uploaderSubscriptions);
+	session().uploader().documentExisting(
+	) | rpl::start_with_next([=](const UploadedExisting &data) {
+		session().api().sendExistingUploadedDocument(
+			data.fullId,
+			data.document,
+			data.options);
+	}, _uploaderSubscriptions);
 	session().uploader().thumbDocumentReady(
 	) | rpl::start_with_next([=](const UploadedThumbDocument &data) {
 		thumbDocumentUploaded(
@@ -69,6 +69,7 @@ Session::Session(
 	_api->refreshProxyPromotion();
 	_api->requestTermsUpdate();
 	_api->requestFullPeer(_user);
+	_downloader->clearUnusedPartialFiles();
 
 	crl::on_main(this, [=] {
 		using Flag = Notify::PeerUpdate::Flag;
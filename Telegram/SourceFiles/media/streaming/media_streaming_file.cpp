@@ -17,6 +17,54 @@ namespace {
 
 constexpr auto kMaxSingleReadAmount = 8 * 1024 * 1024;
 
+[[nodiscard]] crl::time KnownDuration(crl::time duration) {
+	return (duration == kTimeUnknown || duration == kDurationUnavailable)
+		? crl::time(0)
+		: duration;
+}
+
+[[nodiscard]] std::vector<int> KeyframeOffsets(
+		not_null<AVFormatContext*> format,
+		const Stream &stream,
+		int size) {
+	auto result = std::vector<int>();
+	if (stream.index < 0) {
+		return result;
+	}
+	const auto info = format->streams[stream.index];
+	result.reserve(info->nb_index_entries);
+	for (auto i = 0; i != info->nb_index_entries; ++i) {
+		const auto &entry = info->index_entries[i];
+		if ((entry.flags & AVINDEX_KEYFRAME)
+			&& entry.pos >= 0
+			&& entry.pos < size) {
+			result.push_back(int(entry.pos));
+		}
+	}
+	ranges::sort(result);
+	result.erase(ranges::unique(result), end(result));
+	return result;
+}
+
+[[nodiscard]] std::optional<int> KeyframeOffset(
+		not_null<AVFormatContext*> format,
+		const Stream &stream,
+		int64_t pts,
+		int size) {
+	const auto info = format->streams[stream.index];
+	const auto index = av_index_search_timestamp(
+		info,
+		pts,
+		AVSEEK_FLAG_BACKWARD);
+	if (index < 0 || index >= info->nb_index_entries) {
+		return std::nullopt;
+	}
+	const auto pos = info->index_entries[index].pos;
+	return (pos >= 0 && pos < size)
+		? std::make_optional(int(pos))
+		: std::nullopt;
+}
+
 } // namespace
 
 File::Context::Context(
@@ -194,14 +242,20 @@ void File::Context::seekToPosition(
 	//	return;
 	//}
 	//
+	const auto pts = FFmpeg::TimeToPts(
+		std::clamp(position, crl::time(0), stream.duration - 1),
+		stream.timeBase);
 	error = av_seek_frame(
 		format,
 		stream.index,
-		FFmpeg::TimeToPts(
-			std::clamp(position, crl::time(0), stream.duration - 1),
-			stream.timeBase),
+		pts,
 		AVSEEK_FLAG_BACKWARD);
 	if (!error) {
+		// Let the reader drop requests for the previous position.
+		const auto offset = KeyframeOffset(format, stream, pts, _size);
+		if (offset) {
+			_reader->seekTo(*offset);
+		}
 		return;
 	}
 	return logFatal(qstr("av_seek_frame"), error);
@@ -252,11 +306,16 @@ void File::Context::start(crl::time position) {
 	}
 
 	_reader->headerDone();
+	_reader->setDuration(std::max(
+		KnownDuration(video.duration),
+		KnownDuration(audio.duration)));
 	if (_reader->isRemoteLoader()) {
 		sendFullInCache(true);
 	}
 	if (video.codec || audio.codec) {
-		seekToPosition(format.get(), video.codec ? video : audio, position);
+		const auto &stream = video.codec ? video : audio;
+		_reader->setKeyframes(KeyframeOffsets(format.get(), stream, _size));
+		seekToPosition(format.get(), stream, position);
 	}
 	if (unroll()) {
 		return;
@@ -7,6 +7,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "media/streaming/media_streaming_loader.h"
 
+#include <range/v3/algorithm/find.hpp>
+
 namespace Media {
 namespace Streaming {
 
@@ -41,6 +43,17 @@ bool PriorityQueue::add(int value) {
 	return false;
 }
 
+bool PriorityQueue::addLowest(int value) {
+	if (ranges::find(_data, value, &Entry::value) != end(_data)) {
+		return false;
+	}
+	const auto lowest = _data.empty()
+		? _priority
+		: std::min(_data.back().priority, _priority);
+	_data.insert({ value, lowest - 1 });
+	return true;
+}
+
 bool PriorityQueue::remove(int value) {
 	const auto i = ranges::find(_data, value, &Entry::value);
 	if (i == end(_data)) {
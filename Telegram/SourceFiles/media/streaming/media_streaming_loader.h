@@ -7,7 +7,15 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #pragma once
 
+#include "base/flat_set.h"
+#include <rpl/producer.h>
+#include <QtCore/QByteArray>
+#include <optional>
+
 namespace Storage {
+namespace Cache {
+struct Key;
+} // namespace Cache
 class StreamedFileDownloader;
 } // namespace Storage
 
@@ -27,11 +35,17 @@ class Loader {
 public:
 	static constexpr auto kPartSize = 128 * 1024;
 
+	// Parts requested from the network at the same time by one loader.
+	static constexpr auto kMaxConcurrentRequests = 4;
+
 	[[nodiscard]] virtual auto baseCacheKey() const
 	-> std::optional<Storage::Cache::Key> = 0;
 	[[nodiscard]] virtual int size() const = 0;
 
 	virtual void load(int offset) = 0;
+
+	// Loads the part after all the parts requested by load().
+	virtual void prefetch(int offset) = 0;
 	virtual void cancel(int offset) = 0;
 	virtual void increasePriority() = 0;
 	virtual void stop() = 0;
@@ -50,6 +64,7 @@ public:
 class PriorityQueue {
 public:
 	bool add(int value);
+	bool addLowest(int value);
 	bool remove(int value);
 	void increasePriority();
 	std::optional<int> front() const;
@@ -59,6 +59,10 @@ void LoaderLocal::load(int offset) {
 	});
 }
 
+void LoaderLocal::prefetch(int offset) {
+	// The file is read right when the part is needed.
+}
+
 void LoaderLocal::fail() {
 	crl::on_main(this, [=] {
 		_parts.fire({ LoadedPart::kFailedOffset });
@@ -14,11 +14,6 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 namespace Media {
 namespace Streaming {
-namespace {
-
-constexpr auto kMaxConcurrentRequests = 4;
-
-} // namespace
 
 LoaderMtproto::LoaderMtproto(
 	not_null<Storage::Downloader*> owner,
@@ -64,6 +59,16 @@ void LoaderMtproto::load(int offset) {
 	});
 }
 
+void LoaderMtproto::prefetch(int offset) {
+	crl::on_main(this, [=] {
+		if (_requests.contains(offset)) {
+			return;
+		} else if (_requested.addLowest(offset)) {
+			sendNext();
+		}
+	});
+}
+
 void LoaderMtproto::stop() {
 	crl::on_main(this, [=] {
 		ranges::for_each(
@@ -122,6 +127,7 @@ void LoaderMtproto::sendNext() {
 	changeRequestedAmount(index, kPartSize);
 
 	const auto usedFileReference = _location.fileReference();
+	const auto sent = crl::now();
 	const auto id = _sender.request(MTPupload_GetFile(
 		MTP_flags(0),
 		_location.tl(Auth().userId()),
@@ -129,6 +135,7 @@ void LoaderMtproto::sendNext() {
 		MTP_int(kPartSize)
 	)).done([=](const MTPupload_File &result) {
 		changeRequestedAmount(index, -kPartSize);
+		_owner->requestFinished(_dcId, index, kPartSize, crl::now() - sent);
 		requestDone(offset, result);
 	}).fail([=](const RPCError &error) {
 		changeRequestedAmount(index, -kPartSize);
@@ -32,6 +32,7 @@ public:
 	[[nodiscard]] int size() const override;
 
 	void load(int offset) override;
+	void prefetch(int offset) override;
 	void cancel(int offset) override;
 	void increasePriority() override;
 	void stop() override;
@@ -21,11 +21,28 @@ constexpr auto kInSlice = kPartsInSlice * kPartSize;
 constexpr auto kMaxPartsInHeader = 64;
 constexpr auto kMaxOnlyInHeader = 80 * kPartSize;
 constexpr auto kPartsOutsideFirstSliceGood = 8;
-constexpr auto kSlicesInMemory = 2;
+constexpr auto kDownloaderRequestsLimit = 4;
+
+// A single read may touch two slices, so at least two are kept in memory.
+// Slices above that are taken from a budget shared by all the Readers,
+// they're given to the Readers that have to read unloaded slices again.
+constexpr auto kSlicesInMemoryMin = 2;
+constexpr auto kSlicesInMemoryMax = 6;
+constexpr auto kSharedSlicesInMemory = 8;
 
-// 1 MB of parts are requested from cloud ahead of reading demand.
+// 1 MB of parts are requested from cloud ahead of reading demand,
+// if the bitrate is known - enough parts for a few seconds of playback.
 constexpr auto kPreloadPartsAhead = 8;
-constexpr auto kDownloaderRequestsLimit = 4;
+constexpr auto kPreloadPartsAheadMin = 2;
+constexpr auto kPreloadPartsAheadMax = 64;
+constexpr auto kPreloadDuration = 3 * crl::time(1000);
+
+// Recent seek targets keep loading while the user scrubs back and forth,
+// the next seek target is predicted from the last two of them.
+constexpr auto kRecentSeeksCount = 4;
+constexpr auto kPrefetchPartsAtSeek = 2;
+
+std::atomic<int> SharedSlicesLeft = kSharedSlicesInMemory;
 
 using PartsMap = base::flat_map<int, QByteArray>;
 
@@ -190,6 +207,37 @@ void CopyLoaded(bytes::span buffer, Range &&parts, int offset, int till) {
 	}
 }
 
+int TakeSharedSlices(int wanted) {
+	auto left = SharedSlicesLeft.load();
+	while (true) {
+		const auto taken = std::min(left, wanted);
+		if (taken <= 0) {
+			return 0;
+		} else if (SharedSlicesLeft.compare_exchange_weak(
+				left,
+				left - taken)) {
+			return taken;
+		}
+	}
+}
+
+void ReturnSharedSlices(int count) {
+	Expects(count >= 0);
+
+	SharedSlicesLeft += count;
+}
+
+int PreloadPartsForBitrate(int size, crl::time duration) {
+	if (duration <= 0) {
+		return kPreloadPartsAhead;
+	}
+	const auto preload = int64(size) * kPreloadDuration / duration;
+	return std::clamp(
+		int((preload + kPartSize - 1) / kPartSize),
+		kPreloadPartsAheadMin,
+		kPreloadPartsAheadMax);
+}
+
 } // namespace
 
 template <int Size>
@@ -262,14 +310,14 @@ void Reader::Slice::addPart(int offset, QByteArray bytes) {
 	}
 }
 
-auto Reader::Slice::prepareFill(int from, int till) -> PrepareFillResult {
+auto Reader::Slice::prepareFill(int from, int till, int preloadParts)
+-> PrepareFillResult {
 	auto result = PrepareFillResult();
 
 	result.ready = false;
 	const auto fromOffset = (from / kPartSize) * kPartSize;
 	const auto tillPart = (till + kPartSize - 1) / kPartSize;
-	const auto preloadTillOffset = (tillPart + kPreloadPartsAhead)
-		* kPartSize;
+	const auto preloadTillOffset = (tillPart + preloadParts) * kPartSize;
 
 	const auto after = ranges::upper_bound(
 		parts,
@@ -333,7 +381,9 @@ auto Reader::Slice::offsetsFromLoader(int from, int till) const
 }
 
 Reader::Slices::Slices(int size, bool useCache)
-: _size(size) {
+: _slicesInMemory(kSlicesInMemoryMin)
+, _preloadParts(kPreloadPartsAhead)
+, _size(size) {
 	Expects(size > 0);
 
 	if (useCache) {
@@ -346,6 +396,14 @@ Reader::Slices::Slices(int size, bool useCache)
 	}
 }
 
+void Reader::Slices::setLimits(int slicesInMemory, int preloadParts) {
+	Expects(slicesInMemory >= kSlicesInMemoryMin);
+	Expects(preloadParts > 0);
+
+	_slicesInMemory = slicesInMemory;
+	_preloadParts = preloadParts;
+}
+
 bool Reader::Slices::headerModeUnknown() const {
 	return (_headerMode == HeaderMode::Unknown);
 }
@@ -566,6 +624,18 @@ auto Reader::Slices::fill(int offset, bytes::span buffer) -> FillResult {
 		&& (fromSlice + 1 == tillSlice || fromSlice + 2 == tillSlice)
 		&& tillSlice <= _data.size());
 
+	const auto checkReloaded = [&](int sliceIndex) {
+		const auto i = _unloadedByLimit.find(sliceIndex);
+		if (i != end(_unloadedByLimit)) {
+			_unloadedByLimit.erase(i);
+			++result.reloadedSlices;
+		}
+	};
+	checkReloaded(fromSlice);
+	if (fromSlice + 1 < tillSlice) {
+		checkReloaded(fromSlice + 1);
+	}
+
 	const auto cacheNotLoaded = [&](int sliceIndex) {
 		return (_headerMode != HeaderMode::NoCache)
 			&& (_headerMode != HeaderMode::Unknown)
@@ -595,9 +665,15 @@ auto Reader::Slices::fill(int offset, bytes::span buffer) -> FillResult {
 	const auto firstTill = std::min(kInSlice, till - fromSlice * kInSlice);
 	const auto secondFrom = 0;
 	const auto secondTill = till - (fromSlice + 1) * kInSlice;
-	const auto first = _data[fromSlice].prepareFill(firstFrom, firstTill);
+	const auto first = _data[fromSlice].prepareFill(
+		firstFrom,
+		firstTill,
+		_preloadParts);
 	const auto second = (fromSlice + 1 < tillSlice)
-		? _data[fromSlice + 1].prepareFill(secondFrom, secondTill)
+		? _data[fromSlice + 1].prepareFill(
+			secondFrom,
+			secondTill,
+			_preloadParts)
 		: Slice::PrepareFillResult();
 	handlePrepareResult(fromSlice, first);
 	if (fromSlice + 1 < tillSlice) {
@@ -635,7 +711,7 @@ auto Reader::Slices::fillFromHeader(int offset, bytes::span buffer)
 	const auto from = offset;
 	const auto till = int(offset + buffer.size());
 
-	const auto prepared = _header.prepareFill(from, till);
+	const auto prepared = _header.prepareFill(from, till, _preloadParts);
 	for (const auto full : prepared.offsetsFromLoader.values()) {
 		if (full < _size) {
 			result.offsetsFromLoader.add(full);
@@ -703,7 +779,7 @@ Reader::SerializedSlice Reader::Slices::serializeAndUnloadUnused() {
 	using Flag = Slice::Flag;
 
 	if (_headerMode == HeaderMode::Unknown
-		|| _usedSlices.size() <= kSlicesInMemory) {
+		|| _usedSlices.size() <= _slicesInMemory) {
 		return {};
 	}
 	const auto purgeSlice = _usedSlices.front();
@@ -712,6 +788,7 @@ Reader::SerializedSlice Reader::Slices::serializeAndUnloadUnused() {
 		// If the only data in this slice was from _header, just leave it.
 		return {};
 	}
+	_unloadedByLimit.emplace(purgeSlice);
 	const auto noNeedToSaveToCache = [&] {
 		if (_headerMode == HeaderMode::NoCache) {
 			// Cache is not used.
@@ -850,7 +927,8 @@ Reader::Reader(
 : _cache(cache)
 , _loader(std::move(loader))
 , _cacheHelper(InitCacheHelper(_loader->baseCacheKey()))
-, _slices(_loader->size(), _cacheHelper != nullptr) {
+, _slices(_loader->size(), _cacheHelper != nullptr)
+, _preloadParts(kPreloadPartsAhead) {
 	_loader->parts(
 	) | rpl::start_with_next([=](LoadedPart &&part) {
 		if (_attachedDownloader) {
@@ -870,6 +948,128 @@ Reader::Reader(
 	}
 }
 
+void Reader::setDuration(crl::time duration) {
+	_preloadParts = PreloadPartsForBitrate(size(), duration);
+	applySlicesLimits();
+}
+
+auto Reader::stats() const -> Stats {
+	auto result = Stats();
+	result.hits = _hits.load(std::memory_order_relaxed);
+	result.misses = _misses.load(std::memory_order_relaxed);
+	result.reloadedSlices = _reloadedSlices.load(std::memory_order_relaxed);
+	result.slicesInMemory = kSlicesInMemoryMin
+		+ _extraSlicesInMemory.load(std::memory_order_relaxed);
+	result.preloadParts = _preloadParts.load(std::memory_order_relaxed);
+	return result;
+}
+
+void Reader::setKeyframes(std::vector<int> &&offsets) {
+	Expects(ranges::is_sorted(offsets));
+
+	_keyframes = std::move(offsets);
+}
+
+void Reader::seekTo(int offset) {
+	Expects(offset >= 0 && offset < size());
+
+	const auto part = (offset / kPartSize) * kPartSize;
+	_recentSeeks.erase(
+		ranges::remove(_recentSeeks, part),
+		end(_recentSeeks));
+	_recentSeeks.push_back(part);
+	if (_recentSeeks.size() > kRecentSeeksCount) {
+		_recentSeeks.pop_front();
+	}
+	cancelStaleLoads();
+	prefetchNextSeek();
+}
+
+void Reader::cancelStaleLoads() {
+	Expects(!_recentSeeks.empty());
+
+	// Parts requested for the previous playback position only hold
+	// the loader requests limit, while the new position waits for them.
+	auto keep = std::vector<std::pair<int, int>>();
+	keep.reserve(_recentSeeks.size());
+	for (const auto offset : _recentSeeks) {
+		const auto parts = (offset == _recentSeeks.back())
+			? _preloadParts.load()
+			: kPrefetchPartsAtSeek;
+		keep.emplace_back(offset, std::min(offset + parts * kPartSize, size()));
+	}
+	ranges::sort(keep);
+
+	auto from = 0;
+	for (const auto &[start, till] : keep) {
+		if (from < start) {
+			cancelLoadInRange(from, start);
+		}
+		from = std::max(from, till);
+	}
+	if (from < size()) {
+		cancelLoadInRange(from, size());
+	}
+}
+
+void Reader::prefetchNextSeek() {
+	if (_recentSeeks.size() < 2) {
+		return;
+	}
+	const auto last = _recentSeeks.back();
+	const auto delta = last - _recentSeeks[_recentSeeks.size() - 2];
+	auto predicted = int64(last) + delta;
+	if (predicted < 0 || predicted >= size()) {
+		return;
+	} else if (!_keyframes.empty()) {
+		// Decoding after a seek starts from the keyframe before the target.
+		const auto i = ranges::upper_bound(_keyframes, int(predicted));
+		if (i != begin(_keyframes)) {
+			predicted = *(i - 1);
+		}
+	}
+
+	// Only the part at the predicted target is loaded, after all the
+	// parts requested for the current position. The slices are not read,
+	// so nothing is unloaded for it: the part waits in its slice.
+	const auto part = int(predicted / kPartSize) * kPartSize;
+	if (_slices.headerModeUnknown()
+		|| _slices.isFullInHeader()
+		|| _slices.fullInCache()
+		|| !_slices.partForDownloader(part).isEmpty()) {
+		return;
+	} else if (_loadingOffsets.addLowest(part)) {
+		_loader->prefetch(part);
+	}
+}
+
+void Reader::checkSlicesLimits(int reloadedSlices) {
+	if (!reloadedSlices) {
+		return;
+	}
+	_reloadedSlices += reloadedSlices;
+
+	// Reading unloaded slices again means seeking back and forth,
+	// so we try to keep more slices of this file in memory.
+	const auto useful = std::min(kSlicesInMemoryMax, SlicesCount(size()))
+		- kSlicesInMemoryMin;
+	const auto extra = _extraSlicesInMemory.load();
+	if (extra < useful) {
+		const auto taken = TakeSharedSlices(
+			std::min(reloadedSlices, useful - extra));
+		if (taken > 0) {
+			_extraSlicesInMemory = extra + taken;
+			applySlicesLimits();
+		}
+	}
+}
+
+void Reader::applySlicesLimits() {
+	_slices.setLimits(
+		kSlicesInMemoryMin + _extraSlicesInMemory.load(),
+		_preloadParts.load());
+}
+
 void Reader::startSleep(not_null<crl::semaphore*> wake) {
 	_sleeping.store(wake, std::memory_order_release);
 	processDownloaderRequests();
@@ -1215,8 +1415,17 @@ bool Reader::fill(
 
 	do {
 		if (fillFromSlices(offset, buffer)) {
+			if (_missOffset == offset) {
+				_missOffset = -1;
+			} else {
+				++_hits;
+			}
 			clearWaiting();
 			return true;
+		} else if (_missOffset != offset) {
+			// The same read is retried after waiting, count it once.
+			_missOffset = offset;
+			++_misses;
 		}
 		startWaiting();
 	} while (checkForSomethingMoreReceived());
@@ -1232,6 +1441,7 @@ bool Reader::fillFromSlices(int offset, bytes::span buffer) {
 		_streamingError = Error::NotStreamable;
 		return false;
 	}
+	checkSlicesLimits(result.reloadedSlices);
 
 	for (const auto sliceNumber : result.sliceNumbersFromCache.values()) {
 		readFromCache(sliceNumber);
@@ -1361,6 +1571,7 @@ void Reader::finalizeCache() {
 
 Reader::~Reader() {
 	finalizeCache();
+	ReturnSharedSlices(_extraSlicesInMemory.load());
 }
 
 } // namespace Streaming
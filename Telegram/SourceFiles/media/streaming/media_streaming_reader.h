@@ -32,6 +32,14 @@ enum class Error;
 
 class Reader final : public base::has_weak_ptr {
 public:
+	struct Stats {
+		int64 hits = 0;
+		int64 misses = 0;
+		int64 reloadedSlices = 0;
+		int slicesInMemory = 0;
+		int preloadParts = 0;
+	};
+
 	// Main thread.
 	Reader(
 		not_null<Storage::Cache::Database*> cache,
@@ -40,6 +48,7 @@ public:
 	// Any thread.
 	[[nodiscard]] int size() const;
 	[[nodiscard]] bool isRemoteLoader() const;
+	[[nodiscard]] Stats stats() const;
 
 	// Single thread.
 	[[nodiscard]] bool fill(
@@ -48,6 +57,9 @@ public:
 		not_null<crl::semaphore*> notify);
 	[[nodiscard]] std::optional<Error> streamingError() const;
 	void headerDone();
+	void setDuration(crl::time duration);
+	void setKeyframes(std::vector<int> &&offsets);
+	void seekTo(int offset);
 	[[nodiscard]] int headerSize() const;
 	[[nodiscard]] bool fullInCache() const;
 
@@ -96,6 +108,7 @@ private:
 		StackIntVector<kReadFromCacheMax> sliceNumbersFromCache;
 		StackIntVector<kLoadFromRemoteMax> offsetsFromLoader;
 		SerializedSlice toCache;
+		int reloadedSlices = 0;
 		bool filled = false;
 	};
 
@@ -118,7 +131,7 @@ private:
 
 		void processCacheData(PartsMap &&data);
 		void addPart(int offset, QByteArray bytes);
-		PrepareFillResult prepareFill(int from, int till);
+		PrepareFillResult prepareFill(int from, int till, int preloadParts);
 
 		// Get up to kLoadFromRemoteMax not loaded parts in from-till range.
 		StackIntVector<kLoadFromRemoteMax> offsetsFromLoader(
@@ -134,6 +147,7 @@ private:
 	public:
 		Slices(int size, bool useCache);
 
+		void setLimits(int slicesInMemory, int preloadParts);
 		void headerDone(bool fromCache);
 		[[nodiscard]] int headerSize() const;
 		[[nodiscard]] bool fullInCache() const;
@@ -184,6 +198,9 @@ private:
 		std::vector<Slice> _data;
 		Slice _header;
 		std::deque<int> _usedSlices;
+		base::flat_set<int> _unloadedByLimit;
+		int _slicesInMemory = 0;
+		int _preloadParts = 0;
 		int _size = 0;
 		HeaderMode _headerMode = HeaderMode::Unknown;
 		bool _fullInCache = false;
@@ -200,11 +217,15 @@ private:
 	void cancelLoadInRange(int from, int till);
 	void loadAtOffset(int offset);
 	void checkLoadWillBeFirst(int offset);
+	void cancelStaleLoads();
+	void prefetchNextSeek();
 	bool processLoadedParts();
 
 	bool checkForSomethingMoreReceived();
 
 	bool fillFromSlices(int offset, bytes::span buffer);
+	void checkSlicesLimits(int reloadedSlices);
+	void applySlicesLimits();
 
 	void finalizeCache();
 
@@ -232,6 +253,18 @@ private:
 
 	Slices _slices;
 
+	// Written in the streaming thread, read in any thread for stats.
+	std::atomic<int> _extraSlicesInMemory = 0;
+	std::atomic<int> _preloadParts = 0;
+	std::atomic<int64> _hits = 0;
+	std::atomic<int64> _misses = 0;
+	std::atomic<int64> _reloadedSlices = 0;
+	int _missOffset = -1;
+
+	// Sorted byte offsets of the keyframes from the container index.
+	std::vector<int> _keyframes;
+	std::deque<int> _recentSeeks;
+
 	// Even if streaming had failed, the Reader can work for the downloader.
 	std::optional<Error> _streamingError;
 
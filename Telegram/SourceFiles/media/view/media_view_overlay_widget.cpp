@@ -1783,6 +1783,12 @@ void OverlayWidget::showDocument(
 }
 
 void OverlayWidget::displayPhoto(not_null<PhotoData*> photo, HistoryItem *item) {
+	if (_photo != photo) {
+		Auth().downloader().clearViewerPriorities();
+	}
+	const auto priority = Storage::Downloader::PriorityScope(
+		&Auth().downloader(),
+		Storage::DownloadPriority::Viewer);
 	if (photo->isNull()) {
 		displayDocument(nullptr, item);
 		return;
@@ -1841,6 +1847,12 @@ void OverlayWidget::displayDocument(
 		DocumentData *doc,
 		HistoryItem *item,
 		const Data::CloudTheme &cloud) {
+	if (_photo || _doc != doc) {
+		Auth().downloader().clearViewerPriorities();
+	}
+	const auto priority = Storage::Downloader::PriorityScope(
+		&Auth().downloader(),
+		Storage::DownloadPriority::Viewer);
 	if (isHidden()) {
 		moveToScreen();
 	}
@@ -2524,6 +2536,9 @@ void OverlayWidget::validatePhotoImage(Image *image, bool blurred) {
 }
 
 void OverlayWidget::validatePhotoCurrentImage() {
+	const auto priority = Storage::Downloader::PriorityScope(
+		&Auth().downloader(),
+		Storage::DownloadPriority::Viewer);
 	validatePhotoImage(_photo->large(), false);
 	validatePhotoImage(_photo->thumbnail(), true);
 	validatePhotoImage(_photo->thumbnailSmall(), true);
@@ -3263,6 +3278,9 @@ void OverlayWidget::preloadData(int delta) {
 	if (!_index) {
 		return;
 	}
+	const auto priority = Storage::Downloader::PriorityScope(
+		&Auth().downloader(),
+		Storage::DownloadPriority::Viewer);
 	auto from = *_index + (delta ? delta : -1);
 	auto till = *_index + (delta ? delta * kPreloadCount : 1);
 	if (from > till) std::swap(from, till);
@@ -3714,6 +3732,9 @@ void OverlayWidget::setVisibleHook(bool visible) {
 		_controlsOpacity = anim::value(1, 1);
 		_groupThumbs = nullptr;
 		_groupThumbsRect = QRect();
+		if (Main::Session::Exists()) {
+			Auth().downloader().clearViewerPriorities();
+		}
 #ifdef USE_OPENGL_OVERLAY_WIDGET
 		// QOpenGLWidget can't properly destroy a child widget if
 		// it is hidden exactly after that, so it must be repainted
@@ -12,7 +12,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mtproto/rpc_sender.h"
 #include "mtproto/dc_options.h"
 #include "mtproto/connection_abstract.h"
-#include "zlib.h"
+#include "mtproto/mtp_gzip.h"
 #include "core/application.h"
 #include "core/launcher.h"
 #include "lang/lang_keys.h"
@@ -57,6 +57,38 @@ constexpr auto kRequestConfigTimeout = crl::time(8000);
 // Don't try to handle messages larger than this size.
 constexpr auto kMaxMessageLength = 16 * 1024 * 1024;
 
+// How often we check sent requests for resending.
+constexpr auto kCheckSentRequestsTimeout = crl::time(1000);
+
+// How much time passed from send till we resend request or check its state.
+constexpr auto kCheckResendTimeout = crl::time(10000);
+
+// How much time to wait for some more requests,
+// when resending request or checking its state.
+constexpr auto kCheckResendWaiting = crl::time(1000);
+
+// How much ints should message contain for us not to resend,
+// but instead to check its state.
+constexpr auto kResendThreshold = 1;
+
+// Container lives 10 minutes in haveSent map.
+constexpr auto kContainerLives = 600;
+
+// Try to gzip requests starting with this size.
+constexpr auto kGzipRequestsFrom = 1024;
+
+// Send the gzipped request only if it is at least this much smaller.
+constexpr auto kGzipMinSavedPercent = 10;
+
+QString LogIds(const QVector<uint64> &ids) {
+	if (!ids.size()) return "[]";
+	auto idsStr = QString("[%1").arg(*ids.cbegin());
+	for (const auto id : ids) {
+		idsStr += QString(", %2").arg(id);
+	}
+	return idsStr + "]";
+}
+
 QString LogIdsVector(const QVector<MTPlong> &ids) {
 	if (!ids.size()) return "[]";
 	auto idsStr = QString("[%1").arg(ids.cbegin()->v);
@@ -66,6 +98,17 @@ QString LogIdsVector(const QVector<MTPlong> &ids) {
 	return idsStr + "]";
 }
 
+bool RegisterMsgId(ReceivedMsgIds &ids, mtpMsgId msgId, bool needAck) {
+	if (ids.registerMsgId(msgId, needAck)) {
+		return true;
+	} else if (ids.lookup(msgId) != ReceivedMsgIds::State::NotFound) {
+		MTP_LOG(-1, ("No need to handle - %1 already is in map").arg(msgId));
+	} else {
+		MTP_LOG(-1, ("No need to handle - %1 < min = %2").arg(msgId).arg(ids.min()));
+	}
+	return false;
+}
+
 bool IsGoodModExpFirst(
 		const openssl::BigNum &modexp,
 		const openssl::BigNum &prime) {
@@ -433,12 +476,16 @@ ConnectionPrivate::ConnectionPrivate(
 , _waitForReceived(kMinReceiveTimeout)
 , _waitForConnected(kMinConnectedTimeout)
 , _pingSender(thread, [=] { sendPingByTimer(); })
+, _checkSentRequestsTimer(thread, [=] { checkSentRequests(); })
 , sessionData(data) {
 	Expects(_shiftedDcId != 0);
 
 	moveToThread(thread);
 
-	connect(thread, &QThread::started, this, [=] { connectToServer(); });
+	connect(thread, &QThread::started, this, [=] {
+		_checkSentRequestsTimer.callEach(kCheckSentRequestsTimeout);
+		connectToServer();
+	});
 	connect(thread, &QThread::finished, this, [=] { finishAndDestroy(); });
 	connect(this, SIGNAL(finished(internal::Connection*)), _instance, SLOT(connectionFinished(internal::Connection*)), Qt::QueuedConnection);
 
@@ -450,20 +497,11 @@ ConnectionPrivate::ConnectionPrivate(
 	connect(sessionData->owner(), SIGNAL(needToPing()), this, SLOT(onPingSendForce()), Qt::QueuedConnection);
 	connect(this, SIGNAL(sessionResetDone()), sessionData->owner(), SLOT(onResetDone()), Qt::QueuedConnection);
 
-	static bool _registered = false;
-	if (!_registered) {
-		_registered = true;
-		qRegisterMetaType<QVector<quint64> >("QVector<quint64>");
-	}
-
 	connect(this, SIGNAL(needToSendAsync()), sessionData->owner(), SLOT(needToResumeAndSend()), Qt::QueuedConnection);
 	connect(this, SIGNAL(sendAnythingAsync(qint64)), sessionData->owner(), SLOT(sendAnything(qint64)), Qt::QueuedConnection);
 	connect(this, SIGNAL(sendHttpWaitAsync()), sessionData->owner(), SLOT(sendAnything()), Qt::QueuedConnection);
 	connect(this, SIGNAL(sendPongAsync(quint64,quint64)), sessionData->owner(), SLOT(sendPong(quint64,quint64)), Qt::QueuedConnection);
 	connect(this, SIGNAL(sendMsgsStateInfoAsync(quint64, QByteArray)), sessionData->owner(), SLOT(sendMsgsStateInfo(quint64,QByteArray)), Qt::QueuedConnection);
-	connect(this, SIGNAL(resendAsync(quint64,qint64,bool,bool)), sessionData->owner(), SLOT(resend(quint64,qint64,bool,bool)), Qt::QueuedConnection);
-	connect(this, SIGNAL(resendManyAsync(QVector<quint64>,qint64,bool,bool)), sessionData->owner(), SLOT(resendMany(QVector<quint64>,qint64,bool,bool)), Qt::QueuedConnection);
-	connect(this, SIGNAL(resendAllAsync()), sessionData->owner(), SLOT(resendAll()), Qt::QueuedConnection);
 }
 
 void ConnectionPrivate::onConfigLoaded() {
@@ -522,10 +560,6 @@ bool ConnectionPrivate::setState(int32 state, int32 ifState) {
 void ConnectionPrivate::resetSession() { // recreate all msg_id and msg_seqno
 	_needSessionReset = false;
 
-	QWriteLocker locker1(sessionData->haveSentMutex());
-	QWriteLocker locker2(sessionData->toResendMutex());
-	QWriteLocker locker3(sessionData->toSendMutex());
-	QWriteLocker locker4(sessionData->wereAckedMutex());
 	auto &haveSent = sessionData->haveSentMap();
 	auto &toResend = sessionData->toResendMap();
 	auto &toSend = sessionData->toSendMap();
@@ -643,10 +677,7 @@ void ConnectionPrivate::resetSession() { // recreate all msg_id and msg_seqno
 
 	ackRequestData.clear();
 	resendRequestData.clear();
-	{
-		QWriteLocker locker5(sessionData->stateRequestMutex());
-		sessionData->stateRequestMap().clear();
-	}
+	sessionData->stateRequestMap().clear();
 
 	emit sessionResetDone();
 }
@@ -655,7 +686,6 @@ mtpMsgId ConnectionPrivate::prepareToSend(SecureRequest &request, mtpMsgId curre
 	if (request->size() < 9) return 0;
 	mtpMsgId msgId = *(mtpMsgId*)(request->constData() + 4);
 	if (msgId) { // resending this request
-		QWriteLocker locker(sessionData->toResendMutex());
 		auto &toResend = sessionData->toResendMap();
 		const auto i = toResend.find(msgId);
 		if (i != toResend.cend()) {
@@ -674,9 +704,6 @@ mtpMsgId ConnectionPrivate::replaceMsgId(SecureRequest &request, mtpMsgId newId)
 	mtpMsgId oldMsgId = *(mtpMsgId*)(request->constData() + 4);
 	if (oldMsgId != newId) {
 		if (oldMsgId) {
-			QWriteLocker locker(sessionData->toResendMutex());
-			// haveSentMutex() and wereAckedMutex() were locked in tryToSend()
-
 			auto &toResend = sessionData->toResendMap();
 			auto &wereAcked = sessionData->wereAckedMap();
 			auto &haveSent = sessionData->haveSentMap();
@@ -748,9 +775,62 @@ mtpMsgId ConnectionPrivate::placeToContainer(SecureRequest &toSendRequest, mtpMs
 	return msgId;
 }
 
+SecureRequest ConnectionPrivate::gzipRequest(const SecureRequest &request) {
+	const auto ints = int(tl::count_length(request) >> 2);
+	const auto size = ints * kIntSize;
+	if (size < kGzipRequestsFrom) {
+		return request;
+	}
+	const auto body = request->constData()
+		+ SecureRequest::kMessageBodyPosition;
+	switch (mtpTypeId(*body)) {
+	case mtpc_gzip_packed:
+	case mtpc_upload_saveFilePart: // File parts are compressed already.
+	case mtpc_upload_saveBigFilePart:
+		return request;
+	}
+
+	// gzip_packed constructor and the bytes should fit in maxInts + 1.
+	const auto maxInts = ints * (100 - kGzipMinSavedPercent) / 100 - 1;
+	auto result = SecureRequest::Prepare(0, maxInts + 1);
+	memcpy(
+		result->data(),
+		request->constData(),
+		SecureRequest::kMessageLengthPosition * sizeof(mtpPrime));
+	result->push_back(mtpc_gzip_packed);
+	const auto data = bytes::const_span(
+		reinterpret_cast<const bytes::type*>(body),
+		size);
+	if (!details::AppendGzipped(*result, data, maxInts)) {
+		return request;
+	}
+	const auto packedSize = (result->size()
+		- SecureRequest::kMessageBodyPosition) * kIntSize;
+	(*result)[SecureRequest::kMessageLengthPosition] = packedSize;
+	result->msDate = request->msDate;
+	result->requestId = request->requestId;
+	result->after = request->after;
+	result->needsLayer = request->needsLayer;
+
+	++_gzippedRequests;
+	_gzipSavedBytes += size - packedSize;
+	DEBUG_LOG(("MTP Info: request %1 gzipped from %2 to %3 bytes, "
+		"saved %4 bytes in %5 gzipped requests."
+		).arg(request->requestId
+		).arg(size
+		).arg(packedSize
+		).arg(_gzipSavedBytes
+		).arg(_gzippedRequests));
+	return result;
+}
+
 void ConnectionPrivate::tryToSend() {
 	QReadLocker lockFinished(&sessionDataMutex);
-	if (!sessionData || !_connection) {
+	if (!sessionData) {
+		return;
+	}
+	applySessionCommands();
+	if (!_connection) {
 		return;
 	}
 
@@ -817,7 +897,6 @@ void ConnectionPrivate::tryToSend() {
 	if (!prependOnly) {
 		QVector<MTPlong> stateReq;
 		{
-			QWriteLocker locker(sessionData->stateRequestMutex());
 			auto &ids = sessionData->stateRequestMap();
 			if (!ids.isEmpty()) {
 				stateReq.reserve(ids.size());
@@ -889,12 +968,8 @@ void ConnectionPrivate::tryToSend() {
 	bool needAnyResponse = false;
 	SecureRequest toSendRequest;
 	{
-		QWriteLocker locker1(sessionData->toSendMutex());
-
 		auto toSendDummy = PreRequestMap();
 		auto &toSend = prependOnly ? toSendDummy : sessionData->toSendMap();
-		if (prependOnly) locker1.unlock();
-
 		uint32 toSendCount = toSend.size();
 		if (pingRequest) ++toSendCount;
 		if (ackRequest) ++toSendCount;
@@ -908,8 +983,10 @@ void ConnectionPrivate::tryToSend() {
 		if (toSendCount == 1 && first->msDate > 0) { // if can send without container
 			toSendRequest = first;
 			if (!prependOnly) {
+				for (const auto &request : toSend) {
+					request->sending = false;
+				}
 				toSend.clear();
-				locker1.unlock();
 			}
 
 			const auto msgId = prepareToSend(
@@ -926,9 +1003,9 @@ void ConnectionPrivate::tryToSend() {
 				if (toSendRequest.needAck()) {
 					toSendRequest->msDate = toSendRequest.isStateRequest() ? 0 : crl::now();
 
-					QWriteLocker locker2(sessionData->haveSentMutex());
 					auto &haveSent = sessionData->haveSentMap();
 					haveSent.insert(msgId, toSendRequest);
+					toSendRequest = gzipRequest(toSendRequest);
 
 					if (needsLayer && !toSendRequest->needsLayer) needsLayer = false;
 					if (toSendRequest->after) {
@@ -956,7 +1033,6 @@ void ConnectionPrivate::tryToSend() {
 
 					needAnyResponse = true;
 				} else {
-					QWriteLocker locker3(sessionData->wereAckedMutex());
 					sessionData->wereAckedMap().insert(msgId, toSendRequest->requestId);
 				}
 			}
@@ -992,12 +1068,7 @@ void ConnectionPrivate::tryToSend() {
 			// check for a valid container
 			auto bigMsgId = base::unixtime::mtproto_msg_id();
 
-			// the fact of this lock is used in replaceMsgId()
-			QWriteLocker locker2(sessionData->haveSentMutex());
 			auto &haveSent = sessionData->haveSentMap();
-
-			// the fact of this lock is used in replaceMsgId()
-			QWriteLocker locker3(sessionData->wereAckedMutex());
 			auto &wereAcked = sessionData->wereAckedMap();
 
 			// prepare "request-like" wrap for msgId vector
@@ -1014,6 +1085,7 @@ void ConnectionPrivate::tryToSend() {
 			}
 			for (auto i = toSend.begin(), e = toSend.end(); i != e; ++i) {
 				auto &req = i.value();
+				req->sending = false;
 				auto msgId = prepareToSend(req, bigMsgId);
 				if (msgId > bigMsgId) {
 					msgId = replaceMsgId(req, bigMsgId);
@@ -1023,22 +1095,24 @@ void ConnectionPrivate::tryToSend() {
 				}
 				*(haveSentArr++) = msgId;
 				bool added = false;
+				auto serialized = req;
 				if (req->requestId) {
 					if (req.needAck()) {
 						req->msDate = req.isStateRequest() ? 0 : crl::now();
+						serialized = gzipRequest(req);
 						int32 reqNeedsLayer = (needsLayer && req->needsLayer) ? toSendRequest->size() : 0;
 						if (req->after) {
-							wrapInvokeAfter(toSendRequest, req, haveSent, reqNeedsLayer ? initSizeInInts : 0);
+							wrapInvokeAfter(toSendRequest, serialized, haveSent, reqNeedsLayer ? initSizeInInts : 0);
 							if (reqNeedsLayer) {
 								memcpy(toSendRequest->data() + reqNeedsLayer + 4, initSerialized.constData(), initSize);
 								*(toSendRequest->data() + reqNeedsLayer + 3) += initSize;
 							}
 							added = true;
 						} else if (reqNeedsLayer) {
-							toSendRequest->resize(reqNeedsLayer + initSizeInInts + req.messageSize());
-							memcpy(toSendRequest->data() + reqNeedsLayer, req->constData() + 4, 4 * sizeof(mtpPrime));
+							toSendRequest->resize(reqNeedsLayer + initSizeInInts + serialized.messageSize());
+							memcpy(toSendRequest->data() + reqNeedsLayer, serialized->constData() + 4, 4 * sizeof(mtpPrime));
 							memcpy(toSendRequest->data() + reqNeedsLayer + 4, initSerialized.constData(), initSize);
-							memcpy(toSendRequest->data() + reqNeedsLayer + 4 + initSizeInInts, req->constData() + 8, tl::count_length(req));
+							memcpy(toSendRequest->data() + reqNeedsLayer + 4 + initSizeInInts, serialized->constData() + 8, tl::count_length(serialized));
 							*(toSendRequest->data() + reqNeedsLayer + 3) += initSize;
 							added = true;
 						}
@@ -1050,9 +1124,9 @@ void ConnectionPrivate::tryToSend() {
 					}
 				}
 				if (!added) {
-					uint32 from = toSendRequest->size(), len = req.messageSize();
+					uint32 from = toSendRequest->size(), len = serialized.messageSize();
 					toSendRequest->resize(from + len);
-					memcpy(toSendRequest->data() + from, req->constData() + 4, len * sizeof(mtpPrime));
+					memcpy(toSendRequest->data() + from, serialized->constData() + 4, len * sizeof(mtpPrime));
 				}
 			}
 			if (stateRequest) {
@@ -1064,6 +1138,11 @@ void ConnectionPrivate::tryToSend() {
 			if (ackRequest) placeToContainer(toSendRequest, bigMsgId, haveSentArr, ackRequest);
 			if (httpWaitRequest) placeToContainer(toSendRequest, bigMsgId, haveSentArr, httpWaitRequest);
 
+			// Gzipped requests are smaller than the size counted above.
+			(*toSendRequest)[SecureRequest::kMessageLengthPosition]
+				= (toSendRequest->size() - SecureRequest::kMessageBodyPosition)
+					* sizeof(mtpPrime);
+
 			mtpMsgId contMsgId = prepareToSend(toSendRequest, bigMsgId);
 			*(mtpMsgId*)(haveSentIdsWrap->data() + 4) = contMsgId;
 			(*haveSentIdsWrap)[6] = 0; // for container, msDate = 0, seqNo = 0
@@ -1575,7 +1654,7 @@ void ConnectionPrivate::handleReceived() {
 				sessionData->setSalt(serverSalt);
 				if (setState(ConnectedState, ConnectingState)) { // only connected
 					if (restarted) {
-						emit resendAllAsync();
+						resendAll();
 						restarted = false;
 					}
 				}
@@ -1594,18 +1673,14 @@ void ConnectionPrivate::handleReceived() {
 		auto sfrom = decryptedInts + 4U; // msg_id + seq_no + length + message
 		MTP_LOG(_shiftedDcId, ("Recv: ") + mtpTextSerialize(sfrom, end));
 
-		bool needToHandle = false;
-		{
-			QWriteLocker lock(sessionData->receivedIdsMutex());
-			needToHandle = sessionData->receivedIdsSet().registerMsgId(msgId, needAck);
-		}
+		const auto needToHandle = RegisterMsgId(
+			sessionData->receivedIdsSet(),
+			msgId,
+			needAck);
 		if (needToHandle) {
 			res = handleOneReceived(from, end, msgId, serverTime, serverSalt, badTime);
 		}
-		{
-			QWriteLocker lock(sessionData->receivedIdsMutex());
-			sessionData->receivedIdsSet().shrink();
-		}
+		sessionData->receivedIdsSet().shrink();
 
 		// send acks
 		uint32 toAckSize = ackRequestData.size();
@@ -1712,11 +1787,10 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 				return HandleResult::ParseError;
 			}
 
-			bool needToHandle = false;
-			{
-				QWriteLocker lock(sessionData->receivedIdsMutex());
-				needToHandle = sessionData->receivedIdsSet().registerMsgId(inMsgId.v, needAck);
-			}
+			const auto needToHandle = RegisterMsgId(
+				sessionData->receivedIdsSet(),
+				inMsgId.v,
+				needAck);
 			auto res = HandleResult::Success; // if no need to handle, then succeed
 			if (needToHandle) {
 				res = handleOneReceived(from, otherEnd, inMsgId.v, serverTime, serverSalt, badTime);
@@ -1778,7 +1852,6 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 				if (Logs::DebugEnabled()) {
 					SecureRequest request;
 					{
-						QWriteLocker locker(sessionData->haveSentMutex());
 						auto &haveSent = sessionData->haveSentMap();
 
 						const auto i = haveSent.constFind(resendId);
@@ -1872,7 +1945,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		if (setState(ConnectedState, ConnectingState)) { // maybe only connected
 			if (restarted) {
-				emit resendAllAsync();
+				resendAll();
 				restarted = false;
 			}
 		}
@@ -1899,12 +1972,10 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		QByteArray info(idsCount, Qt::Uninitialized);
 		{
-			QReadLocker lock(sessionData->receivedIdsMutex());
 			auto &receivedIds = sessionData->receivedIdsSet();
 			auto minRecv = receivedIds.min();
 			auto maxRecv = receivedIds.max();
 
-			QReadLocker locker(sessionData->wereAckedMutex());
 			const auto &wereAcked = sessionData->wereAckedMap();
 			const auto wereAckedEnd = wereAcked.cend();
 
@@ -1950,7 +2021,6 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		DEBUG_LOG(("Message Info: msg state received, msgId %1, reqMsgId: %2, HEX states %3").arg(msgId).arg(reqMsgId).arg(Logs::mb(states.data(), states.length()).str()));
 		SecureRequest requestBuffer;
 		{ // find this request in session-shared sent requests map
-			QReadLocker locker(sessionData->haveSentMutex());
 			const auto &haveSent = sessionData->haveSentMap();
 			const auto replyTo = haveSent.constFind(reqMsgId);
 			if (replyTo == haveSent.cend()) { // do not look in toResend, because we do not resend msgs_state_req requests
@@ -2036,12 +2106,9 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		}
 		requestsAcked(ids);
 
-		bool received = false;
 		MTPlong resMsgId = data.vanswer_msg_id();
-		{
-			QReadLocker lock(sessionData->receivedIdsMutex());
-			received = (sessionData->receivedIdsSet().lookup(resMsgId.v) != ReceivedMsgIds::State::NotFound);
-		}
+		const auto received = (sessionData->receivedIdsSet().lookup(resMsgId.v)
+			!= ReceivedMsgIds::State::NotFound);
 		if (received) {
 			ackRequestData.push_back(resMsgId);
 		} else {
@@ -2063,12 +2130,9 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		DEBUG_LOG(("Message Info: msg new detailed info, answerId %2, status %3, bytes %4").arg(data.vanswer_msg_id().v).arg(data.vstatus().v).arg(data.vbytes().v));
 
-		bool received = false;
 		MTPlong resMsgId = data.vanswer_msg_id();
-		{
-			QReadLocker lock(sessionData->receivedIdsMutex());
-			received = (sessionData->receivedIdsSet().lookup(resMsgId.v) != ReceivedMsgIds::State::NotFound);
-		}
+		const auto received = (sessionData->receivedIdsSet().lookup(resMsgId.v)
+			!= ReceivedMsgIds::State::NotFound);
 		if (received) {
 			ackRequestData.push_back(resMsgId);
 		} else {
@@ -2174,7 +2238,6 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		mtpMsgId firstMsgId = data.vfirst_msg_id().v;
 		QVector<quint64> toResend;
 		{
-			QReadLocker locker(sessionData->haveSentMutex());
 			const auto &haveSent = sessionData->haveSentMap();
 			toResend.reserve(haveSent.size());
 			for (auto i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) {
@@ -2254,53 +2317,17 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 }
 
 mtpBuffer ConnectionPrivate::ungzip(const mtpPrime *from, const mtpPrime *end) const {
-	mtpBuffer result; // * 4 because of mtpPrime type
-	result.resize(0);
-
-	MTPstring packed;
-	if (!packed.read(from, end)) { // read packed string as serialized mtp string type
+	const auto packed = details::ReadSerializedBytes(from, end);
+	if (!packed) {
 		LOG(("RPC Error: could not read gziped bytes."));
-		return result;
-	}
-	uint32 packedLen = packed.v.size(), unpackedChunk = packedLen, unpackedLen = 0;
-
-	z_stream stream;
-	stream.zalloc = 0;
-	stream.zfree = 0;
-	stream.opaque = 0;
-	stream.avail_in = 0;
-	stream.next_in = 0;
-	int res = inflateInit2(&stream, 16 + MAX_WBITS);
-	if (res != Z_OK) {
-		LOG(("RPC Error: could not init zlib stream, code: %1").arg(res));
-		return result;
-	}
-	stream.avail_in = packedLen;
-	stream.next_in = reinterpret_cast<Bytef*>(packed.v.data());
-
-	stream.avail_out = 0;
-	while (!stream.avail_out) {
-		result.resize(result.size() + unpackedChunk);
-		stream.avail_out = unpackedChunk * sizeof(mtpPrime);
-		stream.next_out = (Bytef*)&result[result.size() - unpackedChunk];
-		int res = inflate(&stream, Z_NO_FLUSH);
-		if (res != Z_OK && res != Z_STREAM_END) {
-			inflateEnd(&stream);
-			LOG(("RPC Error: could not unpack gziped data, code: %1").arg(res));
-			DEBUG_LOG(("RPC Error: bad gzip: %1").arg(Logs::mb(packed.v.constData(), packedLen).str()));
-			return mtpBuffer();
-		}
-	}
-	if (stream.avail_out & 0x03) {
-		uint32 badSize = result.size() * sizeof(mtpPrime) - stream.avail_out;
-		LOG(("RPC Error: bad length of unpacked data %1").arg(badSize));
-		DEBUG_LOG(("RPC Error: bad unpacked data %1").arg(Logs::mb(result.data(), badSize).str()));
 		return mtpBuffer();
 	}
-	result.resize(result.size() - (stream.avail_out >> 2));
-	inflateEnd(&stream);
-	if (!result.size()) {
-		LOG(("RPC Error: bad length of unpacked data 0"));
+	auto result = details::Ungzip(*packed);
+	if (result.empty()) {
+		LOG(("RPC Error: could not unpack gziped data, packed size: %1"
+			).arg(packed->size()));
+		DEBUG_LOG(("RPC Error: bad gzip: %1"
+			).arg(Logs::mb(packed->data(), uint32(packed->size())).str()));
 	}
 	return result;
 }
@@ -2326,11 +2353,9 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 	auto clearedBecauseTooOld = std::vector<RPCCallbackClear>();
 	QVector<MTPlong> toAckMore;
 	{
-		QWriteLocker locker1(sessionData->wereAckedMutex());
 		auto &wereAcked = sessionData->wereAckedMap();
 
 		{
-			QWriteLocker locker2(sessionData->haveSentMutex());
 			auto &haveSent = sessionData->haveSentMap();
 
 			for (uint32 i = 0; i < idsCount; ++i) {
@@ -2361,7 +2386,6 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 					}
 				} else {
 					DEBUG_LOG(("Message Info: msgId %1 was not found in recent sent, while acking requests, searching in resend...").arg(msgId));
-					QWriteLocker locker3(sessionData->toResendMutex());
 					auto &toResend = sessionData->toResendMap();
 					const auto reqIt = toResend.find(msgId);
 					if (reqIt != toResend.cend()) {
@@ -2371,7 +2395,6 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 							moveToAcked = !_instance->hasCallbacks(reqId);
 						}
 						if (moveToAcked) {
-							QWriteLocker locker4(sessionData->toSendMutex());
 							auto &toSend = sessionData->toSendMap();
 							const auto req = toSend.find(reqId);
 							if (req != toSend.cend()) {
@@ -2381,6 +2404,7 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 								} else {
 									DEBUG_LOG(("Message Info: acked msgId %1 that was prepared to resend, requestId %2").arg(msgId).arg(reqId));
 								}
+								req.value()->sending = false;
 								toSend.erase(req);
 							} else {
 								DEBUG_LOG(("Message Info: msgId %1 was found in recent resent, requestId %2 was not found in prepared to send").arg(msgId));
@@ -2435,12 +2459,10 @@ void ConnectionPrivate::handleMsgsStates(const QVector<MTPlong> &ids, const QByt
 		char state = states[i];
 		uint64 requestMsgId = ids[i].v;
 		{
-			QReadLocker locker(sessionData->haveSentMutex());
 			const auto &haveSent = sessionData->haveSentMap();
 			const auto haveSentEnd = haveSent.cend();
 			if (haveSent.find(requestMsgId) == haveSentEnd) {
 				DEBUG_LOG(("Message Info: state was received for msgId %1, but request is not found, looking in resent requests...").arg(requestMsgId));
-				QWriteLocker locker2(sessionData->toResendMutex());
 				auto &toResend = sessionData->toResendMap();
 				const auto reqIt = toResend.find(requestMsgId);
 				if (reqIt != toResend.cend()) {
@@ -2468,17 +2490,136 @@ void ConnectionPrivate::handleMsgsStates(const QVector<MTPlong> &ids, const QByt
 
 void ConnectionPrivate::resend(quint64 msgId, qint64 msCanWait, bool forceContainer, bool sendMsgStateInfo) {
 	if (msgId == _pingMsgId) return;
-	emit resendAsync(msgId, msCanWait, forceContainer, sendMsgStateInfo);
+
+	auto &haveSent = sessionData->haveSentMap();
+	const auto i = haveSent.find(msgId);
+	if (i == haveSent.end()) {
+		if (sendMsgStateInfo) {
+			DEBUG_LOG(("Message Info: cant resend %1, request not found").arg(msgId));
+			emit sendMsgsStateInfoAsync(msgId, QByteArray(1, char(1)));
+		}
+		return;
+	}
+	const auto request = i.value();
+	haveSent.erase(i);
+
+	if (request.isSentContainer()) { // for container just resend all messages we can
+		DEBUG_LOG(("Message Info: resending container from haveSent, msgId %1").arg(msgId));
+		const mtpMsgId *ids = (const mtpMsgId *)(request->constData() + 8);
+		for (uint32 j = 0, l = (request->size() - 8) >> 1; j < l; ++j) {
+			resend(ids[j], 10, true);
+		}
+	} else if (!request.isStateRequest()) {
+		request->msDate = forceContainer ? 0 : crl::now();
+		request->sending = true;
+		sessionData->toSendMap().insert(request->requestId, request);
+		sessionData->toResendMap().insert(msgId, request->requestId);
+		emit sendAnythingAsync(msCanWait);
+	}
 }
 
 void ConnectionPrivate::resendMany(QVector<quint64> msgIds, qint64 msCanWait, bool forceContainer, bool sendMsgStateInfo) {
-	for (int32 i = 0, l = msgIds.size(); i < l; ++i) {
-		if (msgIds.at(i) == _pingMsgId) {
-			msgIds.remove(i);
-			--l;
+	for (const auto msgId : msgIds) {
+		resend(msgId, msCanWait, forceContainer, sendMsgStateInfo);
+	}
+}
+
+void ConnectionPrivate::resendAll() {
+	auto toResend = QVector<mtpMsgId>();
+	const auto &haveSent = sessionData->haveSentMap();
+	toResend.reserve(haveSent.size());
+	for (auto i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) {
+		if (i.value()->requestId) {
+			toResend.push_back(i.key());
+		}
+	}
+	for (const auto msgId : toResend) {
+		resend(msgId, 10, true);
+	}
+}
+
+void ConnectionPrivate::applySessionCommands() {
+	sessionData->takeCommands([&](SessionCommand &&command) {
+		switch (command.type) {
+		case SessionCommand::Type::Send: {
+			const auto &request = command.request;
+			sessionData->toSendMap().insert(request->requestId, request);
+		} break;
+		case SessionCommand::Type::Cancel: {
+			if (command.requestId) {
+				auto &toSend = sessionData->toSendMap();
+				const auto i = toSend.find(command.requestId);
+				if (i != toSend.end()) {
+					i.value()->sending = false;
+					toSend.erase(i);
+				}
+			}
+			if (command.msgId) {
+				sessionData->haveSentMap().remove(command.msgId);
+			}
+		} break;
+		}
+	});
+}
+
+void ConnectionPrivate::checkSentRequests() {
+	QReadLocker lockFinished(&sessionDataMutex);
+	if (!sessionData) {
+		return;
+	}
+	applySessionCommands();
+
+	QVector<mtpMsgId> resendingIds;
+	QVector<mtpMsgId> removingIds; // remove very old (10 minutes) containers and resend requests
+	QVector<mtpMsgId> stateRequestIds;
+
+	auto &haveSent = sessionData->haveSentMap();
+	const auto haveSentCount = haveSent.size();
+	const auto ms = crl::now();
+	for (auto i = haveSent.begin(), e = haveSent.end(); i != e; ++i) {
+		auto &req = i.value();
+		if (req->msDate > 0) {
+			if (req->msDate + kCheckResendTimeout < ms) { // need to resend or check state
+				if (req.messageSize() < kResendThreshold) { // resend
+					resendingIds.reserve(haveSentCount);
+					resendingIds.push_back(i.key());
+				} else {
+					req->msDate = ms;
+					stateRequestIds.reserve(haveSentCount);
+					stateRequestIds.push_back(i.key());
+				}
+			}
+		} else if (base::unixtime::now()
+				> int32(i.key() >> 32) + kContainerLives) {
+			removingIds.reserve(haveSentCount);
+			removingIds.push_back(i.key());
+		}
+	}
+
+	if (stateRequestIds.size()) {
+		DEBUG_LOG(("MTP Info: requesting state of msgs: %1").arg(LogIds(stateRequestIds)));
+		for (const auto msgId : stateRequestIds) {
+			sessionData->stateRequestMap().insert(msgId, true);
+		}
+		emit sendAnythingAsync(kCheckResendWaiting);
+	}
+	for (const auto msgId : resendingIds) {
+		DEBUG_LOG(("MTP Info: resending request %1").arg(msgId));
+		resend(msgId, kCheckResendWaiting);
+	}
+	if (!removingIds.isEmpty()) {
+		auto clearCallbacks = std::vector<RPCCallbackClear>();
+		for (const auto msgId : removingIds) {
+			const auto i = haveSent.find(msgId);
+			if (i != haveSent.cend()) {
+				if (i.value()->requestId) {
+					clearCallbacks.push_back(i.value()->requestId);
+				}
+				haveSent.erase(i);
+			}
 		}
+		_instance->clearCallbacksDelayed(std::move(clearCallbacks));
 	}
-	emit resendManyAsync(msgIds, msCanWait, forceContainer, sendMsgStateInfo);
 }
 
 void ConnectionPrivate::onConnected(
@@ -3042,7 +3183,7 @@ void ConnectionPrivate::authKeyCreated() {
 	if (sessionData->getSalt()) { // else receive salt in bad_server_salt first, then try to send all the requests
 		setState(ConnectedState);
 		if (restarted) {
-			emit resendAllAsync();
+			resendAll();
 			restarted = false;
 		}
 	}
@@ -3259,7 +3400,6 @@ bool ConnectionPrivate::sendSecureRequest(
 mtpRequestId ConnectionPrivate::wasSent(mtpMsgId msgId) const {
 	if (msgId == _pingMsgId) return mtpRequestId(0xFFFFFFFF);
 	{
-		QReadLocker locker(sessionData->haveSentMutex());
 		const auto &haveSent = sessionData->haveSentMap();
 		const auto i = haveSent.constFind(msgId);
 		if (i != haveSent.cend()) {
@@ -3269,13 +3409,11 @@ mtpRequestId ConnectionPrivate::wasSent(mtpMsgId msgId) const {
 		}
 	}
 	{
-		QReadLocker locker(sessionData->toResendMutex());
 		const auto &toResend = sessionData->toResendMap();
 		const auto i = toResend.constFind(msgId);
 		if (i != toResend.cend()) return i.value();
 	}
 	{
-		QReadLocker locker(sessionData->wereAckedMutex());
 		const auto &wereAcked = sessionData->wereAckedMap();
 		const auto i = wereAcked.constFind(msgId);
 		if (i != wereAcked.cend()) return i.value();
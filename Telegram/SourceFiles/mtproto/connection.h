@@ -122,9 +122,6 @@ signals:
 	void sendHttpWaitAsync();
 	void sendPongAsync(quint64 msgId, quint64 pingId);
 	void sendMsgsStateInfoAsync(quint64 msgId, QByteArray data);
-	void resendAsync(quint64 msgId, qint64 msCanWait, bool forceContainer, bool sendMsgStateInfo);
-	void resendManyAsync(QVector<quint64> msgIds, qint64 msCanWait, bool forceContainer, bool sendMsgStateInfo);
-	void resendAllAsync();
 
 	void finished(internal::Connection *connection);
 
@@ -192,6 +189,10 @@ private:
 	mtpMsgId prepareToSend(SecureRequest &request, mtpMsgId currentLastId);
 	mtpMsgId replaceMsgId(SecureRequest &request, mtpMsgId newId);
 
+	// Returns a gzip_packed copy of a large request if that is smaller.
+	// The original request is kept for resending and the maps.
+	[[nodiscard]] SecureRequest gzipRequest(const SecureRequest &request);
+
 	bool sendSecureRequest(
 		SecureRequest &&request,
 		bool needAnyResponse,
@@ -229,6 +230,11 @@ private:
 
 	void resend(quint64 msgId, qint64 msCanWait = 0, bool forceContainer = false, bool sendMsgStateInfo = false);
 	void resendMany(QVector<quint64> msgIds, qint64 msCanWait = 0, bool forceContainer = false, bool sendMsgStateInfo = false);
+	void resendAll(); // after connection restart
+
+	// Moves requests queued by the main thread to the session maps.
+	void applySessionCommands();
+	void checkSentRequests();
 
 	template <typename Request>
 	void sendNotSecureRequest(const Request &request);
@@ -272,6 +278,10 @@ private:
 	crl::time _pingSendAt = 0;
 	mtpMsgId _pingMsgId = 0;
 	base::Timer _pingSender;
+	base::Timer _checkSentRequestsTimer;
+
+	int _gzippedRequests = 0;
+	int64 _gzipSavedBytes = 0;
 
 	bool restarted = false;
 	bool _finished = false;
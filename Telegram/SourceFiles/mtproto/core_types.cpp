@@ -7,7 +7,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 */
 #include "mtproto/core_types.h"
 
-#include "zlib.h"
+#include "mtproto/mtp_gzip.h"
 
 namespace MTP {
 namespace {
@@ -220,44 +220,11 @@ bool mtpTextSerializeCore(MTPStringLogger &to, const mtpPrime *&from, const mtpP
 	} break;
 
 	case mtpc_gzip_packed: {
-		MTPstring packed;
-		// read packed string as serialized mtp string type
-		if (!packed.read(from, end)) {
+		const auto packed = MTP::details::ReadSerializedBytes(from, end);
+		if (!packed) {
 			return false;
 		}
-		uint32 packedLen = packed.v.size(), unpackedChunk = packedLen;
-		mtpBuffer result; // * 4 because of mtpPrime type
-		result.resize(0);
-
-		z_stream stream;
-		stream.zalloc = nullptr;
-		stream.zfree = nullptr;
-		stream.opaque = nullptr;
-		stream.avail_in = 0;
-		stream.next_in = nullptr;
-		int res = inflateInit2(&stream, 16 + MAX_WBITS);
-		if (res != Z_OK) {
-			return false;
-		}
-		stream.avail_in = packedLen;
-		stream.next_in = reinterpret_cast<Bytef*>(packed.v.data());
-		stream.avail_out = 0;
-		while (!stream.avail_out) {
-			result.resize(result.size() + unpackedChunk);
-			stream.avail_out = unpackedChunk * sizeof(mtpPrime);
-			stream.next_out = (Bytef*)&result[result.size() - unpackedChunk];
-			int res = inflate(&stream, Z_NO_FLUSH);
-			if (res != Z_OK && res != Z_STREAM_END) {
-				inflateEnd(&stream);
-				return false;
-			}
-		}
-		if (stream.avail_out & 0x03) {
-			return false;
-		}
-		result.resize(result.size() - (stream.avail_out >> 2));
-		inflateEnd(&stream);
-
+		const auto result = MTP::details::Ungzip(*packed);
 		if (result.empty()) {
 			return false;
 		}
@@ -20,6 +20,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include <QtCore/QString>
 #include <QtCore/QByteArray>
 #include <gsl/gsl>
+#include <atomic>
 
 using mtpPrime = int32;
 using mtpRequestId = int32;
@@ -200,6 +201,9 @@ public:
 	SecureRequest after;
 	bool needsLayer = false;
 
+	// Is waiting in toSend, read by the main thread for MTP::state().
+	std::atomic<bool> sending = false;
+
 };
 
 template <typename Request, typename>
@@ -0,0 +1,233 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "mtproto/mtp_gzip.h"
+
+#include "zlib.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace MTP {
+namespace details {
+namespace {
+
+constexpr auto kIntSize = int(sizeof(int32));
+
+// Gzip header and trailer are at least that long.
+constexpr auto kMinGzipSize = 18;
+
+// Deflate can't compress better than that.
+constexpr auto kMaxCompressionRatio = 1032;
+
+// Don't trust the size from the gzip trailer more than that.
+constexpr auto kMaxPreallocatedSize = 16 * 1024 * 1024;
+
+// One inflate state for each thread, so that the window and the
+// internal tables are allocated once and not for every message.
+class Inflater final {
+public:
+	Inflater() {
+		_stream.zalloc = nullptr;
+		_stream.zfree = nullptr;
+		_stream.opaque = nullptr;
+		_stream.avail_in = 0;
+		_stream.next_in = nullptr;
+		_inited = (inflateInit2(&_stream, 16 + MAX_WBITS) == Z_OK);
+	}
+	Inflater(const Inflater &other) = delete;
+	Inflater &operator=(const Inflater &other) = delete;
+	~Inflater() {
+		if (_inited) {
+			inflateEnd(&_stream);
+		}
+	}
+
+	[[nodiscard]] z_stream *start() {
+		if (!_inited || inflateReset(&_stream) != Z_OK) {
+			return nullptr;
+		}
+		return &_stream;
+	}
+
+private:
+	z_stream _stream;
+	bool _inited = false;
+
+};
+
+// Same for the outgoing data.
+class Deflater final {
+public:
+	Deflater() {
+		_stream.zalloc = nullptr;
+		_stream.zfree = nullptr;
+		_stream.opaque = nullptr;
+		_inited = (deflateInit2(
+			&_stream,
+			Z_DEFAULT_COMPRESSION,
+			Z_DEFLATED,
+			16 + MAX_WBITS,
+			8,
+			Z_DEFAULT_STRATEGY) == Z_OK);
+	}
+	Deflater(const Deflater &other) = delete;
+	Deflater &operator=(const Deflater &other) = delete;
+	~Deflater() {
+		if (_inited) {
+			deflateEnd(&_stream);
+		}
+	}
+
+	[[nodiscard]] z_stream *start() {
+		if (!_inited || deflateReset(&_stream) != Z_OK) {
+			return nullptr;
+		}
+		return &_stream;
+	}
+
+private:
+	z_stream _stream;
+	bool _inited = false;
+
+};
+
+// The last four bytes of a gzip stream hold the unpacked size.
+[[nodiscard]] int EstimateUnpackedSize(bytes::const_span packed) {
+	if (packed.size() < kMinGzipSize) {
+		return int(packed.size());
+	}
+	const auto trailer = reinterpret_cast<const uchar*>(
+		packed.data() + packed.size() - 4);
+	const auto size = uint32(trailer[0])
+		| (uint32(trailer[1]) << 8)
+		| (uint32(trailer[2]) << 16)
+		| (uint32(trailer[3]) << 24);
+	const auto limit = std::min(
+		int64(packed.size()) * kMaxCompressionRatio,
+		int64(kMaxPreallocatedSize));
+	return int(std::min(int64(size), limit));
+}
+
+} // namespace
+
+std::optional<bytes::const_span> ReadSerializedBytes(
+		const int32 *&from,
+		const int32 *end) {
+	if (from >= end) {
+		return std::nullopt;
+	}
+	const auto start = reinterpret_cast<const uchar*>(from);
+	auto length = int64(start[0]);
+	auto offset = 1;
+	if (length == 254) {
+		length = int64(start[1])
+			| (int64(start[2]) << 8)
+			| (int64(start[3]) << 16);
+		offset = 4;
+	} else if (length == 255) {
+		return std::nullopt;
+	}
+	const auto ints = (offset + length + kIntSize - 1) / kIntSize;
+	if (ints > end - from) {
+		return std::nullopt;
+	}
+	from += ints;
+	return bytes::const_span(
+		reinterpret_cast<const bytes::type*>(start + offset),
+		length);
+}
+
+bool AppendGzipped(
+		QVector<int32> &to,
+		bytes::const_span data,
+		int maxInts) {
+	static thread_local auto deflater = Deflater();
+
+	// Space for the long form of the bytes length is always reserved,
+	// the data is moved if the short form is enough in the end.
+	constexpr auto kLongHeader = 4;
+	constexpr auto kMaxLength = 0xFFFFFF;
+	const auto available = std::min(
+		int64(maxInts) * kIntSize - kLongHeader,
+		int64(kMaxLength));
+	const auto stream = deflater.start();
+	if (!stream || available <= 0) {
+		return false;
+	}
+	const auto offset = to.size();
+	to.resize(offset + maxInts);
+	const auto start = reinterpret_cast<uchar*>(to.data() + offset);
+	stream->avail_in = uInt(data.size());
+	stream->next_in = reinterpret_cast<Bytef*>(
+		const_cast<bytes::type*>(data.data()));
+	stream->avail_out = uInt(available);
+	stream->next_out = start + kLongHeader;
+	if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+		to.resize(offset);
+		return false;
+	}
+	const auto length = int(available - stream->avail_out);
+	auto header = kLongHeader;
+	if (length < 254) {
+		header = 1;
+		start[0] = uchar(length);
+		memmove(start + header, start + kLongHeader, length);
+	} else {
+		start[0] = 254;
+		start[1] = uchar(length & 0xFF);
+		start[2] = uchar((length >> 8) & 0xFF);
+		start[3] = uchar((length >> 16) & 0xFF);
+	}
+	const auto ints = (header + length + kIntSize - 1) / kIntSize;
+	const auto padding = ints * kIntSize - header - length;
+	memset(start + header + length, 0, padding);
+	to.resize(offset + ints);
+	return true;
+}
+
+QVector<int32> Ungzip(bytes::const_span packed) {
+	static thread_local auto inflater = Inflater();
+
+	const auto stream = inflater.start();
+	if (!stream) {
+		return {};
+	}
+	stream->avail_in = uInt(packed.size());
+	stream->next_in = reinterpret_cast<Bytef*>(
+		const_cast<bytes::type*>(packed.data()));
+
+	const auto estimated = EstimateUnpackedSize(packed);
+	auto result = QVector<int32>(
+		std::max((estimated + kIntSize - 1) / kIntSize, 1));
+	auto unpacked = 0;
+	while (true) {
+		const auto available = result.size() * kIntSize - unpacked;
+		stream->avail_out = uInt(available);
+		stream->next_out = reinterpret_cast<Bytef*>(result.data())
+			+ unpacked;
+		const auto code = inflate(stream, Z_NO_FLUSH);
+		unpacked += available - int(stream->avail_out);
+		if (code == Z_STREAM_END) {
+			break;
+		} else if (code != Z_OK && code != Z_BUF_ERROR) {
+			return {};
+		} else if (stream->avail_out) {
+			// All the input is consumed, but the stream is not finished.
+			return {};
+		}
+		result.resize(result.size() * 2);
+	}
+	if (unpacked % kIntSize) {
+		return {};
+	}
+	result.resize(unpacked / kIntSize);
+	return result;
+}
+
+} // namespace details
+} // namespace MTP
@@ -0,0 +1,38 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/bytes.h"
+#include "base/basic_types.h"
+
+#include <QtCore/QVector>
+#include <optional>
+
+namespace MTP {
+namespace details {
+
+// Reads a serialized TL bytes value, like the gzip_packed payload,
+// returning a view into the serialized data instead of copying it.
+[[nodiscard]] std::optional<bytes::const_span> ReadSerializedBytes(
+	const int32 *&from,
+	const int32 *end);
+
+// Appends the gzipped data to the serialized TL as a bytes value, only
+// if it takes no more than maxInts. Leaves the serialized TL unchanged
+// and returns false if the data doesn't compress that well.
+bool AppendGzipped(
+	QVector<int32> &to,
+	bytes::const_span data,
+	int maxInts);
+
+// Unpacks a gzip stream of serialized TL data.
+// Returns an empty vector if the stream is broken or is not whole ints.
+[[nodiscard]] QVector<int32> Ungzip(bytes::const_span packed);
+
+} // namespace details
+} // namespace MTP
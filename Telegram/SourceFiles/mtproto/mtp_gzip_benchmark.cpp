@@ -0,0 +1,187 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/mtp_gzip.h"
+#include "zlib.h"
+#include "core/benchmark_helpers.h"
+
+#include <QtCore/QByteArray>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr auto kRepeats = 20;
+
+// Something like messages.getHistory or updates.getDifference result:
+// vectors of objects with ids, dates, flags and short message texts.
+std::vector<int32> GenerateResponse(int size) {
+	const auto words = {
+		"hello", "see", "you", "tomorrow", "at", "the", "office", "ok",
+		"thanks", "link", "https://telegram.org", "photo", "where", "are",
+	};
+	auto generator = std::mt19937(size);
+	auto result = std::vector<int32>();
+	result.reserve(size / 4 + 64);
+	result.push_back(0x1cb5c415); // vector
+	result.push_back(0);
+	auto date = int32(1570000000);
+	auto id = int32(100000);
+	while (int(result.size()) * 4 < size) {
+		++result[1];
+		result.push_back(0x452c0e65); // message
+		result.push_back(0x100 | (generator() & 0x3F)); // flags
+		result.push_back(++id);
+		result.push_back(int32(generator() % 64) + 1000); // from_id
+		result.push_back(0x9db1bc6d); // peerUser
+		result.push_back(int32(generator() % 16) + 1000);
+		result.push_back(date += int32(generator() % 600));
+		result.push_back(0x3ded6320); // messageMediaEmpty
+		result.push_back(0x1cb5c415); // vector of entities
+		result.push_back(0);
+		result.push_back(0); // views
+		result.push_back(0); // edit_date
+		result.push_back(0); // grouped_id
+		result.push_back(0);
+
+		auto text = std::string();
+		const auto count = 2 + int(generator() % 12);
+		for (auto i = 0; i != count; ++i) {
+			text += *(std::begin(words) + generator() % words.size());
+			text += ' ';
+		}
+		const auto length = int(text.size());
+		const auto ints = (1 + length + 3) / 4;
+		const auto offset = result.size();
+		result.resize(offset + ints);
+		const auto bytes = reinterpret_cast<char*>(result.data() + offset);
+		bytes[0] = char(length);
+		memcpy(bytes + 1, text.data(), length);
+	}
+	return result;
+}
+
+std::vector<int32> Pack(const std::vector<int32> &data) {
+	auto stream = z_stream();
+	deflateInit2(
+		&stream,
+		Z_DEFAULT_COMPRESSION,
+		Z_DEFLATED,
+		16 + MAX_WBITS,
+		8,
+		Z_DEFAULT_STRATEGY);
+	const auto size = int(data.size() * 4);
+	auto packed = std::vector<char>(deflateBound(&stream, size));
+	stream.next_in = (Bytef*)data.data();
+	stream.avail_in = size;
+	stream.next_out = (Bytef*)packed.data();
+	stream.avail_out = uInt(packed.size());
+	deflate(&stream, Z_FINISH);
+	packed.resize(packed.size() - stream.avail_out);
+	deflateEnd(&stream);
+
+	// Serialize as TL bytes, the way gzip_packed comes from the server.
+	const auto length = int(packed.size());
+	auto result = std::vector<int32>((4 + length + 3) / 4);
+	const auto bytes = reinterpret_cast<uchar*>(result.data());
+	bytes[0] = 254;
+	bytes[1] = uchar(length & 0xFF);
+	bytes[2] = uchar((length >> 8) & 0xFF);
+	bytes[3] = uchar((length >> 16) & 0xFF);
+	memcpy(bytes + 4, packed.data(), length);
+	return result;
+}
+
+// The way gzip_packed was unpacked before: the packed string is copied
+// out of the message and the result grows by the packed size chunks.
+QVector<int32> UngzipWithCopy(const int32 *from, const int32 *end) {
+	const auto start = reinterpret_cast<const uchar*>(from);
+	const auto length = int(start[1])
+		| (int(start[2]) << 8)
+		| (int(start[3]) << 16);
+	auto packed = QByteArray(
+		reinterpret_cast<const char*>(start + 4),
+		length);
+	const auto packedLen = uint32(packed.size());
+	const auto unpackedChunk = packedLen;
+
+	auto result = QVector<int32>();
+	z_stream stream;
+	stream.zalloc = nullptr;
+	stream.zfree = nullptr;
+	stream.opaque = nullptr;
+	stream.avail_in = 0;
+	stream.next_in = nullptr;
+	if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+		return result;
+	}
+	stream.avail_in = packedLen;
+	stream.next_in = reinterpret_cast<Bytef*>(packed.data());
+	stream.avail_out = 0;
+	while (!stream.avail_out) {
+		result.resize(result.size() + unpackedChunk);
+		stream.avail_out = unpackedChunk * 4;
+		stream.next_out = (Bytef*)&result[result.size() - unpackedChunk];
+		const auto res = inflate(&stream, Z_NO_FLUSH);
+		if (res != Z_OK && res != Z_STREAM_END) {
+			inflateEnd(&stream);
+			return QVector<int32>();
+		}
+	}
+	result.resize(result.size() - (stream.avail_out >> 2));
+	inflateEnd(&stream);
+	return result;
+}
+
+QVector<int32> UngzipInPlace(const int32 *from, const int32 *end) {
+	const auto packed = MTP::details::ReadSerializedBytes(from, end);
+	return packed ? MTP::details::Ungzip(*packed) : QVector<int32>();
+}
+
+template <typename Method>
+double Simulate(
+		const std::vector<int32> &packed,
+		const std::vector<int32> &original,
+		Method method) {
+	auto checked = 0;
+	const auto result = Core::MeasureMilliseconds([&] {
+		for (auto i = 0; i != kRepeats; ++i) {
+			const auto from = packed.data();
+			const auto unpacked = method(from, from + packed.size());
+			if (unpacked.size() == int(original.size())
+				&& unpacked[0] == original[0]) {
+				++checked;
+			}
+		}
+	});
+	REQUIRE(checked == kRepeats);
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("benchmark gzip_packed unpacking", "[mtp_gzip]") {
+	for (const auto size : { 256 * 1024, 1024 * 1024, 4 * 1024 * 1024 }) {
+		const auto original = GenerateResponse(size);
+		const auto packed = Pack(original);
+		const auto copying = Simulate(packed, original, UngzipWithCopy);
+		const auto inplace = Simulate(packed, original, UngzipInPlace);
+		WARN(kRepeats
+			<< " responses of "
+			<< (original.size() * 4 / 1024)
+			<< " KB packed to "
+			<< (packed.size() * 4 / 1024)
+			<< " KB: copy and chunks "
+			<< int(copying)
+			<< " ms, in place "
+			<< int(inplace)
+			<< " ms");
+	}
+}
@@ -0,0 +1,188 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/mtp_gzip.h"
+#include "zlib.h"
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::vector<char> Gzip(const void *data, int size) {
+	auto stream = z_stream();
+	deflateInit2(
+		&stream,
+		Z_DEFAULT_COMPRESSION,
+		Z_DEFLATED,
+		16 + MAX_WBITS,
+		8,
+		Z_DEFAULT_STRATEGY);
+	auto result = std::vector<char>(deflateBound(&stream, size));
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = size;
+	stream.next_out = (Bytef*)result.data();
+	stream.avail_out = uInt(result.size());
+	deflate(&stream, Z_FINISH);
+	result.resize(result.size() - stream.avail_out);
+	deflateEnd(&stream);
+	return result;
+}
+
+bytes::const_span Span(const std::vector<char> &data) {
+	return bytes::const_span(
+		reinterpret_cast<const bytes::type*>(data.data()),
+		data.size());
+}
+
+// Serializes as TL bytes: length, data and padding to whole ints.
+std::vector<int32> Serialize(const std::vector<char> &data) {
+	const auto size = int(data.size());
+	const auto header = (size < 254) ? 1 : 4;
+	auto result = std::vector<int32>((header + size + 3) / 4);
+	const auto bytes = reinterpret_cast<uchar*>(result.data());
+	if (size < 254) {
+		bytes[0] = uchar(size);
+	} else {
+		bytes[0] = 254;
+		bytes[1] = uchar(size & 0xFF);
+		bytes[2] = uchar((size >> 8) & 0xFF);
+		bytes[3] = uchar((size >> 16) & 0xFF);
+	}
+	memcpy(bytes + header, data.data(), size);
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("reading serialized bytes", "[mtp_gzip]") {
+	using MTP::details::ReadSerializedBytes;
+
+	for (const auto size : { 0, 3, 253, 254, 1000 }) {
+		auto data = std::vector<char>(size);
+		for (auto i = 0; i != size; ++i) {
+			data[i] = char(i * 7);
+		}
+		const auto serialized = Serialize(data);
+		auto from = serialized.data();
+		const auto end = from + serialized.size();
+		const auto read = ReadSerializedBytes(from, end);
+		REQUIRE(read.has_value());
+		REQUIRE(from == end);
+		REQUIRE(int(read->size()) == size);
+		REQUIRE(!memcmp(read->data(), data.data(), size));
+
+		if (!serialized.empty()) {
+			auto cut = serialized.data();
+			REQUIRE(!ReadSerializedBytes(cut, end - 1).has_value());
+			REQUIRE(cut == serialized.data());
+		}
+	}
+}
+
+TEST_CASE("ungzip", "[mtp_gzip]") {
+	using MTP::details::Ungzip;
+
+	SECTION("unpacks whole ints") {
+		for (const auto count : { 1, 100, 100000 }) {
+			auto data = std::vector<int32>(count);
+			for (auto i = 0; i != count; ++i) {
+				data[i] = (i % 17) * 0x01010101;
+			}
+			const auto packed = Gzip(data.data(), count * 4);
+			const auto result = Ungzip(Span(packed));
+			REQUIRE(result.size() == count);
+			REQUIRE(!memcmp(result.constData(), data.data(), count * 4));
+		}
+	}
+	SECTION("grows the buffer and checks the trailer") {
+		auto data = std::vector<int32>(10000, 0x12345678);
+		auto packed = Gzip(data.data(), int(data.size()) * 4);
+		packed[packed.size() - 4] = 4;
+		packed[packed.size() - 3] = 0;
+		packed[packed.size() - 2] = 0;
+		packed[packed.size() - 1] = 0;
+
+		// The size is wrong, so it is found out only after the buffer
+		// grows enough to unpack all the data.
+		REQUIRE(Ungzip(Span(packed)).isEmpty());
+	}
+	SECTION("fails on broken streams") {
+		auto data = std::vector<int32>(1000, 1);
+		const auto packed = Gzip(data.data(), int(data.size()) * 4);
+
+		auto truncated = packed;
+		truncated.resize(truncated.size() / 2);
+		REQUIRE(Ungzip(Span(truncated)).isEmpty());
+
+		auto garbage = packed;
+		garbage[0] = 0;
+		REQUIRE(Ungzip(Span(garbage)).isEmpty());
+
+		const auto odd = Gzip(data.data(), 7);
+		REQUIRE(Ungzip(Span(odd)).isEmpty());
+
+		// The reused inflate state is not broken by the failures.
+		REQUIRE(Ungzip(Span(packed)).size() == 1000);
+	}
+}
+
+TEST_CASE("appending gzipped", "[mtp_gzip]") {
+	using MTP::details::AppendGzipped;
+	using MTP::details::ReadSerializedBytes;
+	using MTP::details::Ungzip;
+
+	const auto check = [](
+			const QVector<int32> &serialized,
+			int from,
+			const std::vector<int32> &data) {
+		auto begin = serialized.constData() + from;
+		const auto end = serialized.constData() + serialized.size();
+		const auto packed = ReadSerializedBytes(begin, end);
+		REQUIRE(packed.has_value());
+		REQUIRE(begin == end);
+		const auto unpacked = Ungzip(*packed);
+		REQUIRE(unpacked.size() == int(data.size()));
+		REQUIRE(!memcmp(unpacked.constData(), data.data(), data.size() * 4));
+	};
+	const auto span = [](const std::vector<int32> &data) {
+		return bytes::const_span(
+			reinterpret_cast<const bytes::type*>(data.data()),
+			data.size() * 4);
+	};
+
+	SECTION("long and short bytes length") {
+		for (const auto count : { 1000, 100000 }) {
+			auto data = std::vector<int32>(count);
+			for (auto i = 0; i != count; ++i) {
+				data[i] = (i % 13) + ((i % 7) << 16);
+			}
+			auto serialized = QVector<int32>(1, 0x3072cfa1);
+			REQUIRE(AppendGzipped(serialized, span(data), count));
+			REQUIRE(serialized.size() < count / 4);
+			check(serialized, 1, data);
+		}
+	}
+	SECTION("keeps the serialized data if it doesn't fit") {
+		auto generator = std::mt19937(0);
+		auto data = std::vector<int32>(1000);
+		for (auto &value : data) {
+			value = int32(generator());
+		}
+		auto serialized = QVector<int32>(1, 0x3072cfa1);
+		REQUIRE(!AppendGzipped(serialized, span(data), 900));
+		REQUIRE(serialized.size() == 1);
+
+		// The state is reused after a failure.
+		auto zeros = std::vector<int32>(1000, 0);
+		REQUIRE(AppendGzipped(serialized, span(zeros), 900));
+		check(serialized, 1, zeros);
+	}
+}
@@ -15,6 +15,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mtproto/connection.h"
 #include "mtproto/sender.h"
 #include "mtproto/rsa_public_key.h"
+#include "mtproto/mtp_sharded_map.h"
 #include "storage/localstorage.h"
 #include "calls/calls_instance.h"
 #include "main/main_account.h"
@@ -201,17 +202,13 @@ private:
 	std::map<ShiftedDcId, mtpRequestId> _logoutGuestRequestIds;
 
 	// holds dcWithShift for request to this dc or -dc for request to main dc
-	std::map<mtpRequestId, ShiftedDcId> _requestsByDc;
-	mutable QMutex _requestByDcLock;
+	details::ShardedMap<mtpRequestId, ShiftedDcId> _requestsByDc;
 
 	// holds target dcWithShift for auth export request
 	std::map<mtpRequestId, ShiftedDcId> _authExportRequests;
 
-	std::map<mtpRequestId, RPCResponseHandler> _parserMap;
-	QMutex _parserMapLock;
-
-	std::map<mtpRequestId, SecureRequest> _requestMap;
-	QReadWriteLock _requestMapLock;
+	details::ShardedMap<mtpRequestId, RPCResponseHandler> _parserMap;
+	details::ShardedMap<mtpRequestId, SecureRequest> _requestMap;
 
 	std::deque<std::pair<mtpRequestId, crl::time>> _delayedRequests;
 
@@ -540,13 +537,8 @@ void Instance::Private::cancel(mtpRequestId requestId) {
 	DEBUG_LOG(("MTP Info: Cancel request %1.").arg(requestId));
 	const auto shiftedDcId = queryRequestByDc(requestId);
 	auto msgId = mtpMsgId(0);
-	{
-		QWriteLocker locker(&_requestMapLock);
-		auto it = _requestMap.find(requestId);
-		if (it != _requestMap.end()) {
-			msgId = *(mtpMsgId*)(it->second->constData() + 4);
-			_requestMap.erase(it);
-		}
+	if (const auto request = _requestMap.take(requestId)) {
+		msgId = *(mtpMsgId*)((*request)->constData() + 4);
 	}
 	unregisterRequest(requestId);
 	if (shiftedDcId) {
@@ -561,12 +553,12 @@ int32 Instance::Private::state(mtpRequestId requestId) {
 	if (requestId > 0) {
 		if (const auto shiftedDcId = queryRequestByDc(requestId)) {
 			const auto session = getSession(qAbs(*shiftedDcId));
-			return session->requestState(requestId);
+			return session->requestState(getRequest(requestId));
 		}
 		return MTP::RequestSent;
 	}
 	const auto session = getSession(-requestId);
-	return session->requestState(0);
+	return session->requestState(SecureRequest());
 }
 
 void Instance::Private::killSession(ShiftedDcId shiftedDcId) {
@@ -835,28 +827,17 @@ bool Instance::Private::configLoadFail(const RPCError &error) {
 
 std::optional<ShiftedDcId> Instance::Private::queryRequestByDc(
 		mtpRequestId requestId) const {
-	QMutexLocker locker(&_requestByDcLock);
-	auto it = _requestsByDc.find(requestId);
-	if (it != _requestsByDc.cend()) {
-		return it->second;
-	}
-	return std::nullopt;
+	return _requestsByDc.find(requestId);
 }
 
 std::optional<ShiftedDcId> Instance::Private::changeRequestByDc(
 		mtpRequestId requestId,
 		DcId newdc) {
-	QMutexLocker locker(&_requestByDcLock);
-	auto it = _requestsByDc.find(requestId);
-	if (it != _requestsByDc.cend()) {
-		if (it->second < 0) {
-			it->second = -newdc;
-		} else {
-			it->second = ShiftDcId(newdc, GetDcIdShift(it->second));
-		}
-		return it->second;
-	}
-	return std::nullopt;
+	return _requestsByDc.update(requestId, [&](ShiftedDcId &shiftedDcId) {
+		shiftedDcId = (shiftedDcId < 0)
+			? -newdc
+			: ShiftDcId(newdc, GetDcIdShift(shiftedDcId));
+	});
 }
 
 void Instance::Private::checkDelayedRequests() {
@@ -873,18 +854,13 @@ void Instance::Private::checkDelayedRequests() {
 			continue;
 		}
 
-		auto request = SecureRequest();
-		{
-			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
-				DEBUG_LOG(("MTP Error: could not find request %1").arg(requestId));
-				continue;
-			}
-			request = it->second;
+		const auto request = _requestMap.find(requestId);
+		if (!request) {
+			DEBUG_LOG(("MTP Error: could not find request %1").arg(requestId));
+			continue;
 		}
 		const auto session = getSession(qAbs(dcWithShift));
-		session->sendPrepared(request);
+		session->sendPrepared(*request);
 	}
 
 	if (!_delayedRequests.empty()) {
@@ -922,8 +898,7 @@ void Instance::Private::sendRequest(
 void Instance::Private::registerRequest(
 		mtpRequestId requestId,
 		ShiftedDcId shiftedDcId) {
-	QMutexLocker locker(&_requestByDcLock);
-	_requestsByDc[requestId] = shiftedDcId;
+	_requestsByDc.set(requestId, shiftedDcId);
 }
 
 void Instance::Private::unregisterRequest(mtpRequestId requestId) {
@@ -931,13 +906,8 @@ void Instance::Private::unregisterRequest(mtpRequestId requestId) {
 
 	_requestsDelays.erase(requestId);
 
-	{
-		QWriteLocker locker(&_requestMapLock);
-		_requestMap.erase(requestId);
-	}
-
-	QMutexLocker locker(&_requestByDcLock);
-	_requestsByDc.erase(requestId);
+	_requestMap.remove(requestId);
+	_requestsByDc.remove(requestId);
 }
 
 void Instance::Private::storeRequest(
@@ -945,49 +915,26 @@ void Instance::Private::storeRequest(
 		const SecureRequest &request,
 		RPCResponseHandler &&callbacks) {
 	if (callbacks.onDone || callbacks.onFail) {
-		QMutexLocker locker(&_parserMapLock);
 		_parserMap.emplace(requestId, std::move(callbacks));
 	}
-	{
-		QWriteLocker locker(&_requestMapLock);
-		_requestMap.emplace(requestId, request);
-	}
+	_requestMap.emplace(requestId, request);
 }
 
 SecureRequest Instance::Private::getRequest(mtpRequestId requestId) {
-	auto result = SecureRequest();
-	{
-		QReadLocker locker(&_requestMapLock);
-		auto it = _requestMap.find(requestId);
-		if (it != _requestMap.cend()) {
-			result = it->second;
-		}
-	}
-	return result;
+	return _requestMap.find(requestId).value_or(SecureRequest());
 }
 
 
 void Instance::Private::clearCallbacks(mtpRequestId requestId, int32 errorCode) {
-	RPCResponseHandler h;
-	bool found = false;
-	{
-		QMutexLocker locker(&_parserMapLock);
-		auto it = _parserMap.find(requestId);
-		if (it != _parserMap.end()) {
-			h = it->second;
-			found = true;
-
-			_parserMap.erase(it);
-		}
-	}
-	if (errorCode && found) {
+	const auto h = _parserMap.take(requestId);
+	if (errorCode && h) {
 		LOG(("API Error: callbacks cleared without handling! "
 			"Request: %1, error code: %2"
 			).arg(requestId
 			).arg(errorCode));
 		rpcErrorOccured(
 			requestId,
-			h,
+			*h,
 			RPCError::Local(
 				"CLEAR_CALLBACK",
 				QString("did not handle request %1, error code %2"
@@ -1023,9 +970,8 @@ void Instance::Private::clearCallbacks(
 
 	for (const auto &clearRequest : ids) {
 		if (Logs::DebugEnabled()) {
-			QMutexLocker locker(&_parserMapLock);
-			const auto hasParsers = (_parserMap.find(clearRequest.requestId)
-				!= _parserMap.end());
+			const auto hasParsers = _parserMap.contains(
+				clearRequest.requestId);
 			DEBUG_LOG(("RPC Info: "
 				"clearing delayed callback %1, error code %2, parsers: %3"
 				).arg(clearRequest.requestId
@@ -1041,18 +987,10 @@ void Instance::Private::execCallback(
 		mtpRequestId requestId,
 		const mtpPrime *from,
 		const mtpPrime *end) {
-	RPCResponseHandler h;
-	{
-		QMutexLocker locker(&_parserMapLock);
-		auto it = _parserMap.find(requestId);
-		if (it != _parserMap.cend()) {
-			h = it->second;
-			_parserMap.erase(it);
-
-			DEBUG_LOG(("RPC Info: found parser for request %1, trying to parse response...").arg(requestId));
-		}
-	}
+	auto h = _parserMap.take(requestId).value_or(RPCResponseHandler());
 	if (h.onDone || h.onFail) {
+		DEBUG_LOG(("RPC Info: found parser for request %1, trying to parse response...").arg(requestId));
+
 		const auto handleError = [&](const RPCError &error) {
 			DEBUG_LOG(("RPC Info: "
 				"error received, code %1, type %2, description: %3"
@@ -1062,7 +1000,6 @@ void Instance::Private::execCallback(
 			if (rpcErrorOccured(requestId, h, error)) {
 				unregisterRequest(requestId);
 			} else {
-				QMutexLocker locker(&_parserMapLock);
 				_parserMap.emplace(requestId, h);
 			}
 		};
@@ -1093,9 +1030,7 @@ void Instance::Private::execCallback(
 }
 
 bool Instance::Private::hasCallbacks(mtpRequestId requestId) {
-	QMutexLocker locker(&_parserMapLock);
-	auto it = _parserMap.find(requestId);
-	return (it != _parserMap.cend());
+	return _parserMap.contains(requestId);
 }
 
 void Instance::Private::globalCallback(const mtpPrime *from, const mtpPrime *end) {
@@ -1157,10 +1092,9 @@ void Instance::Private::importDone(const MTPauth_Authorization &result, mtpReque
 
 	auto &waiters = _authWaiters[newdc];
 	if (waiters.size()) {
-		QReadLocker locker(&_requestMapLock);
 		for (auto waitedRequestId : waiters) {
-			auto it = _requestMap.find(waitedRequestId);
-			if (it == _requestMap.cend()) {
+			const auto request = _requestMap.find(waitedRequestId);
+			if (!request) {
 				LOG(("MTP Error: could not find request %1 for resending").arg(waitedRequestId));
 				continue;
 			}
@@ -1173,7 +1107,7 @@ void Instance::Private::importDone(const MTPauth_Authorization &result, mtpReque
 			}
 			DEBUG_LOG(("MTP Info: resending request %1 to dc %2 after import auth").arg(waitedRequestId).arg(*shiftedDcId));
 			const auto session = getSession(*shiftedDcId);
-			session->sendPrepared(it->second);
+			session->sendPrepared(*request);
 		}
 		waiters.clear();
 	}
@@ -1279,15 +1213,10 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 			newdcWithShift = ShiftDcId(newdcWithShift, GetDcIdShift(dcWithShift));
 		}
 
-		auto request = SecureRequest();
-		{
-			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
-				LOG(("MTP Error: could not find request %1").arg(requestId));
-				return false;
-			}
-			request = it->second;
+		const auto request = getRequest(requestId);
+		if (!request) {
+			LOG(("MTP Error: could not find request %1").arg(requestId));
+			return false;
 		}
 		const auto session = getSession(newdcWithShift);
 		registerRequest(
@@ -1350,15 +1279,10 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		if (badGuestDc) _badGuestDcRequests.insert(requestId);
 		return true;
 	} else if (err == qstr("CONNECTION_NOT_INITED") || err == qstr("CONNECTION_LAYER_INVALID")) {
-		SecureRequest request;
-		{
-			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
-				LOG(("MTP Error: could not find request %1").arg(requestId));
-				return false;
-			}
-			request = it->second;
+		const auto request = getRequest(requestId);
+		if (!request) {
+			LOG(("MTP Error: could not find request %1").arg(requestId));
+			return false;
 		}
 		auto dcWithShift = ShiftedDcId(0);
 		if (const auto shiftedDcId = queryRequestByDc(requestId)) {
@@ -1375,15 +1299,10 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 	} else if (err == qstr("CONNECTION_LANG_CODE_INVALID")) {
 		Lang::CurrentCloudManager().resetToDefault();
 	} else if (err == qstr("MSG_WAIT_FAILED")) {
-		SecureRequest request;
-		{
-			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
-				LOG(("MTP Error: could not find request %1").arg(requestId));
-				return false;
-			}
-			request = it->second;
+		const auto request = getRequest(requestId);
+		if (!request) {
+			LOG(("MTP Error: could not find request %1").arg(requestId));
+			return false;
 		}
 		if (!request->after) {
 			LOG(("MTP Error: wait failed for not dependent request %1").arg(requestId));
@@ -0,0 +1,89 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <optional>
+
+namespace MTP {
+namespace details {
+
+// Bounded lock-free queue with any number of producers and one consumer.
+// Every cell has a sequence number telling whether it is free to write
+// (equal to the position) or ready to read (equal to the position + 1).
+template <typename Type>
+class MpscQueue final {
+public:
+	// Capacity should be a power of two, not less than two.
+	explicit MpscQueue(int capacity)
+	: _cells(std::make_unique<Cell[]>(capacity))
+	, _mask(size_t(capacity) - 1) {
+		for (auto i = 0; i != capacity; ++i) {
+			_cells[i].sequence.store(size_t(i), std::memory_order_relaxed);
+		}
+	}
+
+	// Any thread. Returns false without touching the value if full.
+	bool push(Type &&value) {
+		auto position = _enqueue.load(std::memory_order_relaxed);
+		while (true) {
+			auto &cell = _cells[position & _mask];
+			const auto sequence = cell.sequence.load(
+				std::memory_order_acquire);
+			const auto difference = intptr_t(sequence) - intptr_t(position);
+			if (!difference) {
+				if (_enqueue.compare_exchange_weak(
+						position,
+						position + 1,
+						std::memory_order_relaxed)) {
+					cell.value.emplace(std::move(value));
+					cell.sequence.store(
+						position + 1,
+						std::memory_order_release);
+					return true;
+				}
+			} else if (difference < 0) {
+				return false;
+			} else {
+				position = _enqueue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Consumer thread only.
+	std::optional<Type> pop() {
+		auto &cell = _cells[_dequeue & _mask];
+		const auto sequence = cell.sequence.load(std::memory_order_acquire);
+		if (intptr_t(sequence) - intptr_t(_dequeue + 1) < 0) {
+			return std::nullopt;
+		}
+		auto result = std::move(cell.value);
+		cell.value.reset();
+		cell.sequence.store(_dequeue + _mask + 1, std::memory_order_release);
+		++_dequeue;
+		return result;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> sequence = 0;
+		std::optional<Type> value;
+	};
+
+	const std::unique_ptr<Cell[]> _cells;
+	const size_t _mask = 0;
+
+	// Producers and the consumer work on different cache lines.
+	alignas(64) std::atomic<size_t> _enqueue = 0;
+	alignas(64) size_t _dequeue = 0;
+
+};
+
+} // namespace details
+} // namespace MTP
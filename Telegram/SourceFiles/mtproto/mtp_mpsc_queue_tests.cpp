@@ -0,0 +1,76 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/mtp_mpsc_queue.h"
+#include "base/basic_types.h"
+#include <thread>
+#include <vector>
+
+using Queue = MTP::details::MpscQueue<int>;
+
+TEST_CASE("mpsc queue", "[mtp_mpsc_queue]") {
+	SECTION("keeps the order and the bound") {
+		auto queue = Queue(4);
+		REQUIRE(!queue.pop());
+		for (auto i = 0; i != 4; ++i) {
+			REQUIRE(queue.push(int(i)));
+		}
+		REQUIRE(!queue.push(4));
+		REQUIRE(queue.pop() == 0);
+		REQUIRE(queue.push(4));
+		for (auto i = 1; i != 5; ++i) {
+			REQUIRE(queue.pop() == i);
+		}
+		REQUIRE(!queue.pop());
+	}
+	SECTION("doesn't take the value if full") {
+		auto queue = MTP::details::MpscQueue<std::vector<int>>(2);
+		REQUIRE(queue.push(std::vector<int>{ 0 }));
+		REQUIRE(queue.push(std::vector<int>{ 1 }));
+		auto value = std::vector<int>{ 2, 3 };
+		REQUIRE(!queue.push(std::move(value)));
+		REQUIRE(value.size() == 2);
+	}
+	SECTION("delivers everything from many producers") {
+		constexpr auto kProducers = 4;
+		constexpr auto kCount = 100000;
+		auto queue = Queue(64);
+		auto threads = std::vector<std::thread>();
+		for (auto p = 0; p != kProducers; ++p) {
+			threads.emplace_back([&, p] {
+				for (auto i = 0; i != kCount; ++i) {
+					while (!queue.push(p * kCount + i)) {
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+		auto last = std::vector<int>(kProducers, -1);
+		auto ordered = true;
+		auto sum = int64(0);
+		for (auto received = 0; received != kProducers * kCount;) {
+			if (const auto value = queue.pop()) {
+				const auto producer = *value / kCount;
+				const auto index = *value % kCount;
+				ordered = ordered && (index > last[producer]);
+				last[producer] = index;
+				sum += *value;
+				++received;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+		for (auto &thread : threads) {
+			thread.join();
+		}
+		const auto total = int64(kProducers) * kCount;
+		REQUIRE(ordered);
+		REQUIRE(sum == total * (total - 1) / 2);
+	}
+}
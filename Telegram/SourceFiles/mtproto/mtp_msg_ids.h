@@ -0,0 +1,243 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace MTP {
+namespace details {
+
+// Msg ids grow with time, so they almost always come in order and the
+// oldest ones are the ones dropped. Both containers keep the ids in one
+// sorted array: an in-order id is appended, an out-of-order one is put
+// in place after a binary search and the oldest ones are dropped from
+// the front just by moving the first live index. The dropped prefix is
+// compacted away once it gets larger than the live part.
+
+template <typename Key, typename Value>
+class FlatIdsMap final {
+	struct Entry {
+		Key key = Key();
+		Value value = Value();
+	};
+
+public:
+	// The subset of the QMap iterator interface used with msg id maps.
+	// Any insert or erase invalidates all the iterators.
+	class const_iterator final {
+	public:
+		const_iterator() = default;
+
+		[[nodiscard]] const Key &key() const {
+			return _entry->key;
+		}
+		[[nodiscard]] const Value &value() const {
+			return _entry->value;
+		}
+
+		const_iterator &operator++() {
+			++_entry;
+			return *this;
+		}
+		const_iterator &operator--() {
+			--_entry;
+			return *this;
+		}
+		[[nodiscard]] bool operator==(const const_iterator &other) const {
+			return (_entry == other._entry);
+		}
+		[[nodiscard]] bool operator!=(const const_iterator &other) const {
+			return (_entry != other._entry);
+		}
+
+	private:
+		friend class FlatIdsMap;
+
+		explicit const_iterator(const Entry *entry) : _entry(entry) {
+		}
+
+		const Entry *_entry = nullptr;
+
+	};
+	using iterator = const_iterator;
+
+	[[nodiscard]] int size() const {
+		return int(_entries.size() - _first);
+	}
+	[[nodiscard]] bool isEmpty() const {
+		return (_first == _entries.size());
+	}
+
+	[[nodiscard]] const_iterator cbegin() const {
+		return const_iterator(_entries.data() + _first);
+	}
+	[[nodiscard]] const_iterator cend() const {
+		return const_iterator(_entries.data() + _entries.size());
+	}
+	[[nodiscard]] const_iterator begin() const {
+		return cbegin();
+	}
+	[[nodiscard]] const_iterator end() const {
+		return cend();
+	}
+
+	[[nodiscard]] const_iterator constFind(const Key &key) const {
+		const auto i = lowerBound(key);
+		return (i != _entries.end() && i->key == key)
+			? const_iterator(&*i)
+			: cend();
+	}
+	[[nodiscard]] const_iterator find(const Key &key) const {
+		return constFind(key);
+	}
+
+	[[nodiscard]] Key min() const {
+		return isEmpty() ? Key() : _entries[_first].key;
+	}
+	[[nodiscard]] Key max() const {
+		return isEmpty() ? Key() : _entries.back().key;
+	}
+
+	// Replaces the value if the key is already in the map.
+	void insert(const Key &key, const Value &value) {
+		if (isEmpty() || _entries.back().key < key) {
+			_entries.push_back({ key, value });
+			return;
+		}
+		const auto i = lowerBound(key);
+		if (i->key == key) {
+			i->value = value;
+		} else {
+			_entries.insert(i, { key, value });
+		}
+	}
+
+	void erase(const_iterator i) {
+		const auto index = size_t(i._entry - _entries.data());
+		if (index != _first) {
+			_entries.erase(_entries.begin() + index);
+			return;
+		}
+		_entries[_first] = Entry();
+		if (++_first == _entries.size()) {
+			clear();
+		} else if (_first > _entries.size() - _first) {
+			_entries.erase(_entries.begin(), _entries.begin() + _first);
+			_first = 0;
+		}
+	}
+
+	void clear() {
+		_entries.clear();
+		_first = 0;
+	}
+
+private:
+	[[nodiscard]] auto lowerBound(const Key &key) {
+		return std::lower_bound(
+			_entries.begin() + _first,
+			_entries.end(),
+			key,
+			[](const Entry &entry, const Key &key) { return entry.key < key; });
+	}
+	[[nodiscard]] auto lowerBound(const Key &key) const {
+		return std::lower_bound(
+			_entries.begin() + _first,
+			_entries.end(),
+			key,
+			[](const Entry &entry, const Key &key) { return entry.key < key; });
+	}
+
+	std::vector<Entry> _entries;
+	size_t _first = 0;
+
+};
+
+// Keeps at least kBufferSize most recent ids after each shrink().
+template <typename Id, int kBufferSize>
+class ReceivedIds final {
+public:
+	enum class State {
+		NotFound,
+		NeedsAck,
+		NoAckNeeded,
+	};
+
+	// Returns false if the id is already known or is older than all the
+	// kept ones while the buffer is full.
+	bool registerMsgId(Id msgId, bool needAck) {
+		if (isEmpty() || _ids.back() < msgId) {
+			_ids.push_back(msgId);
+			_needAck.push_back(needAck);
+			return true;
+		}
+		const auto i = lowerBound(msgId);
+		if (*i == msgId || (size() >= kBufferSize && msgId < min())) {
+			return false;
+		}
+		const auto index = i - _ids.cbegin();
+		_ids.insert(i, msgId);
+		_needAck.insert(_needAck.begin() + index, needAck);
+		return true;
+	}
+
+	[[nodiscard]] State lookup(Id msgId) const {
+		const auto i = lowerBound(msgId);
+		if (i == _ids.end() || *i != msgId) {
+			return State::NotFound;
+		}
+		return _needAck[i - _ids.cbegin()]
+			? State::NeedsAck
+			: State::NoAckNeeded;
+	}
+
+	[[nodiscard]] int size() const {
+		return int(_ids.size() - _first);
+	}
+	[[nodiscard]] bool isEmpty() const {
+		return (_first == _ids.size());
+	}
+	[[nodiscard]] Id min() const {
+		return isEmpty() ? Id() : _ids[_first];
+	}
+	[[nodiscard]] Id max() const {
+		return isEmpty() ? Id() : _ids.back();
+	}
+
+	void shrink() {
+		if (size() <= kBufferSize) {
+			return;
+		}
+		_first = _ids.size() - kBufferSize;
+		if (_first > _ids.size() - _first) {
+			_ids.erase(_ids.begin(), _ids.begin() + _first);
+			_needAck.erase(_needAck.begin(), _needAck.begin() + _first);
+			_first = 0;
+		}
+	}
+
+	void clear() {
+		_ids.clear();
+		_needAck.clear();
+		_first = 0;
+	}
+
+private:
+	[[nodiscard]] auto lowerBound(Id msgId) const {
+		return std::lower_bound(_ids.begin() + _first, _ids.end(), msgId);
+	}
+
+	std::vector<Id> _ids;
+	std::vector<bool> _needAck;
+	size_t _first = 0;
+
+};
+
+} // namespace details
+} // namespace MTP
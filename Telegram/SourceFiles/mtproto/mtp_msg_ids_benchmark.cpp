@@ -0,0 +1,158 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/mtp_msg_ids.h"
+#include "base/basic_types.h"
+#include "core/benchmark_helpers.h"
+#include <QtCore/QMap>
+#include <vector>
+
+namespace {
+
+constexpr auto kBufferSize = 400;
+constexpr auto kMessages = 200000;
+constexpr auto kRepeats = 5;
+
+// The way received msg ids were kept before.
+class QMapReceivedIds final {
+public:
+	bool registerMsgId(uint64 msgId, bool needAck) {
+		if (_idsNeedAck.constFind(msgId) != _idsNeedAck.cend()) {
+			return false;
+		} else if (_idsNeedAck.size() < kBufferSize || msgId > min()) {
+			_idsNeedAck.insert(msgId, needAck);
+			return true;
+		}
+		return false;
+	}
+	bool needsAck(uint64 msgId) const {
+		const auto i = _idsNeedAck.constFind(msgId);
+		return (i != _idsNeedAck.cend()) && i.value();
+	}
+	uint64 min() const {
+		return _idsNeedAck.isEmpty() ? 0 : _idsNeedAck.cbegin().key();
+	}
+	void shrink() {
+		auto size = _idsNeedAck.size();
+		while (size-- > kBufferSize) {
+			_idsNeedAck.erase(_idsNeedAck.begin());
+		}
+	}
+
+private:
+	QMap<uint64, bool> _idsNeedAck;
+
+};
+
+class FlatReceivedIds final {
+public:
+	bool registerMsgId(uint64 msgId, bool needAck) {
+		return _ids.registerMsgId(msgId, needAck);
+	}
+	bool needsAck(uint64 msgId) const {
+		return (_ids.lookup(msgId) == Ids::State::NeedsAck);
+	}
+	void shrink() {
+		_ids.shrink();
+	}
+
+private:
+	using Ids = MTP::details::ReceivedIds<uint64, kBufferSize>;
+	Ids _ids;
+
+};
+
+// A burst of messages after a reconnect: mostly growing ids, every
+// sixteenth one arriving a bit late, some duplicates resent by server.
+std::vector<uint64> GenerateMsgIds() {
+	auto result = std::vector<uint64>();
+	result.reserve(kMessages);
+	auto next = uint64(0x5E00000000000000ULL);
+	for (auto i = 0; i != kMessages; ++i) {
+		next += 4;
+		result.push_back((i % 16) ? next : (next - 4 * 8));
+		if (!(i % 100)) {
+			result.push_back(next);
+		}
+	}
+	return result;
+}
+
+template <typename Ids>
+double SimulateReceived(const std::vector<uint64> &msgIds) {
+	auto handled = 0;
+	auto acks = 0;
+	const auto result = Core::MeasureMilliseconds([&] {
+		for (auto repeat = 0; repeat != kRepeats; ++repeat) {
+			auto ids = Ids();
+			for (const auto msgId : msgIds) {
+				if (ids.registerMsgId(msgId, (msgId & 4) != 0)) {
+					++handled;
+				}
+				ids.shrink();
+				if (ids.needsAck(msgId - 8)) {
+					++acks;
+				}
+			}
+		}
+	});
+	REQUIRE(handled > 0);
+	REQUIRE(acks > 0);
+	return result;
+}
+
+// wereAcked usage: insert acked msg ids, drop the oldest over the limit.
+template <typename Map>
+double SimulateAcked(const std::vector<uint64> &msgIds) {
+	auto found = int64(0);
+	const auto result = Core::MeasureMilliseconds([&] {
+		for (auto repeat = 0; repeat != kRepeats; ++repeat) {
+			auto map = Map();
+			for (const auto msgId : msgIds) {
+				map.insert(msgId, int32(msgId & 0xFFFF));
+				auto size = map.size();
+				while (size-- > kBufferSize) {
+					map.erase(map.begin());
+				}
+				const auto i = map.constFind(msgId - 8);
+				if (i != map.cend()) {
+					found += i.value();
+				}
+			}
+		}
+	});
+	REQUIRE(found > 0);
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("benchmark msg ids containers", "[mtp_msg_ids]") {
+	const auto msgIds = GenerateMsgIds();
+
+	const auto qmapReceived = SimulateReceived<QMapReceivedIds>(msgIds);
+	const auto flatReceived = SimulateReceived<FlatReceivedIds>(msgIds);
+	WARN(msgIds.size() * kRepeats
+		<< " received msg ids: QMap "
+		<< int(qmapReceived)
+		<< " ms, flat "
+		<< int(flatReceived)
+		<< " ms");
+
+	using QMapAcked = QMap<uint64, int32>;
+	using FlatAcked = MTP::details::FlatIdsMap<uint64, int32>;
+	const auto qmapAcked = SimulateAcked<QMapAcked>(msgIds);
+	const auto flatAcked = SimulateAcked<FlatAcked>(msgIds);
+	WARN(msgIds.size() * kRepeats
+		<< " acked msg ids: QMap "
+		<< int(qmapAcked)
+		<< " ms, flat "
+		<< int(flatAcked)
+		<< " ms");
+}
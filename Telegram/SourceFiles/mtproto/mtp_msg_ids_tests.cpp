@@ -0,0 +1,123 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/mtp_msg_ids.h"
+#include "base/basic_types.h"
+
+namespace {
+
+constexpr auto kBufferSize = 4;
+
+using Map = MTP::details::FlatIdsMap<uint64, int32>;
+using Ids = MTP::details::ReceivedIds<uint64, kBufferSize>;
+
+} // namespace
+
+TEST_CASE("flat msg ids map", "[mtp_msg_ids]") {
+	auto map = Map();
+
+	SECTION("keeps keys sorted") {
+		REQUIRE(map.isEmpty());
+		REQUIRE(map.min() == 0);
+		map.insert(20, 2);
+		map.insert(40, 4);
+		map.insert(10, 1);
+		map.insert(30, 3);
+		REQUIRE(map.size() == 4);
+		REQUIRE(map.min() == 10);
+		REQUIRE(map.max() == 40);
+
+		auto expected = uint64(10);
+		for (auto i = map.cbegin(), e = map.cend(); i != e; ++i) {
+			REQUIRE(i.key() == expected);
+			REQUIRE(i.value() == int32(expected / 10));
+			expected += 10;
+		}
+		auto last = map.cend();
+		REQUIRE((--last).key() == 40);
+	}
+	SECTION("find and replace") {
+		map.insert(10, 1);
+		map.insert(20, 2);
+		REQUIRE(map.constFind(15) == map.cend());
+		REQUIRE(map.constFind(30) == map.cend());
+		REQUIRE(map.find(20).value() == 2);
+		map.insert(20, 5);
+		REQUIRE(map.size() == 2);
+		REQUIRE(map.find(20).value() == 5);
+	}
+	SECTION("erase from the front and the middle") {
+		for (auto i = 1; i <= 10; ++i) {
+			map.insert(uint64(i), i);
+		}
+		map.erase(map.find(5));
+		REQUIRE(map.constFind(5) == map.cend());
+		for (auto i = 0; i != 6; ++i) {
+			map.erase(map.begin());
+		}
+		REQUIRE(map.size() == 3);
+		REQUIRE(map.min() == 8);
+		REQUIRE(map.find(9).value() == 9);
+
+		map.insert(7, 7);
+		REQUIRE(map.min() == 7);
+		while (!map.isEmpty()) {
+			map.erase(map.begin());
+		}
+		REQUIRE(map.cbegin() == map.cend());
+		map.insert(1, 1);
+		REQUIRE(map.size() == 1);
+	}
+}
+
+TEST_CASE("received msg ids", "[mtp_msg_ids]") {
+	using State = Ids::State;
+	auto ids = Ids();
+
+	SECTION("registers each id once") {
+		REQUIRE(ids.registerMsgId(10, true));
+		REQUIRE(ids.registerMsgId(30, false));
+		REQUIRE(ids.registerMsgId(20, true));
+		REQUIRE(!ids.registerMsgId(20, false));
+		REQUIRE(ids.lookup(10) == State::NeedsAck);
+		REQUIRE(ids.lookup(20) == State::NeedsAck);
+		REQUIRE(ids.lookup(30) == State::NoAckNeeded);
+		REQUIRE(ids.lookup(15) == State::NotFound);
+		REQUIRE(ids.min() == 10);
+		REQUIRE(ids.max() == 30);
+	}
+	SECTION("shrink keeps the most recent ids") {
+		for (auto i = 1; i <= 10; ++i) {
+			REQUIRE(ids.registerMsgId(uint64(i) * 10, (i % 2) != 0));
+			ids.shrink();
+		}
+		REQUIRE(ids.size() == kBufferSize);
+		REQUIRE(ids.min() == 70);
+		REQUIRE(ids.lookup(60) == State::NotFound);
+		REQUIRE(ids.lookup(70) == State::NeedsAck);
+		REQUIRE(ids.lookup(80) == State::NoAckNeeded);
+
+		// Too old for the full buffer.
+		REQUIRE(!ids.registerMsgId(65, true));
+
+		// Out of order, but still inside the kept range.
+		REQUIRE(ids.registerMsgId(75, false));
+		REQUIRE(ids.lookup(75) == State::NoAckNeeded);
+		ids.shrink();
+		REQUIRE(ids.min() == 75);
+		REQUIRE(ids.lookup(90) == State::NeedsAck);
+	}
+	SECTION("clear") {
+		ids.registerMsgId(10, true);
+		ids.clear();
+		REQUIRE(ids.size() == 0);
+		REQUIRE(ids.lookup(10) == State::NotFound);
+		REQUIRE(ids.registerMsgId(5, true));
+	}
+}
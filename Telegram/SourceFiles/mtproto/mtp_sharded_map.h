@@ -0,0 +1,115 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <QtCore/QReadWriteLock>
+#include <array>
+#include <optional>
+#include <unordered_map>
+
+namespace MTP {
+namespace details {
+
+// Request id keyed table used from the main and the connection threads.
+// Keys are spread over independently locked shards, so that lookups of
+// different requests don't wait for each other and only the writers of
+// the same shard ever block the readers.
+template <typename Key, typename Value, int kShardsCount = 16>
+class ShardedMap final {
+	static_assert(
+		kShardsCount > 0 && !(kShardsCount & (kShardsCount - 1)),
+		"kShardsCount should be a power of two.");
+
+public:
+	// Replaces the value if the key is already in the map.
+	void set(const Key &key, Value value) {
+		auto &shard = shardFor(key);
+		QWriteLocker lock(&shard.lock);
+		shard.map.insert_or_assign(key, std::move(value));
+	}
+
+	// Returns false if the key is already in the map.
+	bool emplace(const Key &key, Value value) {
+		auto &shard = shardFor(key);
+		QWriteLocker lock(&shard.lock);
+		return shard.map.emplace(key, std::move(value)).second;
+	}
+
+	[[nodiscard]] std::optional<Value> find(const Key &key) const {
+		const auto &shard = shardFor(key);
+		QReadLocker lock(&shard.lock);
+		const auto i = shard.map.find(key);
+		if (i == shard.map.end()) {
+			return std::nullopt;
+		}
+		return i->second;
+	}
+
+	[[nodiscard]] bool contains(const Key &key) const {
+		const auto &shard = shardFor(key);
+		QReadLocker lock(&shard.lock);
+		return shard.map.find(key) != shard.map.end();
+	}
+
+	// Changes the value in place and returns the result.
+	template <typename Method>
+	std::optional<Value> update(const Key &key, Method &&method) {
+		auto &shard = shardFor(key);
+		QWriteLocker lock(&shard.lock);
+		const auto i = shard.map.find(key);
+		if (i == shard.map.end()) {
+			return std::nullopt;
+		}
+		method(i->second);
+		return i->second;
+	}
+
+	std::optional<Value> take(const Key &key) {
+		auto &shard = shardFor(key);
+		QWriteLocker lock(&shard.lock);
+		const auto i = shard.map.find(key);
+		if (i == shard.map.end()) {
+			return std::nullopt;
+		}
+		auto result = std::optional<Value>(std::move(i->second));
+		shard.map.erase(i);
+		return result;
+	}
+
+	bool remove(const Key &key) {
+		auto &shard = shardFor(key);
+		QWriteLocker lock(&shard.lock);
+		return shard.map.erase(key) > 0;
+	}
+
+private:
+	// Each shard on its own cache line, so that the locks of neighbour
+	// shards taken from different threads don't bounce the same line.
+	struct alignas(64) Shard {
+		mutable QReadWriteLock lock;
+		std::unordered_map<Key, Value> map;
+	};
+
+	[[nodiscard]] static int IndexFor(const Key &key) {
+		// Request ids are sequential, hashing keeps them apart anyway.
+		const auto hash = std::hash<Key>()(key);
+		return int((hash ^ (hash >> 16)) & (kShardsCount - 1));
+	}
+	[[nodiscard]] Shard &shardFor(const Key &key) {
+		return _shards[IndexFor(key)];
+	}
+	[[nodiscard]] const Shard &shardFor(const Key &key) const {
+		return _shards[IndexFor(key)];
+	}
+
+	std::array<Shard, kShardsCount> _shards;
+
+};
+
+} // namespace details
+} // namespace MTP
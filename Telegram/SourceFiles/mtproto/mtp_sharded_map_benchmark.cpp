@@ -0,0 +1,114 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/mtp_sharded_map.h"
+#include "base/basic_types.h"
+#include "core/benchmark_helpers.h"
+#include <QtCore/QMutex>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr auto kRequests = 100000;
+constexpr auto kLookupsPerRequest = 4;
+
+// The way request tables were kept before: one lock for the whole map.
+template <typename Key, typename Value>
+class LockedMap final {
+public:
+	void set(const Key &key, Value value) {
+		QMutexLocker lock(&_lock);
+		_map[key] = std::move(value);
+	}
+	std::optional<Value> find(const Key &key) const {
+		QMutexLocker lock(&_lock);
+		const auto i = _map.find(key);
+		if (i == _map.end()) {
+			return std::nullopt;
+		}
+		return i->second;
+	}
+	std::optional<Value> take(const Key &key) {
+		QMutexLocker lock(&_lock);
+		const auto i = _map.find(key);
+		if (i == _map.end()) {
+			return std::nullopt;
+		}
+		auto result = std::optional<Value>(std::move(i->second));
+		_map.erase(i);
+		return result;
+	}
+
+private:
+	mutable QMutex _lock;
+	std::map<Key, Value> _map;
+
+};
+
+// The main thread registers requests, while every connection thread
+// looks up the requests it sends and takes the ones it receives answers
+// for, the same way MTP::Instance tables are used.
+template <typename Map>
+double Simulate(int connections) {
+	auto map = Map();
+	auto registered = std::atomic<int>(0);
+	auto answered = std::atomic<int64>(0);
+	auto missing = std::atomic<int>(0);
+	return Core::MeasureMilliseconds([&] {
+		auto threads = std::vector<std::thread>();
+		for (auto c = 0; c != connections; ++c) {
+			threads.emplace_back([&, c] {
+				for (auto id = c + 1; id <= kRequests; id += connections) {
+					while (registered.load(std::memory_order_acquire) < id) {
+						std::this_thread::yield();
+					}
+					for (auto i = 0; i != kLookupsPerRequest; ++i) {
+						if (!map.find(id)) {
+							++missing;
+						}
+					}
+					if (const auto value = map.take(id)) {
+						answered += *value;
+					}
+				}
+			});
+		}
+		for (auto id = 1; id <= kRequests; ++id) {
+			map.set(id, id);
+			registered.store(id, std::memory_order_release);
+		}
+		for (auto &thread : threads) {
+			thread.join();
+		}
+		REQUIRE(missing == 0);
+		REQUIRE(answered == int64(kRequests) * (kRequests + 1) / 2);
+	});
+}
+
+} // namespace
+
+TEST_CASE("benchmark request tables", "[mtp_sharded_map]") {
+	using Sharded = MTP::details::ShardedMap<int32, int>;
+	using Locked = LockedMap<int32, int>;
+	for (const auto connections : { 1, 2, 4, 8 }) {
+		const auto locked = Simulate<Locked>(connections);
+		const auto sharded = Simulate<Sharded>(connections);
+		WARN(connections
+			<< " connection threads, "
+			<< kRequests
+			<< " requests: single lock "
+			<< int(locked)
+			<< " ms, sharded "
+			<< int(sharded)
+			<< " ms");
+	}
+}
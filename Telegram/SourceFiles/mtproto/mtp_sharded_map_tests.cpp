@@ -0,0 +1,74 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "mtproto/mtp_sharded_map.h"
+#include "base/basic_types.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using Map = MTP::details::ShardedMap<int32, int>;
+
+TEST_CASE("sharded map", "[mtp_sharded_map]") {
+	auto map = Map();
+
+	SECTION("insert and find") {
+		REQUIRE(!map.find(1));
+		REQUIRE(map.emplace(1, 10));
+		REQUIRE(!map.emplace(1, 20));
+		REQUIRE(map.find(1) == 10);
+		REQUIRE(map.contains(1));
+		REQUIRE(!map.contains(2));
+
+		map.set(1, 30);
+		map.set(2, 40);
+		REQUIRE(map.find(1) == 30);
+		REQUIRE(map.find(2) == 40);
+	}
+	SECTION("take and remove") {
+		map.set(1, 10);
+		map.set(17, 20);
+		REQUIRE(map.take(1) == 10);
+		REQUIRE(!map.take(1));
+		REQUIRE(map.find(17) == 20);
+		REQUIRE(map.remove(17));
+		REQUIRE(!map.remove(17));
+		REQUIRE(!map.contains(17));
+	}
+	SECTION("update in place") {
+		const auto negate = [](int &value) { value = -value; };
+		REQUIRE(!map.update(1, negate));
+		map.set(1, 10);
+		REQUIRE(map.update(1, negate) == -10);
+		REQUIRE(map.find(1) == -10);
+	}
+	SECTION("concurrent take of each key happens once") {
+		constexpr auto kCount = 10000;
+		constexpr auto kThreads = 4;
+		for (auto i = 1; i <= kCount; ++i) {
+			map.set(i, i);
+		}
+		auto taken = std::atomic<int64>(0);
+		auto threads = std::vector<std::thread>();
+		for (auto t = 0; t != kThreads; ++t) {
+			threads.emplace_back([&] {
+				for (auto i = 1; i <= kCount; ++i) {
+					if (const auto value = map.take(i)) {
+						taken += *value;
+					}
+				}
+			});
+		}
+		for (auto &thread : threads) {
+			thread.join();
+		}
+		REQUIRE(taken == int64(kCount) * (kCount + 1) / 2);
+		REQUIRE(!map.contains(kCount / 2));
+	}
+}
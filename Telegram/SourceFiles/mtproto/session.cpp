@@ -18,28 +18,8 @@ namespace MTP {
 namespace internal {
 namespace {
 
-// How much time passed from send till we resend request or check its state.
-constexpr auto kCheckResendTimeout = crl::time(10000);
-
-// How much time to wait for some more requests,
-// when resending request or checking its state.
-constexpr auto kCheckResendWaiting = crl::time(1000);
-
-// How much ints should message contain for us not to resend,
-// but instead to check its state.
-constexpr auto kResendThreshold = 1;
-
-// Container lives 10 minutes in haveSent map.
-constexpr auto kContainerLives = 600;
-
-QString LogIds(const QVector<uint64> &ids) {
-	if (!ids.size()) return "[]";
-	auto idsStr = QString("[%1").arg(*ids.cbegin());
-	for (const auto id : ids) {
-		idsStr += QString(", %2").arg(id);
-	}
-	return idsStr + "]";
-}
+// How many commands may wait for the connection thread before overflow.
+constexpr auto kCommandsQueueSize = 1024;
 
 } // namespace
 
@@ -62,6 +42,11 @@ ConnectionOptions::ConnectionOptions(
 , useTcp(useTcp) {
 }
 
+SessionData::SessionData(not_null<Session*> creator)
+: _owner(creator)
+, _commands(kCommandsQueueSize) {
+}
+
 void SessionData::setKey(const AuthKeyPtr &key) {
 	if (_authKey != key) {
 		uint64 session = rand_value<uint64>();
@@ -91,10 +76,22 @@ void SessionData::notifyConnectionInited(const ConnectionOptions &options) {
 	}
 }
 
+void SessionData::queueCommand(SessionCommand &&command) {
+	if (!_commandsOverflown.load(std::memory_order_acquire)
+		&& _commands.push(std::move(command))) {
+		return;
+	}
+	QMutexLocker lock(&_commandsOverflowLock);
+	if (_commandsOverflown || !_commands.push(std::move(command))) {
+		_commandsOverflow.push_back(std::move(command));
+		_commandsOverflown = true;
+	}
+}
+
 void SessionData::clear(Instance *instance) {
 	auto clearCallbacks = std::vector<RPCCallbackClear>();
 	{
-		QReadLocker locker1(haveSentMutex()), locker2(toResendMutex()), locker3(haveReceivedMutex()), locker4(wereAckedMutex());
+		QReadLocker locker(haveReceivedMutex());
 		auto receivedResponsesEnd = _receivedResponses.cend();
 		clearCallbacks.reserve(_haveSent.size() + _wereAcked.size());
 		for (auto i = _haveSent.cbegin(), e = _haveSent.cend(); i != e; ++i) {
@@ -116,22 +113,10 @@ void SessionData::clear(Instance *instance) {
 			}
 		}
 	}
-	{
-		QWriteLocker locker(haveSentMutex());
-		_haveSent.clear();
-	}
-	{
-		QWriteLocker locker(toResendMutex());
-		_toResend.clear();
-	}
-	{
-		QWriteLocker locker(wereAckedMutex());
-		_wereAcked.clear();
-	}
-	{
-		QWriteLocker locker(receivedIdsMutex());
-		_receivedIds.clear();
-	}
+	_haveSent.clear();
+	_toResend.clear();
+	_wereAcked.clear();
+	_receivedIds.clear();
 	instance->clearCallbacksDelayed(std::move(clearCallbacks));
 }
 
@@ -140,9 +125,6 @@ Session::Session(not_null<Instance*> instance, ShiftedDcId shiftedDcId) : QObjec
 , data(this)
 , dcWithShift(shiftedDcId)
 , sender([=] { needToResumeAndSend(); }) {
-	connect(&timeouter, SIGNAL(timeout()), this, SLOT(checkRequestsByTimer()));
-	timeouter.start(1000);
-
 	refreshOptions();
 }
 
@@ -308,72 +290,6 @@ void Session::sendMsgsStateInfo(quint64 msgId, QByteArray data) {
 			MTP_msgs_state_info(MTP_long(msgId), MTP_bytes(data))));
 }
 
-void Session::checkRequestsByTimer() {
-	QVector<mtpMsgId> resendingIds;
-	QVector<mtpMsgId> removingIds; // remove very old (10 minutes) containers and resend requests
-	QVector<mtpMsgId> stateRequestIds;
-
-	{
-		QReadLocker locker(data.haveSentMutex());
-		auto &haveSent = data.haveSentMap();
-		const auto haveSentCount = haveSent.size();
-		auto ms = crl::now();
-		for (auto i = haveSent.begin(), e = haveSent.end(); i != e; ++i) {
-			auto &req = i.value();
-			if (req->msDate > 0) {
-				if (req->msDate + kCheckResendTimeout < ms) { // need to resend or check state
-					if (req.messageSize() < kResendThreshold) { // resend
-						resendingIds.reserve(haveSentCount);
-						resendingIds.push_back(i.key());
-					} else {
-						req->msDate = ms;
-						stateRequestIds.reserve(haveSentCount);
-						stateRequestIds.push_back(i.key());
-					}
-				}
-			} else if (base::unixtime::now()
-					> int32(i.key() >> 32) + kContainerLives) {
-				removingIds.reserve(haveSentCount);
-				removingIds.push_back(i.key());
-			}
-		}
-	}
-
-	if (stateRequestIds.size()) {
-		DEBUG_LOG(("MTP Info: requesting state of msgs: %1").arg(LogIds(stateRequestIds)));
-		{
-			QWriteLocker locker(data.stateRequestMutex());
-			for (uint32 i = 0, l = stateRequestIds.size(); i < l; ++i) {
-				data.stateRequestMap().insert(stateRequestIds[i], true);
-			}
-		}
-		sendAnything(kCheckResendWaiting);
-	}
-	if (!resendingIds.isEmpty()) {
-		for (uint32 i = 0, l = resendingIds.size(); i < l; ++i) {
-			DEBUG_LOG(("MTP Info: resending request %1").arg(resendingIds[i]));
-			resend(resendingIds[i], kCheckResendWaiting);
-		}
-	}
-	if (!removingIds.isEmpty()) {
-		auto clearCallbacks = std::vector<RPCCallbackClear>();
-		{
-			QWriteLocker locker(data.haveSentMutex());
-			auto &haveSent = data.haveSentMap();
-			for (uint32 i = 0, l = removingIds.size(); i < l; ++i) {
-				auto j = haveSent.find(removingIds[i]);
-				if (j != haveSent.cend()) {
-					if (j.value()->requestId) {
-						clearCallbacks.push_back(j.value()->requestId);
-					}
-					haveSent.erase(j);
-				}
-			}
-		}
-		_instance->clearCallbacksDelayed(std::move(clearCallbacks));
-	}
-}
-
 void Session::onConnectionStateChange(qint32 newState) {
 	_instance->onStateChange(dcWithShift, newState);
 }
@@ -383,13 +299,12 @@ void Session::onResetDone() {
 }
 
 void Session::cancel(mtpRequestId requestId, mtpMsgId msgId) {
-	if (requestId) {
-		QWriteLocker locker(data.toSendMutex());
-		data.toSendMap().remove(requestId);
-	}
-	if (msgId) {
-		QWriteLocker locker(data.haveSentMutex());
-		data.haveSentMap().remove(msgId);
+	if (requestId || msgId) {
+		data.queueCommand({
+			SessionCommand::Type::Cancel,
+			SecureRequest(),
+			requestId,
+			msgId });
 	}
 }
 
@@ -398,7 +313,7 @@ void Session::ping() {
 	sendAnything(0);
 }
 
-int32 Session::requestState(mtpRequestId requestId) const {
+int32 Session::requestState(const SecureRequest &request) const {
 	int32 result = MTP::RequestSent;
 
 	bool connected = false;
@@ -419,16 +334,11 @@ int32 Session::requestState(mtpRequestId requestId) const {
 	if (!connected) {
 		return result;
 	}
-	if (!requestId) return MTP::RequestSent;
+	if (!request) return MTP::RequestSent;
 
-	QWriteLocker locker(data.toSendMutex());
-	const auto &toSend = data.toSendMap();
-	const auto i = toSend.constFind(requestId);
-	if (i != toSend.cend()) {
-		return MTP::RequestSending;
-	} else {
-		return MTP::RequestSent;
-	}
+	return request->sending.load(std::memory_order_acquire)
+		? MTP::RequestSending
+		: MTP::RequestSent;
 }
 
 int32 Session::getState() const {
@@ -458,92 +368,17 @@ QString Session::transport() const {
 	return _connection ? _connection->transport() : QString();
 }
 
-mtpRequestId Session::resend(quint64 msgId, qint64 msCanWait, bool forceContainer, bool sendMsgStateInfo) {
-	SecureRequest request;
-	{
-		QWriteLocker locker(data.haveSentMutex());
-		auto &haveSent = data.haveSentMap();
-
-		auto i = haveSent.find(msgId);
-		if (i == haveSent.end()) {
-			if (sendMsgStateInfo) {
-				char cantResend[2] = {1, 0};
-				DEBUG_LOG(("Message Info: cant resend %1, request not found").arg(msgId));
-
-				auto info = std::string(cantResend, cantResend + 1);
-				return _instance->sendProtocolMessage(
-					dcWithShift,
-					MTPMsgsStateInfo(
-						MTP_msgs_state_info(
-							MTP_long(msgId),
-							MTP_string(std::move(info)))));
-			}
-			return 0;
-		}
-
-		request = i.value();
-		haveSent.erase(i);
-	}
-	if (request.isSentContainer()) { // for container just resend all messages we can
-		DEBUG_LOG(("Message Info: resending container from haveSent, msgId %1").arg(msgId));
-		const mtpMsgId *ids = (const mtpMsgId *)(request->constData() + 8);
-		for (uint32 i = 0, l = (request->size() - 8) >> 1; i < l; ++i) {
-			resend(ids[i], 10, true);
-		}
-		return 0xFFFFFFFF;
-	} else if (!request.isStateRequest()) {
-		request->msDate = forceContainer ? 0 : crl::now();
-		sendPrepared(request, msCanWait, false);
-		{
-			QWriteLocker locker(data.toResendMutex());
-			data.toResendMap().insert(msgId, request->requestId);
-		}
-		return request->requestId;
-	} else {
-		return 0;
-	}
-}
-
-void Session::resendMany(QVector<quint64> msgIds, qint64 msCanWait, bool forceContainer, bool sendMsgStateInfo) {
-	for (int32 i = 0, l = msgIds.size(); i < l; ++i) {
-		resend(msgIds.at(i), msCanWait, forceContainer, sendMsgStateInfo);
-	}
-}
-
-void Session::resendAll() {
-	QVector<mtpMsgId> toResend;
-	{
-		QReadLocker locker(data.haveSentMutex());
-		const auto &haveSent = data.haveSentMap();
-		toResend.reserve(haveSent.size());
-		for (auto i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) {
-			if (i.value()->requestId) {
-				toResend.push_back(i.key());
-			}
-		}
-	}
-	for (uint32 i = 0, l = toResend.size(); i < l; ++i) {
-		resend(toResend[i], 10, true);
-	}
-}
-
 void Session::sendPrepared(
 		const SecureRequest &request,
-		crl::time msCanWait,
-		bool newRequest) {
+		crl::time msCanWait) {
 	DEBUG_LOG(("MTP Info: adding request to toSendMap, msCanWait %1"
 		).arg(msCanWait));
-	{
-		QWriteLocker locker(data.toSendMutex());
-		data.toSendMap().insert(request->requestId, request);
-
-		if (newRequest) {
-			*(mtpMsgId*)(request->data() + 4) = 0;
-			*(request->data() + 6) = 0;
-		}
-	}
+	*(mtpMsgId*)(request->data() + 4) = 0;
+	*(request->data() + 6) = 0;
+	request->sending = true;
+	data.queueCommand({ SessionCommand::Type::Send, request });
 
-	DEBUG_LOG(("MTP Info: added, requestId %1").arg(request->requestId));
+	DEBUG_LOG(("MTP Info: queued, requestId %1").arg(request->requestId));
 
 	sendAnything(msCanWait);
 }
@@ -9,8 +9,11 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "base/timer.h"
 #include "mtproto/rpc_sender.h"
+#include "mtproto/mtp_mpsc_queue.h"
+#include "mtproto/mtp_msg_ids.h"
 
 #include <QtCore/QTimer>
+#include <deque>
 
 namespace MTP {
 
@@ -29,74 +32,8 @@ class Connection;
 using PreRequestMap = QMap<mtpRequestId, SecureRequest>;
 using RequestMap = QMap<mtpMsgId, SecureRequest>;
 
-class RequestIdsMap : public QMap<mtpMsgId, mtpRequestId> {
-public:
-	using ParentType = QMap<mtpMsgId, mtpRequestId>;
-
-	mtpMsgId min() const {
-		return size() ? cbegin().key() : 0;
-	}
-
-	mtpMsgId max() const {
-		ParentType::const_iterator e(cend());
-		return size() ? (--e).key() : 0;
-	}
-
-};
-
-class ReceivedMsgIds {
-public:
-	bool registerMsgId(mtpMsgId msgId, bool needAck) {
-		auto i = _idsNeedAck.constFind(msgId);
-		if (i == _idsNeedAck.cend()) {
-			if (_idsNeedAck.size() < kIdsBufferSize || msgId > min()) {
-				_idsNeedAck.insert(msgId, needAck);
-				return true;
-			}
-			MTP_LOG(-1, ("No need to handle - %1 < min = %2").arg(msgId).arg(min()));
-		} else {
-			MTP_LOG(-1, ("No need to handle - %1 already is in map").arg(msgId));
-		}
-		return false;
-	}
-
-	mtpMsgId min() const {
-		return _idsNeedAck.isEmpty() ? 0 : _idsNeedAck.cbegin().key();
-	}
-
-	mtpMsgId max() const {
-		auto end = _idsNeedAck.cend();
-		return _idsNeedAck.isEmpty() ? 0 : (--end).key();
-	}
-
-	void shrink() {
-		auto size = _idsNeedAck.size();
-		while (size-- > kIdsBufferSize) {
-			_idsNeedAck.erase(_idsNeedAck.begin());
-		}
-	}
-
-	enum class State {
-		NotFound,
-		NeedsAck,
-		NoAckNeeded,
-	};
-	State lookup(mtpMsgId msgId) const {
-		auto i = _idsNeedAck.constFind(msgId);
-		if (i == _idsNeedAck.cend()) {
-			return State::NotFound;
-		}
-		return i.value() ? State::NeedsAck : State::NoAckNeeded;
-	}
-
-	void clear() {
-		_idsNeedAck.clear();
-	}
-
-private:
-	QMap<mtpMsgId, bool> _idsNeedAck;
-
-};
+using RequestIdsMap = details::FlatIdsMap<mtpMsgId, mtpRequestId>;
+using ReceivedMsgIds = details::ReceivedIds<mtpMsgId, kIdsBufferSize>;
 
 using SerializedMessage = mtpBuffer;
 
@@ -134,11 +71,24 @@ struct ConnectionOptions {
 
 };
 
+// What the main thread asks the connection thread to do with the
+// requests it owns.
+struct SessionCommand {
+	enum class Type : uchar {
+		Send,
+		Cancel,
+	};
+
+	Type type = Type::Send;
+	SecureRequest request;
+	mtpRequestId requestId = 0;
+	mtpMsgId msgId = 0;
+};
+
 class Session;
 class SessionData {
 public:
-	SessionData(not_null<Session*> creator) : _owner(creator) {
-	}
+	SessionData(not_null<Session*> creator);
 
 	void setSession(uint64 session) {
 		DEBUG_LOG(("MTP Info: setting server_session: %1").arg(session));
@@ -194,28 +144,19 @@ public:
 
 	not_null<QReadWriteLock*> keyMutex() const;
 
-	not_null<QReadWriteLock*> toSendMutex() const {
-		return &_toSendLock;
-	}
-	not_null<QReadWriteLock*> haveSentMutex() const {
-		return &_haveSentLock;
-	}
-	not_null<QReadWriteLock*> toResendMutex() const {
-		return &_toResendLock;
-	}
-	not_null<QReadWriteLock*> wereAckedMutex() const {
-		return &_wereAckedLock;
-	}
-	not_null<QReadWriteLock*> receivedIdsMutex() const {
-		return &_receivedIdsLock;
-	}
 	not_null<QReadWriteLock*> haveReceivedMutex() const {
 		return &_haveReceivedLock;
 	}
-	not_null<QReadWriteLock*> stateRequestMutex() const {
-		return &_stateRequestLock;
-	}
 
+	// Any thread, the commands are applied in the connection thread.
+	void queueCommand(SessionCommand &&command);
+
+	// Connection thread only.
+	template <typename Method>
+	void takeCommands(Method &&method);
+
+	// The request maps are owned by the connection thread, the main thread
+	// accesses them only through the queued commands.
 	PreRequestMap &toSendMap() {
 		return _toSend;
 	}
@@ -279,6 +220,7 @@ public:
 		return result * 2 + (needAck ? 1 : 0);
 	}
 
+	// Connection thread only.
 	void clear(Instance *instance);
 
 private:
@@ -304,18 +246,39 @@ private:
 	QMap<mtpRequestId, SerializedMessage> _receivedResponses; // map of request_id -> response that should be processed in the main thread
 	QList<SerializedMessage> _receivedUpdates; // list of updates that should be processed in the main thread
 
+	details::MpscQueue<SessionCommand> _commands;
+
+	// When the queue is full the commands wait here, so that the main
+	// thread never blocks on a busy connection thread.
+	std::atomic<bool> _commandsOverflown = false;
+	QMutex _commandsOverflowLock;
+	std::deque<SessionCommand> _commandsOverflow;
+
 	// mutexes
 	mutable QReadWriteLock _lock;
-	mutable QReadWriteLock _toSendLock;
-	mutable QReadWriteLock _haveSentLock;
-	mutable QReadWriteLock _toResendLock;
-	mutable QReadWriteLock _receivedIdsLock;
-	mutable QReadWriteLock _wereAckedLock;
 	mutable QReadWriteLock _haveReceivedLock;
-	mutable QReadWriteLock _stateRequestLock;
 
 };
 
+template <typename Method>
+void SessionData::takeCommands(Method &&method) {
+	while (auto command = _commands.pop()) {
+		method(std::move(*command));
+	}
+	if (!_commandsOverflown.load(std::memory_order_acquire)) {
+		return;
+	}
+	auto overflow = std::deque<SessionCommand>();
+	{
+		QMutexLocker lock(&_commandsOverflowLock);
+		overflow = base::take(_commandsOverflow);
+		_commandsOverflown = false;
+	}
+	for (auto &command : overflow) {
+		method(std::move(command));
+	}
+}
+
 class Session : public QObject {
 	Q_OBJECT
 
@@ -340,15 +303,14 @@ public:
 
 	void ping();
 	void cancel(mtpRequestId requestId, mtpMsgId msgId);
-	int32 requestState(mtpRequestId requestId) const;
+	int32 requestState(const SecureRequest &request) const;
 	int32 getState() const;
 	QString transport() const;
 
-	// Nulls msgId and seqNo in request, if newRequest = true.
+	// Nulls msgId and seqNo in request.
 	void sendPrepared(
 		const SecureRequest &request,
-		crl::time msCanWait = 0,
-		bool newRequest = true);
+		crl::time msCanWait = 0);
 
 	~Session();
 
@@ -361,15 +323,10 @@ signals:
 public slots:
 	void needToResumeAndSend();
 
-	mtpRequestId resend(quint64 msgId, qint64 msCanWait = 0, bool forceContainer = false, bool sendMsgStateInfo = false);
-	void resendMany(QVector<quint64> msgIds, qint64 msCanWait, bool forceContainer, bool sendMsgStateInfo);
-	void resendAll(); // after connection restart
-
 	void authKeyCreatedForDC();
 	void connectionWasInitedForDC();
 
 	void tryToReceive();
-	void checkRequestsByTimer();
 	void onConnectionStateChange(qint32 newState);
 	void onResetDone();
 
@@ -398,7 +355,6 @@ private:
 
 	bool _ping = false;
 
-	QTimer timeouter;
 	base::Timer sender;
 
 };
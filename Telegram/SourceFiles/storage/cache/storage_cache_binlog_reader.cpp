@@ -30,6 +30,10 @@ bool BinlogWrapper::failed() const {
 	return _failed;
 }
 
+int64 BinlogWrapper::offset() const {
+	return _binlog.offset() - _part.size();
+}
+
 std::optional<BasicHeader> BinlogWrapper::ReadHeader(
 		File &binlog,
 		const Settings &settings) {
@@ -106,6 +110,54 @@ void BinlogWrapper::finish(size_type rollback) {
 	_binlog.seek(_binlog.offset() - rollback);
 }
 
+BinlogPipe::BinlogPipe(Split &&split, int chunksLimit)
+: _chunksLimit(chunksLimit)
+, _thread([=, split = std::move(split)]() mutable {
+	split([=](BinlogChunk &&chunk) { return push(std::move(chunk)); });
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_finished = true;
+	_variable.notify_all();
+}) {
+	Expects(_chunksLimit > 0);
+}
+
+bool BinlogPipe::push(BinlogChunk &&chunk) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_variable.wait(lock, [&] {
+		return _cancelled || (_chunks.size() < _chunksLimit);
+	});
+	if (_cancelled) {
+		return false;
+	}
+	_chunks.push_back(std::move(chunk));
+	_variable.notify_all();
+	return true;
+}
+
+std::optional<BinlogChunk> BinlogPipe::take() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_variable.wait(lock, [&] {
+		return _finished || !_chunks.empty();
+	});
+	if (_chunks.empty()) {
+		return std::nullopt;
+	}
+	auto result = std::move(_chunks.front());
+	_chunks.pop_front();
+	_variable.notify_all();
+	return result;
+}
+
+BinlogPipe::~BinlogPipe() {
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_cancelled = true;
+		_variable.notify_all();
+	}
+	_thread.join();
+}
+
 } // namespace details
 } // namespace Cache
 } // namespace Storage
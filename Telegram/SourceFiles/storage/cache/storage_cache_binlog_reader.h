@@ -11,6 +11,10 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/storage_encrypted_file.h"
 #include "base/bytes.h"
 #include "base/match_method.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
 
 namespace Storage {
 namespace Cache {
@@ -19,6 +23,13 @@ namespace details {
 template <typename ...Records>
 class BinlogReader;
 
+// Complete records read from the binlog one after another.
+struct BinlogChunk {
+	int64 offset = 0;
+	bytes::vector data;
+	std::vector<size_type> sizes;
+};
+
 class BinlogWrapper {
 public:
 	BinlogWrapper(File &binlog, const Settings &settings, int64 till = 0);
@@ -26,6 +37,9 @@ public:
 	bool finished() const;
 	bool failed() const;
 
+	// Offset right after the last record that was read completely.
+	int64 offset() const;
+
 	static std::optional<BasicHeader> ReadHeader(
 		File &binlog,
 		const Settings &settings);
@@ -62,18 +76,51 @@ public:
 	template <typename ...Handlers>
 	bool readTillEnd(Handlers &&...handlers);
 
+	// Reads the next part without handling records, true when finished.
+	bool splitTillEnd(BinlogChunk &chunk);
+
+	template <typename ...Handlers>
+	static bool HandleRecord(
+		bytes::const_span data,
+		Handlers &&...handlers);
+
 private:
 	static size_type ReadRecordSize(
 		const BinlogWrapper &that,
 		bytes::const_span data);
 
-	template <typename ...Handlers>
-	bool handleRecord(bytes::const_span data, Handlers &&...handlers) const;
-
 	BinlogWrapper &_wrapper;
 
 };
 
+// Runs the read-and-decrypt stage of binlog replay on its own thread,
+// so that records are applied on the database queue at the same time.
+class BinlogPipe {
+public:
+	using Push = Fn<bool(BinlogChunk&&)>;
+	using Split = FnMut<void(const Push &push)>;
+
+	BinlogPipe(Split &&split, int chunksLimit);
+	BinlogPipe(const BinlogPipe &other) = delete;
+	BinlogPipe &operator=(const BinlogPipe &other) = delete;
+	~BinlogPipe();
+
+	// Waits for the next chunk, returns std::nullopt when finished.
+	std::optional<BinlogChunk> take();
+
+private:
+	bool push(BinlogChunk &&chunk);
+
+	const int _chunksLimit = 0;
+	std::mutex _mutex;
+	std::condition_variable _variable;
+	std::deque<BinlogChunk> _chunks;
+	bool _finished = false;
+	bool _cancelled = false;
+	std::thread _thread;
+
+};
+
 template <typename Record>
 struct MultiRecord {
 	using true_t = char;
@@ -226,7 +273,7 @@ bool BinlogReader<Records...>::readTillEnd(Handlers &&...handlers) {
 		return _wrapper.readRecord(&BinlogReader::ReadRecordSize);
 	};
 	for (auto bytes = readRecord(); !bytes.empty(); bytes = readRecord()) {
-		if (!handleRecord(bytes, std::forward<Handlers>(handlers)...)) {
+		if (!HandleRecord(bytes, std::forward<Handlers>(handlers)...)) {
 			_wrapper.finish(bytes.size());
 			return true;
 		}
@@ -234,6 +281,23 @@ bool BinlogReader<Records...>::readTillEnd(Handlers &&...handlers) {
 	return false;
 }
 
+template <typename ...Records>
+bool BinlogReader<Records...>::splitTillEnd(BinlogChunk &chunk) {
+	if (!_wrapper.readPart()) {
+		return true;
+	}
+	chunk.offset = _wrapper.offset();
+	chunk.data.reserve(_wrapper._part.size());
+	const auto readRecord = [&] {
+		return _wrapper.readRecord(&BinlogReader::ReadRecordSize);
+	};
+	for (auto bytes = readRecord(); !bytes.empty(); bytes = readRecord()) {
+		chunk.data.insert(end(chunk.data), bytes.begin(), bytes.end());
+		chunk.sizes.push_back(bytes.size());
+	}
+	return false;
+}
+
 template <typename ...Records>
 size_type BinlogReader<Records...>::ReadRecordSize(
 		const BinlogWrapper &that,
@@ -249,9 +313,9 @@ size_type BinlogReader<Records...>::ReadRecordSize(
 
 template <typename ...Records>
 template <typename ...Handlers>
-bool BinlogReader<Records...>::handleRecord(
+bool BinlogReader<Records...>::HandleRecord(
 		bytes::const_span data,
-		Handlers &&...handlers) const {
+		Handlers &&...handlers) {
 	Expects(!data.empty());
 
 	return BinlogReaderRecursive<Records...>::HandleRecord(
@@ -9,11 +9,24 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "storage/cache/storage_cache_database_object.h"
 #include "storage/cache/storage_cache_binlog_reader.h"
+#include "base/concurrent_timer.h"
 #include <unordered_set>
 
 namespace Storage {
 namespace Cache {
 namespace details {
+namespace {
+
+struct ResumeInfo {
+	int64 till = 0;
+	int64 processed = 0;
+	int64 compactSize = 0;
+	int64 reserved = 0;
+};
+
+static_assert(GoodForEncryption<ResumeInfo>);
+
+} // namespace
 
 class CompactorObject {
 public:
@@ -33,14 +46,21 @@ private:
 	using Raw = DatabaseObject::Raw;
 	using RawSpan = gsl::span<const Raw>;
 	static QString CompactFilename();
+	static QString ResumeFilename();
 
 	void start();
 	QString binlogPath() const;
 	QString compactPath() const;
+	QString resumePath() const;
 	bool openBinlog();
 	bool readHeader();
 	bool openCompact();
+	bool resumeCompact();
+	bool readCompactKeys();
+	bool saveResumeInfo();
 	void parseChunk();
+	void scheduleNextChunk();
+	void reportProgress();
 	void fail();
 	void done(int64 till);
 	void finish();
@@ -73,7 +93,11 @@ private:
 	Info _info;
 	File _binlog;
 	File _compact;
-	BinlogWrapper _wrapper;
+	std::optional<BinlogWrapper> _wrapper;
+	base::ConcurrentTimer _nextChunkTimer;
+	crl::time _chunkStarted = 0;
+	int64 _chunkStartOffset = 0;
+	int64 _chunkStartCompactSize = 0;
 	size_type _partSize = 0;
 	std::unordered_set<Key> _written;
 	base::variant<
@@ -97,7 +121,7 @@ CompactorObject::CompactorObject(
 , _settings(settings)
 , _key(std::move(key))
 , _info(info)
-, _wrapper(_binlog, _settings, _info.till)
+, _nextChunkTimer(_weak, [=] { parseChunk(); })
 , _partSize(_settings.maxBundledRecords) { // Perhaps a better estimate?
 	Expects(_settings.compactChunkSize > 0);
 
@@ -114,9 +138,19 @@ void CompactorObject::initList() {
 }
 
 void CompactorObject::start() {
-	if (!openBinlog() || !readHeader() || !openCompact()) {
+	if (!openBinlog() || !readHeader()) {
 		fail();
+		return;
+	} else if (!resumeCompact()) {
+		_written.clear();
+		if (!_binlog.seek(0)
+			|| !readHeader()
+			|| !openCompact()) {
+			fail();
+			return;
+		}
 	}
+	_wrapper.emplace(_binlog, _settings, _info.till);
 	if (_settings.trackEstimatedTime) {
 		initList<MultiStoreWithTime>();
 	} else {
@@ -129,6 +163,10 @@ QString CompactorObject::CompactFilename() {
 	return QStringLiteral("binlog-temp");
 }
 
+QString CompactorObject::ResumeFilename() {
+	return QStringLiteral("binlog-temp-resume");
+}
+
 QString CompactorObject::binlogPath() const {
 	return _base + DatabaseObject::BinlogFilename();
 }
@@ -137,6 +175,10 @@ QString CompactorObject::compactPath() const {
 	return _base + CompactFilename();
 }
 
+QString CompactorObject::resumePath() const {
+	return _base + ResumeFilename();
+}
+
 bool CompactorObject::openBinlog() {
 	const auto path = binlogPath();
 	const auto result = _binlog.open(path, File::Mode::Read, _key);
@@ -164,9 +206,97 @@ bool CompactorObject::openCompact() {
 	return true;
 }
 
+bool CompactorObject::resumeCompact() {
+	// The compaction started in a previous launch can be continued if
+	// the binlog wasn't replaced since then. All the changes that were
+	// written after the original 'till' will be caught up in finalize().
+	auto file = File();
+	const auto opened = file.open(resumePath(), File::Mode::Read, _key);
+	if (opened != File::Result::Success) {
+		return false;
+	}
+	auto info = ResumeInfo();
+	const auto read = file.read(bytes::object_as_span(&info));
+	file.close();
+	if (read != sizeof(info)
+		|| info.till <= 0
+		|| info.till > _binlog.size()
+		|| info.processed > info.till) {
+		return false;
+	}
+	const auto result = _compact.open(
+		compactPath(),
+		File::Mode::ReadAppend,
+		_key);
+	if (result != File::Result::Success
+		|| _compact.size() != info.compactSize) {
+		_compact.close();
+		return false;
+	}
+	const auto header = BinlogWrapper::ReadHeader(_compact, _settings);
+	if (!header
+		|| bytes::compare(
+			bytes::object_as_span(&*header),
+			bytes::object_as_span(&_header)) != 0
+		|| !readCompactKeys()
+		|| !_compact.seek(_compact.size())
+		|| !_binlog.seek(info.processed)) {
+		_compact.close();
+		return false;
+	}
+	_info.till = info.till;
+	return true;
+}
+
+bool CompactorObject::readCompactKeys() {
+	// Only multi store records are written before the final catch up.
+	auto wrapper = BinlogWrapper(_compact, _settings);
+	const auto push = [&](const auto &element) {
+		while (const auto record = element()) {
+			_written.emplace(record->key);
+		}
+		return true;
+	};
+	while (true) {
+		const auto done = [&] {
+			if (_settings.trackEstimatedTime) {
+				BinlogReader<MultiStoreWithTime> reader(wrapper);
+				return reader.readTillEnd([&](
+						const MultiStoreWithTime &header,
+						const auto &element) {
+					return push(element);
+				});
+			}
+			BinlogReader<MultiStore> reader(wrapper);
+			return reader.readTillEnd([&](
+					const MultiStore &header,
+					const auto &element) {
+				return push(element);
+			});
+		}();
+		if (done) {
+			break;
+		}
+	}
+	return !wrapper.failed();
+}
+
+bool CompactorObject::saveResumeInfo() {
+	auto info = ResumeInfo();
+	info.till = _info.till;
+	info.processed = _wrapper->offset();
+	info.compactSize = _compact.size();
+	auto file = File();
+	const auto result = file.open(resumePath(), File::Mode::Write, _key);
+	return (result == File::Result::Success)
+		&& file.write(bytes::object_as_span(&info))
+		&& file.flush();
+}
+
 void CompactorObject::fail() {
 	_compact.close();
 	QFile(compactPath()).remove();
+	QFile(resumePath()).remove();
 	_database.with([](DatabaseObject &database) {
 		database.compactorFail();
 	});
@@ -192,6 +322,7 @@ void CompactorObject::finish() {
 void CompactorObject::finalize() {
 	_binlog.close();
 	_compact.close();
+	QFile(resumePath()).remove();
 
 	auto lastCatchUp = 0;
 	auto from = _info.till;
@@ -271,7 +402,7 @@ bool CompactorObject::readBlock(std::vector<Key> &result) {
 			StoreWithTime,
 			MultiStoreWithTime,
 			MultiRemove,
-			MultiAccess> reader(_wrapper);
+			MultiAccess> reader(*_wrapper);
 		return !reader.readTillEnd([&](const StoreWithTime &record) {
 			return push(record);
 		}, [&](const MultiStoreWithTime &header, const auto &element) {
@@ -285,7 +416,7 @@ bool CompactorObject::readBlock(std::vector<Key> &result) {
 		BinlogReader<
 			Store,
 			MultiStore,
-			MultiRemove> reader(_wrapper);
+			MultiRemove> reader(*_wrapper);
 		return !reader.readTillEnd([&](const Store &record) {
 			return push(record);
 		}, [&](const MultiStore &header, const auto &element) {
@@ -297,8 +428,12 @@ bool CompactorObject::readBlock(std::vector<Key> &result) {
 }
 
 void CompactorObject::parseChunk() {
+	_chunkStarted = crl::now();
+	_chunkStartOffset = _wrapper->offset();
+	_chunkStartCompactSize = _compact.size();
+
 	auto keys = readChunk();
-	if (_wrapper.failed()) {
+	if (_wrapper->failed()) {
 		fail();
 		return;
 	} else if (keys.empty()) {
@@ -328,7 +463,38 @@ void CompactorObject::processValues(
 			return;
 		}
 	}
-	parseChunk();
+	if (!writeList() || !saveResumeInfo()) {
+		fail();
+		return;
+	}
+	reportProgress();
+	scheduleNextChunk();
+}
+
+void CompactorObject::scheduleNextChunk() {
+	const auto rate = _settings.compactBytesPerSecond;
+	if (rate <= 0) {
+		parseChunk();
+		return;
+	}
+	const auto bytes = (_wrapper->offset() - _chunkStartOffset)
+		+ (_compact.size() - _chunkStartCompactSize);
+	const auto spent = crl::now() - _chunkStarted;
+	const auto wait = crl::time(bytes * 1000 / rate) - spent;
+	if (wait > 0) {
+		_nextChunkTimer.callOnce(wait);
+	} else {
+		parseChunk();
+	}
+}
+
+void CompactorObject::reportProgress() {
+	_database.with([
+		processed = _wrapper->offset(),
+		total = _info.till
+	](DatabaseObject &database) {
+		database.compactorProgress(processed, total);
+	});
 }
 
 auto CompactorObject::fillList(RawSpan values) -> RawSpan {
@@ -8,49 +8,188 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/cache/storage_cache_database.h"
 
 #include "storage/cache/storage_cache_database_object.h"
+#include "storage/storage_encryption.h"
+#include <crl/crl.h>
+#include <mutex>
 
 namespace Storage {
 namespace Cache {
+namespace {
 
-Database::Database(const QString &path, const Settings &settings)
-: _wrapped(path, settings) {
+constexpr auto kMaxShardsCount = 64;
+
+QString ShardPath(const QString &path, int index) {
+	// Shard folders can't be put inside the main one,
+	// because the Cleaner removes all unknown folders from there.
+	return index ? (path + '_' + QString::number(index)) : path;
+}
+
+class JoinedDone final {
+public:
+	JoinedDone(int count, FnMut<void(Error)> &&done);
+
+	[[nodiscard]] FnMut<void(Error)> callback() const;
+
+private:
+	struct State {
+		std::mutex mutex;
+		int left = 0;
+		Error error;
+		FnMut<void(Error)> done;
+	};
+	std::shared_ptr<State> _state;
+
+};
+
+JoinedDone::JoinedDone(int count, FnMut<void(Error)> &&done) {
+	Expects(count > 0);
+
+	if (done) {
+		_state = std::make_shared<State>();
+		_state->left = count;
+		_state->done = std::move(done);
+	}
+}
+
+FnMut<void(Error)> JoinedDone::callback() const {
+	if (!_state) {
+		return nullptr;
+	}
+	return [state = _state](Error error) {
+		auto lock = std::unique_lock<std::mutex>(state->mutex);
+		if (state->error.type == Error::Type::None) {
+			state->error = error;
+		}
+		if (--state->left > 0) {
+			return;
+		}
+		auto done = base::take(state->done);
+		const auto result = state->error;
+		lock.unlock();
+
+		done(result);
+	};
+}
+
+FnMut<void(Error)> IgnoreError(FnMut<void()> &&done) {
+	if (!done) {
+		return nullptr;
+	}
+	return [done = std::move(done)](Error) mutable {
+		done();
+	};
+}
+
+FnMut<void()> NoError(FnMut<void(Error)> &&done) {
+	if (!done) {
+		return nullptr;
+	}
+	return [done = std::move(done)]() mutable {
+		done(Error::NoError());
+	};
+}
+
+} // namespace
+
+Database::Database(const QString &path, const Settings &settings) {
+	Expects(settings.shardsCount > 0
+		&& settings.shardsCount <= kMaxShardsCount);
+
+	_shards.reserve(settings.shardsCount);
+	for (auto i = 0; i != settings.shardsCount; ++i) {
+		_shards.push_back(std::make_shared<Shard>(
+			ShardPath(path, i),
+			shardSettings(settings)));
+	}
+}
+
+auto Database::shard(const Key &key) const -> Shard & {
+	const auto count = int(_shards.size());
+	return *_shards[(count > 1) ? details::ShardIndex(key, count) : 0];
+}
+
+auto Database::weakShard(const Key &key) const -> std::weak_ptr<Shard> {
+	const auto count = int(_shards.size());
+	return _shards[(count > 1) ? details::ShardIndex(key, count) : 0];
+}
+
+auto Database::shardSettings(const Settings &settings) const -> Settings {
+	auto result = settings;
+	const auto count = settings.shardsCount;
+	if (count > 1 && result.totalSizeLimit > 0) {
+		result.totalSizeLimit = std::max(
+			result.totalSizeLimit / count,
+			int64(result.maxDataSize) + 1);
+	}
+	if (count > 1) {
+		result.hotCacheSizeLimit /= count;
+	}
+	return result;
+}
+
+template <typename Method>
+void Database::withEachShard(Method &&method) {
+	for (const auto &shard : _shards) {
+		shard->with(method);
+	}
 }
 
 void Database::reconfigure(const Settings &settings) {
-	_wrapped.with([settings](Implementation &unwrapped) mutable {
+	Expects(settings.shardsCount == int(_shards.size()));
+
+	withEachShard([settings = shardSettings(settings)](
+			Implementation &unwrapped) mutable {
 		unwrapped.reconfigure(settings);
 	});
 }
 
 void Database::updateSettings(const SettingsUpdate &update) {
-	_wrapped.with([update](Implementation &unwrapped) mutable {
-		unwrapped.updateSettings(update);
+	auto settings = Settings();
+	settings.shardsCount = int(_shards.size());
+	settings.totalSizeLimit = update.totalSizeLimit;
+	auto shardUpdate = update;
+	shardUpdate.totalSizeLimit = shardSettings(settings).totalSizeLimit;
+	withEachShard([shardUpdate](Implementation &unwrapped) mutable {
+		unwrapped.updateSettings(shardUpdate);
 	});
 }
 
 void Database::open(EncryptionKey &&key, FnMut<void(Error)> &&done) {
-	_wrapped.with([
-		key = std::move(key),
-		done = std::move(done)
-	](Implementation &unwrapped) mutable {
-		unwrapped.open(std::move(key), std::move(done));
-	});
+	const auto joined = JoinedDone(int(_shards.size()), std::move(done));
+	for (const auto &shard : _shards) {
+		shard->with([
+			key = base::duplicate(key),
+			done = joined.callback()
+		](Implementation &unwrapped) mutable {
+			unwrapped.open(std::move(key), std::move(done));
+		});
+	}
 }
 
 void Database::close(FnMut<void()> &&done) {
-	_wrapped.with([
-		done = std::move(done)
-	](Implementation &unwrapped) mutable {
-		unwrapped.close(std::move(done));
-	});
+	const auto joined = JoinedDone(
+		int(_shards.size()),
+		IgnoreError(std::move(done)));
+	for (const auto &shard : _shards) {
+		shard->with([
+			done = NoError(joined.callback())
+		](Implementation &unwrapped) mutable {
+			unwrapped.close(std::move(done));
+		});
+	}
 }
 
 void Database::waitForCleaner(FnMut<void()> &&done) {
-	_wrapped.with([
-		done = std::move(done)
-	](Implementation &unwrapped) mutable {
-		unwrapped.waitForCleaner(std::move(done));
-	});
+	const auto joined = JoinedDone(
+		int(_shards.size()),
+		IgnoreError(std::move(done)));
+	for (const auto &shard : _shards) {
+		shard->with([
+			done = NoError(joined.callback())
+		](Implementation &unwrapped) mutable {
+			unwrapped.waitForCleaner(std::move(done));
+		});
+	}
 }
 
 void Database::put(
@@ -72,7 +211,7 @@ void Database::get(const Key &key, FnMut<void(QByteArray&&)> &&done) {
 }
 
 void Database::remove(const Key &key, FnMut<void(Error)> &&done) {
-	_wrapped.with([
+	shard(key).with([
 		key,
 		done = std::move(done)
 	](Implementation &unwrapped) mutable {
@@ -94,25 +233,102 @@ void Database::copyIfEmpty(
 		const Key &from,
 		const Key &to,
 		FnMut<void(Error)> &&done) {
-	_wrapped.with([
-		from,
-		to,
-		done = std::move(done)
-	](Implementation &unwrapped) mutable {
-		unwrapped.copyIfEmpty(from, to, std::move(done));
-	});
+	auto &source = shard(from);
+	if (&source == &shard(to)) {
+		source.with([
+			from,
+			to,
+			done = std::move(done)
+		](Implementation &unwrapped) mutable {
+			unwrapped.copyIfEmpty(from, to, std::move(done));
+		});
+		return;
+	}
+	copyAcrossShards(from, to, false, std::move(done));
 }
 
 void Database::moveIfEmpty(
 		const Key &from,
 		const Key &to,
 		FnMut<void(Error)> &&done) {
-	_wrapped.with([
+	auto &source = shard(from);
+	if (&source == &shard(to)) {
+		source.with([
+			from,
+			to,
+			done = std::move(done)
+		](Implementation &unwrapped) mutable {
+			unwrapped.moveIfEmpty(from, to, std::move(done));
+		});
+		return;
+	}
+	copyAcrossShards(from, to, true, std::move(done));
+}
+
+void Database::copyAcrossShards(
+		const Key &from,
+		const Key &to,
+		bool removeSource,
+		FnMut<void(Error)> &&done) {
+	// The source value is read first, the target shard puts it only if
+	// the key is still empty there and the source is removed only after
+	// the value was really put, the same way moveIfEmpty works in a shard.
+	shard(from).with([
+		source = weakShard(from),
+		target = weakShard(to),
 		from,
 		to,
+		removeSource,
 		done = std::move(done)
 	](Implementation &unwrapped) mutable {
-		unwrapped.moveIfEmpty(from, to, std::move(done));
+		unwrapped.get(from, [
+			source,
+			target,
+			from,
+			to,
+			removeSource,
+			done = std::move(done)
+		](TaggedValue &&value) mutable {
+			const auto strong = target.lock();
+			if (value.bytes.isEmpty() || !strong) {
+				if (done) {
+					done(Error::NoError());
+				}
+				return;
+			}
+			strong->with([
+				source,
+				from,
+				to,
+				removeSource,
+				value = std::move(value),
+				done = std::move(done)
+			](Implementation &unwrapped) mutable {
+				unwrapped.tryPut(to, std::move(value), [
+					source,
+					from,
+					removeSource,
+					done = std::move(done)
+				](Error error, bool put) mutable {
+					const auto strong = source.lock();
+					if (!removeSource
+						|| !put
+						|| error.type != Error::Type::None
+						|| !strong) {
+						if (done) {
+							done(error);
+						}
+						return;
+					}
+					strong->with([
+						from,
+						done = std::move(done)
+					](Implementation &unwrapped) mutable {
+						unwrapped.remove(from, std::move(done));
+					});
+				});
+			});
+		});
 	});
 }
 
@@ -120,7 +336,7 @@ void Database::put(
 		const Key &key,
 		TaggedValue &&value,
 		FnMut<void(Error)> &&done) {
-	_wrapped.with([
+	shard(key).with([
 		key,
 		value = std::move(value),
 		done = std::move(done)
@@ -133,7 +349,7 @@ void Database::putIfEmpty(
 		const Key &key,
 		TaggedValue &&value,
 		FnMut<void(Error)> &&done) {
-	_wrapped.with([
+	shard(key).with([
 		key,
 		value = std::move(value),
 		done = std::move(done)
@@ -145,7 +361,7 @@ void Database::putIfEmpty(
 void Database::getWithTag(
 		const Key &key,
 		FnMut<void(TaggedValue&&)> &&done) {
-	_wrapped.with([
+	shard(key).with([
 		key,
 		done = std::move(done)
 	](Implementation &unwrapped) mutable {
@@ -153,11 +369,78 @@ void Database::getWithTag(
 	});
 }
 
+void Database::getMany(
+		std::vector<Key> &&keys,
+		FnMut<void(std::vector<TaggedValue>&&)> &&done) {
+	if (_shards.size() == 1) {
+		_shards.front()->with([
+			keys = std::move(keys),
+			done = std::move(done)
+		](Implementation &unwrapped) mutable {
+			unwrapped.getMany(std::move(keys), std::move(done));
+		});
+		return;
+	}
+	auto keysByShard = base::flat_map<Shard*, std::vector<int>>();
+	for (auto i = 0, count = int(keys.size()); i != count; ++i) {
+		keysByShard[&shard(keys[i])].push_back(i);
+	}
+	struct State {
+		std::mutex mutex;
+		std::vector<TaggedValue> values;
+		int left = 0;
+		FnMut<void(std::vector<TaggedValue>&&)> done;
+	};
+	const auto state = done ? std::make_shared<State>() : nullptr;
+	if (state) {
+		state->values.resize(keys.size());
+		state->left = int(keysByShard.size());
+		state->done = std::move(done);
+		if (!state->left) {
+			state->done({});
+			return;
+		}
+	}
+	for (auto &[target, indices] : keysByShard) {
+		auto list = ranges::view::all(
+			indices
+		) | ranges::view::transform([&](int index) {
+			return keys[index];
+		}) | ranges::to_vector;
+		auto got = FnMut<void(std::vector<TaggedValue>&&)>();
+		if (state) {
+			got = [=, indices = std::move(indices)](
+					std::vector<TaggedValue> &&values) {
+				Expects(values.size() == indices.size());
+
+				auto lock = std::unique_lock<std::mutex>(state->mutex);
+				for (auto i = 0, count = int(values.size()); i != count; ++i) {
+					state->values[indices[i]] = std::move(values[i]);
+				}
+				if (--state->left > 0) {
+					return;
+				}
+				auto done = base::take(state->done);
+				auto result = base::take(state->values);
+				lock.unlock();
+
+				done(std::move(result));
+			};
+		}
+		target->with([
+			list = std::move(list),
+			done = std::move(got)
+		](Implementation &unwrapped) mutable {
+			unwrapped.getMany(std::move(list), std::move(done));
+		});
+	}
+}
+
 void Database::getWithSizes(
 		const Key &key,
 		std::vector<Key> &&keys,
 		FnMut<void(QByteArray&&, std::vector<int>&&)> &&done) {
-	_wrapped.with([
+	shard(key).with([
 		key,
 		keys = std::move(keys),
 		done = std::move(done)
@@ -167,34 +450,77 @@ void Database::getWithSizes(
 }
 
 auto Database::statsOnMain() const -> rpl::producer<Stats> {
-	return _wrapped.producer_on_main([](const Implementation &unwrapped) {
+	const auto stats = [](const Implementation &unwrapped) {
 		return unwrapped.stats();
-	});
+	};
+	if (_shards.size() == 1) {
+		return _shards.front()->producer_on_main(stats);
+	}
+	auto list = std::vector<const Shard*>();
+	list.reserve(_shards.size());
+	for (const auto &shard : _shards) {
+		list.push_back(shard.get());
+	}
+	return [=](auto consumer) {
+		auto lifetime = rpl::lifetime();
+		struct State {
+			std::vector<Stats> stats;
+			std::vector<bool> received;
+			int waiting = 0;
+		};
+		const auto state = lifetime.make_state<State>();
+		state->stats.resize(list.size());
+		state->received.resize(list.size());
+		state->waiting = int(list.size());
+		for (auto i = 0, count = int(list.size()); i != count; ++i) {
+			list[i]->producer_on_main(
+				stats
+			) | rpl::start_with_next([=](Stats &&value) {
+				state->stats[i] = std::move(value);
+				if (!state->received[i]) {
+					state->received[i] = true;
+					--state->waiting;
+				}
+				if (!state->waiting) {
+					consumer.put_next(details::MergeStats(state->stats));
+				}
+			}, lifetime);
+		}
+		return lifetime;
+	};
 }
 
 void Database::clear(FnMut<void(Error)> &&done) {
-	_wrapped.with([
-		done = std::move(done)
-	](Implementation &unwrapped) mutable {
-		unwrapped.clear(std::move(done));
-	});
+	const auto joined = JoinedDone(int(_shards.size()), std::move(done));
+	for (const auto &shard : _shards) {
+		shard->with([
+			done = joined.callback()
+		](Implementation &unwrapped) mutable {
+			unwrapped.clear(std::move(done));
+		});
+	}
 }
 
 void Database::clearByTag(uint8 tag, FnMut<void(Error)> &&done) {
-	_wrapped.with([
-		tag,
-		done = std::move(done)
-	](Implementation &unwrapped) mutable {
-		unwrapped.clearByTag(tag, std::move(done));
-	});
+	const auto joined = JoinedDone(int(_shards.size()), std::move(done));
+	for (const auto &shard : _shards) {
+		shard->with([
+			tag,
+			done = joined.callback()
+		](Implementation &unwrapped) mutable {
+			unwrapped.clearByTag(tag, std::move(done));
+		});
+	}
 }
 
 void Database::sync() {
-	auto semaphore = crl::semaphore();
-	_wrapped.with([&](Implementation &) {
-		semaphore.release();
-	});
-	semaphore.acquire();
+	for (const auto &shard : _shards) {
+		auto semaphore = crl::semaphore();
+		shard->with([&](Implementation &) {
+			semaphore.release();
+		});
+		semaphore.acquire();
+	}
 }
 
 Database::~Database() = default;
@@ -13,6 +13,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include <crl/crl_time.h>
 #include <rpl/producer.h>
 #include <QtCore/QString>
+#include <memory>
+#include <vector>
 
 namespace Storage {
 class EncryptionKey;
@@ -64,6 +66,11 @@ public:
 		FnMut<void(Error)> &&done = nullptr);
 	void getWithTag(const Key &key, FnMut<void(TaggedValue&&)> &&done);
 
+	// Values are returned in the order of keys, missing ones are empty.
+	void getMany(
+		std::vector<Key> &&keys,
+		FnMut<void(std::vector<TaggedValue>&&)> &&done);
+
 	void getWithSizes(
 		const Key &key,
 		std::vector<Key> &&keys,
@@ -83,7 +90,22 @@ public:
 
 private:
 	using Implementation = details::DatabaseObject;
-	crl::object_on_queue<Implementation> _wrapped;
+	using Shard = crl::object_on_queue<Implementation>;
+
+	[[nodiscard]] Shard &shard(const Key &key) const;
+	[[nodiscard]] std::weak_ptr<Shard> weakShard(const Key &key) const;
+	[[nodiscard]] Settings shardSettings(const Settings &settings) const;
+	template <typename Method>
+	void withEachShard(Method &&method);
+	void copyAcrossShards(
+		const Key &from,
+		const Key &to,
+		bool removeSource,
+		FnMut<void(Error)> &&done);
+
+	// Cross-shard calls go from one shard queue to another one directly,
+	// without Database, so they hold weak pointers to the shards.
+	std::vector<std::shared_ptr<Shard>> _shards;
 
 };
 
@@ -26,6 +26,17 @@ namespace details {
 namespace {
 
 constexpr auto kMaxDelayAfterFailure = 24 * 60 * 60 * crl::time(1000);
+constexpr auto kReplayChunksLimit = 2;
+
+using SimpleReader = BinlogReader<
+	Store,
+	MultiStore,
+	MultiRemove>;
+using TrackingReader = BinlogReader<
+	StoreWithTime,
+	MultiStoreWithTime,
+	MultiRemove,
+	MultiAccess>;
 
 uint32 CountChecksum(bytes::const_span data) {
 	const auto seed = uint32(0);
@@ -60,6 +71,14 @@ int32 GetUnixtime() {
 
 } // namespace
 
+struct DatabaseObject::Replay {
+	std::unique_ptr<BinlogPipe> pipe;
+	BinlogChunk chunk;
+	size_type record = 0;
+	size_type position = 0;
+	std::vector<FnMut<void()>> delayed;
+};
+
 DatabaseObject::Entry::Entry(
 	PlaceId place,
 	uint8 tag,
@@ -93,6 +112,9 @@ void DatabaseObject::reconfigure(const Settings &settings) {
 }
 
 void DatabaseObject::updateSettings(const SettingsUpdate &update) {
+	if (delayTillReplayed(&DatabaseObject::updateSettings, update)) {
+		return;
+	}
 	_settings.totalSizeLimit = update.totalSizeLimit;
 	_settings.totalTimeLimit = update.totalTimeLimit;
 	checkSettings();
@@ -102,6 +124,7 @@ void DatabaseObject::updateSettings(const SettingsUpdate &update) {
 
 void DatabaseObject::checkSettings() {
 	Expects(_settings.staleRemoveChunk > 0);
+	Expects(_settings.replayRecordsPerStep > 0);
 	Expects(_settings.maxDataSize > 0
 		&& _settings.maxDataSize < kDataSizeLimit);
 	Expects(_settings.maxBundledRecords > 0
@@ -125,12 +148,38 @@ Error DatabaseObject::ioError(const QString &path) const {
 	return { Error::Type::IO, path };
 }
 
+template <typename Method, typename ...Args>
+bool DatabaseObject::delayTillReplayed(Method method, Args &&...args) {
+	if (!_replay) {
+		return false;
+	}
+	// Arguments are moved, the delayed call takes ownership of callbacks.
+	_replay->delayed.push_back([
+		=,
+		arguments = std::make_tuple(std::move(args)...)
+	]() mutable {
+		std::apply([&](auto &...values) {
+			(this->*method)(std::move(values)...);
+		}, arguments);
+	});
+	return true;
+}
+
 void DatabaseObject::open(EncryptionKey &&key, FnMut<void(Error)> &&done) {
+	if (delayTillReplayed(&DatabaseObject::open, key, done)) {
+		return;
+	}
 	close(nullptr);
 
 	const auto error = openSomeBinlog(std::move(key));
 	if (error.type != Error::Type::None) {
 		close(nullptr);
+	} else if (_replay) {
+		// Report the open result after the whole binlog is applied.
+		_replay->delayed.push_back([=, done = std::move(done)]() mutable {
+			invokeCallback(done, error);
+		});
+		return;
 	}
 	invokeCallback(done, error);
 }
@@ -235,28 +284,95 @@ bool DatabaseObject::writeHeader() {
 	return _binlog.write(bytes::object_as_span(&header));
 }
 
-template <typename Reader, typename ...Handlers>
-void DatabaseObject::readBinlogHelper(
-		Reader &reader,
-		Handlers &&...handlers) {
-	while (true) {
-		const auto done = reader.readTillEnd(
-			std::forward<Handlers>(handlers)...);
-		if (done) {
-			break;
+void DatabaseObject::readBinlog() {
+	// Binlog holds at least one record per live key plus some excess
+	// before it gets compacted, so reserve the index only once.
+	const auto size = _binlog.size();
+	const auto live = size - std::min(size, _settings.compactAfterExcess);
+	const auto record = _settings.trackEstimatedTime
+		? sizeof(StoreWithTime)
+		: sizeof(Store);
+	_map.reserve(size_type(live / int64(record)));
+
+	if (_binlog.offset() == size) {
+		adjustRelativeTime();
+		optimize();
+		return;
+	}
+	if (_settings.trackEstimatedTime) {
+		startReplay<TrackingReader>();
+	} else {
+		startReplay<SimpleReader>();
+	}
+	replayStep();
+}
+
+template <typename Reader>
+void DatabaseObject::startReplay() {
+	Expects(_replay == nullptr);
+
+	// Reading and decrypting goes on a separate thread, records are
+	// applied here, on the database queue, in chunks between other calls.
+	auto split = [binlog = &_binlog, settings = _settings](
+			const BinlogPipe::Push &push) {
+		BinlogWrapper wrapper(*binlog, settings);
+		Reader reader(wrapper);
+		while (true) {
+			auto chunk = BinlogChunk();
+			if (reader.splitTillEnd(chunk) || !push(std::move(chunk))) {
+				break;
+			}
+		}
+	};
+	_replay = std::make_unique<Replay>();
+	_replay->pipe = std::make_unique<BinlogPipe>(
+		std::move(split),
+		kReplayChunksLimit);
+}
+
+void DatabaseObject::replayStep() {
+	Expects(_replay != nullptr);
+
+	auto &replay = *_replay;
+	for (auto left = _settings.replayRecordsPerStep; left > 0;) {
+		if (replay.record == size_type(replay.chunk.sizes.size())) {
+			auto chunk = replay.pipe->take();
+			if (!chunk) {
+				finishReplay();
+				return;
+			}
+			replay.chunk = std::move(*chunk);
+			replay.record = replay.position = 0;
+			continue;
 		}
+		const auto size = replay.chunk.sizes[replay.record];
+		const auto data = bytes::make_span(
+			replay.chunk.data
+		).subspan(replay.position, size);
+		if (!replayRecord(data)) {
+			// Stop reading and continue writing from the bad record.
+			replay.pipe = nullptr;
+			_binlog.seek(replay.chunk.offset + replay.position);
+			finishReplay();
+			return;
+		}
+		++replay.record;
+		replay.position += size;
+		--left;
 	}
+
+	// Let the calls queued meanwhile run before the next records.
+	_weak.with([](DatabaseObject &that) {
+		if (that._replay) {
+			that.replayStep();
+		}
+	});
 }
 
-void DatabaseObject::readBinlog() {
-	BinlogWrapper wrapper(_binlog, _settings);
+bool DatabaseObject::replayRecord(bytes::const_span data) {
 	if (_settings.trackEstimatedTime) {
-		BinlogReader<
-			StoreWithTime,
-			MultiStoreWithTime,
-			MultiRemove,
-			MultiAccess> reader(wrapper);
-		readBinlogHelper(reader, [&](const StoreWithTime &record) {
+		return TrackingReader::HandleRecord(data, [&](
+				const StoreWithTime &record) {
 			return processRecordStore(
 				&record,
 				std::is_class<StoreWithTime>{});
@@ -267,21 +383,27 @@ void DatabaseObject::readBinlog() {
 		}, [&](const MultiAccess &header, const auto &element) {
 			return processRecordMultiAccess(header, element);
 		});
-	} else {
-		BinlogReader<
-			Store,
-			MultiStore,
-			MultiRemove> reader(wrapper);
-		readBinlogHelper(reader, [&](const Store &record) {
-			return processRecordStore(&record, std::is_class<Store>{});
-		}, [&](const MultiStore &header, const auto &element) {
-			return processRecordMultiStore(header, element);
-		}, [&](const MultiRemove &header, const auto &element) {
-			return processRecordMultiRemove(header, element);
-		});
 	}
+	return SimpleReader::HandleRecord(data, [&](const Store &record) {
+		return processRecordStore(&record, std::is_class<Store>{});
+	}, [&](const MultiStore &header, const auto &element) {
+		return processRecordMultiStore(header, element);
+	}, [&](const MultiRemove &header, const auto &element) {
+		return processRecordMultiRemove(header, element);
+	});
+}
+
+void DatabaseObject::finishReplay() {
+	Expects(_replay != nullptr);
+
+	auto delayed = base::take(_replay->delayed);
+	_replay = nullptr;
+
 	adjustRelativeTime();
 	optimize();
+	for (auto &method : delayed) {
+		method();
+	}
 }
 
 uint64 DatabaseObject::countRelativeTime() const {
@@ -443,41 +565,39 @@ void DatabaseObject::collectSizeStale(
 		return;
 	}
 
-	using Bucket = std::pair<const Key, Entry>;
 	auto oldest = base::flat_multi_map<
 		int64,
-		const Bucket*,
+		Raw,
 		std::greater<>>();
 	auto oldestTotalSize = int64();
 
 	const auto canRemoveFirst = [&](const Entry &adding) {
 		const auto totalSizeAfterAdd = oldestTotalSize + adding.size;
-		const auto &first = oldest.begin()->second->second;
+		const auto &first = oldest.begin()->second.second;
 		return (adding.useTime <= first.useTime
 			&& (totalSizeAfterAdd - removeSize >= first.size));
 	};
 
-	for (const auto &bucket : _map) {
-		const auto &entry = bucket.second;
-		if (stale.contains(bucket.first)) {
+	for (const auto &[key, entry] : _map) {
+		if (stale.contains(key)) {
 			continue;
 		}
 		const auto add = (oldestTotalSize < removeSize)
 			? true
-			: (entry.useTime < oldest.begin()->second->second.useTime);
+			: (entry.useTime < oldest.begin()->second.second.useTime);
 		if (!add) {
 			continue;
 		}
 		while (!oldest.empty() && canRemoveFirst(entry)) {
-			oldestTotalSize -= oldest.begin()->second->second.size;
+			oldestTotalSize -= oldest.begin()->second.second.size;
 			oldest.erase(oldest.begin());
 		}
 		oldestTotalSize += entry.size;
-		oldest.emplace(entry.useTime, &bucket);
+		oldest.emplace(entry.useTime, Raw(key, entry));
 	}
 
 	for (const auto &pair : oldest) {
-		stale.emplace(pair.second->first);
+		stale.emplace(pair.second.first);
 	}
 	staleTotalSize += oldestTotalSize;
 }
@@ -554,7 +674,7 @@ bool DatabaseObject::processRecordMultiRemove(
 	_binlogExcessLength += sizeof(header);
 	while (const auto entry = element()) {
 		_binlogExcessLength += sizeof(*entry);
-		if (const auto i = _map.find(*entry); i != end(_map)) {
+		if (const auto i = _map.find(*entry); i != _map.end()) {
 			eraseMapEntry(i);
 		}
 	}
@@ -573,7 +693,7 @@ bool DatabaseObject::processRecordMultiAccess(
 	_binlogExcessLength += sizeof(header);
 	while (const auto entry = element()) {
 		_binlogExcessLength += sizeof(*entry);
-		if (const auto i = _map.find(*entry); i != end(_map)) {
+		if (const auto i = _map.find(*entry); i != _map.end()) {
 			i->second.useTime = relative;
 		}
 	}
@@ -648,7 +768,7 @@ void DatabaseObject::pushStats() {
 }
 
 void DatabaseObject::eraseMapEntry(const Map::const_iterator &i) {
-	if (i != end(_map)) {
+	if (i != _map.end()) {
 		const auto &entry = i->second;
 		updateStats(entry, Entry());
 		if (_minimalEntryTime != 0 && entry.useTime == _minimalEntryTime) {
@@ -678,6 +798,12 @@ void DatabaseObject::applyTimePoint(EstimatedTimePoint time) {
 	}
 }
 
+void DatabaseObject::compactorProgress(int64 processed, int64 total) {
+	_compactStats.processed = processed;
+	_compactStats.total = total;
+	pushStatsDelayed();
+}
+
 void DatabaseObject::compactorDone(
 		const QString &path,
 		int64 originalReadTill) {
@@ -719,9 +845,16 @@ void DatabaseObject::compactorDone(
 	}
 	_binlogExcessLength -= _compactor.excessLength;
 	Assert(_binlogExcessLength >= 0);
+
+	_compactStats.processed = _compactStats.total = 0;
+	_compactStats.reclaimed += std::max(size - _binlog.size(), int64(0));
+	pushStatsDelayed();
 }
 
 void DatabaseObject::compactorFail() {
+	_compactStats.processed = _compactStats.total = 0;
+	pushStatsDelayed();
+
 	const auto delay = _compactor.delayAfterFailure;
 	_compactor = CompactorWrap();
 	_compactor.nextAttempt = crl::now() + delay;
@@ -732,6 +865,9 @@ void DatabaseObject::compactorFail() {
 }
 
 void DatabaseObject::close(FnMut<void()> &&done) {
+	if (delayTillReplayed(&DatabaseObject::close, done)) {
+		return;
+	}
 	if (_binlog.isOpen()) {
 		writeBundles();
 		_binlog.close();
@@ -747,6 +883,11 @@ void DatabaseObject::clearState() {
 	_removing = {};
 	_accessed = {};
 	_stale = {};
+	_mapped = {};
+	_hot = {};
+	_hotMap = {};
+	_hotStats = {};
+	_compactStats = {};
 	_time = {};
 	_binlogExcessLength = 0;
 	_totalSize = 0;
@@ -763,10 +904,13 @@ void DatabaseObject::put(
 		const Key &key,
 		TaggedValue &&value,
 		FnMut<void(Error)> &&done) {
-	if (value.bytes.isEmpty()) {
+	if (delayTillReplayed(&DatabaseObject::put, key, value, done)) {
+		return;
+	} else if (value.bytes.isEmpty()) {
 		remove(key, std::move(done));
 		return;
 	}
+	hotForget(key);
 	_removing.erase(key);
 	_stale.erase(ranges::remove(_stale, key), end(_stale));
 
@@ -782,6 +926,9 @@ void DatabaseObject::put(
 		return;
 	}
 	const auto path = *maybepath;
+	if (const auto i = _map.find(key); i != _map.end()) {
+		unmapPlace(i->second.place);
+	}
 	File data;
 	const auto result = data.open(path, File::Mode::Write, _key);
 	switch (result) {
@@ -826,7 +973,7 @@ std::optional<QString> DatabaseObject::writeKeyPlaceGeneric(
 	record.key = key;
 	record.setSize(size);
 	record.checksum = checksum;
-	if (const auto i = _map.find(key); i != end(_map)) {
+	if (const auto i = _map.find(key); i != _map.end()) {
 		const auto &already = i->second;
 		if (already.tag == record.tag
 			&& already.size == size
@@ -886,7 +1033,7 @@ Error DatabaseObject::writeExistingPlaceGeneric(
 	record.tag = entry.tag;
 	record.setSize(entry.size);
 	record.checksum = entry.checksum;
-	if (const auto i = _map.find(key); i != end(_map)) {
+	if (const auto i = _map.find(key); i != _map.end()) {
 		const auto &already = i->second;
 		if (already.tag == record.tag
 			&& already.size == entry.size
@@ -935,30 +1082,100 @@ Error DatabaseObject::writeExistingPlace(
 void DatabaseObject::get(
 		const Key &key,
 		FnMut<void(TaggedValue&&)> &&done) {
+	if (_replay) {
+		// A key that is applied already may be changed by the binlog tail,
+		// so it is served only if the data it points to is still valid.
+		if (auto value = readReplayedValue(key); !value.bytes.isEmpty()) {
+			invokeCallback(done, std::move(value));
+			_replay->delayed.push_back([=] { recordEntryAccess(key); });
+		} else {
+			delayTillReplayed(&DatabaseObject::get, key, done);
+		}
+		return;
+	}
+	auto value = readValue(key);
+	const auto found = !value.bytes.isEmpty();
+	invokeCallback(done, std::move(value));
+	if (found) {
+		recordEntryAccess(key);
+	}
+}
+
+void DatabaseObject::getMany(
+		std::vector<Key> &&keys,
+		FnMut<void(std::vector<TaggedValue>&&)> &&done) {
+	if (delayTillReplayed(&DatabaseObject::getMany, keys, done)) {
+		return;
+	}
+
+	// Read the values in the order of their places on disk.
+	auto order = std::vector<std::pair<PlaceId, int>>();
+	order.reserve(keys.size());
+	for (auto i = 0, count = int(keys.size()); i != count; ++i) {
+		if (const auto j = _map.find(keys[i]); j != _map.end()) {
+			order.emplace_back(j->second.place, i);
+		}
+	}
+	ranges::sort(order);
+
+	auto result = std::vector<TaggedValue>(keys.size());
+	auto found = std::vector<Key>();
+	found.reserve(order.size());
+	for (const auto &[place, index] : order) {
+		auto &value = result[index];
+		value = readValue(keys[index]);
+		if (!value.bytes.isEmpty()) {
+			found.push_back(keys[index]);
+		}
+	}
+	invokeCallback(done, std::move(result));
+	recordEntriesAccess(found);
+}
+
+TaggedValue DatabaseObject::readValue(const Key &key) {
 	const auto i = _map.find(key);
 	if (i == _map.end()) {
-		invokeCallback(done, TaggedValue());
-		return;
+		return TaggedValue();
+	}
+	if (auto hot = hotValue(key)) {
+		return std::move(*hot);
 	}
 	const auto &entry = i->second;
 
 	auto bytes = readValueData(entry.place, entry.size);
 	if (bytes.isEmpty()) {
 		remove(key, nullptr);
-		invokeCallback(done, TaggedValue());
+		return TaggedValue();
 	} else if (CountChecksum(bytes::make_span(bytes)) != entry.checksum) {
 		remove(key, nullptr);
-		invokeCallback(done, TaggedValue());
-	} else {
-		invokeCallback(done, TaggedValue(std::move(bytes), entry.tag));
-		recordEntryAccess(key);
+		return TaggedValue();
 	}
+	auto result = TaggedValue(std::move(bytes), entry.tag);
+	hotRemember(key, result);
+	return result;
+}
+
+TaggedValue DatabaseObject::readReplayedValue(const Key &key) {
+	const auto i = _map.find(key);
+	if (i == _map.end()) {
+		return TaggedValue();
+	}
+	const auto &entry = i->second;
+	auto bytes = readValueData(entry.place, entry.size);
+	if (bytes.isEmpty()
+		|| CountChecksum(bytes::make_span(bytes)) != entry.checksum) {
+		return TaggedValue();
+	}
+	return TaggedValue(std::move(bytes), entry.tag);
 }
 
 void DatabaseObject::getWithSizes(
 		const Key &key,
 		std::vector<Key> &&keys,
 		FnMut<void(QByteArray&&, std::vector<int>&&)> &&done) {
+	if (delayTillReplayed(&DatabaseObject::getWithSizes, key, keys, done)) {
+		return;
+	}
 	get(key, [&](TaggedValue &&value) {
 		if (value.bytes.isEmpty()) {
 			invokeCallback(done, QByteArray(), std::vector<int>());
@@ -967,16 +1184,20 @@ void DatabaseObject::getWithSizes(
 
 		auto sizes = keys | ranges::view::transform([&](const Key &sizeKey) {
 			const auto i = _map.find(sizeKey);
-			return (i != end(_map)) ? int(i->second.size) : 0;
+			return (i != _map.end()) ? int(i->second.size) : 0;
 		}) | ranges::to_vector;
 
 		invokeCallback(done, std::move(value.bytes), std::move(sizes));
 	});
 }
 
-QByteArray DatabaseObject::readValueData(
-		PlaceId place,
-		size_type size) const {
+QByteArray DatabaseObject::readValueData(PlaceId place, size_type size) {
+	if (_settings.mappedPlacesLimit > 0) {
+		auto result = readMappedValueData(place, size);
+		if (!result.isEmpty()) {
+			return result;
+		}
+	}
 	const auto path = placePath(place);
 	File data;
 	const auto result = data.open(path, File::Mode::Read, _key);
@@ -996,6 +1217,113 @@ QByteArray DatabaseObject::readValueData(
 	Unexpected("Result in DatabaseObject::get.");
 }
 
+QByteArray DatabaseObject::readMappedValueData(
+		PlaceId place,
+		size_type size) {
+	const auto file = mappedPlace(place);
+	if (!file) {
+		return QByteArray();
+	}
+	auto result = QByteArray(size, Qt::Uninitialized);
+	const auto bytes = bytes::make_detached_span(result);
+	const auto read = file->readMappedWithPadding(0, bytes);
+	if (read != size) {
+		unmapPlace(place);
+		return QByteArray();
+	}
+	return result;
+}
+
+File *DatabaseObject::mappedPlace(PlaceId place) {
+	const auto i = ranges::find(_mapped, place, &MappedPlace::place);
+	if (i != end(_mapped)) {
+		// Keep the most recently used mapping at the end.
+		std::rotate(i, i + 1, end(_mapped));
+		return _mapped.back().file.get();
+	}
+	auto file = std::make_unique<File>();
+	const auto result = file->openMapped(placePath(place), _key);
+	if (result != File::Result::Success) {
+		return nullptr;
+	}
+	if (_mapped.size() >= _settings.mappedPlacesLimit) {
+		_mapped.erase(begin(_mapped));
+	}
+	_mapped.push_back({ place, std::move(file) });
+	return _mapped.back().file.get();
+}
+
+void DatabaseObject::unmapPlace(PlaceId place) {
+	// The file can't be rewritten or removed while it is still mapped.
+	const auto i = ranges::find(_mapped, place, &MappedPlace::place);
+	if (i != end(_mapped)) {
+		_mapped.erase(i);
+	}
+}
+
+std::optional<TaggedValue> DatabaseObject::hotValue(const Key &key) {
+	if (!_settings.hotCacheSizeLimit) {
+		return std::nullopt;
+	}
+	if (_stats.has_consumers()) {
+		pushStatsDelayed();
+	}
+	const auto i = _hotMap.find(key);
+	if (i == end(_hotMap)) {
+		++_hotStats.misses;
+		return std::nullopt;
+	}
+	++_hotStats.hits;
+	_hot.splice(end(_hot), _hot, i->second);
+	return i->second->second;
+}
+
+void DatabaseObject::hotRemember(const Key &key, const TaggedValue &value) {
+	const auto size = int64(value.bytes.size());
+	if (!_settings.hotCacheSizeLimit
+		|| size > _settings.hotCacheSizeLimit / 4) {
+		return;
+	}
+	hotForget(key);
+	_hot.emplace_back(key, value);
+	_hotMap.emplace(key, std::prev(end(_hot)));
+	++_hotStats.count;
+	_hotStats.totalSize += size;
+	while (_hotStats.totalSize > _settings.hotCacheSizeLimit) {
+		hotEraseOldest();
+	}
+}
+
+void DatabaseObject::hotForget(const Key &key) {
+	const auto i = _hotMap.find(key);
+	if (i == end(_hotMap)) {
+		return;
+	}
+	--_hotStats.count;
+	_hotStats.totalSize -= i->second->second.bytes.size();
+	_hot.erase(i->second);
+	_hotMap.erase(i);
+}
+
+void DatabaseObject::hotForgetTag(uint8 tag) {
+	for (auto i = begin(_hot); i != end(_hot);) {
+		if (i->second.tag == tag) {
+			--_hotStats.count;
+			_hotStats.totalSize -= i->second.bytes.size();
+			_hotMap.erase(i->first);
+			i = _hot.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
+void DatabaseObject::hotEraseOldest() {
+	Expects(!_hot.empty());
+
+	hotForget(_hot.front().first);
+}
+
 void DatabaseObject::recordEntryAccess(const Key &key) {
 	if (!_settings.trackEstimatedTime) {
 		return;
@@ -1005,13 +1333,32 @@ void DatabaseObject::recordEntryAccess(const Key &key) {
 	optimize();
 }
 
+void DatabaseObject::recordEntriesAccess(const std::vector<Key> &keys) {
+	if (!_settings.trackEstimatedTime || keys.empty()) {
+		return;
+	}
+	for (const auto &key : keys) {
+		_accessed.emplace(key);
+		if (_accessed.size() == _settings.maxBundledRecords) {
+			writeMultiAccess();
+		}
+	}
+	writeBundlesLazy();
+	optimize();
+}
+
 void DatabaseObject::remove(const Key &key, FnMut<void(Error)> &&done) {
+	if (delayTillReplayed(&DatabaseObject::remove, key, done)) {
+		return;
+	}
+	hotForget(key);
 	const auto i = _map.find(key);
 	if (i != _map.end()) {
 		_removing.emplace(key);
 		writeMultiRemoveLazy();
 
 		const auto path = placePath(i->second.place);
+		unmapPlace(i->second.place);
 		eraseMapEntry(i);
 		if (QFile(path).remove() || !QFile(path).exists()) {
 			invokeCallback(done, Error::NoError());
@@ -1027,18 +1374,39 @@ void DatabaseObject::putIfEmpty(
 		const Key &key,
 		TaggedValue &&value,
 		FnMut<void(Error)> &&done) {
-	if (_map.find(key) != end(_map)) {
+	if (delayTillReplayed(&DatabaseObject::putIfEmpty, key, value, done)) {
+		return;
+	} else if (_map.find(key) != _map.end()) {
 		invokeCallback(done, Error::NoError());
 		return;
 	}
 	put(key, std::move(value), std::move(done));
 }
 
+void DatabaseObject::tryPut(
+		const Key &key,
+		TaggedValue &&value,
+		FnMut<void(Error, bool)> &&done) {
+	if (delayTillReplayed(&DatabaseObject::tryPut, key, value, done)) {
+		return;
+	} else if (_map.find(key) != _map.end()) {
+		invokeCallback(done, Error::NoError(), false);
+		return;
+	}
+	put(key, std::move(value), [done = std::move(done)](Error error) mutable {
+		if (done) {
+			done(error, true);
+		}
+	});
+}
+
 void DatabaseObject::copyIfEmpty(
 		const Key &from,
 		const Key &to,
 		FnMut<void(Error)> &&done) {
-	if (_map.find(to) != end(_map)) {
+	if (delayTillReplayed(&DatabaseObject::copyIfEmpty, from, to, done)) {
+		return;
+	} else if (_map.find(to) != _map.end()) {
 		invokeCallback(done, Error::NoError());
 		return;
 	}
@@ -1051,7 +1419,9 @@ void DatabaseObject::moveIfEmpty(
 		const Key &from,
 		const Key &to,
 		FnMut<void(Error)> &&done) {
-	if (_map.find(to) != end(_map)) {
+	if (delayTillReplayed(&DatabaseObject::moveIfEmpty, from, to, done)) {
+		return;
+	} else if (_map.find(to) != _map.end()) {
 		invokeCallback(done, Error::NoError());
 		return;
 	}
@@ -1061,6 +1431,7 @@ void DatabaseObject::moveIfEmpty(
 		return;
 	}
 	_removing.emplace(from);
+	hotForget(from);
 
 	const auto entry = i->second;
 	eraseMapEntry(i);
@@ -1084,6 +1455,8 @@ Stats DatabaseObject::collectStats() const {
 	result.tagged = _taggedStats;
 	result.full.count = _map.size();
 	result.full.totalSize = _totalSize;
+	result.hot = _hotStats;
+	result.compact = _compactStats;
 	result.clearing = (_cleaner.object != nullptr) || !_stale.empty();
 	return result;
 }
@@ -1157,7 +1530,7 @@ Error DatabaseObject::writeMultiAccessBlock() {
 	}
 	_time = time;
 	for (const auto &entry : list) {
-		if (const auto i = _map.find(entry); i != end(_map)) {
+		if (const auto i = _map.find(entry); i != _map.end()) {
 			i->second.useTime = _time.getRelative();
 		}
 	}
@@ -1226,6 +1599,9 @@ void DatabaseObject::checkCompactor() {
 }
 
 void DatabaseObject::clear(FnMut<void(Error)> &&done) {
+	if (delayTillReplayed(&DatabaseObject::clear, done)) {
+		return;
+	}
 	auto key = std::move(_key);
 	if (!key.empty()) {
 		close(nullptr);
@@ -1244,7 +1620,11 @@ void DatabaseObject::clear(FnMut<void(Error)> &&done) {
 }
 
 void DatabaseObject::clearByTag(uint8 tag, FnMut<void(Error)> &&done) {
+	if (delayTillReplayed(&DatabaseObject::clearByTag, tag, done)) {
+		return;
+	}
 	const auto hadStale = !_stale.empty();
+	hotForgetTag(tag);
 	for (const auto &[key, entry] : _map) {
 		if (entry.tag == tag) {
 			_stale.push_back(key);
@@ -1272,7 +1652,7 @@ auto DatabaseObject::getManyRaw(const std::vector<Key> &keys) const
 	auto result = std::vector<Raw>();
 	result.reserve(keys.size());
 	for (const auto &key : keys) {
-		if (const auto i = _map.find(key); i != end(_map)) {
+		if (const auto i = _map.find(key); i != _map.end()) {
 			result.push_back(*i);
 		}
 	}
@@ -1280,6 +1660,7 @@ auto DatabaseObject::getManyRaw(const std::vector<Key> &keys) const
 }
 
 DatabaseObject::~DatabaseObject() {
+	_replay = nullptr;
 	close(nullptr);
 }
 
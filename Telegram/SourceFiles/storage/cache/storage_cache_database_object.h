@@ -8,12 +8,14 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #pragma once
 
 #include "storage/cache/storage_cache_database.h"
+#include "storage/cache/storage_cache_key_map.h"
 #include "storage/storage_encrypted_file.h"
 #include "base/binary_guard.h"
 #include "base/concurrent_timer.h"
 #include "base/bytes.h"
 #include "base/flat_set.h"
 #include <set>
+#include <list>
 #include <rpl/event_stream.h>
 
 namespace Storage {
@@ -41,12 +43,21 @@ public:
 		TaggedValue &&value,
 		FnMut<void(Error)> &&done);
 	void get(const Key &key, FnMut<void(TaggedValue&&)> &&done);
+	void getMany(
+		std::vector<Key> &&keys,
+		FnMut<void(std::vector<TaggedValue>&&)> &&done);
 	void remove(const Key &key, FnMut<void(Error)> &&done);
 
 	void putIfEmpty(
 		const Key &key,
 		TaggedValue &&value,
 		FnMut<void(Error)> &&done);
+
+	// Like putIfEmpty, but reports if the value was put.
+	void tryPut(
+		const Key &key,
+		TaggedValue &&value,
+		FnMut<void(Error, bool)> &&done);
 	void copyIfEmpty(
 		const Key &from,
 		const Key &to,
@@ -70,6 +81,7 @@ public:
 	static QString BinlogFilename();
 	static QString CompactReadyFilename();
 
+	void compactorProgress(int64 processed, int64 total);
 	void compactorDone(const QString &path, int64 originalReadTill);
 	void compactorFail();
 
@@ -106,7 +118,13 @@ private:
 		crl::time delayAfterFailure = 10 * crl::time(1000);
 		base::binary_guard guard;
 	};
-	using Map = std::unordered_map<Key, Entry>;
+	struct MappedPlace {
+		PlaceId place = { { 0 } };
+		std::unique_ptr<File> file;
+	};
+	struct Replay;
+	using Map = KeyMap<Entry>;
+	using HotList = std::list<std::pair<Key, TaggedValue>>;
 
 	template <typename Callback, typename ...Args>
 	void invokeCallback(Callback &&callback, Args &&...args) const;
@@ -129,8 +147,13 @@ private:
 	bool writeHeader();
 
 	void readBinlog();
-	template <typename Reader, typename ...Handlers>
-	void readBinlogHelper(Reader &reader, Handlers &&...handlers);
+	template <typename Reader>
+	void startReplay();
+	void replayStep();
+	void finishReplay();
+	bool replayRecord(bytes::const_span data);
+	template <typename Method, typename ...Args>
+	bool delayTillReplayed(Method method, Args &&...args);
 	template <typename Record, typename Postprocess>
 	bool processRecordStoreGeneric(
 		const Record *record,
@@ -181,7 +204,19 @@ private:
 	void setMapEntry(const Key &key, Entry &&entry);
 	void eraseMapEntry(const Map::const_iterator &i);
 	void recordEntryAccess(const Key &key);
-	QByteArray readValueData(PlaceId place, size_type size) const;
+	void recordEntriesAccess(const std::vector<Key> &keys);
+	TaggedValue readValue(const Key &key);
+	TaggedValue readReplayedValue(const Key &key);
+	QByteArray readValueData(PlaceId place, size_type size);
+	QByteArray readMappedValueData(PlaceId place, size_type size);
+	File *mappedPlace(PlaceId place);
+	void unmapPlace(PlaceId place);
+
+	std::optional<TaggedValue> hotValue(const Key &key);
+	void hotRemember(const Key &key, const TaggedValue &value);
+	void hotForget(const Key &key);
+	void hotForgetTag(uint8 tag);
+	void hotEraseOldest();
 
 	Version findAvailableVersion() const;
 	QString versionPath() const;
@@ -230,6 +265,12 @@ private:
 	std::set<Key> _removing;
 	std::set<Key> _accessed;
 	std::vector<Key> _stale;
+	std::vector<MappedPlace> _mapped;
+
+	HotList _hot;
+	std::unordered_map<Key, HotList::iterator> _hotMap;
+	HotSummary _hotStats;
+	CompactSummary _compactStats;
 
 	EstimatedTimePoint _time;
 
@@ -248,6 +289,7 @@ private:
 
 	CleanerWrap _cleaner;
 	CompactorWrap _compactor;
+	std::unique_ptr<Replay> _replay;
 
 };
 
@@ -117,6 +117,19 @@ Database::TaggedValue GetWithTag(Database &db, const Key &key) {
 	return ValueWithTag;
 }
 
+std::vector<Database::TaggedValue> GetMany(
+		Database &db,
+		std::vector<Key> &&keys) {
+	auto result = std::vector<Database::TaggedValue>();
+	db.getMany(std::move(keys), [&](
+			std::vector<Database::TaggedValue> &&values) {
+		result = std::move(values);
+		Semaphore.release();
+	});
+	Semaphore.acquire();
+	return result;
+}
+
 Error Put(Database &db, const Key &key, QByteArray &&value) {
 	db.put(key, std::move(value), GetResult);
 	Semaphore.acquire();
@@ -158,6 +171,17 @@ Error ClearByTag(Database &db, uint8 tag) {
 	return Result;
 }
 
+// Finds a key that is put to a different shard than the given one.
+Key OtherShardKey(const Key &key, int shardsCount, uint64 skip) {
+	const auto index = details::ShardIndex(key, shardsCount);
+	for (auto high = key.high + 1;; ++high) {
+		const auto result = Key{ high, key.low };
+		if (details::ShardIndex(result, shardsCount) != index && !--skip) {
+			return result;
+		}
+	}
+}
+
 const auto Settings = [] {
 	auto result = Database::Settings();
 	result.trackEstimatedTime = false;
@@ -173,9 +197,13 @@ const auto AdvanceTime = [](int32 seconds) {
 
 TEST_CASE("init timers", "[storage_cache_database]") {
 	static auto init = [] {
-		int argc = 0;
+		static int argc = 0;
 		char **argv = nullptr;
-		static QCoreApplication application(argc, argv);
+
+		// Other tests in the same binary may have created it already.
+		if (!QCoreApplication::instance()) {
+			static QCoreApplication application(argc, argv);
+		}
 		static base::ConcurrentTimerEnvironment environment;
 		return true;
 	}();
@@ -302,6 +330,108 @@ TEST_CASE("compacting db", "[storage_cache_database]") {
 		fullcheck();
 		Close(db);
 	}
+	SECTION("throttled compact in chunks") {
+		auto settings = Settings;
+		settings.writeBundleDelay = crl::time(100);
+		settings.readBlockSize = 512;
+		settings.maxBundledRecords = 5;
+		settings.compactAfterExcess = 3 * (16 * 5 + 16) + 15 * 32;
+		settings.compactChunkSize = 5;
+		settings.compactBytesPerSecond = 2048;
+		Database db(name, settings);
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		put(db, 0, 30);
+		remove(db, 0, 15);
+		put(db, 30, 40);
+		reput(db, 15, 29);
+		AdvanceTime(1);
+		const auto path = GetBinlogPath();
+		const auto size = QFile(path).size();
+		reput(db, 29, 30); // starts compactor
+		remove(db, 30, 35);
+		AdvanceTime(4);
+		REQUIRE(QFile(path).size() < size);
+		reput(db, 35, 37);
+		put(db, 15, 20);
+		put(db, 40, 45);
+
+		const auto fullcheck = [&] {
+			check(db, 0, 15, {});
+			check(db, 15, 20, Test1());
+			check(db, 20, 30, Test2());
+			check(db, 30, 35, {});
+			check(db, 35, 37, Test2());
+			check(db, 37, 45, Test1());
+		};
+		fullcheck();
+		Close(db);
+
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		fullcheck();
+		Close(db);
+	}
+	SECTION("compact resumed after reopen") {
+		auto settings = Settings;
+		settings.writeBundleDelay = crl::time(100);
+		settings.readBlockSize = 512;
+		settings.maxBundledRecords = 5;
+		settings.compactAfterExcess = 3 * (16 * 5 + 16) + 15 * 32;
+		settings.compactChunkSize = 5;
+		auto throttled = settings;
+		throttled.compactBytesPerSecond = 256;
+
+		auto path = QString();
+		auto size = int64();
+		{
+			Database db(name, throttled);
+
+			REQUIRE(Clear(db).type == Error::Type::None);
+			REQUIRE(Open(db, key).type == Error::Type::None);
+			put(db, 0, 30);
+			remove(db, 0, 15);
+			put(db, 30, 40);
+			reput(db, 15, 29);
+			AdvanceTime(1);
+			path = GetBinlogPath();
+			size = QFile(path).size();
+			reput(db, 29, 30); // starts compactor
+			AdvanceTime(1);
+
+			// Only the first chunks are processed before closing.
+			REQUIRE(QFile(path + "-temp-resume").exists());
+			Close(db);
+		}
+		REQUIRE(QFile(path + "-temp-resume").exists());
+		REQUIRE(QFile(path).size() >= size);
+
+		Database db(name, settings);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		remove(db, 30, 35); // restarts compactor
+		AdvanceTime(2);
+		REQUIRE(QFile(path).size() < size);
+		REQUIRE(!QFile(path + "-temp-resume").exists());
+		REQUIRE(!QFile(path + "-temp").exists());
+		reput(db, 35, 37);
+		put(db, 15, 20);
+		put(db, 40, 45);
+
+		const auto fullcheck = [&] {
+			check(db, 0, 15, {});
+			check(db, 15, 20, Test1());
+			check(db, 20, 30, Test2());
+			check(db, 30, 35, {});
+			check(db, 35, 37, Test2());
+			check(db, 37, 45, Test1());
+		};
+		fullcheck();
+		Close(db);
+
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		fullcheck();
+		Close(db);
+	}
 	SECTION("double compact") {
 		auto settings = Settings;
 		settings.writeBundleDelay = crl::time(100);
@@ -538,6 +668,318 @@ TEST_CASE("cache db remove", "[storage_cache_database]") {
 	}
 }
 
+TEST_CASE("sharded cache db", "[storage_cache_database]") {
+	if (!DisableLargeTest) {
+		return;
+	}
+	SECTION("db shards keep values") {
+		auto settings = Settings;
+		settings.shardsCount = 4;
+		Database db(name, settings);
+
+		const auto count = 32U;
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		for (auto i = 0U; i != count; ++i) {
+			auto value = Test1();
+			value[0] = char('A') + i;
+			const auto result = Put(
+				db,
+				Key{ i, i * 3 },
+				Database::TaggedValue(std::move(value), (i % 2) + 1));
+			REQUIRE(result.type == Error::Type::None);
+		}
+		Close(db);
+
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		for (auto i = 0U; i != count; ++i) {
+			auto value = Test1();
+			value[0] = char('A') + i;
+			REQUIRE((Get(db, Key{ i, i * 3 }) == value));
+		}
+		REQUIRE(ClearByTag(db, 1).type == Error::Type::None);
+		Remove(db, Key{ 1, 3 });
+		for (auto i = 0U; i != count; ++i) {
+			auto value = Test1();
+			value[0] = char('A') + i;
+			if (i % 2 == 0 || i == 1) {
+				REQUIRE(Get(db, Key{ i, i * 3 }).isEmpty());
+			} else {
+				REQUIRE((Get(db, Key{ i, i * 3 }) == value));
+			}
+		}
+		Close(db);
+	}
+	SECTION("db shards copy and move values across shards") {
+		auto settings = Settings;
+		settings.shardsCount = 4;
+		Database db(name, settings);
+
+		const auto from = Key{ 0, 1 };
+		const auto to = OtherShardKey(from, settings.shardsCount, 1);
+		const auto other = OtherShardKey(from, settings.shardsCount, 2);
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		REQUIRE(Put(db, from, Test1()).type == Error::Type::None);
+		REQUIRE(CopyIfEmpty(db, from, to).type == Error::Type::None);
+		REQUIRE((Get(db, from) == Test1()));
+		REQUIRE((Get(db, to) == Test1()));
+
+		REQUIRE(Put(db, other, Test2()).type == Error::Type::None);
+		REQUIRE(MoveIfEmpty(db, from, other).type == Error::Type::None);
+		REQUIRE((Get(db, from) == Test1()));
+		REQUIRE((Get(db, other) == Test2()));
+
+		Remove(db, other);
+		REQUIRE(MoveIfEmpty(db, from, other).type == Error::Type::None);
+		REQUIRE(Get(db, from).isEmpty());
+		REQUIRE((Get(db, other) == Test1()));
+		Close(db);
+
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		REQUIRE(Get(db, from).isEmpty());
+		REQUIRE((Get(db, to) == Test1()));
+		REQUIRE((Get(db, other) == Test1()));
+		Close(db);
+	}
+	SECTION("db shards move values while replaying binlog") {
+		auto settings = Settings;
+		settings.shardsCount = 4;
+		settings.replayRecordsPerStep = 1;
+		Database db(name, settings);
+
+		const auto from = Key{ 0, 1 };
+		const auto to = OtherShardKey(from, settings.shardsCount, 1);
+		const auto other = OtherShardKey(from, settings.shardsCount, 2);
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		for (auto i = 0; i != 1000; ++i) {
+			const auto key = Key{ uint64(i) + 1000, uint64(i) };
+			REQUIRE(Put(db, key, Test2()).type == Error::Type::None);
+		}
+		REQUIRE(Put(db, from, Test1()).type == Error::Type::None);
+		REQUIRE(Put(db, other, Test2()).type == Error::Type::None);
+		Close(db);
+
+		// The source and the target shards are both still replaying,
+		// so every step of the move is delayed till the replay ends.
+		auto moved = Error();
+		auto kept = Error();
+		db.open(base::duplicate(key), GetResult);
+		db.moveIfEmpty(from, other, [&](Error error) {
+			kept = error;
+			Semaphore.release();
+		});
+		db.moveIfEmpty(from, to, [&](Error error) {
+			moved = error;
+			Semaphore.release();
+		});
+		Semaphore.acquire();
+		Semaphore.acquire();
+		Semaphore.acquire();
+		REQUIRE(Result.type == Error::Type::None);
+		REQUIRE(kept.type == Error::Type::None);
+		REQUIRE(moved.type == Error::Type::None);
+		REQUIRE(Get(db, from).isEmpty());
+		REQUIRE((Get(db, to) == Test1()));
+		REQUIRE((Get(db, other) == Test2()));
+		Close(db);
+	}
+	SECTION("db shards keep parts of one file together") {
+		auto settings = Settings;
+		settings.shardsCount = 4;
+		Database db(name, settings);
+
+		// Parts of one streamed file differ only in the lowest bits.
+		const auto first = Key{ 5, 0x10000 };
+		const auto second = Key{ 5, 0x10001 };
+		const auto missing = Key{ 5, 0x10002 };
+		REQUIRE(details::ShardIndex(first, settings.shardsCount)
+			== details::ShardIndex(second, settings.shardsCount));
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		REQUIRE(Put(db, first, Test1()).type == Error::Type::None);
+		REQUIRE(Put(db, second, Test2()).type == Error::Type::None);
+		auto sizes = std::vector<int>();
+		db.getWithSizes(first, { second, missing }, [&](
+				QByteArray &&value,
+				std::vector<int> &&result) {
+			Value = value;
+			sizes = std::move(result);
+			Semaphore.release();
+		});
+		Semaphore.acquire();
+		REQUIRE((Value == Test1()));
+		REQUIRE(sizes.size() == 2);
+		REQUIRE(sizes[0] == Test2().size());
+		REQUIRE(sizes[1] == 0);
+		Close(db);
+	}
+	SECTION("db shards stats are merged") {
+		auto first = details::Stats();
+		first.full = { 2, 30 };
+		first.tagged[1] = { 1, 10 };
+		first.hot = { 1, 10, 3, 1 };
+		first.compact = { 5, 10, 100 };
+		auto second = details::Stats();
+		second.full = { 3, 50 };
+		second.tagged[1] = { 2, 20 };
+		second.tagged[2] = { 1, 30 };
+		second.hot = { 2, 40, 1, 2 };
+		second.clearing = true;
+
+		const auto merged = details::MergeStats({ first, second });
+		REQUIRE(merged.full.count == 5);
+		REQUIRE(merged.full.totalSize == 80);
+		REQUIRE(merged.tagged.size() == 2);
+		REQUIRE(merged.tagged.find(1)->second.count == 3);
+		REQUIRE(merged.tagged.find(1)->second.totalSize == 30);
+		REQUIRE(merged.tagged.find(2)->second.count == 1);
+		REQUIRE(merged.hot.count == 3);
+		REQUIRE(merged.hot.totalSize == 50);
+		REQUIRE(merged.hot.hits == 4);
+		REQUIRE(merged.hot.misses == 3);
+		REQUIRE(merged.compact.processed == 5);
+		REQUIRE(merged.compact.reclaimed == 100);
+		REQUIRE(merged.clearing);
+	}
+}
+
+TEST_CASE("cache db hot values", "[storage_cache_database]") {
+	if (!DisableLargeTest) {
+		return;
+	}
+	SECTION("db hot values are invalidated") {
+		auto settings = Settings;
+		settings.hotCacheSizeLimit = 1024;
+		Database db(name, settings);
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		REQUIRE(Put(db, Key{ 0, 1 }, Test1()).type == Error::Type::None);
+		REQUIRE(Put(db, Key{ 1, 0 }, Database::TaggedValue(Test1(), 1)).type
+			== Error::Type::None);
+		REQUIRE((Get(db, Key{ 0, 1 }) == Test1()));
+		REQUIRE((Get(db, Key{ 0, 1 }) == Test1()));
+		REQUIRE(Put(db, Key{ 0, 1 }, Test2()).type == Error::Type::None);
+		REQUIRE((Get(db, Key{ 0, 1 }) == Test2()));
+		Remove(db, Key{ 0, 1 });
+		REQUIRE(Get(db, Key{ 0, 1 }).isEmpty());
+		REQUIRE((Get(db, Key{ 1, 0 }) == Test1()));
+		REQUIRE(ClearByTag(db, 1).type == Error::Type::None);
+		REQUIRE(Get(db, Key{ 1, 0 }).isEmpty());
+		Close(db);
+	}
+}
+
+TEST_CASE("cache db get many", "[storage_cache_database]") {
+	if (!DisableLargeTest) {
+		return;
+	}
+	const auto check = [](Database &db) {
+		const auto values = GetMany(db, {
+			Key{ 0, 1 },
+			Key{ 7, 7 },
+			Key{ 1, 0 },
+			Key{ 0, 2 },
+		});
+		REQUIRE(values.size() == 4);
+		REQUIRE(((values[0].bytes == Test1()) && (values[0].tag == 0)));
+		REQUIRE(values[1].bytes.isEmpty());
+		REQUIRE(((values[2].bytes == Test2()) && (values[2].tag == 1)));
+		REQUIRE(((values[3].bytes == Test1()) && (values[3].tag == 2)));
+	};
+	SECTION("db get many values") {
+		Database db(name, Settings);
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		REQUIRE(Put(db, Key{ 0, 1 }, Test1()).type == Error::Type::None);
+		REQUIRE(Put(db, Key{ 1, 0 }, Database::TaggedValue(Test2(), 1)).type
+			== Error::Type::None);
+		REQUIRE(Put(db, Key{ 0, 2 }, Database::TaggedValue(Test1(), 2)).type
+			== Error::Type::None);
+		check(db);
+		REQUIRE(GetMany(db, {}).empty());
+		Close(db);
+	}
+	SECTION("sharded db get many values") {
+		auto settings = Settings;
+		settings.shardsCount = 3;
+		Database db(name, settings);
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		REQUIRE(Put(db, Key{ 0, 1 }, Test1()).type == Error::Type::None);
+		REQUIRE(Put(db, Key{ 1, 0 }, Database::TaggedValue(Test2(), 1)).type
+			== Error::Type::None);
+		REQUIRE(Put(db, Key{ 0, 2 }, Database::TaggedValue(Test1(), 2)).type
+			== Error::Type::None);
+		check(db);
+		REQUIRE(GetMany(db, {}).empty());
+		Close(db);
+	}
+}
+
+TEST_CASE("cache db replay", "[storage_cache_database]") {
+	SECTION("db answers while replaying binlog") {
+		auto settings = Settings;
+		settings.maxBundledRecords = 16;
+		settings.readBlockSize = 1024;
+
+		// Each put is a separate record, so the first step applies
+		// the keys { 0, 1 } and { 1, 2 }, and the replay takes thousands
+		// of steps after that.
+		settings.replayRecordsPerStep = 2;
+		Database db(name, settings);
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		const auto kCount = 6000;
+		for (auto i = 0; i != kCount; ++i) {
+			const auto key = Key{ uint64(i), uint64(i) + 1 };
+			REQUIRE(Put(db, key, Test1()).type == Error::Type::None);
+		}
+		for (auto i = 0; i < kCount; i += 2) {
+			Remove(db, Key{ uint64(i), uint64(i) + 1 });
+		}
+		Close(db);
+
+		// Both callbacks are called on the database queue.
+		auto answers = std::vector<QString>();
+		db.open(base::duplicate(key), [&](Error error) {
+			answers.push_back("open");
+			GetResult(error);
+		});
+		db.get(Key{ 1, 2 }, [&](QByteArray value) {
+			answers.push_back("get");
+			GetValue(value);
+		});
+		Semaphore.acquire();
+		Semaphore.acquire();
+		REQUIRE(Result.type == Error::Type::None);
+		REQUIRE((Value == Test1()));
+		REQUIRE(answers.size() == 2);
+		REQUIRE(answers[0] == "get");
+		REQUIRE(answers[1] == "open");
+
+		REQUIRE(Get(db, Key{ 0, 1 }).isEmpty());
+		REQUIRE((Get(db, Key{ kCount - 1, kCount }) == Test1()));
+		REQUIRE(Put(db, Key{ 0, 1 }, Test2()).type == Error::Type::None);
+		Close(db);
+
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		REQUIRE((Get(db, Key{ 0, 1 }) == Test2()));
+		REQUIRE(Get(db, Key{ 2, 3 }).isEmpty());
+		REQUIRE((Get(db, Key{ 3, 4 }) == Test1()));
+		Close(db);
+	}
+}
+
 TEST_CASE("cache db bundled actions", "[storage_cache_database]") {
 	if (!DisableLargeTest) {
 		return;
@@ -738,3 +1180,36 @@ TEST_CASE("large db", "[storage_cache_database]") {
 		Close(db);
 	}
 }
+
+TEST_CASE("large db open", "[storage_cache_database]") {
+	if (DisableLargeTest) {
+		return;
+	}
+	SECTION("large db index load time") {
+		auto settings = Database::Settings();
+		settings.writeBundleDelay = crl::time(1000);
+		settings.maxDataSize = 20;
+		settings.totalSizeLimit = 1024 * 1024 * 1024;
+		Database db(name, settings);
+
+		REQUIRE(Clear(db).type == Error::Type::None);
+		REQUIRE(Open(db, key).type == Error::Type::None);
+
+		const auto kWriteRecords = 256 * 1024;
+		for (auto i = 0; i != kWriteRecords; ++i) {
+			db.put(Key{ uint64(i) / 4, uint64(i) % 4 }, Test1(), nullptr);
+		}
+		Close(db);
+
+		const auto start = std::chrono::steady_clock::now();
+		REQUIRE(Open(db, key).type == Error::Type::None);
+		const auto finish = std::chrono::steady_clock::now();
+		WARN("Index of "
+			<< kWriteRecords
+			<< " keys loaded in "
+			<< std::chrono::duration_cast<std::chrono::milliseconds>(
+				finish - start).count()
+			<< "ms");
+		Close(db);
+	}
+}
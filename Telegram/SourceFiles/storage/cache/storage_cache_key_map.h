@@ -0,0 +1,336 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "storage/cache/storage_cache_types.h"
+#include <vector>
+#include <algorithm>
+
+namespace Storage {
+namespace Cache {
+namespace details {
+
+// Open addressing hash map with linear probing. Control bytes, keys and
+// values live in separate arrays, so probing scans only the control bytes
+// and compares keys only when the stored hash bits match.
+template <typename Value>
+class KeyMap {
+	template <bool Const>
+	class Iterator {
+		using Map = std::conditional_t<Const, const KeyMap, KeyMap>;
+		using Stored = std::conditional_t<Const, const Value, Value>;
+
+	public:
+		using Reference = std::pair<const Key&, Stored&>;
+
+		class Pointer {
+		public:
+			explicit Pointer(Reference value) : _value(value) {
+			}
+			const Reference *operator->() const {
+				return &_value;
+			}
+
+		private:
+			Reference _value;
+
+		};
+
+		Iterator() = default;
+		Iterator(Map *map, size_type index) : _map(map), _index(index) {
+		}
+		template <
+			bool OtherConst,
+			typename = std::enable_if_t<Const && !OtherConst>>
+		Iterator(const Iterator<OtherConst> &other)
+		: _map(other._map)
+		, _index(other._index) {
+		}
+
+		Reference operator*() const {
+			return { _map->_keys[_index], _map->_values[_index] };
+		}
+		Pointer operator->() const {
+			return Pointer(**this);
+		}
+		Iterator &operator++() {
+			++_index;
+			skipFree();
+			return *this;
+		}
+
+		friend inline bool operator==(
+				const Iterator &a,
+				const Iterator &b) {
+			return (a._index == b._index);
+		}
+		friend inline bool operator!=(
+				const Iterator &a,
+				const Iterator &b) {
+			return !(a == b);
+		}
+
+	private:
+		friend class KeyMap;
+		template <bool OtherConst>
+		friend class Iterator;
+
+		void skipFree() {
+			const auto capacity = size_type(_map->_control.size());
+			while (_index != capacity && !IsFull(_map->_control[_index])) {
+				++_index;
+			}
+		}
+
+		Map *_map = nullptr;
+		size_type _index = 0;
+
+	};
+
+public:
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+
+	KeyMap() = default;
+	KeyMap(KeyMap &&other);
+	KeyMap &operator=(KeyMap &&other);
+
+	size_type size() const {
+		return _size;
+	}
+	bool empty() const {
+		return !_size;
+	}
+	size_type capacity() const {
+		return size_type(_control.size());
+	}
+	int64 memoryUsage() const {
+		return int64(capacity())
+			* int64(sizeof(uint8) + sizeof(Key) + sizeof(Value));
+	}
+
+	void reserve(size_type count);
+
+	iterator begin();
+	iterator end();
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	iterator find(const Key &key);
+	const_iterator find(const Key &key) const;
+	Value &operator[](const Key &key);
+	void erase(const_iterator i);
+
+private:
+	static constexpr auto kEmpty = uint8(0x00);
+	static constexpr auto kDeleted = uint8(0x01);
+	static constexpr auto kFull = uint8(0x80);
+	static constexpr auto kMinCapacity = size_type(16);
+
+	static bool IsFull(uint8 control) {
+		return (control & kFull) != 0;
+	}
+	static uint64 Hash(const Key &key);
+	static uint8 Control(uint64 hash) {
+		return kFull | uint8(hash & 0x7F);
+	}
+	static size_type CapacityFor(size_type count);
+
+	size_type home(uint64 hash) const {
+		// Maps the high hash bits to [0, capacity) without a division.
+		const auto high = uint64(uint32(hash >> 32));
+		return size_type((high * uint64(capacity())) >> 32);
+	}
+	size_type next(size_type index) const {
+		return (++index == capacity()) ? 0 : index;
+	}
+
+	size_type findIndex(const Key &key) const;
+	void rehash(size_type capacity);
+
+	std::vector<uint8> _control;
+	std::vector<Key> _keys;
+	std::vector<Value> _values;
+	size_type _size = 0;
+	size_type _deleted = 0;
+
+};
+
+template <typename Value>
+KeyMap<Value>::KeyMap(KeyMap &&other)
+: _control(base::take(other._control))
+, _keys(base::take(other._keys))
+, _values(base::take(other._values))
+, _size(base::take(other._size))
+, _deleted(base::take(other._deleted)) {
+}
+
+template <typename Value>
+KeyMap<Value> &KeyMap<Value>::operator=(KeyMap &&other) {
+	if (this != &other) {
+		_control = base::take(other._control);
+		_keys = base::take(other._keys);
+		_values = base::take(other._values);
+		_size = base::take(other._size);
+		_deleted = base::take(other._deleted);
+	}
+	return *this;
+}
+
+template <typename Value>
+uint64 KeyMap<Value>::Hash(const Key &key) {
+	auto result = key.high ^ (key.low * 0x9E3779B97F4A7C15ULL);
+	result = (result ^ (result >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	result = (result ^ (result >> 27)) * 0x94D049BB133111EBULL;
+	return result ^ (result >> 31);
+}
+
+template <typename Value>
+size_type KeyMap<Value>::CapacityFor(size_type count) {
+	// Keep the load factor, including deleted slots, under 7/8.
+	return std::max(kMinCapacity, (count + 1) * 8 / 7 + 1);
+}
+
+template <typename Value>
+void KeyMap<Value>::reserve(size_type count) {
+	const auto capacity = CapacityFor(count);
+	if (capacity > this->capacity()) {
+		rehash(capacity);
+	}
+}
+
+template <typename Value>
+auto KeyMap<Value>::begin() -> iterator {
+	auto result = iterator(this, 0);
+	result.skipFree();
+	return result;
+}
+
+template <typename Value>
+auto KeyMap<Value>::end() -> iterator {
+	return iterator(this, capacity());
+}
+
+template <typename Value>
+auto KeyMap<Value>::begin() const -> const_iterator {
+	auto result = const_iterator(this, 0);
+	result.skipFree();
+	return result;
+}
+
+template <typename Value>
+auto KeyMap<Value>::end() const -> const_iterator {
+	return const_iterator(this, capacity());
+}
+
+template <typename Value>
+size_type KeyMap<Value>::findIndex(const Key &key) const {
+	const auto capacity = this->capacity();
+	if (!capacity) {
+		return capacity;
+	}
+	const auto hash = Hash(key);
+	const auto control = Control(hash);
+	for (auto index = home(hash);; index = next(index)) {
+		const auto current = _control[index];
+		if (current == kEmpty) {
+			return capacity;
+		} else if (current == control && _keys[index] == key) {
+			return index;
+		}
+	}
+}
+
+template <typename Value>
+auto KeyMap<Value>::find(const Key &key) -> iterator {
+	return iterator(this, findIndex(key));
+}
+
+template <typename Value>
+auto KeyMap<Value>::find(const Key &key) const -> const_iterator {
+	return const_iterator(this, findIndex(key));
+}
+
+template <typename Value>
+Value &KeyMap<Value>::operator[](const Key &key) {
+	if ((_size + _deleted + 1) * 8 > capacity() * 7) {
+		// Grow only if there is not enough deleted slots to reuse.
+		const auto required = CapacityFor(_size + 1);
+		rehash((required > capacity())
+			? std::max(required, capacity() + capacity() / 2)
+			: capacity());
+	}
+	const auto hash = Hash(key);
+	const auto control = Control(hash);
+	auto reuse = capacity();
+	for (auto index = home(hash);; index = next(index)) {
+		const auto current = _control[index];
+		if (current == kEmpty) {
+			if (reuse != capacity()) {
+				index = reuse;
+				--_deleted;
+			}
+			_control[index] = control;
+			_keys[index] = key;
+			_values[index] = Value();
+			++_size;
+			return _values[index];
+		} else if (current == kDeleted) {
+			if (reuse == capacity()) {
+				reuse = index;
+			}
+		} else if (current == control && _keys[index] == key) {
+			return _values[index];
+		}
+	}
+}
+
+template <typename Value>
+void KeyMap<Value>::erase(const_iterator i) {
+	Expects(i._index < capacity());
+	Expects(IsFull(_control[i._index]));
+
+	const auto index = i._index;
+	if (_control[next(index)] == kEmpty) {
+		_control[index] = kEmpty;
+	} else {
+		_control[index] = kDeleted;
+		++_deleted;
+	}
+	_values[index] = Value();
+	--_size;
+}
+
+template <typename Value>
+void KeyMap<Value>::rehash(size_type capacity) {
+	Expects(capacity >= kMinCapacity && capacity > _size);
+
+	auto control = std::vector<uint8>(capacity, kEmpty);
+	auto keys = std::vector<Key>(capacity);
+	auto values = std::vector<Value>(capacity);
+	std::swap(control, _control);
+	std::swap(keys, _keys);
+	std::swap(values, _values);
+	_deleted = 0;
+	for (auto i = size_type(0); i != size_type(control.size()); ++i) {
+		if (!IsFull(control[i])) {
+			continue;
+		}
+		auto index = home(Hash(keys[i]));
+		while (_control[index] != kEmpty) {
+			index = next(index);
+		}
+		_control[index] = control[i];
+		_keys[index] = keys[i];
+		_values[index] = std::move(values[i]);
+	}
+}
+
+} // namespace details
+} // namespace Cache
+} // namespace Storage
@@ -0,0 +1,220 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/cache/storage_cache_key_map.h"
+#include <unordered_map>
+#include <random>
+#include <chrono>
+
+using namespace Storage::Cache;
+using Storage::Cache::details::KeyMap;
+
+const auto DisableBenchmark = true;
+
+namespace {
+
+// Same size as the database index entry.
+struct Value {
+	uint64 data = 0;
+	uint32 size = 0;
+	uint32 checksum = 0;
+	uint64 place = 0;
+};
+
+int64 AllocatedBytes = 0;
+
+template <typename T>
+struct CountingAllocator {
+	using value_type = T;
+
+	CountingAllocator() = default;
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U> &other) {
+	}
+
+	T *allocate(std::size_t count) {
+		AllocatedBytes += int64(count * sizeof(T));
+		return std::allocator<T>().allocate(count);
+	}
+	void deallocate(T *pointer, std::size_t count) {
+		AllocatedBytes -= int64(count * sizeof(T));
+		std::allocator<T>().deallocate(pointer, count);
+	}
+
+	template <typename U>
+	bool operator==(const CountingAllocator<U> &other) const {
+		return true;
+	}
+	template <typename U>
+	bool operator!=(const CountingAllocator<U> &other) const {
+		return false;
+	}
+};
+
+Key RandomKey(std::mt19937_64 &generator, uint64 range) {
+	// Streamed file slices share high part and differ in low bits.
+	const auto value = generator() % range;
+	return Key{ value / 4, value % 4 };
+}
+
+template <typename Method>
+double MeasureSeconds(Method &&method) {
+	const auto start = std::chrono::steady_clock::now();
+	method();
+	const auto finish = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(finish - start).count();
+}
+
+} // namespace
+
+TEST_CASE("cache key map", "[storage_cache_key_map]") {
+	SECTION("key map inserts and finds values") {
+		auto map = KeyMap<Value>();
+		REQUIRE(map.empty());
+		REQUIRE(map.find(Key{ 1, 2 }) == map.end());
+
+		map[Key{ 1, 2 }].data = 12;
+		map[Key{ 2, 1 }].data = 21;
+		REQUIRE(map.size() == 2);
+		REQUIRE(map.find(Key{ 1, 2 }) != map.end());
+		REQUIRE(map.find(Key{ 1, 2 })->second.data == 12);
+		REQUIRE(map.find(Key{ 2, 1 })->second.data == 21);
+		REQUIRE(map.find(Key{ 1, 1 }) == map.end());
+
+		map[Key{ 1, 2 }].size = 5;
+		REQUIRE(map.size() == 2);
+		REQUIRE(map.find(Key{ 1, 2 })->second.data == 12);
+		REQUIRE(map.find(Key{ 1, 2 })->second.size == 5);
+	}
+	SECTION("key map erases values") {
+		auto map = KeyMap<Value>();
+		for (auto i = uint64(); i != 100; ++i) {
+			map[Key{ i, i }].data = i;
+		}
+		for (auto i = uint64(); i != 100; i += 2) {
+			map.erase(map.find(Key{ i, i }));
+		}
+		REQUIRE(map.size() == 50);
+		for (auto i = uint64(); i != 100; ++i) {
+			const auto j = map.find(Key{ i, i });
+			if (i % 2) {
+				REQUIRE(j != map.end());
+				REQUIRE(j->second.data == i);
+			} else {
+				REQUIRE(j == map.end());
+			}
+		}
+		auto count = 0;
+		for (const auto &[key, value] : map) {
+			REQUIRE(key.high % 2 == 1);
+			REQUIRE(key.high == value.data);
+			++count;
+		}
+		REQUIRE(count == 50);
+	}
+	SECTION("key map matches unordered_map") {
+		auto generator = std::mt19937_64(1);
+		auto map = KeyMap<Value>();
+		auto check = std::unordered_map<Key, Value>();
+		for (auto step = 0; step != 200000; ++step) {
+			const auto key = RandomKey(generator, 20000);
+			const auto i = map.find(key);
+			const auto j = check.find(key);
+			REQUIRE((i == map.end()) == (j == check.end()));
+			if (generator() % 3) {
+				map[key].data = check[key].data = uint64(step);
+			} else if (i != map.end()) {
+				REQUIRE(i->second.data == j->second.data);
+				map.erase(i);
+				check.erase(j);
+			}
+			REQUIRE(map.size() == size_type(check.size()));
+		}
+		auto count = size_type();
+		for (const auto &[key, value] : map) {
+			const auto j = check.find(key);
+			REQUIRE(j != check.end());
+			REQUIRE(j->second.data == value.data);
+			++count;
+		}
+		REQUIRE(count == size_type(check.size()));
+	}
+	SECTION("key map reserve keeps values") {
+		auto map = KeyMap<Value>();
+		map[Key{ 1, 1 }].data = 1;
+		map.reserve(1000);
+		REQUIRE(map.capacity() * 7 >= 1000 * 8);
+		const auto capacity = map.capacity();
+		for (auto i = uint64(2); i != 1001; ++i) {
+			map[Key{ i, i }].data = i;
+		}
+		REQUIRE(map.capacity() == capacity);
+		REQUIRE(map.find(Key{ 1, 1 })->second.data == 1);
+		REQUIRE(map.find(Key{ 1000, 1000 })->second.data == 1000);
+	}
+}
+
+TEST_CASE("cache key map benchmark", "[storage_cache_key_map]") {
+	if (DisableBenchmark) {
+		return;
+	}
+	constexpr auto kCount = 1000 * 1000;
+	const auto keys = [&] {
+		auto generator = std::mt19937_64(1);
+		auto result = std::vector<Key>();
+		result.reserve(kCount);
+		for (auto i = 0; i != kCount; ++i) {
+			result.push_back(Key{ generator(), generator() });
+		}
+		return result;
+	}();
+
+	using Standard = std::unordered_map<
+		Key,
+		Value,
+		std::hash<Key>,
+		std::equal_to<Key>,
+		CountingAllocator<std::pair<const Key, Value>>>;
+	auto standard = Standard();
+	auto found = uint64();
+	const auto standardInsert = MeasureSeconds([&] {
+		for (const auto &key : keys) {
+			standard[key].data = key.low;
+		}
+	});
+	const auto standardFind = MeasureSeconds([&] {
+		for (const auto &key : keys) {
+			found += standard.find(key)->second.data;
+		}
+	});
+	const auto standardBytes = AllocatedBytes;
+
+	auto compact = KeyMap<Value>();
+	const auto compactInsert = MeasureSeconds([&] {
+		for (const auto &key : keys) {
+			compact[key].data = key.low;
+		}
+	});
+	const auto compactFind = MeasureSeconds([&] {
+		for (const auto &key : keys) {
+			found -= compact.find(key)->second.data;
+		}
+	});
+	const auto compactBytes = compact.memoryUsage();
+	REQUIRE(found == 0);
+
+	WARN("unordered_map: "
+		<< (standardBytes / kCount) << " bytes per entry, "
+		<< "insert " << standardInsert << "s, "
+		<< "find " << standardFind << "s");
+	WARN("KeyMap: "
+		<< (compactBytes / kCount) << " bytes per entry, "
+		<< "insert " << compactInsert << "s, "
+		<< "find " << compactFind << "s");
+}
@@ -133,6 +133,35 @@ size_type MultiAccess::validateCount() const {
 	return ReadFrom(count);
 }
 
+int ShardIndex(const Key &key, int count) {
+	// Keys of a single streamed file differ only in the lowest bits,
+	// we want them in one shard so that getWithSizes() could see them.
+	const auto mixed = (key.high ^ (key.low >> 16)) * 0x9E3779B97F4A7C15ULL;
+	return int((mixed >> 32) % uint64(count));
+}
+
+Stats MergeStats(const std::vector<Stats> &list) {
+	auto result = Stats();
+	for (const auto &stats : list) {
+		result.full.count += stats.full.count;
+		result.full.totalSize += stats.full.totalSize;
+		for (const auto &[tag, summary] : stats.tagged) {
+			auto &merged = result.tagged[tag];
+			merged.count += summary.count;
+			merged.totalSize += summary.totalSize;
+		}
+		result.hot.count += stats.hot.count;
+		result.hot.totalSize += stats.hot.totalSize;
+		result.hot.hits += stats.hot.hits;
+		result.hot.misses += stats.hot.misses;
+		result.compact.processed += stats.compact.processed;
+		result.compact.total += stats.compact.total;
+		result.compact.reclaimed += stats.compact.reclaimed;
+		result.clearing = result.clearing || stats.clearing;
+	}
+	return result;
+}
+
 } // namespace details
 } // namespace Cache
 } // namespace Storage
@@ -13,6 +13,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include <crl/crl_time.h>
 #include <QtCore/QString>
 #include <QtCore/QByteArray>
+#include <vector>
 
 namespace Storage {
 namespace Cache {
@@ -71,9 +72,13 @@ struct Settings {
 	crl::time writeBundleDelay = 15 * 60 * crl::time(1000);
 	size_type staleRemoveChunk = 256;
 
+	// Other calls are processed between the steps of the binlog replay.
+	size_type replayRecordsPerStep = 4096;
+
 	int64 compactAfterExcess = 8 * 1024 * 1024;
 	int64 compactAfterFullSize = 0;
 	size_type compactChunkSize = 16 * 1024;
+	int64 compactBytesPerSecond = 0; // Unlimited.
 
 	bool trackEstimatedTime = true;
 	int64 totalSizeLimit = 1024 * 1024 * 1024;
@@ -82,6 +87,17 @@ struct Settings {
 	crl::time maxPruneCheckTimeout = 3600 * crl::time(1000);
 
 	bool clearOnWrongKey = false;
+
+	// Keep up to this count of value files mapped to memory, 0 disables.
+	size_type mappedPlacesLimit = 0;
+
+	// Keep recently read values decrypted in memory, 0 disables.
+	int64 hotCacheSizeLimit = 0;
+
+	// Each shard is a separate binlog with its own queue, so lookups of
+	// unrelated keys don't wait for each other. Changing the shards count
+	// makes values put before the change unreachable (until pruned).
+	int shardsCount = 1;
 };
 
 struct SettingsUpdate {
@@ -101,12 +117,31 @@ struct TaggedSummary {
 	size_type count = 0;
 	int64 totalSize = 0;
 };
+struct HotSummary {
+	size_type count = 0;
+	int64 totalSize = 0;
+	int64 hits = 0;
+	int64 misses = 0;
+};
+struct CompactSummary {
+	int64 processed = 0;
+	int64 total = 0;
+	int64 reclaimed = 0;
+};
 struct Stats {
 	TaggedSummary full;
 	base::flat_map<uint8, TaggedSummary> tagged;
+	HotSummary hot;
+	CompactSummary compact;
 	bool clearing = false;
 };
 
+// Index of the shard holding the key in a sharded database.
+[[nodiscard]] int ShardIndex(const Key &key, int count);
+
+// Sums the stats of several shards.
+[[nodiscard]] Stats MergeStats(const std::vector<Stats> &list);
+
 using Version = int32;
 
 QString ComputeBasePath(const QString &original);
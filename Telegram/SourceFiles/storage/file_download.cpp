@@ -14,6 +14,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "mainwindow.h"
 #include "core/application.h"
 #include "storage/localstorage.h"
+#include "storage/storage_web_file.h"
 #include "platform/platform_file_utilities.h"
 #include "mtproto/connection.h" // for MTP::kAckSendWaiting
 #include "main/main_session.h"
@@ -24,15 +25,14 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "facades.h"
 #include "app.h"
 
+#include <QtCore/QDataStream>
+
 namespace Storage {
 namespace {
 
 // How much time without download causes additional session kill.
 constexpr auto kKillSessionTimeout = crl::time(5000);
 
-// Max 16 file parts downloaded at the same time, 128 KB each.
-constexpr auto kMaxFileQueries = 16;
-
 // Max 8 http[s] files downloaded at the same time.
 constexpr auto kMaxWebFileQueries = 8;
 
@@ -42,6 +42,52 @@ constexpr auto kMaxWebFileQueries = 8;
 // fixed part size download for hash checking.
 constexpr auto kPartSize = 128 * 1024;
 
+constexpr auto kPartialFilesSerializeVersion = qint32(1);
+
+QByteArray SerializePartialFiles(
+		const base::flat_map<QString, Cache::Key> &files) {
+	auto result = QByteArray();
+	{
+		QDataStream stream(&result, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_1);
+		stream << kPartialFilesSerializeVersion << qint32(files.size());
+		for (const auto &[path, key] : files) {
+			stream << path << quint64(key.high) << quint64(key.low);
+		}
+	}
+	return result;
+}
+
+base::flat_map<QString, Cache::Key> DeserializePartialFiles(
+		const QByteArray &value) {
+	if (value.isEmpty()) {
+		return {};
+	}
+	QDataStream stream(value);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	auto version = qint32();
+	auto count = qint32();
+	stream >> version >> count;
+	if (stream.status() != QDataStream::Ok
+		|| version != kPartialFilesSerializeVersion
+		|| count < 0) {
+		return {};
+	}
+	auto result = base::flat_map<QString, Cache::Key>();
+	for (auto i = 0; i != count; ++i) {
+		auto path = QString();
+		auto high = quint64();
+		auto low = quint64();
+		stream >> path >> high >> low;
+		if (stream.status() != QDataStream::Ok) {
+			return {};
+		}
+		result.emplace(path, Cache::Key{ high, low });
+	}
+	return result;
+}
+
 } // namespace
 
 Downloader::Downloader(not_null<ApiWrap*> api)
@@ -54,19 +100,107 @@ void Downloader::clearPriorities() {
 	++_priority;
 }
 
-void Downloader::requestedAmountIncrement(MTP::DcId dcId, int index, int amount) {
-	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
+void Downloader::clearViewerPriorities() {
+	for (auto &[dcId, queue] : _queuesForDc) {
+		FileLoader::ClearViewerPriority(&queue);
+	}
+	FileLoader::ClearViewerPriority(&_queueForWeb);
+}
+
+void Downloader::clearUnusedPartialFiles() {
+	_api->session().data().cache().get(
+		Data::PartialDownloadsListCacheKey(),
+		[=](QByteArray &&value) {
+			crl::on_main(this, [=, value = std::move(value)] {
+				partialFilesLoaded(DeserializePartialFiles(value));
+			});
+		});
+}
+
+void Downloader::partialFilesLoaded(
+		base::flat_map<QString, Cache::Key> &&stored) {
+	_partialFilesLoaded = true;
+	auto &cache = _api->session().data().cache();
+	for (const auto &[path, key] : stored) {
+		if (_partialFiles.contains(path)) {
+			// Already used by a loader in this run.
+			continue;
+		}
+		_partialFiles.emplace(path, key);
+		_partialFilesToCheck.emplace(path);
+		cache.get(key, [=, path = path](QByteArray &&value) {
+			const auto saved = !value.isEmpty();
+			crl::on_main(this, [=] {
+				partialFileChecked(path, saved);
+			});
+		});
+	}
+	writePartialFiles();
+}
+
+void Downloader::partialFileChecked(const QString &path, bool saved) {
+	if (!_partialFilesToCheck.remove(path) || saved) {
+		return;
+	}
+	QFile::remove(path);
+	_partialFiles.remove(path);
+	writePartialFiles();
+}
+
+void Downloader::registerPartialFile(
+		const QString &path,
+		const Cache::Key &key) {
+	_partialFilesToCheck.remove(path);
+	const auto i = _partialFiles.find(path);
+	if (i != _partialFiles.end() && i->second == key) {
+		return;
+	}
+	_partialFiles[path] = key;
+	writePartialFiles();
+}
 
-	using namespace rpl::mappers;
+void Downloader::unregisterPartialFile(const QString &path) {
+	_partialFilesToCheck.remove(path);
+	if (_partialFiles.remove(path)) {
+		writePartialFiles();
+	}
+}
 
-	auto it = _requestedBytesAmount.find(dcId);
-	if (it == _requestedBytesAmount.cend()) {
-		it = _requestedBytesAmount.emplace(dcId, RequestedInDc { { 0 } }).first;
+void Downloader::writePartialFiles() {
+	if (!_partialFilesLoaded) {
+		// The stored list is merged with this one when it is loaded.
+		return;
+	}
+	auto &cache = _api->session().data().cache();
+	if (_partialFiles.empty()) {
+		cache.remove(Data::PartialDownloadsListCacheKey());
+	} else {
+		cache.put(
+			Data::PartialDownloadsListCacheKey(),
+			SerializePartialFiles(_partialFiles));
 	}
-	it->second[index] += amount;
+}
+
+Downloader::PriorityScope::PriorityScope(
+	not_null<Downloader*> downloader,
+	DownloadPriority priority)
+: _downloader(downloader)
+, _was(std::exchange(downloader->_priorityClass, priority)) {
+}
+
+Downloader::PriorityScope::~PriorityScope() {
+	_downloader->_priorityClass = _was;
+}
+
+void Downloader::requestedAmountIncrement(MTP::DcId dcId, int index, int amount) {
+	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
+
+	const auto idle = sessionsForDc(dcId).requestedAmountIncrement(
+		index,
+		amount);
 	if (amount > 0) {
 		killDownloadSessionsStop(dcId);
-	} else if (ranges::find_if(it->second, _1 > 0) == end(it->second)) {
+	} else if (idle) {
 		killDownloadSessionsStart(dcId);
 	}
 }
@@ -112,23 +246,72 @@ void Downloader::killDownloadSessions() {
 }
 
 int Downloader::chooseDcIndexForRequest(MTP::DcId dcId) const {
-	auto result = 0;
-	auto it = _requestedBytesAmount.find(dcId);
-	if (it != _requestedBytesAmount.cend()) {
-		for (auto i = 1; i != MTP::kDownloadSessionsCount; ++i) {
-			if (it->second[i] < it->second[result]) {
-				result = i;
-			}
-		}
+	const auto i = _sessions.find(dcId);
+	return (i != end(_sessions)) ? i->second.chooseIndex(kPartSize) : 0;
+}
+
+void Downloader::requestFinished(
+		MTP::DcId dcId,
+		int index,
+		int amount,
+		crl::time duration) {
+	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
+
+	auto &sessions = sessionsForDc(dcId);
+	if (sessions.requestFinished(index, amount, duration, crl::now())) {
+		_stats.fire(computeStats(dcId, sessions));
+	}
+
+	const auto i = _queuesForDc.find(dcId);
+	if (i != end(_queuesForDc)) {
+		i->second.queriesLimit = sessions.window().queriesLimit();
+	}
+}
+
+auto Downloader::sessionsForDc(MTP::DcId dcId) -> DownloadSessions& {
+	const auto i = _sessions.find(dcId);
+	if (i != end(_sessions)) {
+		return i->second;
 	}
+	return _sessions.emplace(
+		dcId,
+		DownloadSessions(MTP::kDownloadSessionsCount, crl::now())
+	).first->second;
+}
+
+auto Downloader::computeStats(
+		MTP::DcId dcId,
+		const DownloadSessions &sessions) const -> DcStats {
+	auto result = DcStats();
+	result.dcId = dcId;
+	result.queriesLimit = sessions.window().queriesLimit();
+	result.rtt = sessions.window().rtt();
+	result.bytesPerSecond = sessions.window().bytesPerSecond();
 	return result;
 }
 
+auto Downloader::statsForDc(MTP::DcId dcId) const -> DcStats {
+	const auto i = _sessions.find(dcId);
+	if (i == end(_sessions)) {
+		auto result = DcStats();
+		result.dcId = dcId;
+		result.queriesLimit = DownloadWindow::kStartQueries;
+		return result;
+	}
+	return computeStats(dcId, i->second);
+}
+
+rpl::producer<Downloader::DcStats> Downloader::stats() const {
+	return _stats.events();
+}
+
 not_null<Downloader::Queue*> Downloader::queueForDc(MTP::DcId dcId) {
 	const auto i = _queuesForDc.find(dcId);
 	const auto result = (i != end(_queuesForDc))
 		? i
-		: _queuesForDc.emplace(dcId, Queue(kMaxFileQueries)).first;
+		: _queuesForDc.emplace(
+			dcId,
+			Queue(statsForDc(dcId).queriesLimit)).first;
 	return &result->second;
 }
 
@@ -144,6 +327,52 @@ Downloader::~Downloader() {
 
 namespace {
 
+// Only large files downloaded right to the disk are resumed,
+// the progress is saved to the cache database not more often than that.
+constexpr auto kMinResumableSize = 1024 * 1024;
+constexpr auto kPartialSaveDelay = crl::time(1000);
+constexpr auto kPartialSerializeVersion = qint32(1);
+
+// Web files saved right to the disk never hold more than a read buffer
+// and a part of data in memory for each of (up to four) ranges.
+constexpr auto kWebReadBufferSize = 256 * 1024;
+
+struct PartialDownload {
+	QString path;
+	QByteArray parts;
+};
+
+QByteArray SerializePartial(const PartialDownload &data) {
+	auto result = QByteArray();
+	{
+		QDataStream stream(&result, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_1);
+		stream
+			<< kPartialSerializeVersion
+			<< data.path
+			<< data.parts;
+	}
+	return result;
+}
+
+std::optional<PartialDownload> DeserializePartial(const QByteArray &value) {
+	if (value.isEmpty()) {
+		return std::nullopt;
+	}
+	QDataStream stream(value);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	auto version = qint32();
+	auto result = PartialDownload();
+	stream >> version >> result.path >> result.parts;
+	if (stream.status() != QDataStream::Ok
+		|| version != kPartialSerializeVersion
+		|| result.path.isEmpty()) {
+		return std::nullopt;
+	}
+	return result;
+}
+
 QThread *_webLoadThread = nullptr;
 WebLoadManager *_webLoadManager = nullptr;
 WebLoadManager *webLoadManager() {
@@ -165,7 +394,7 @@ FileLoader::FileLoader(
 , _autoLoading(autoLoading)
 , _cacheTag(cacheTag)
 , _filename(toFile)
-, _file(_filename)
+, _sink(_filename, Storage::kPartSize)
 , _toCache(toCache)
 , _fromCloud(fromCloud)
 , _size(size)
@@ -181,25 +410,23 @@ void FileLoader::finishWithBytes(const QByteArray &data) {
 	_data = data;
 	_localStatus = LocalStatus::Loaded;
 	if (!_filename.isEmpty() && _toCache == LoadToCacheAsWell) {
-		if (!_fileIsOpen) _fileIsOpen = _file.open(QIODevice::WriteOnly);
-		if (!_fileIsOpen) {
+		if (!_sink.isOpen() && !_sink.open(_data.size())) {
 			cancel(true);
 			return;
-		}
-		_file.seek(0);
-		if (_file.write(_data) != qint64(_data.size())) {
+		} else if (!_sink.write(0, bytes::make_span(_data))) {
 			cancel(true);
 			return;
 		}
 	}
-
-	_finished = true;
-	if (_fileIsOpen) {
-		_file.close();
-		_fileIsOpen = false;
+	if (_sink.isOpen()) {
+		if (!_sink.finish()) {
+			cancel(true);
+			return;
+		}
 		Platform::File::PostprocessDownloaded(
-			QFileInfo(_file).absoluteFilePath());
+			QFileInfo(_sink.fileName()).absoluteFilePath());
 	}
+	_finished = true;
 	_downloader->taskFinished().notify();
 }
 
@@ -249,7 +476,7 @@ bool FileLoader::setFileName(const QString &fileName) {
 		return fileName.isEmpty() || (fileName == _filename);
 	}
 	_filename = fileName;
-	_file.setFileName(_filename);
+	_sink.setFileName(_filename);
 	return true;
 }
 
@@ -268,7 +495,10 @@ void FileLoader::LoadNextFromQueue(not_null<Queue*> queue) {
 		return;
 	}
 	for (auto i = queue->start; i;) {
-		if (i->loadPart()) {
+		if (queue->queriesCount >= queue->limitFor(i->_priorityClass)) {
+			// All the following loaders are of the same or lower class.
+			return;
+		} else if (i->loadPart()) {
 			if (queue->queriesCount >= queue->queriesLimit) {
 				return;
 			}
@@ -278,6 +508,64 @@ void FileLoader::LoadNextFromQueue(not_null<Queue*> queue) {
 	}
 }
 
+void FileLoader::ClearViewerPriority(not_null<Queue*> queue) {
+	auto viewer = std::vector<not_null<FileLoader*>>();
+	for (auto i = queue->start; i; i = i->_next) {
+		if (i->_priorityClass == Storage::DownloadPriority::Viewer) {
+			viewer.push_back(i);
+		}
+	}
+
+	// Inside the class they are ordered by their old generations,
+	// so everything prioritized after them is served first.
+	for (const auto loader : viewer) {
+		loader->removeFromQueue();
+		loader->_priorityClass = Storage::DownloadPriority::Visible;
+		loader->insertToQueue();
+	}
+}
+
+Storage::DownloadPriority FileLoader::computePriorityClass() const {
+	using Priority = Storage::DownloadPriority;
+	const auto current = _downloader->currentPriorityClass();
+	if (!_autoLoading || current == Priority::Viewer) {
+		return current;
+	}
+	return (_toCache == LoadToCacheAsWell)
+		? Priority::Preload
+		: Priority::Background;
+}
+
+bool FileLoader::servedBefore(not_null<const FileLoader*> other) const {
+	return (_priorityClass != other->_priorityClass)
+		? (_priorityClass > other->_priorityClass)
+		: (_priority > other->_priority);
+}
+
+void FileLoader::insertToQueue() {
+	Expects(!_inQueue);
+
+	auto before = _queue->start;
+	while (before && !servedBefore(before)) {
+		before = before->_next;
+	}
+	_inQueue = true;
+	if (before) {
+		_next = before;
+		_prev = before->_prev;
+		before->_prev = this;
+	} else {
+		_next = nullptr;
+		_prev = _queue->end;
+		_queue->end = this;
+	}
+	if (_prev) {
+		_prev->_next = this;
+	} else {
+		_queue->start = this;
+	}
+}
+
 void FileLoader::removeFromQueue() {
 	if (!_inQueue) return;
 	if (_next) {
@@ -297,6 +585,18 @@ void FileLoader::removeFromQueue() {
 }
 
 FileLoader::~FileLoader() {
+	if (_sink.isOpen()) {
+		if (keepsPartial() && _sink.writtenBytes() > 0) {
+			// The app is closing, resume the download on the next start.
+			savePartial();
+			_sink.close();
+		} else {
+			if (keepsPartial()) {
+				forgetPartial();
+			}
+			_sink.remove();
+		}
+	}
 	removeFromQueue();
 }
 
@@ -326,75 +626,26 @@ void FileLoader::start() {
 		return;
 	}
 
-	if (!_filename.isEmpty() && _toCache == LoadToFileOnly && !_fileIsOpen) {
-		_fileIsOpen = _file.open(QIODevice::WriteOnly);
-		if (!_fileIsOpen) {
+	if (!_filename.isEmpty()
+		&& _toCache == LoadToFileOnly
+		&& !_sink.isOpen()
+		&& !writesFileDirectly()) {
+		if (tryLoadPartial()) {
+			return;
+		} else if (!_sink.isOpen() && !_sink.open(_size)) {
 			return cancel(true);
 		}
 	}
 
-	auto currentPriority = _downloader->currentPriority();
-	FileLoader *before = nullptr, *after = nullptr;
-	if (_inQueue && _priority == currentPriority) {
-		if (!_next || _next->_priority < currentPriority) return startLoading();
-		after = _next;
-		while (after->_next && after->_next->_priority == currentPriority) {
-			after = after->_next;
-		}
-	} else {
-		_priority = currentPriority;
-		if (_inQueue) {
-			if (_next && _next->_priority == currentPriority) {
-				after = _next;
-			} else if (_prev && _prev->_priority < currentPriority) {
-				before = _prev;
-				while (before->_prev && before->_prev->_priority < currentPriority) {
-					before = before->_prev;
-				}
-			} else {
-				return startLoading();
-			}
-		} else {
-			if (_queue->start && _queue->start->_priority == currentPriority) {
-				after = _queue->start;
-			} else {
-				before = _queue->start;
-			}
-		}
-		if (after) {
-			while (after->_next && after->_next->_priority == currentPriority) {
-				after = after->_next;
-			}
-		}
-	}
-
-	removeFromQueue();
-
-	_inQueue = true;
-	if (!_queue->start) {
-		_queue->start = _queue->end = this;
-	} else if (before) {
-		if (before != _next) {
-			_prev = before->_prev;
-			_next = before;
-			_next->_prev = this;
-			if (_prev) {
-				_prev->_next = this;
-			}
-			if (_queue->start->_prev) _queue->start = _queue->start->_prev;
-		}
-	} else if (after) {
-		if (after != _prev) {
-			_next = after->_next;
-			_prev = after;
-			after->_next = this;
-			if (_next) {
-				_next->_prev = this;
-			}
-			if (_queue->end->_next) _queue->end = _queue->end->_next;
-		}
-	} else {
-		LOG(("Queue Error: _start && !before && !after"));
+	const auto priority = _downloader->currentPriority();
+	const auto priorityClass = computePriorityClass();
+	if (!_inQueue
+		|| _priority != priority
+		|| _priorityClass != priorityClass) {
+		removeFromQueue();
+		_priority = priority;
+		_priorityClass = priorityClass;
+		insertToQueue();
 	}
 	return startLoading();
 }
@@ -466,6 +717,89 @@ bool FileLoader::tryLoadLocal() {
 	return false;
 }
 
+bool FileLoader::resumable() const {
+	return !_filename.isEmpty()
+		&& (_toCache == LoadToFileOnly)
+		&& (_size >= kMinResumableSize);
+}
+
+Storage::Cache::Key FileLoader::partialKey() const {
+	return Data::PartialDownloadCacheKey(cacheKey(), _size);
+}
+
+bool FileLoader::tryLoadPartial() {
+	if (!resumable() || _partialStatus == PartialStatus::Done) {
+		return false;
+	} else if (_partialStatus == PartialStatus::Loading) {
+		return true;
+	}
+	_partialStatus = PartialStatus::Loading;
+	auto done = [=, guard = _partialLoading.make_guard()](
+			QByteArray &&value) mutable {
+		crl::on_main(std::move(guard), [
+			=,
+			value = std::move(value)
+		]() mutable {
+			partialLoaded(std::move(value));
+		});
+	};
+	session().data().cache().get(partialKey(), std::move(done));
+	return true;
+}
+
+void FileLoader::partialLoaded(QByteArray &&value) {
+	_partialStatus = PartialStatus::Done;
+	if (_finished || _sink.isOpen()) {
+		return;
+	}
+	if (const auto partial = DeserializePartial(value)) {
+		_sink.setFileName(partial->path);
+		if (!_sink.resume(_size, partial->parts)) {
+			QFile::remove(partial->path);
+			_downloader->unregisterPartialFile(partial->path);
+		}
+	}
+	if (!_sink.isOpen()) {
+		_sink.setFileName(Storage::PartialFilePath(_filename));
+		if (!_sink.open(_size, false)) {
+			return cancel(true);
+		}
+	}
+	_downloader->registerPartialFile(_sink.fileName(), partialKey());
+	if (_sink.writtenBytes() >= _size) {
+		if (finalizeResult()) {
+			notifyAboutProgress();
+		}
+		return;
+	}
+	_partialSavedAt = crl::now();
+	start();
+}
+
+void FileLoader::savePartial() {
+	Expects(_sink.isOpen());
+
+	_partialSavedAt = crl::now();
+	session().data().cache().put(
+		partialKey(),
+		SerializePartial({ _sink.fileName(), _sink.writtenParts() }));
+}
+
+void FileLoader::forgetPartial() {
+	session().data().cache().remove(partialKey());
+	_downloader->unregisterPartialFile(_sink.fileName());
+}
+
+bool FileLoader::keepsPartial() const {
+	return resumable() && (_sink.fileName() != _filename);
+}
+
+bool FileLoader::partLoadedAlready(int offset) const {
+	return (offset < _size)
+		&& _sink.isOpen()
+		&& _sink.contains(offset, std::min(Storage::kPartSize, _size - offset));
+}
+
 void FileLoader::cancel() {
 	cancel(false);
 }
@@ -475,10 +809,13 @@ void FileLoader::cancel(bool fail) {
 	cancelRequests();
 	_cancelled = true;
 	_finished = true;
-	if (_fileIsOpen) {
-		_file.close();
-		_fileIsOpen = false;
-		_file.remove();
+	if (_sink.isOpen()) {
+		// Only the parts of a download interrupted by the app closing
+		// are kept, see ~FileLoader().
+		if (keepsPartial()) {
+			forgetPartial();
+		}
+		_sink.remove();
 	}
 	_data = QByteArray();
 	removeFromQueue();
@@ -493,7 +830,7 @@ void FileLoader::cancel(bool fail) {
 	}
 	if (weak) {
 		_filename = QString();
-		_file.setFileName(_filename);
+		_sink.setFileName(_filename);
 	}
 
 	// Current cancel() call could be made from ~Main::Session().
@@ -501,14 +838,17 @@ void FileLoader::cancel(bool fail) {
 }
 
 void FileLoader::startLoading() {
-	if ((_queue->queriesCount >= _queue->queriesLimit) || _finished) {
+	if ((_queue->queriesCount >= _queue->limitFor(_priorityClass))
+		|| _finished) {
 		return;
 	}
 	loadPart();
 }
 
 int FileLoader::currentOffset() const {
-	return (_fileIsOpen ? _file.size() : _data.size()) - _skippedBytes;
+	return _sink.isOpen()
+		? int(_sink.writtenBytes())
+		: (_data.size() - _skippedBytes);
 }
 
 bool FileLoader::writeResultPart(int offset, bytes::const_span buffer) {
@@ -517,17 +857,13 @@ bool FileLoader::writeResultPart(int offset, bytes::const_span buffer) {
 	if (buffer.empty()) {
 		return true;
 	}
-	if (_fileIsOpen) {
-		auto fsize = _file.size();
-		if (offset < fsize) {
-			_skippedBytes -= buffer.size();
-		} else if (offset > fsize) {
-			_skippedBytes += offset - fsize;
-		}
-		_file.seek(offset);
-		if (_file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size()) != qint64(buffer.size())) {
+	if (_sink.isOpen()) {
+		if (!_sink.write(offset, buffer)) {
 			cancel(true);
 			return false;
+		} else if (keepsPartial()
+			&& (crl::now() - _partialSavedAt >= kPartialSaveDelay)) {
+			savePartial();
 		}
 		return true;
 	}
@@ -554,20 +890,8 @@ bool FileLoader::writeResultPart(int offset, bytes::const_span buffer) {
 QByteArray FileLoader::readLoadedPartBack(int offset, int size) {
 	Expects(offset >= 0 && size > 0);
 
-	if (_fileIsOpen) {
-		if (_file.openMode() == QIODevice::WriteOnly) {
-			_file.close();
-			_fileIsOpen = _file.open(QIODevice::ReadWrite);
-			if (!_fileIsOpen) {
-				cancel(true);
-				return QByteArray();
-			}
-		}
-		if (!_file.seek(offset)) {
-			return QByteArray();
-		}
-		auto result = _file.read(size);
-		return (result.size() == size) ? result : QByteArray();
+	if (_sink.isOpen()) {
+		return _sink.read(offset, size);
 	}
 	return (offset + size <= _data.size())
 		? _data.mid(offset, size)
@@ -578,23 +902,35 @@ bool FileLoader::finalizeResult() {
 	Expects(!_finished);
 
 	if (!_filename.isEmpty() && (_toCache == LoadToCacheAsWell)) {
-		if (!_fileIsOpen) {
-			_fileIsOpen = _file.open(QIODevice::WriteOnly);
-		}
-		_file.seek(0);
-		if (!_fileIsOpen || _file.write(_data) != qint64(_data.size())) {
+		if (!_sink.isOpen() && !_sink.open(_data.size())) {
+			cancel(true);
+			return false;
+		} else if (!_sink.write(0, bytes::make_span(_data))) {
 			cancel(true);
 			return false;
 		}
 	}
-
-	_finished = true;
-	if (_fileIsOpen) {
-		_file.close();
-		_fileIsOpen = false;
+	if (_sink.isOpen()) {
+		const auto path = _sink.fileName();
+		if (!_sink.finish()) {
+			cancel(true);
+			return false;
+		} else if (path != _filename) {
+			forgetPartial();
+			if (!Storage::MovePartialFile(path, _filename)) {
+				QFile::remove(path);
+				cancel(true);
+				return false;
+			}
+			_sink.setFileName(_filename);
+		}
+		Platform::File::PostprocessDownloaded(
+			QFileInfo(_filename).absoluteFilePath());
+	} else if (writesFileDirectly()) {
 		Platform::File::PostprocessDownloaded(
-			QFileInfo(_file).absoluteFilePath());
+			QFileInfo(_filename).absoluteFilePath());
 	}
+	_finished = true;
 	removeFromQueue();
 
 	if (_localStatus == LocalStatus::NotFound) {
@@ -700,11 +1036,14 @@ void mtpFileLoader::refreshFileReferenceFrom(
 		cancel(true);
 		return;
 	}
-	const auto offset = finishSentRequestGetOffset(requestId);
+	const auto offset = finishSentRequestGetOffset(
+		requestId,
+		FinishRequestReason::Redirect);
 	makeRequest(offset);
 }
 
 bool mtpFileLoader::loadPart() {
+	skipLoadedParts();
 	if (_finished || _lastComplete || (!_sentRequests.empty() && !_size)) {
 		return false;
 	} else if (_size && _nextRequestOffset >= _size) {
@@ -713,9 +1052,18 @@ bool mtpFileLoader::loadPart() {
 
 	makeRequest(_nextRequestOffset);
 	_nextRequestOffset += Storage::kPartSize;
+
+	// So that the last answer sees that nothing is left to request.
+	skipLoadedParts();
 	return true;
 }
 
+void mtpFileLoader::skipLoadedParts() {
+	while (partLoadedAlready(_nextRequestOffset)) {
+		_nextRequestOffset += Storage::kPartSize;
+	}
+}
+
 MTP::DcId mtpFileLoader::dcId() const {
 	if (const auto storage = base::get_if<StorageFileLocation>(&_location)) {
 		return storage->dcId();
@@ -835,10 +1183,15 @@ void mtpFileLoader::normalPartLoaded(
 	Expects(!_finished);
 	Expects(result.type() == mtpc_upload_fileCdnRedirect || result.type() == mtpc_upload_file);
 
-	auto offset = finishSentRequestGetOffset(requestId);
 	if (result.type() == mtpc_upload_fileCdnRedirect) {
+		const auto offset = finishSentRequestGetOffset(
+			requestId,
+			FinishRequestReason::Redirect);
 		return switchToCDN(offset, result.c_upload_fileCdnRedirect());
 	}
+	const auto offset = finishSentRequestGetOffset(
+		requestId,
+		FinishRequestReason::Success);
 	auto buffer = bytes::make_span(result.c_upload_file().vbytes().v);
 	return partLoaded(offset, buffer);
 }
@@ -847,7 +1200,9 @@ void mtpFileLoader::webPartLoaded(
 		const MTPupload_WebFile &result,
 		mtpRequestId requestId) {
 	result.match([&](const MTPDupload_webFile &data) {
-		const auto offset = finishSentRequestGetOffset(requestId);
+		const auto offset = finishSentRequestGetOffset(
+			requestId,
+			FinishRequestReason::Success);
 		if (!_size) {
 			_size = data.vsize().v;
 		} else if (data.vsize().v != _size) {
@@ -865,7 +1220,11 @@ void mtpFileLoader::webPartLoaded(
 void mtpFileLoader::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId requestId) {
 	Expects(!_finished);
 
-	const auto offset = finishSentRequestGetOffset(requestId);
+	const auto offset = finishSentRequestGetOffset(
+		requestId,
+		((result.type() == mtpc_upload_cdnFileReuploadNeeded)
+			? FinishRequestReason::Redirect
+			: FinishRequestReason::Success));
 	result.match([&](const MTPDupload_cdnFileReuploadNeeded &data) {
 		auto requestData = RequestData();
 		requestData.dcId = dcId();
@@ -939,7 +1298,9 @@ mtpFileLoader::CheckCdnHashResult mtpFileLoader::checkCdnFileHash(
 void mtpFileLoader::reuploadDone(
 		const MTPVector<MTPFileHash> &result,
 		mtpRequestId requestId) {
-	auto offset = finishSentRequestGetOffset(requestId);
+	const auto offset = finishSentRequestGetOffset(
+		requestId,
+		FinishRequestReason::Redirect);
 	addCdnHashes(result.v);
 	makeRequest(offset);
 }
@@ -952,7 +1313,9 @@ void mtpFileLoader::getCdnFileHashesDone(
 
 	_cdnHashesRequestId = 0;
 
-	const auto offset = finishSentRequestGetOffset(requestId);
+	const auto offset = finishSentRequestGetOffset(
+		requestId,
+		FinishRequestReason::Redirect);
 	addCdnHashes(result.v);
 	auto someMoreChecked = false;
 	for (auto i = _cdnUncheckedParts.begin(); i != _cdnUncheckedParts.cend();) {
@@ -1013,10 +1376,13 @@ void mtpFileLoader::placeSentRequest(
 		requestData.dcIndex,
 		Storage::kPartSize);
 	++_queue->queriesCount;
-	_sentRequests.emplace(requestId, requestData);
+	auto &sent = _sentRequests.emplace(requestId, requestData).first->second;
+	sent.sent = crl::now();
 }
 
-int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
+int mtpFileLoader::finishSentRequestGetOffset(
+		mtpRequestId requestId,
+		FinishRequestReason reason) {
 	auto it = _sentRequests.find(requestId);
 	Assert(it != _sentRequests.cend());
 
@@ -1025,6 +1391,13 @@ int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
 		requestData.dcId,
 		requestData.dcIndex,
 		-Storage::kPartSize);
+	if (reason == FinishRequestReason::Success) {
+		_downloader->requestFinished(
+			requestData.dcId,
+			requestData.dcIndex,
+			Storage::kPartSize,
+			crl::now() - requestData.sent);
+	}
 
 	--_queue->queriesCount;
 	_sentRequests.erase(it);
@@ -1096,7 +1469,9 @@ bool mtpFileLoader::cdnPartFailed(
 	}
 	if (error.type() == qstr("FILE_TOKEN_INVALID")
 		|| error.type() == qstr("REQUEST_TOKEN_INVALID")) {
-		auto offset = finishSentRequestGetOffset(requestId);
+		const auto offset = finishSentRequestGetOffset(
+			requestId,
+			FinishRequestReason::Redirect);
 		changeCDNParams(
 			offset,
 			0,
@@ -1113,7 +1488,7 @@ void mtpFileLoader::cancelRequests() {
 	while (!_sentRequests.empty()) {
 		auto requestId = _sentRequests.begin()->first;
 		MTP::cancel(requestId);
-		finishSentRequestGetOffset(requestId);
+		finishSentRequestGetOffset(requestId, FinishRequestReason::Cancel);
 	}
 }
 
@@ -1170,7 +1545,9 @@ void mtpFileLoader::changeCDNParams(
 		while (!_sentRequests.empty()) {
 			auto requestId = _sentRequests.begin()->first;
 			MTP::cancel(requestId);
-			auto resendOffset = finishSentRequestGetOffset(requestId);
+			const auto resendOffset = finishSentRequestGetOffset(
+				requestId,
+				FinishRequestReason::Cancel);
 			resendOffsets.push_back(resendOffset);
 		}
 		for (auto resendOffset : resendOffsets) {
@@ -1204,14 +1581,15 @@ mtpFileLoader::~mtpFileLoader() {
 webFileLoader::webFileLoader(
 	const QString &url,
 	const QString &to,
+	LoadToCacheSetting toCache,
 	LoadFromCloudSetting fromCloud,
 	bool autoLoading,
 	uint8 cacheTag)
 : FileLoader(
-	QString(),
+	(toCache == LoadToFileOnly) ? to : QString(),
 	0,
 	UnknownFileLocation,
-	LoadToCacheAsWell,
+	toCache,
 	fromCloud,
 	autoLoading,
 	cacheTag)
@@ -1235,7 +1613,10 @@ bool webFileLoader::loadPart() {
 	}
 
 	_requestSent = true;
-	_webLoadManager->append(this, _url);
+	_webLoadManager->append(
+		this,
+		_url,
+		writesFileDirectly() ? _filename : QString());
 	return false;
 }
 
@@ -1250,7 +1631,12 @@ void webFileLoader::loadProgress(qint64 already, qint64 size) {
 }
 
 void webFileLoader::loadFinished(const QByteArray &data) {
-	if (writeResultPart(0, bytes::make_span(data))) {
+	if (writesFileDirectly()) {
+		_already = _size;
+		if (finalizeResult()) {
+			notifyAboutProgress();
+		}
+	} else if (writeResultPart(0, bytes::make_span(data))) {
 		if (finalizeResult()) {
 			notifyAboutProgress();
 		}
@@ -1269,6 +1655,10 @@ std::optional<MediaKey> webFileLoader::fileLocationKey() const {
 	return std::nullopt;
 }
 
+bool webFileLoader::writesFileDirectly() const {
+	return !_filename.isEmpty() && (_toCache == LoadToFileOnly);
+}
+
 void webFileLoader::cancelRequests() {
 	if (!webLoadManager()) return;
 	webLoadManager()->stop(this);
@@ -1279,10 +1669,16 @@ webFileLoader::~webFileLoader() {
 
 class webFileLoaderPrivate {
 public:
-	webFileLoaderPrivate(webFileLoader *loader, const QString &url)
-		: _interface(loader)
-		, _url(url)
-		, _redirectsLeft(kMaxHttpRedirects) {
+	webFileLoaderPrivate(
+		webFileLoader *loader,
+		const QString &url,
+		const QString &path)
+	: _interface(loader)
+	, _url(url)
+	, _redirectsLeft(kMaxHttpRedirects) {
+		if (!path.isEmpty()) {
+			_writer = std::make_unique<Storage::WebFileWriter>(path);
+		}
 	}
 
 	QNetworkReply *reply() {
@@ -1292,13 +1688,38 @@ public:
 	QNetworkReply *request(QNetworkAccessManager &manager, const QString &redirect) {
 		if (!redirect.isEmpty()) _url = redirect;
 
+		if (streaming()) {
+			_writer->restart();
+			_rangeReplies.clear();
+		}
+		const auto from = streaming() ? 0 : _already;
 		QNetworkRequest req(_url);
-		QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(_already) + "-";
+		QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(from) + "-";
 		req.setRawHeader("Range", rangeHeaderValue);
 		_reply = manager.get(req);
+		if (streaming()) {
+			_reply->setReadBufferSize(kWebReadBufferSize);
+			_rangeReplies.push_back(_reply);
+		}
 		return _reply;
 	}
 
+	QNetworkReply *requestRange(QNetworkAccessManager &manager, int index) {
+		Expects(streaming());
+		Expects(index >= 0 && index < int(_writer->ranges().size()));
+
+		QNetworkRequest req(_url);
+		req.setRawHeader("Range", _writer->rangeHeader(index));
+		const auto result = manager.get(req);
+		result->setReadBufferSize(kWebReadBufferSize);
+		_rangeReplies.resize(_writer->ranges().size(), nullptr);
+		_rangeReplies[index] = result;
+		if (!index) {
+			_reply = result;
+		}
+		return result;
+	}
+
 	bool oneMoreRedirect() {
 		if (_redirectsLeft) {
 			--_redirectsLeft;
@@ -1328,6 +1749,31 @@ public:
 		return _already;
 	}
 
+	bool streaming() const {
+		return (_writer != nullptr);
+	}
+	Storage::WebFileWriter &writer() {
+		Expects(streaming());
+
+		return *_writer;
+	}
+
+	int rangeIndex(QNetworkReply *reply) const {
+		const auto i = ranges::find(_rangeReplies, reply);
+		return (i != end(_rangeReplies))
+			? int(i - begin(_rangeReplies))
+			: -1;
+	}
+	void rangeFinished(int index) {
+		Expects(index >= 0 && index < int(_rangeReplies.size()));
+
+		_rangeReplies[index] = nullptr;
+	}
+	bool rangeRequested(int index) const {
+		return (index < int(_rangeReplies.size()))
+			&& (_rangeReplies[index] != nullptr);
+	}
+
 private:
 	static constexpr auto kMaxHttpRedirects = 5;
 
@@ -1339,6 +1785,9 @@ private:
 	int32 _redirectsLeft = kMaxHttpRedirects;
 	QByteArray _data;
 
+	std::unique_ptr<Storage::WebFileWriter> _writer;
+	std::vector<QNetworkReply*> _rangeReplies;
+
 	friend class WebLoadManager;
 };
 
@@ -1373,8 +1822,11 @@ WebLoadManager::WebLoadManager(QThread *thread) {
 #endif // OS_MAC_OLD
 }
 
-void WebLoadManager::append(webFileLoader *loader, const QString &url) {
-	loader->_private = new webFileLoaderPrivate(loader, url);
+void WebLoadManager::append(
+		webFileLoader *loader,
+		const QString &url,
+		const QString &path) {
+	loader->_private = new webFileLoaderPrivate(loader, url, path);
 
 	QMutexLocker lock(&_loaderPointersMutex);
 	_loaderPointers.insert(loader, loader->_private);
@@ -1402,7 +1854,7 @@ bool WebLoadManager::handleReplyResult(webFileLoaderPrivate *loader, WebReplyPro
 		return false;
 	}
 
-	if (result == WebReplyProcessProgress) {
+	if (result == WebReplyProcessProgress && !loader->streaming()) {
 		if (loader->size() > Storage::kMaxFileInMemory) {
 			LOG(("API Error: too large file is loaded to cache: %1").arg(loader->size()));
 			result = WebReplyProcessError;
@@ -1439,9 +1891,16 @@ void WebLoadManager::onFailed(QNetworkReply *reply) {
 
 	LOG(("Network Error: Failed to request '%1', error %2 (%3)").arg(QString::fromLatin1(loader->_url.toEncoded())).arg(int(reply->error())).arg(reply->errorString()));
 
+	if (loader->streaming()) {
+		// Request the rest of the range from where it was interrupted.
+		const auto index = loader->rangeIndex(reply);
+		if (index >= 0 && loader->writer().retryRange(index)) {
+			sendRangeRequest(loader, index);
+			return;
+		}
+	}
 	if (!handleReplyResult(loader, WebReplyProcessError)) {
-		_loaders.remove(loader);
-		delete loader;
+		destroyLoader(loader);
 	}
 }
 
@@ -1474,25 +1933,59 @@ void WebLoadManager::onProgress(qint64 already, qint64 size) {
 			LOG(("Network Error: Bad HTTP status received in WebLoadManager::onProgress(): %1").arg(statusCode.toInt()));
 			result = WebReplyProcessError;
 		}
+	} else if (size == 0) {
+		LOG(("Network Error: Zero size received for HTTP download progress in WebLoadManager::onProgress(): %1 / %2").arg(already).arg(size));
+		result = WebReplyProcessError;
+	} else if (loader->streaming()) {
+		result = processStreamed(loader, reply, status, already, size);
 	} else {
 		loader->setProgress(already, size);
 		QByteArray r = reply->readAll();
 		if (!r.isEmpty()) {
 			loader->addData(r);
 		}
-		if (size == 0) {
-			LOG(("Network Error: Zero size received for HTTP download progress in WebLoadManager::onProgress(): %1 / %2").arg(already).arg(size));
-			result = WebReplyProcessError;
-		}
 	}
 	if (!handleReplyResult(loader, result)) {
-		_replies.erase(j);
-		_loaders.remove(loader);
-		delete loader;
-
+		destroyLoader(loader);
+	}
+}
+
+WebReplyProcessResult WebLoadManager::processStreamed(
+		webFileLoaderPrivate *loader,
+		QNetworkReply *reply,
+		int status,
+		qint64 already,
+		qint64 size) {
+	auto &writer = loader->writer();
+	const auto index = loader->rangeIndex(reply);
+	if (index < 0) {
+		return WebReplyProcessError;
+	} else if (writer.ranges()[index].offset > 0 && status != 206) {
+		LOG(("Network Error: Range ignored by the server in WebLoadManager::processStreamed(): %1").arg(status));
+		return WebReplyProcessError;
+	}
+	if (!loader->size() && size > 0) {
+		loader->setProgress(loader->already(), size);
+		writer.setSize(size);
+	}
+	const auto complete = (size > 0) && (already >= size);
+	if (!writer.feed(index, reply->readAll(), complete)) {
+		LOG(("File Error: Could not write web file to '%1'").arg(writer.path()));
+		return WebReplyProcessError;
+	} else if (writer.ranges()[index].done) {
+		_replies.remove(reply);
+		loader->rangeFinished(index);
 		reply->abort();
 		reply->deleteLater();
 	}
+	loader->setProgress(writer.received(), loader->size());
+	if (!writer.complete()) {
+		return WebReplyProcessProgress;
+	} else if (!writer.finish()) {
+		LOG(("File Error: Could not finish web file '%1'").arg(writer.path()));
+		return WebReplyProcessError;
+	}
+	return WebReplyProcessFinished;
 }
 
 void WebLoadManager::onMeta() {
@@ -1511,13 +2004,22 @@ void WebLoadManager::onMeta() {
 			const auto m = QRegularExpression(qsl("/(\\d+)([^\\d]|$)")).match(QString::fromUtf8(pair.second));
 			if (m.hasMatch()) {
 				loader->setProgress(qMax(qint64(loader->data().size()), loader->already()), m.captured(1).toLongLong());
+				if (loader->streaming() && reply == loader->reply()) {
+					auto &writer = loader->writer();
+					writer.setSize(loader->size());
+					writer.setRangesSupported();
+					if (writer.splitToRanges()) {
+						const auto count = int(writer.ranges().size());
+						for (auto index = 0; index != count; ++index) {
+							if (!loader->rangeRequested(index)) {
+								sendRangeRequest(loader, index);
+							}
+						}
+					}
+				}
 				if (!handleReplyResult(loader, WebReplyProcessProgress)) {
-					_replies.erase(j);
-					_loaders.remove(loader);
-					delete loader;
-
-					reply->abort();
-					reply->deleteLater();
+					destroyLoader(loader);
+					return;
 				}
 			}
 		}
@@ -1544,11 +2046,7 @@ void WebLoadManager::process() {
 				it = _loaderPointers.end();
 			}
 			if (it == _loaderPointers.cend()) {
-				if (QNetworkReply *reply = (*i)->reply()) {
-					_replies.remove(reply);
-					reply->abort();
-					reply->deleteLater();
-				}
+				abortReplies(*i);
 				delete (*i);
 				i = _loaders.erase(i);
 			} else {
@@ -1573,14 +2071,43 @@ void WebLoadManager::sendRequest(webFileLoaderPrivate *loader, const QString &re
 		r->deleteLater();
 	}
 
-	QNetworkReply *r = loader->request(_manager, redirect);
+	watchReply(loader, loader->request(_manager, redirect));
+}
+
+void WebLoadManager::sendRangeRequest(
+		webFileLoaderPrivate *loader,
+		int index) {
+	watchReply(loader, loader->requestRange(_manager, index));
+}
 
+void WebLoadManager::watchReply(
+		webFileLoaderPrivate *loader,
+		QNetworkReply *reply) {
 	// Those use QObject::sender, so don't just remove the receiver pointer!
-	connect(r, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(onProgress(qint64, qint64)));
-	connect(r, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onFailed(QNetworkReply::NetworkError)));
-	connect(r, SIGNAL(metaDataChanged()), this, SLOT(onMeta()));
+	connect(reply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(onProgress(qint64, qint64)));
+	connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(onFailed(QNetworkReply::NetworkError)));
+	connect(reply, SIGNAL(metaDataChanged()), this, SLOT(onMeta()));
+
+	_replies.insert(reply, loader);
+}
+
+void WebLoadManager::abortReplies(webFileLoaderPrivate *loader) {
+	for (auto i = _replies.begin(); i != _replies.end();) {
+		if (i.value() == loader) {
+			const auto reply = i.key();
+			i = _replies.erase(i);
+			reply->abort();
+			reply->deleteLater();
+		} else {
+			++i;
+		}
+	}
+}
 
-	_replies.insert(r, loader);
+void WebLoadManager::destroyLoader(webFileLoaderPrivate *loader) {
+	abortReplies(loader);
+	_loaders.remove(loader);
+	delete loader;
 }
 
 void WebLoadManager::finish() {
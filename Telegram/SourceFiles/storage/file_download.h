@@ -10,7 +10,12 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "base/observer.h"
 #include "base/timer.h"
 #include "base/binary_guard.h"
+#include "base/flat_set.h"
+#include "base/weak_ptr.h"
 #include "data/data_file_origin.h"
+#include "storage/storage_file_sink.h"
+#include "storage/cache/storage_cache_types.h"
+#include "storage/storage_download_sessions.h"
 
 #include <QtNetwork/QNetworkReply>
 
@@ -21,9 +26,6 @@ class Session;
 } // namespace Main
 
 namespace Storage {
-namespace Cache {
-struct Key;
-} // namespace Cache
 
 // This value is used in local cache database settings!
 constexpr auto kMaxFileInMemory = 10 * 1024 * 1024; // 10 MB max file could be hold in memory
@@ -34,16 +36,54 @@ constexpr auto kMaxWallPaperInMemory = kMaxFileInMemory;
 constexpr auto kMaxAnimationInMemory = kMaxFileInMemory; // 10 MB gif and mp4 animations held in memory while playing
 constexpr auto kMaxWallPaperDimension = 4096; // 4096x4096 is max area.
 
-class Downloader final {
+// Loaders of a higher class are served before all loaders of a lower one,
+// inside a class the most recently prioritized loaders go first.
+enum class DownloadPriority : uchar {
+	Background, // Data::AutoDownload of the files saved to the disk.
+	Preload, // Data::AutoDownload of the media shown inline (to cache).
+	Visible, // Thumbnails and files requested by the user.
+	Viewer, // Everything loaded for the media viewer.
+};
+
+class Downloader final : public base::has_weak_ptr {
 public:
 	struct Queue {
 		Queue(int queriesLimit) : queriesLimit(queriesLimit) {
 		}
+
+		// Some of the queries are always left for the files that
+		// the user is looking at, background parts wait for them.
+		int limitFor(DownloadPriority priority) const {
+			return (priority == DownloadPriority::Background)
+				? std::max(queriesLimit - std::max(queriesLimit / 4, 1), 1)
+				: queriesLimit;
+		}
+
 		int queriesCount = 0;
 		int queriesLimit = 0;
 		FileLoader *start = nullptr;
 		FileLoader *end = nullptr;
 	};
+	class PriorityScope final {
+	public:
+		PriorityScope(
+			not_null<Downloader*> downloader,
+			DownloadPriority priority);
+		PriorityScope(const PriorityScope &other) = delete;
+		PriorityScope &operator=(const PriorityScope &other) = delete;
+		~PriorityScope();
+
+	private:
+		const not_null<Downloader*> _downloader;
+		const DownloadPriority _was;
+
+	};
+	struct DcStats {
+		MTP::DcId dcId = 0;
+		int queriesLimit = 0;
+		crl::time rtt = 0;
+		int64 bytesPerSecond = 0;
+	};
 
 	explicit Downloader(not_null<ApiWrap*> api);
 	~Downloader();
@@ -55,8 +95,15 @@ public:
 	int currentPriority() const {
 		return _priority;
 	}
+	DownloadPriority currentPriorityClass() const {
+		return _priorityClass;
+	}
 	void clearPriorities();
 
+	// The media viewer closed or switched to another item, so the files
+	// it requested before are served like the other visible ones.
+	void clearViewerPriorities();
+
 	base::Observable<void> &taskFinished() {
 		return _taskFinishedObservable;
 	}
@@ -64,21 +111,47 @@ public:
 	void requestedAmountIncrement(MTP::DcId dcId, int index, int amount);
 	int chooseDcIndexForRequest(MTP::DcId dcId) const;
 
+	// Answered part requests adapt the queries limit for the dc.
+	void requestFinished(
+		MTP::DcId dcId,
+		int index,
+		int amount,
+		crl::time duration);
+	[[nodiscard]] DcStats statsForDc(MTP::DcId dcId) const;
+	[[nodiscard]] rpl::producer<DcStats> stats() const;
+
 	not_null<Queue*> queueForDc(MTP::DcId dcId);
 	not_null<Queue*> queueForWeb();
 
+	// The ".part" files kept for resuming large downloads are listed
+	// in the cache, the ones left without a saved state (evicted from
+	// the cache or never saved before a crash) are removed on start.
+	void clearUnusedPartialFiles();
+	void registerPartialFile(
+		const QString &path,
+		const Storage::Cache::Key &key);
+	void unregisterPartialFile(const QString &path);
+
 private:
+	[[nodiscard]] DownloadSessions &sessionsForDc(MTP::DcId dcId);
+	[[nodiscard]] DcStats computeStats(
+		MTP::DcId dcId,
+		const DownloadSessions &sessions) const;
+
 	void killDownloadSessionsStart(MTP::DcId dcId);
 	void killDownloadSessionsStop(MTP::DcId dcId);
 	void killDownloadSessions();
 
+	void partialFilesLoaded(
+		base::flat_map<QString, Storage::Cache::Key> &&stored);
+	void partialFileChecked(const QString &path, bool saved);
+	void writePartialFiles();
+
 	not_null<ApiWrap*> _api;
 
 	base::Observable<void> _taskFinishedObservable;
 	int _priority = 1;
-
-	using RequestedInDc = std::array<int64, MTP::kDownloadSessionsCount>;
-	std::map<MTP::DcId, RequestedInDc> _requestedBytesAmount;
+	DownloadPriority _priorityClass = DownloadPriority::Visible;
 
 	base::flat_map<MTP::DcId, crl::time> _killDownloadSessionTimes;
 	base::Timer _killDownloadSessionsTimer;
@@ -86,6 +159,13 @@ private:
 	std::map<MTP::DcId, Queue> _queuesForDc;
 	Queue _queueForWeb;
 
+	base::flat_map<MTP::DcId, DownloadSessions> _sessions;
+	rpl::event_stream<DcStats> _stats;
+
+	base::flat_map<QString, Storage::Cache::Key> _partialFiles;
+	base::flat_set<QString> _partialFilesToCheck;
+	bool _partialFilesLoaded = false;
+
 };
 
 } // namespace Storage
@@ -173,6 +253,8 @@ signals:
 	void failed(FileLoader *loader, bool started);
 
 protected:
+	friend class Storage::Downloader;
+
 	using Queue = Storage::Downloader::Queue;
 
 	enum class LocalStatus {
@@ -181,21 +263,48 @@ protected:
 		Loading,
 		Loaded,
 	};
+	enum class PartialStatus {
+		NotTried,
+		Loading,
+		Done,
+	};
 
 	void readImage(const QSize &shrinkBox) const;
 
 	bool tryLoadLocal();
 	void loadLocal(const Storage::Cache::Key &key);
+
+	// Large files written right to the disk are first downloaded to
+	// a ".part" file, its written parts are kept in the cache database
+	// so that a download interrupted by the app closing is resumed later.
+	// A cancelled or failed download removes the file and the state.
+	[[nodiscard]] bool resumable() const;
+	[[nodiscard]] Storage::Cache::Key partialKey() const;
+	bool tryLoadPartial();
+	void partialLoaded(QByteArray &&value);
+	void savePartial();
+	void forgetPartial();
+	[[nodiscard]] bool keepsPartial() const;
+	[[nodiscard]] bool partLoadedAlready(int offset) const;
 	virtual Storage::Cache::Key cacheKey() const = 0;
 	virtual std::optional<MediaKey> fileLocationKey() const = 0;
 	virtual void cancelRequests() = 0;
 
+	// Loaders writing the file on their own thread don't use the sink.
+	virtual bool writesFileDirectly() const {
+		return false;
+	}
+
 	void startLoading();
+	[[nodiscard]] Storage::DownloadPriority computePriorityClass() const;
+	[[nodiscard]] bool servedBefore(not_null<const FileLoader*> other) const;
+	void insertToQueue();
 	void removeFromQueue();
 	void cancel(bool failed);
 
 	void notifyAboutProgress();
 	static void LoadNextFromQueue(not_null<Queue*> queue);
+	static void ClearViewerPriority(not_null<Queue*> queue);
 	virtual bool loadPart() = 0;
 
 	bool writeResultPart(int offset, bytes::const_span buffer);
@@ -206,6 +315,7 @@ protected:
 	FileLoader *_prev = nullptr;
 	FileLoader *_next = nullptr;
 	int _priority = 0;
+	Storage::DownloadPriority _priorityClass = Storage::DownloadPriority();
 	Queue *_queue = nullptr;
 
 	bool _autoLoading = false;
@@ -216,8 +326,7 @@ protected:
 	mutable LocalStatus _localStatus = LocalStatus::NotTried;
 
 	QString _filename;
-	QFile _file;
-	bool _fileIsOpen = false;
+	Storage::FileSink _sink;
 
 	LoadToCacheSetting _toCache;
 	LoadFromCloudSetting _fromCloud;
@@ -229,6 +338,9 @@ protected:
 	LocationType _locationType = LocationType();
 
 	base::binary_guard _localLoading;
+	base::binary_guard _partialLoading;
+	PartialStatus _partialStatus = PartialStatus::NotTried;
+	crl::time _partialSavedAt = 0;
 	mutable QByteArray _imageFormat;
 	mutable QImage _imageData;
 
@@ -280,6 +392,7 @@ private:
 		MTP::DcId dcId = 0;
 		int dcIndex = 0;
 		int offset = 0;
+		crl::time sent = 0;
 	};
 	struct CdnFileHash {
 		CdnFileHash(int limit, QByteArray hash) : limit(limit), hash(hash) {
@@ -296,6 +409,7 @@ private:
 	void makeRequest(int offset);
 
 	bool loadPart() override;
+	void skipLoadedParts();
 	void normalPartLoaded(const MTPupload_File &result, mtpRequestId requestId);
 	void webPartLoaded(const MTPupload_WebFile &result, mtpRequestId requestId);
 	void cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId requestId);
@@ -312,7 +426,14 @@ private:
 
 	mtpRequestId sendRequest(const RequestData &requestData);
 	void placeSentRequest(mtpRequestId requestId, const RequestData &requestData);
-	int finishSentRequestGetOffset(mtpRequestId requestId);
+	enum class FinishRequestReason {
+		Success,
+		Redirect,
+		Cancel,
+	};
+	int finishSentRequestGetOffset(
+		mtpRequestId requestId,
+		FinishRequestReason reason);
 	void switchToCDN(int offset, const MTPDupload_fileCdnRedirect &redirect);
 	void addCdnHashes(const QVector<MTPFileHash> &hashes);
 	void changeCDNParams(int offset, MTP::DcId dcId, const QByteArray &token, const QByteArray &encryptionKey, const QByteArray &encryptionIV, const QVector<MTPFileHash> &hashes);
@@ -353,6 +474,7 @@ public:
 	webFileLoader(
 		const QString &url,
 		const QString &to,
+		LoadToCacheSetting toCache,
 		LoadFromCloudSetting fromCloud,
 		bool autoLoading,
 		uint8 cacheTag);
@@ -373,6 +495,7 @@ protected:
 	void cancelRequests() override;
 	Storage::Cache::Key cacheKey() const override;
 	std::optional<MediaKey> fileLocationKey() const override;
+	bool writesFileDirectly() const override;
 	bool loadPart() override;
 
 	QString _url;
@@ -397,7 +520,11 @@ class WebLoadManager : public QObject {
 public:
 	WebLoadManager(QThread *thread);
 
-	void append(webFileLoader *loader, const QString &url);
+	// With a non empty path the file is streamed right to the disk.
+	void append(
+		webFileLoader *loader,
+		const QString &url,
+		const QString &path);
 	void stop(webFileLoader *reader);
 	bool carries(webFileLoader *reader) const;
 
@@ -422,7 +549,19 @@ public slots:
 private:
 	void clear();
 	void sendRequest(webFileLoaderPrivate *loader, const QString &redirect = QString());
+	void sendRangeRequest(
+		webFileLoaderPrivate *loader,
+		int index);
+	void watchReply(webFileLoaderPrivate *loader, QNetworkReply *reply);
+	void abortReplies(webFileLoaderPrivate *loader);
+	void destroyLoader(webFileLoaderPrivate *loader);
 	bool handleReplyResult(webFileLoaderPrivate *loader, WebReplyProcessResult result);
+	WebReplyProcessResult processStreamed(
+		webFileLoaderPrivate *loader,
+		QNetworkReply *reply,
+		int status,
+		qint64 already,
+		qint64 size);
 
 	QNetworkAccessManager _manager;
 	typedef QMap<webFileLoader*, webFileLoaderPrivate*> LoaderPointers;
@@ -13,14 +13,15 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "data/data_document.h"
 #include "data/data_photo.h"
 #include "data/data_session.h"
+#include "storage/storage_uploaded_index.h"
 #include "main/main_session.h"
+#include "base/weak_ptr.h"
+
+#include <crl/crl_object_on_queue.h>
 
 namespace Storage {
 namespace {
 
-// max 512kb uploaded at the same time in each session
-constexpr auto kMaxUploadFileParallelSize = MTP::kUploadSessionsCount * 512 * 1024;
-
 constexpr auto kDocumentMaxPartsCount = 3000;
 
 // 32kb for tiny document ( < 1mb )
@@ -44,6 +45,180 @@ constexpr auto kUploadRequestInterval = crl::time(500);
 // How much time without upload causes additional session kill.
 constexpr auto kKillSessionTimeout = crl::time(5000);
 
+// Document parts are read from disk ahead of sending, up to 2 MB.
+constexpr auto kReadAheadSize = 2 * 1024 * 1024;
+constexpr auto kReadAheadPartsMin = 2;
+
+// Reads the document parts and computes md5 on a background queue,
+// so that the main thread never waits for the disk.
+class PartsReader final : public base::has_weak_ptr {
+public:
+	PartsReader(
+		const QString &path,
+		int partSize,
+		int partsCount,
+		bool computeMd5,
+		Fn<void()> ready);
+
+	[[nodiscard]] bool failed() const;
+	[[nodiscard]] std::optional<QByteArray> take();
+
+	// Hex md5 of the whole file, available when the last part was read.
+	[[nodiscard]] QByteArray md5() const;
+
+private:
+	class Worker;
+
+	void readMore();
+	void partRead(QByteArray &&bytes, QByteArray &&md5);
+
+	crl::object_on_queue<Worker> _worker;
+	const Fn<void()> _ready;
+	const int _partsCount = 0;
+	const int _readAheadParts = 0;
+	std::deque<QByteArray> _parts;
+	int _partsRequested = 0;
+	int _partsReading = 0;
+	QByteArray _md5;
+	bool _failed = false;
+
+};
+
+class PartsReader::Worker final {
+public:
+	Worker(
+		crl::weak_on_queue<Worker> weak,
+		const QString &path,
+		int partSize,
+		int partsCount,
+		bool computeMd5,
+		base::weak_ptr<PartsReader> owner);
+
+	void read();
+
+private:
+	[[nodiscard]] QByteArray readPart();
+
+	QFile _file;
+	const int _partSize = 0;
+	const int _partsCount = 0;
+	const bool _computeMd5 = false;
+	const base::weak_ptr<PartsReader> _owner;
+	HashMd5 _md5Hash;
+	int _partsRead = 0;
+	bool _failed = false;
+
+};
+
+PartsReader::Worker::Worker(
+	crl::weak_on_queue<Worker> weak,
+	const QString &path,
+	int partSize,
+	int partsCount,
+	bool computeMd5,
+	base::weak_ptr<PartsReader> owner)
+: _file(path)
+, _partSize(partSize)
+, _partsCount(partsCount)
+, _computeMd5(computeMd5)
+, _owner(owner) {
+}
+
+void PartsReader::Worker::read() {
+	auto bytes = readPart();
+	auto md5 = QByteArray();
+	if (bytes.isEmpty()) {
+		_failed = true;
+	} else if (_computeMd5) {
+		_md5Hash.feed(bytes.constData(), bytes.size());
+		if (_partsRead == _partsCount) {
+			md5 = QByteArray(32, Qt::Uninitialized);
+			hashMd5Hex(_md5Hash.result(), md5.data());
+		}
+	}
+	crl::on_main(_owner, [
+		owner = _owner,
+		bytes = std::move(bytes),
+		md5 = std::move(md5)
+	]() mutable {
+		owner.get()->partRead(std::move(bytes), std::move(md5));
+	});
+}
+
+QByteArray PartsReader::Worker::readPart() {
+	if (_failed || _partsRead == _partsCount) {
+		return QByteArray();
+	} else if (!_file.isOpen() && !_file.open(QIODevice::ReadOnly)) {
+		return QByteArray();
+	}
+	auto result = _file.read(_partSize);
+	const auto last = (++_partsRead == _partsCount);
+	const auto good = (result.size() == _partSize)
+		|| (last && !result.isEmpty() && result.size() < _partSize);
+	if (!good) {
+		return QByteArray();
+	} else if (last) {
+		_file.close();
+	}
+	return result;
+}
+
+PartsReader::PartsReader(
+	const QString &path,
+	int partSize,
+	int partsCount,
+	bool computeMd5,
+	Fn<void()> ready)
+: _worker(path, partSize, partsCount, computeMd5, base::make_weak(this))
+, _ready(std::move(ready))
+, _partsCount(partsCount)
+, _readAheadParts(std::max(kReadAheadSize / partSize, kReadAheadPartsMin)) {
+	readMore();
+}
+
+bool PartsReader::failed() const {
+	return _failed;
+}
+
+std::optional<QByteArray> PartsReader::take() {
+	if (_parts.empty()) {
+		return std::nullopt;
+	}
+	auto result = std::move(_parts.front());
+	_parts.pop_front();
+	readMore();
+	return result;
+}
+
+QByteArray PartsReader::md5() const {
+	return _md5;
+}
+
+void PartsReader::readMore() {
+	while (!_failed
+		&& _partsRequested < _partsCount
+		&& _partsReading + int(_parts.size()) < _readAheadParts) {
+		++_partsRequested;
+		++_partsReading;
+		_worker.with([](Worker &worker) {
+			worker.read();
+		});
+	}
+}
+
+void PartsReader::partRead(QByteArray &&bytes, QByteArray &&md5) {
+	--_partsReading;
+	if (bytes.isEmpty()) {
+		_failed = true;
+	} else {
+		_parts.push_back(std::move(bytes));
+		if (!md5.isEmpty()) {
+			_md5 = std::move(md5);
+		}
+	}
+	_ready();
+}
+
 } // namespace
 
 struct Uploader::File {
@@ -52,6 +227,7 @@ struct Uploader::File {
 
 	void setDocSize(int32 size);
 	bool setPartSize(uint32 partSize);
+	void adaptPartSize(const UploadSessions &sessions);
 
 	std::shared_ptr<FileLoadResult> file;
 	SendMediaReady media;
@@ -65,7 +241,7 @@ struct Uploader::File {
 
 	HashMd5 md5Hash;
 
-	std::unique_ptr<QFile> docFile;
+	std::unique_ptr<PartsReader> docReader;
 	int32 docSentParts = 0;
 	int32 docSize = 0;
 	int32 docPartSize = 0;
@@ -117,6 +293,19 @@ void Uploader::File::setDocSize(int32 size) {
 	}
 }
 
+void Uploader::File::adaptPartSize(const UploadSessions &sessions) {
+	Expects(docSentParts == 0);
+
+	const auto partSize = sessions.choosePartSize(
+		docPartSize,
+		kDocumentUploadPartSize4,
+		docSize);
+	if (partSize != docPartSize) {
+		// Larger part size only decreases the parts count.
+		setPartSize(partSize);
+	}
+}
+
 bool Uploader::File::setPartSize(uint32 partSize) {
 	docPartSize = partSize;
 	docPartsCount = (docSize / docPartSize)
@@ -141,7 +330,8 @@ const QString &Uploader::File::filename() const {
 }
 
 Uploader::Uploader(not_null<ApiWrap*> api)
-: _api(api) {
+: _api(api)
+, _sessions(MTP::kUploadSessionsCount) {
 	nextTimer.setSingleShot(true);
 	connect(&nextTimer, SIGNAL(timeout()), this, SLOT(sendNext()));
 	stopSessionsTimer.setSingleShot(true);
@@ -206,11 +396,70 @@ void Uploader::upload(
 		if (!file->filepath.isEmpty()) {
 			document->setLocation(FileLocation(file->filepath));
 		}
+		if (file->uploadedIndexKey) {
+			Auth().data().uploadedIndex().expect(
+				document,
+				*file->uploadedIndexKey);
+		}
+	}
+	if (file->uploadedIndexKey && !file->edit) {
+		findExisting(msgId, file);
+		return;
 	}
 	queue.emplace(msgId, File(file));
 	sendNext();
 }
 
+void Uploader::findExisting(
+		const FullMsgId &msgId,
+		const std::shared_ptr<FileLoadResult> &file) {
+	clearSentExisting();
+
+	_findingExisting.emplace(msgId, file);
+	Auth().data().uploadedIndex().find(
+		*file->uploadedIndexKey,
+		crl::guard(this, [=](std::optional<MTPInputDocument> document) {
+			existingFound(msgId, std::move(document));
+		}));
+}
+
+void Uploader::existingFound(
+		const FullMsgId &msgId,
+		std::optional<MTPInputDocument> document) {
+	auto file = _findingExisting.take(msgId);
+	if (!file) {
+		return;
+	} else if (!document) {
+		queue.emplace(msgId, File(*file));
+		sendNext();
+		return;
+	}
+	_sendingExisting.emplace(msgId, *file);
+	_documentExisting.fire({ msgId, (*file)->to.options, *document });
+}
+
+void Uploader::existingFailed(const FullMsgId &msgId) {
+	auto file = _sendingExisting.take(msgId);
+	if (!file) {
+		return;
+	}
+	Auth().data().uploadedIndex().forget(*(*file)->uploadedIndexKey);
+	queue.emplace(msgId, File(*file));
+	sendNext();
+}
+
+void Uploader::clearSentExisting() {
+	// The local message gets the server id when it is sent,
+	// after that the file won't be required for the upload fallback.
+	for (auto i = begin(_sendingExisting); i != end(_sendingExisting);) {
+		if (Auth().data().message(i->first)) {
+			++i;
+		} else {
+			i = _sendingExisting.erase(i);
+		}
+	}
+}
+
 void Uploader::currentFailed() {
 	auto j = queue.find(uploadingId);
 	if (j != queue.end()) {
@@ -236,10 +485,7 @@ void Uploader::currentFailed() {
 	docRequestsSent.clear();
 	dcMap.clear();
 	uploadingId = FullMsgId();
-	sentSize = 0;
-	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
-		sentSizes[i] = 0;
-	}
+	_sessions.clear();
 
 	sendNext();
 }
@@ -251,7 +497,7 @@ void Uploader::stopSessions() {
 }
 
 void Uploader::sendNext() {
-	if (sentSize >= kMaxUploadFileParallelSize || _pausedId.msg) return;
+	if (_sessions.full() || _pausedId.msg) return;
 
 	bool stopping = stopSessionsTimer.isActive();
 	if (queue.empty()) {
@@ -274,12 +520,7 @@ void Uploader::sendNext() {
 	}
 	auto &uploadingData = i->second;
 
-	auto todc = 0;
-	for (auto dc = 1; dc != MTP::kUploadSessionsCount; ++dc) {
-		if (sentSizes[dc] < sentSizes[todc]) {
-			todc = dc;
-		}
-	}
+	const auto todc = _sessions.chooseIndex();
 
 	auto &parts = uploadingData.file
 		? ((uploadingData.type() == SendMediaType::Photo
@@ -321,8 +562,15 @@ void Uploader::sendNext() {
 				} else if (uploadingData.type() == SendMediaType::File
 					|| uploadingData.type() == SendMediaType::ThemeFile
 					|| uploadingData.type() == SendMediaType::Audio) {
-					QByteArray docMd5(32, Qt::Uninitialized);
-					hashMd5Hex(uploadingData.md5Hash.result(), docMd5.data());
+					auto docMd5 = QByteArray();
+					if (uploadingData.docReader) {
+						docMd5 = uploadingData.docReader->md5();
+					} else {
+						docMd5 = QByteArray(32, Qt::Uninitialized);
+						hashMd5Hex(
+							uploadingData.md5Hash.result(),
+							docMd5.data());
+					}
 
 					const auto file = (uploadingData.docSize > kUseBigFilesFrom)
 						? MTP_inputFileBig(
@@ -375,22 +623,32 @@ void Uploader::sendNext() {
 		auto &content = uploadingData.file
 			? uploadingData.file->content
 			: uploadingData.media.data;
+		if (!uploadingData.docSentParts && !uploadingData.docReader) {
+			uploadingData.adaptPartSize(_sessions);
+		}
 		QByteArray toSend;
 		if (content.isEmpty()) {
-			if (!uploadingData.docFile) {
+			if (!uploadingData.docReader) {
 				const auto filepath = uploadingData.file
 					? uploadingData.file->filepath
 					: uploadingData.media.file;
-				uploadingData.docFile = std::make_unique<QFile>(filepath);
-				if (!uploadingData.docFile->open(QIODevice::ReadOnly)) {
-					currentFailed();
-					return;
-				}
+				uploadingData.docReader = std::make_unique<PartsReader>(
+					filepath,
+					uploadingData.docPartSize,
+					uploadingData.docPartsCount,
+					(uploadingData.docSize <= kUseBigFilesFrom),
+					[=] { sendNext(); });
 			}
-			toSend = uploadingData.docFile->read(uploadingData.docPartSize);
-			if (uploadingData.docSize <= kUseBigFilesFrom) {
-				uploadingData.md5Hash.feed(toSend.constData(), toSend.size());
+			if (uploadingData.docReader->failed()) {
+				currentFailed();
+				return;
+			}
+			auto part = uploadingData.docReader->take();
+			if (!part) {
+				// We'll get here again when the next part is read.
+				return;
 			}
+			toSend = std::move(*part);
 		} else {
 			const auto offset = uploadingData.docSentParts
 				* uploadingData.docPartSize;
@@ -431,8 +689,7 @@ void Uploader::sendNext() {
 		}
 		docRequestsSent.emplace(requestId, uploadingData.docSentParts);
 		dcMap.emplace(requestId, todc);
-		sentSize += uploadingData.docPartSize;
-		sentSizes[todc] += uploadingData.docPartSize;
+		_sessions.partSent(todc, uploadingData.docPartSize);
 
 		uploadingData.docSentParts++;
 	} else {
@@ -448,8 +705,7 @@ void Uploader::sendNext() {
 			MTP::uploadDcId(todc));
 		requestsSent.emplace(requestId, part.value());
 		dcMap.emplace(requestId, todc);
-		sentSize += part.value().size();
-		sentSizes[todc] += part.value().size();
+		_sessions.partSent(todc, part.value().size());
 
 		parts.erase(part);
 	}
@@ -458,6 +714,8 @@ void Uploader::sendNext() {
 
 void Uploader::cancel(const FullMsgId &msgId) {
 	uploaded.erase(msgId);
+	_findingExisting.remove(msgId);
+	_sendingExisting.remove(msgId);
 	if (uploadingId == msgId) {
 		currentFailed();
 	} else {
@@ -480,6 +738,8 @@ void Uploader::confirm(const FullMsgId &msgId) {
 void Uploader::clear() {
 	uploaded.clear();
 	queue.clear();
+	_findingExisting.clear();
+	_sendingExisting.clear();
 	for (const auto &requestData : requestsSent) {
 		MTP::cancel(requestData.first);
 	}
@@ -489,10 +749,9 @@ void Uploader::clear() {
 	}
 	docRequestsSent.clear();
 	dcMap.clear();
-	sentSize = 0;
+	_sessions.clear();
 	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
 		MTP::stopSession(MTP::uploadDcId(i));
-		sentSizes[i] = 0;
 	}
 	stopSessionsTimer.stop();
 }
@@ -527,8 +786,7 @@ void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
 				sentPartSize = file.docPartSize;
 				docRequestsSent.erase(j);
 			}
-			sentSize -= sentPartSize;
-			sentSizes[dc] -= sentPartSize;
+			_sessions.partDone(dc, sentPartSize, crl::now());
 			if (file.type() == SendMediaType::Photo) {
 				file.fileSentSize += sentPartSize;
 				const auto photo = Auth().data().photo(file.id());
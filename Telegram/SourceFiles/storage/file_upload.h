@@ -8,6 +8,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #pragma once
 
 #include "api/api_common.h"
+#include "storage/storage_upload_sessions.h"
 
 #include <QtCore/QTimer>
 
@@ -42,6 +43,12 @@ struct UploadedThumbDocument {
 	bool edit = false;
 };
 
+struct UploadedExisting {
+	FullMsgId fullId;
+	Api::SendOptions options;
+	MTPInputDocument document;
+};
+
 struct UploadSecureProgress {
 	FullMsgId fullId;
 	int offset = 0;
@@ -70,6 +77,9 @@ public:
 	void pause(const FullMsgId &msgId);
 	void confirm(const FullMsgId &msgId);
 
+	// The server didn't accept the reference to the same file sent before.
+	void existingFailed(const FullMsgId &msgId);
+
 	void clear();
 
 	rpl::producer<UploadedPhoto> photoReady() const {
@@ -81,6 +91,9 @@ public:
 	rpl::producer<UploadedThumbDocument> thumbDocumentReady() const {
 		return _thumbDocumentReady.events();
 	}
+	rpl::producer<UploadedExisting> documentExisting() const {
+		return _documentExisting.events();
+	}
 	rpl::producer<UploadSecureDone> secureReady() const {
 		return _secureReady.events();
 	}
@@ -116,22 +129,36 @@ private:
 
 	void currentFailed();
 
+	void findExisting(
+		const FullMsgId &msgId,
+		const std::shared_ptr<FileLoadResult> &file);
+	void existingFound(
+		const FullMsgId &msgId,
+		std::optional<MTPInputDocument> document);
+	void clearSentExisting();
+
 	not_null<ApiWrap*> _api;
 	base::flat_map<mtpRequestId, QByteArray> requestsSent;
 	base::flat_map<mtpRequestId, int32> docRequestsSent;
 	base::flat_map<mtpRequestId, int32> dcMap;
-	uint32 sentSize = 0;
-	uint32 sentSizes[MTP::kUploadSessionsCount] = { 0 };
+	UploadSessions _sessions;
 
 	FullMsgId uploadingId;
 	FullMsgId _pausedId;
 	std::map<FullMsgId, File> queue;
 	std::map<FullMsgId, File> uploaded;
+	base::flat_map<
+		FullMsgId,
+		std::shared_ptr<FileLoadResult>> _findingExisting;
+	base::flat_map<
+		FullMsgId,
+		std::shared_ptr<FileLoadResult>> _sendingExisting;
 	QTimer nextTimer, stopSessionsTimer;
 
 	rpl::event_stream<UploadedPhoto> _photoReady;
 	rpl::event_stream<UploadedDocument> _documentReady;
 	rpl::event_stream<UploadedThumbDocument> _thumbDocumentReady;
+	rpl::event_stream<UploadedExisting> _documentExisting;
 	rpl::event_stream<UploadSecureDone> _secureReady;
 	rpl::event_stream<FullMsgId> _photoProgress;
 	rpl::event_stream<FullMsgId> _documentProgress;
@@ -22,6 +22,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "lang/lang_keys.h"
 #include "storage/file_download.h"
 #include "storage/storage_media_prepare.h"
+#include "storage/storage_image_scale.h"
+#include "storage/storage_uploaded_index.h"
 #include "window/themes/window_theme_preview.h"
 #include "mainwidget.h"
 #include "mainwindow.h"
@@ -46,9 +48,9 @@ struct PreparedFileThumbnail {
 	MTPPhotoSize mtpSize = MTP_photoSizeEmpty(MTP_string());
 };
 
-PreparedFileThumbnail PrepareFileThumbnail(QImage &&original) {
-	const auto width = original.width();
-	const auto height = original.height();
+PreparedFileThumbnail PrepareFileThumbnail(Storage::ImageMipChain &chain) {
+	const auto width = chain.originalSize().width();
+	const auto height = chain.originalSize().height();
 	if (!ValidateThumbDimensions(width, height)) {
 		return {};
 	}
@@ -66,12 +68,8 @@ PreparedFileThumbnail PrepareFileThumbnail(QImage &&original) {
 			: kThumbnailSize;
 	};
 	result.image = scaled
-		? original.scaled(
-			scaledWidth(),
-			scaledHeight(),
-			Qt::IgnoreAspectRatio,
-			Qt::SmoothTransformation)
-		: std::move(original);
+		? chain.scaled(QSize(scaledWidth(), scaledHeight()))
+		: chain.original();
 	result.mtpSize = MTP_photoSize(
 		MTP_string(),
 		MTP_fileLocationToBeDeprecated(MTP_long(0), MTP_int(0)),
@@ -81,6 +79,14 @@ PreparedFileThumbnail PrepareFileThumbnail(QImage &&original) {
 	return result;
 }
 
+PreparedFileThumbnail PrepareFileThumbnail(QImage &&original) {
+	if (original.isNull()) {
+		return {};
+	}
+	auto chain = Storage::ImageMipChain(std::move(original));
+	return PrepareFileThumbnail(chain);
+}
+
 bool FileThumbnailUploadRequired(const QString &filemime, int32 filesize) {
 	constexpr auto kThumbnailUploadBySize = 5 * 1024 * 1024;
 	const auto kThumbnailKnownMimes = {
@@ -191,12 +197,9 @@ SendMediaReady PreparePeerPhoto(PeerId peerId, QImage &&image) {
 	QBuffer jpegBuffer(&jpeg);
 	image.save(&jpegBuffer, "JPG", 87);
 
+	auto chain = Storage::ImageMipChain(image);
 	const auto scaled = [&](int size) {
-		return image.scaled(
-			size,
-			size,
-			Qt::KeepAspectRatio,
-			Qt::SmoothTransformation);
+		return chain.fitted(size);
 	};
 	const auto push = [&](const char *type, QImage &&image) {
 		photoSizes.push_back(MTP_photoSize(
@@ -241,154 +244,6 @@ SendMediaReady PreparePeerPhoto(PeerId peerId, QImage &&image) {
 		0);
 }
 
-TaskQueue::TaskQueue(crl::time stopTimeoutMs) {
-	if (stopTimeoutMs > 0) {
-		_stopTimer = new QTimer(this);
-		connect(_stopTimer, SIGNAL(timeout()), this, SLOT(stop()));
-		_stopTimer->setSingleShot(true);
-		_stopTimer->setInterval(int(stopTimeoutMs));
-	}
-}
-
-TaskId TaskQueue::addTask(std::unique_ptr<Task> &&task) {
-	const auto result = task->id();
-	{
-		QMutexLocker lock(&_tasksToProcessMutex);
-		_tasksToProcess.push_back(std::move(task));
-	}
-
-	wakeThread();
-
-	return result;
-}
-
-void TaskQueue::addTasks(std::vector<std::unique_ptr<Task>> &&tasks) {
-	{
-		QMutexLocker lock(&_tasksToProcessMutex);
-		for (auto &task : tasks) {
-			_tasksToProcess.push_back(std::move(task));
-		}
-	}
-
-	wakeThread();
-}
-
-void TaskQueue::wakeThread() {
-	if (!_thread) {
-		_thread = new QThread();
-
-		_worker = new TaskQueueWorker(this);
-		_worker->moveToThread(_thread);
-
-		connect(this, SIGNAL(taskAdded()), _worker, SLOT(onTaskAdded()));
-		connect(_worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
-
-		_thread->start();
-	}
-	if (_stopTimer) _stopTimer->stop();
-	emit taskAdded();
-}
-
-void TaskQueue::cancelTask(TaskId id) {
-	const auto removeFrom = [&](std::deque<std::unique_ptr<Task>> &queue) {
-		const auto proj = [](const std::unique_ptr<Task> &task) {
-			return task->id();
-		};
-		auto i = ranges::find(queue, id, proj);
-		if (i != queue.end()) {
-			queue.erase(i);
-		}
-	};
-	{
-		QMutexLocker lock(&_tasksToProcessMutex);
-		removeFrom(_tasksToProcess);
-		if (_taskInProcessId == id) {
-			_taskInProcessId = TaskId();
-		}
-	}
-	QMutexLocker lock(&_tasksToFinishMutex);
-	removeFrom(_tasksToFinish);
-}
-
-void TaskQueue::onTaskProcessed() {
-	do {
-		auto task = std::unique_ptr<Task>();
-		{
-			QMutexLocker lock(&_tasksToFinishMutex);
-			if (_tasksToFinish.empty()) break;
-			task = std::move(_tasksToFinish.front());
-			_tasksToFinish.pop_front();
-		}
-		task->finish();
-	} while (true);
-
-	if (_stopTimer) {
-		QMutexLocker lock(&_tasksToProcessMutex);
-		if (_tasksToProcess.empty() && !_taskInProcessId) {
-			_stopTimer->start();
-		}
-	}
-}
-
-void TaskQueue::stop() {
-	if (_thread) {
-		_thread->requestInterruption();
-		_thread->quit();
-		DEBUG_LOG(("Waiting for taskThread to finish"));
-		_thread->wait();
-		delete base::take(_worker);
-		delete base::take(_thread);
-	}
-	_tasksToProcess.clear();
-	_tasksToFinish.clear();
-	_taskInProcessId = TaskId();
-}
-
-TaskQueue::~TaskQueue() {
-	stop();
-	delete _stopTimer;
-}
-
-void TaskQueueWorker::onTaskAdded() {
-	if (_inTaskAdded) return;
-	_inTaskAdded = true;
-
-	bool someTasksLeft = false;
-	do {
-		auto task = std::unique_ptr<Task>();
-		{
-			QMutexLocker lock(&_queue->_tasksToProcessMutex);
-			if (!_queue->_tasksToProcess.empty()) {
-				task = std::move(_queue->_tasksToProcess.front());
-				_queue->_tasksToProcess.pop_front();
-				_queue->_taskInProcessId = task->id();
-			}
-		}
-
-		if (task) {
-			task->process();
-			bool emitTaskProcessed = false;
-			{
-				QMutexLocker lockToProcess(&_queue->_tasksToProcessMutex);
-				if (_queue->_taskInProcessId == task->id()) {
-					_queue->_taskInProcessId = TaskId();
-					someTasksLeft = !_queue->_tasksToProcess.empty();
-
-					QMutexLocker lockToFinish(&_queue->_tasksToFinishMutex);
-					emitTaskProcessed = _queue->_tasksToFinish.empty();
-					_queue->_tasksToFinish.push_back(std::move(task));
-				}
-			}
-			if (emitTaskProcessed) {
-				emit taskProcessed();
-			}
-		}
-		QCoreApplication::processEvents();
-	} while (someTasksLeft && !thread()->isInterruptionRequested());
-
-	_inTaskAdded = false;
-}
-
 SendingAlbum::SendingAlbum() : groupId(rand_value<uint64>()) {
 }
 
@@ -768,6 +623,8 @@ void FileLoadTask::process() {
 
 	if (!filesize || filesize > App::kFileSizeLimit) {
 		return;
+	} else if (cancelled()) {
+		return;
 	}
 
 	PreparedPhotoThumbs photoThumbs;
@@ -830,6 +687,9 @@ void FileLoadTask::process() {
 		auto w = fullimage.width(), h = fullimage.height();
 		attributes.push_back(MTP_documentAttributeImageSize(MTP_int(w), MTP_int(h)));
 
+		// All the thumbnails are scaled from the same halved copies.
+		auto chain = Storage::ImageMipChain(fullimage);
+
 		if (ValidateThumbDimensions(w, h)) {
 			isSticker = (filemime == stickerMime
 				|| filemime == animatedStickerMime)
@@ -854,18 +714,21 @@ void FileLoadTask::process() {
 			} else if (isAnimation) {
 				attributes.push_back(MTP_documentAttributeAnimated());
 			} else if (_type != SendMediaType::File) {
-				auto thumb = (w > 100 || h > 100) ? fullimage.scaled(100, 100, Qt::KeepAspectRatio, Qt::SmoothTransformation) : fullimage;
+				auto thumb = chain.fitted(100);
 				photoThumbs.emplace('s', thumb);
 				photoSizes.push_back(MTP_photoSize(MTP_string("s"), MTP_fileLocationToBeDeprecated(MTP_long(0), MTP_int(0)), MTP_int(thumb.width()), MTP_int(thumb.height()), MTP_int(0)));
 
-				auto medium = (w > 320 || h > 320) ? fullimage.scaled(320, 320, Qt::KeepAspectRatio, Qt::SmoothTransformation) : fullimage;
+				auto medium = chain.fitted(320);
 				photoThumbs.emplace('m', medium);
 				photoSizes.push_back(MTP_photoSize(MTP_string("m"), MTP_fileLocationToBeDeprecated(MTP_long(0), MTP_int(0)), MTP_int(medium.width()), MTP_int(medium.height()), MTP_int(0)));
 
-				auto full = (w > 1280 || h > 1280) ? fullimage.scaled(1280, 1280, Qt::KeepAspectRatio, Qt::SmoothTransformation) : fullimage;
+				auto full = chain.fitted(1280);
 				photoThumbs.emplace('y', full);
 				photoSizes.push_back(MTP_photoSize(MTP_string("y"), MTP_fileLocationToBeDeprecated(MTP_long(0), MTP_int(0)), MTP_int(full.width()), MTP_int(full.height()), MTP_int(0)));
 
+				if (cancelled()) {
+					return;
+				}
 				{
 					QBuffer buffer(&filedata);
 					full.save(&buffer, "JPG", 87);
@@ -884,7 +747,7 @@ void FileLoadTask::process() {
 					filesize = _result->filesize = filedata.size();
 				}
 			}
-			thumbnail = PrepareFileThumbnail(std::move(fullimage));
+			thumbnail = PrepareFileThumbnail(chain);
 		}
 	}
 	thumbnail = FinalizeFileThumbnail(
@@ -927,6 +790,23 @@ void FileLoadTask::process() {
 		_type = SendMediaType::File;
 	}
 
+	// Hashing the file parts is the last expensive step.
+	if (cancelled()) {
+		return;
+	}
+
+	if (_type == SendMediaType::File
+		&& info.exists()
+		&& !_album
+		&& !_msgIdToEdit) {
+		_result->uploadedIndexKey = Storage::ComputeUploadedFileKey(
+			info,
+			[=] { return cancelled(); });
+		if (cancelled()) {
+			return;
+		}
+	}
+
 	_result->type = _type;
 	_result->filepath = _filepath;
 	_result->content = _content;
@@ -9,6 +9,8 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "base/variant.h"
 #include "api/api_common.h"
+#include "storage/cache/storage_cache_types.h"
+#include "storage/storage_task_queue.h"
 
 enum class CompressConfirm {
 	Auto,
@@ -86,74 +88,6 @@ struct SendMediaReady {
 
 SendMediaReady PreparePeerPhoto(PeerId peerId, QImage &&image);
 
-using TaskId = void*; // no interface, just id
-
-class Task {
-public:
-	virtual void process() = 0; // is executed in a separate thread
-	virtual void finish() = 0; // is executed in the same as TaskQueue thread
-	virtual ~Task() = default;
-
-	TaskId id() const {
-		return static_cast<TaskId>(const_cast<Task*>(this));
-	}
-
-};
-
-class TaskQueueWorker;
-class TaskQueue : public QObject {
-	Q_OBJECT
-
-public:
-	explicit TaskQueue(crl::time stopTimeoutMs = 0); // <= 0 - never stop worker
-
-	TaskId addTask(std::unique_ptr<Task> &&task);
-	void addTasks(std::vector<std::unique_ptr<Task>> &&tasks);
-	void cancelTask(TaskId id); // this task finish() won't be called
-
-	~TaskQueue();
-
-signals:
-	void taskAdded();
-
-public slots:
-	void onTaskProcessed();
-	void stop();
-
-private:
-	friend class TaskQueueWorker;
-
-	void wakeThread();
-
-	std::deque<std::unique_ptr<Task>> _tasksToProcess;
-	std::deque<std::unique_ptr<Task>> _tasksToFinish;
-	TaskId _taskInProcessId = TaskId();
-	QMutex _tasksToProcessMutex, _tasksToFinishMutex;
-	QThread *_thread = nullptr;
-	TaskQueueWorker *_worker = nullptr;
-	QTimer *_stopTimer = nullptr;
-
-};
-
-class TaskQueueWorker : public QObject {
-	Q_OBJECT
-
-public:
-	TaskQueueWorker(TaskQueue *queue) : _queue(queue) {
-	}
-
-signals:
-	void taskProcessed();
-
-public slots:
-	void onTaskAdded();
-
-private:
-	TaskQueue *_queue;
-	bool _inTaskAdded = false;
-
-};
-
 struct SendingAlbum {
 	struct Item {
 		explicit Item(TaskId taskId) : taskId(taskId) {
@@ -214,6 +148,9 @@ struct FileLoadResult {
 	QByteArray filemd5;
 	int32 partssize;
 
+	// Set for local files that can be sent without an upload next time.
+	std::optional<Storage::Cache::Key> uploadedIndexKey;
+
 	uint64 thumbId = 0; // id is always file-id of media, thumbId is file-id of thumb ( == id for photos)
 	QString thumbname;
 	UploadFileParts thumbparts;
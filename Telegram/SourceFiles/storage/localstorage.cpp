@@ -55,6 +55,16 @@ constexpr auto kFileLoaderQueueStopTimeout = crl::time(5000);
 constexpr auto kDefaultStickerInstallDate = TimeId(1);
 constexpr auto kProxyTypeShift = 1024;
 constexpr auto kWriteMapTimeout = crl::time(1000);
+constexpr auto kCacheShardsCount = 4;
+
+// The small files cache got a new folder when it was split to shards,
+// because the values put before are looked up in the other shards now.
+// The unsharded cache is not migrated, its folder is just removed.
+constexpr auto kCacheFolder = "cache_v1";
+constexpr auto kLegacyCacheFolder = "cache";
+constexpr auto kCacheMappedPlacesLimit = 16;
+constexpr auto kCacheHotSizeLimit = 16 * 1024 * 1024;
+constexpr auto kCacheCompactBytesPerSecond = 4 * 1024 * 1024;
 constexpr auto kSavedBackgroundFormat = QImage::Format_ARGB32_Premultiplied;
 
 constexpr auto kWallPaperLegacySerializeTagId = int32(-111);
@@ -2873,6 +2883,12 @@ base::flat_set<QString> CollectGoodNames() {
 	return result;
 }
 
+void ClearLegacyCache() {
+	crl::async([path = _userDbPath + kLegacyCacheFolder] {
+		QDir(path).removeRecursively();
+	});
+}
+
 void FilterLegacyFiles(FnMut<void(base::flat_set<QString>&&)> then) {
 	crl::on_main([then = std::move(then)]() mutable {
 		then(CollectGoodNames());
@@ -2887,6 +2903,7 @@ ReadMapState readMap(const QByteArray &pass) {
 	}
 	if (result != ReadMapPassNeeded) {
 		Storage::ClearLegacyFiles(_userBasePath, FilterLegacyFiles);
+		ClearLegacyCache();
 	}
 	return result;
 }
@@ -3175,7 +3192,7 @@ Storage::EncryptionKey cacheBigFileKey() {
 QString cachePath() {
 	Expects(!_userDbPath.isEmpty());
 
-	return _userDbPath + "cache";
+	return _userDbPath + kCacheFolder;
 }
 
 Storage::Cache::Database::Settings cacheSettings() {
@@ -3184,6 +3201,10 @@ Storage::Cache::Database::Settings cacheSettings() {
 	result.totalSizeLimit = _cacheTotalSizeLimit;
 	result.totalTimeLimit = _cacheTotalTimeLimit;
 	result.maxDataSize = Storage::kMaxFileInMemory;
+	result.shardsCount = kCacheShardsCount;
+	result.mappedPlacesLimit = kCacheMappedPlacesLimit;
+	result.hotCacheSizeLimit = kCacheHotSizeLimit;
+	result.compactBytesPerSecond = kCacheCompactBytesPerSecond;
 	return result;
 }
 
@@ -3220,6 +3241,7 @@ Storage::Cache::Database::Settings cacheBigFileSettings() {
 	result.totalSizeLimit = _cacheBigFileTotalSizeLimit;
 	result.totalTimeLimit = _cacheBigFileTotalTimeLimit;
 	result.maxDataSize = Storage::kMaxFileInMemory;
+	result.compactBytesPerSecond = kCacheCompactBytesPerSecond;
 	return result;
 }
 
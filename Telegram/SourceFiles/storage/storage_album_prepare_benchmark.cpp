@@ -0,0 +1,149 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_image_scale.h"
+#include "storage/storage_task_queue.h"
+#include "core/benchmark_helpers.h"
+#include <QtCore/QBuffer>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QEventLoop>
+#include <QtGui/QImageWriter>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr auto kAlbumSize = 10;
+
+// The same limit as the sending TaskQueue in ApiWrap has.
+constexpr auto kMaxWorkers = 4;
+
+QImage GenerateImage(int width, int height, int seed) {
+	auto result = QImage(width, height, QImage::Format_RGB32);
+	for (auto y = 0; y != height; ++y) {
+		const auto line = reinterpret_cast<uint32*>(result.scanLine(y));
+		for (auto x = 0; x != width; ++x) {
+			line[x] = 0xFF000000U
+				| uint32(x * 7 + y * 13 + seed) * 2654435761U;
+		}
+	}
+	return result;
+}
+
+// The work FileLoadTask::process() does for each photo of an album:
+// three thumbnails from one mip chain and the full size encoding.
+int PreparePhoto(const QImage &original, const char *format) {
+	auto chain = Storage::ImageMipChain(original);
+	auto result = chain.fitted(100).width() + chain.fitted(320).width();
+	const auto full = chain.fitted(1280);
+	auto filedata = QByteArray();
+	{
+		QBuffer buffer(&filedata);
+		full.save(&buffer, format, 87);
+	}
+	return result + filedata.size();
+}
+
+// Does the work of FileLoadTask for one photo of an album.
+class PreparePhotoTask final : public Task {
+public:
+	PreparePhotoTask(
+		const QImage &original,
+		const char *format,
+		std::function<void(int)> done)
+	: _original(original)
+	, _format(format)
+	, _done(std::move(done)) {
+	}
+
+	void process() override {
+		_result = PreparePhoto(_original, _format);
+	}
+	void finish() override {
+		_done(_result);
+	}
+
+private:
+	QImage _original;
+	const char *_format = nullptr;
+	std::function<void(int)> _done;
+	int _result = 0;
+
+};
+
+void EnsureApplication() {
+	if (!QCoreApplication::instance()) {
+		static auto argc = 0;
+		static QCoreApplication application(argc, nullptr);
+	}
+}
+
+// The album is added to a TaskQueue the way ApiWrap sends it and the
+// time is measured till the last finish() on this thread.
+double PrepareAlbum(
+		const std::vector<QImage> &album,
+		const char *format,
+		int workersCount) {
+	QEventLoop loop;
+	auto prepared = 0;
+	auto finished = 0;
+	const auto done = [&](int result) {
+		if (result > 0) {
+			++prepared;
+		}
+		if (++finished == int(album.size())) {
+			loop.quit();
+		}
+	};
+	TaskQueue queue(0, workersCount);
+	const auto result = Core::MeasureMilliseconds([&] {
+		auto tasks = std::vector<std::unique_ptr<Task>>();
+		for (const auto &image : album) {
+			tasks.push_back(
+				std::make_unique<PreparePhotoTask>(image, format, done));
+		}
+		queue.addTasks(std::move(tasks));
+		loop.exec();
+	});
+	REQUIRE(prepared == int(album.size()));
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("benchmark album photos preparing", "[storage_album_prepare]") {
+	EnsureApplication();
+
+	const auto format = QImageWriter::supportedImageFormats().contains("jpg")
+		? "JPG"
+		: "PNG";
+	const auto workers = std::clamp(
+		int(std::thread::hardware_concurrency()) - 1,
+		1,
+		kMaxWorkers);
+
+	auto album = std::vector<QImage>();
+	for (auto i = 0; i != kAlbumSize; ++i) {
+		album.push_back(GenerateImage(4000, 3000, i));
+	}
+	const auto single = PrepareAlbum(album, format, 1);
+	const auto several = PrepareAlbum(album, format, workers);
+	WARN(kAlbumSize
+		<< " photos of 12 MP to "
+		<< format
+		<< ": one worker "
+		<< int(single)
+		<< " ms, "
+		<< workers
+		<< " workers "
+		<< int(several)
+		<< " ms");
+}
@@ -0,0 +1,70 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_download_sessions.h"
+
+namespace Storage {
+
+DownloadSessions::DownloadSessions(int count, crl::time now)
+: _sessions(count)
+, _window(now) {
+	Expects(count > 0);
+}
+
+int DownloadSessions::chooseIndex(int amount) const {
+	// Estimate the answer time by the already requested amount and
+	// the session rtt, the sessions without answers use the dc one.
+	const auto fallbackRtt = std::max(_window.rtt(), crl::time(1));
+	const auto estimate = [&](const Session &session) {
+		const auto rtt = session.rtt ? session.rtt : fallbackRtt;
+		return (session.requested + amount) * rtt;
+	};
+	auto result = 0;
+	auto best = estimate(_sessions.front());
+	for (auto i = 1, count = int(_sessions.size()); i != count; ++i) {
+		const auto value = estimate(_sessions[i]);
+		if (value < best) {
+			best = value;
+			result = i;
+		}
+	}
+	return result;
+}
+
+bool DownloadSessions::requestedAmountIncrement(int index, int amount) {
+	Expects(index >= 0 && index < int(_sessions.size()));
+
+	_sessions[index].requested += amount;
+	return ranges::none_of(_sessions, [](const Session &session) {
+		return session.requested > 0;
+	});
+}
+
+bool DownloadSessions::requestFinished(
+		int index,
+		int amount,
+		crl::time duration,
+		crl::time now) {
+	Expects(index >= 0 && index < int(_sessions.size()));
+
+	const auto rtt = std::max(duration, crl::time(1));
+	auto &sessionRtt = _sessions[index].rtt;
+	sessionRtt = sessionRtt ? ((sessionRtt * 7 + rtt) / 8) : rtt;
+	return _window.requestFinished(rtt, amount, now);
+}
+
+const DownloadWindow &DownloadSessions::window() const {
+	return _window;
+}
+
+int64 DownloadSessions::requestedAmount(int index) const {
+	Expects(index >= 0 && index < int(_sessions.size()));
+
+	return _sessions[index].requested;
+}
+
+} // namespace Storage
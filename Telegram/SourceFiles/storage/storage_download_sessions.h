@@ -0,0 +1,49 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "storage/storage_download_window.h"
+
+#include <vector>
+
+namespace Storage {
+
+// Part requests of all the loaders to one dc, spread over its download
+// sessions. A new request is sent to the session that is expected to
+// answer it first and the requests count is limited by the window.
+class DownloadSessions final {
+public:
+	DownloadSessions(int count, crl::time now);
+
+	[[nodiscard]] int chooseIndex(int amount) const;
+
+	// Returns true if nothing is requested in any session after that.
+	bool requestedAmountIncrement(int index, int amount);
+
+	// Returns true if a new window bytesPerSecond() value was computed.
+	bool requestFinished(
+		int index,
+		int amount,
+		crl::time duration,
+		crl::time now);
+
+	[[nodiscard]] const DownloadWindow &window() const;
+	[[nodiscard]] int64 requestedAmount(int index) const;
+
+private:
+	struct Session {
+		int64 requested = 0;
+		crl::time rtt = 0;
+	};
+
+	std::vector<Session> _sessions;
+	DownloadWindow _window;
+
+};
+
+} // namespace Storage
@@ -0,0 +1,47 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_download_sessions.h"
+
+namespace {
+
+constexpr auto kPartSize = 128 * 1024;
+
+} // namespace
+
+TEST_CASE("download sessions", "[storage_download_sessions]") {
+	auto sessions = Storage::DownloadSessions(2, 0);
+	REQUIRE(sessions.chooseIndex(kPartSize) == 0);
+
+	SECTION("spreading requests by the requested amount") {
+		REQUIRE(!sessions.requestedAmountIncrement(0, kPartSize));
+		REQUIRE(sessions.chooseIndex(kPartSize) == 1);
+		REQUIRE(!sessions.requestedAmountIncrement(1, kPartSize));
+		REQUIRE(sessions.chooseIndex(kPartSize) == 0);
+		REQUIRE(!sessions.requestedAmountIncrement(0, -kPartSize));
+		REQUIRE(sessions.requestedAmount(1) == kPartSize);
+		REQUIRE(sessions.requestedAmountIncrement(1, -kPartSize));
+	}
+	SECTION("preferring the session that answers faster") {
+		sessions.requestFinished(0, kPartSize, 100, 100);
+		sessions.requestFinished(1, kPartSize, 400, 400);
+		sessions.requestedAmountIncrement(0, 2 * kPartSize);
+		REQUIRE(sessions.chooseIndex(kPartSize) == 0);
+		sessions.requestedAmountIncrement(0, 2 * kPartSize);
+		REQUIRE(sessions.chooseIndex(kPartSize) == 1);
+	}
+	SECTION("limiting requests by the window") {
+		using Window = Storage::DownloadWindow;
+		REQUIRE(sessions.window().queriesLimit() == Window::kStartQueries);
+		for (auto i = 1; i != 100; ++i) {
+			sessions.requestFinished(i % 2, kPartSize, 100, i * 10);
+		}
+		REQUIRE(sessions.window().queriesLimit() == Window::kMaxQueries);
+	}
+}
@@ -0,0 +1,89 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_download_window.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kQueueingRttFactor = 2;
+constexpr auto kMinRttExpireTimeout = crl::time(30000);
+constexpr auto kStatsPeriod = crl::time(1000);
+
+} // namespace
+
+DownloadWindow::DownloadWindow(crl::time now)
+: _window(kStartQueries)
+, _slowStartThreshold(kMaxQueries)
+, _periodStart(now) {
+}
+
+bool DownloadWindow::requestFinished(
+		crl::time rtt,
+		int amount,
+		crl::time now) {
+	Expects(rtt > 0);
+
+	updateWindow(rtt, now);
+	return updateThroughput(amount, now);
+}
+
+int DownloadWindow::queriesLimit() const {
+	return int(_window);
+}
+
+crl::time DownloadWindow::rtt() const {
+	return _smoothedRtt;
+}
+
+int64 DownloadWindow::bytesPerSecond() const {
+	return _bytesPerSecond;
+}
+
+void DownloadWindow::updateWindow(crl::time rtt, crl::time now) {
+	_smoothedRtt = _smoothedRtt ? ((_smoothedRtt * 7 + rtt) / 8) : rtt;
+	if (!_minRtt
+		|| rtt <= _minRtt
+		|| now - _minRttUpdated > kMinRttExpireTimeout) {
+		// Expiring allows to notice a slower route after a network change.
+		_minRtt = rtt;
+		_minRttUpdated = now;
+	}
+
+	const auto queueing = (_smoothedRtt > _minRtt * kQueueingRttFactor);
+	if (queueing) {
+		// Multiplicative decrease, at most once per round trip.
+		if (now - _lastDecrease >= _smoothedRtt) {
+			_slowStartThreshold = std::max(_window / 2., float64(kMinQueries));
+			_window = _slowStartThreshold;
+			_lastDecrease = now;
+		}
+	} else if (_window < _slowStartThreshold) {
+		_window += 1.;
+	} else {
+		// Additive increase, by one query per window of answers.
+		_window += 1. / _window;
+	}
+	_window = std::clamp(
+		_window,
+		float64(kMinQueries),
+		float64(kMaxQueries));
+}
+
+bool DownloadWindow::updateThroughput(int amount, crl::time now) {
+	_periodBytes += amount;
+	const auto passed = now - _periodStart;
+	if (passed < kStatsPeriod) {
+		return false;
+	}
+	_bytesPerSecond = _periodBytes * 1000 / passed;
+	_periodBytes = 0;
+	_periodStart = now;
+	return true;
+}
+
+} // namespace Storage
@@ -0,0 +1,47 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+namespace Storage {
+
+// From 2 to 32 file parts downloaded at the same time from one dc.
+// The limit grows while the answers come back as fast as the quickest
+// ones and halves when they start to queue up, so that the downloads
+// don't delay the other requests on slow connections.
+class DownloadWindow final {
+public:
+	static constexpr auto kMinQueries = 2;
+	static constexpr auto kStartQueries = 4;
+	static constexpr auto kMaxQueries = 32;
+
+	explicit DownloadWindow(crl::time now);
+
+	// Returns true if a new bytesPerSecond() value was computed.
+	bool requestFinished(crl::time rtt, int amount, crl::time now);
+
+	[[nodiscard]] int queriesLimit() const;
+	[[nodiscard]] crl::time rtt() const;
+	[[nodiscard]] int64 bytesPerSecond() const;
+
+private:
+	void updateWindow(crl::time rtt, crl::time now);
+	bool updateThroughput(int amount, crl::time now);
+
+	float64 _window = 0.;
+	float64 _slowStartThreshold = 0.;
+	crl::time _minRtt = 0;
+	crl::time _minRttUpdated = 0;
+	crl::time _smoothedRtt = 0;
+	crl::time _lastDecrease = 0;
+	crl::time _periodStart = 0;
+	int64 _periodBytes = 0;
+	int64 _bytesPerSecond = 0;
+
+};
+
+} // namespace Storage
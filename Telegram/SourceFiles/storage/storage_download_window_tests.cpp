@@ -0,0 +1,51 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_download_window.h"
+
+namespace {
+
+constexpr auto kPartSize = 128 * 1024;
+
+} // namespace
+
+TEST_CASE("download window", "[storage_download_window]") {
+	using Window = Storage::DownloadWindow;
+
+	auto window = Window(0);
+	REQUIRE(window.queriesLimit() == Window::kStartQueries);
+
+	SECTION("growing while answers are fast") {
+		for (auto i = 1; i != 100; ++i) {
+			window.requestFinished(100, kPartSize, i * 10);
+		}
+		REQUIRE(window.queriesLimit() == Window::kMaxQueries);
+		REQUIRE(window.rtt() == 100);
+	}
+	SECTION("halving once per round trip when answers queue up") {
+		for (auto i = 1; i != 40; ++i) {
+			window.requestFinished(100, kPartSize, i * 10);
+		}
+		REQUIRE(window.queriesLimit() == Window::kMaxQueries);
+		for (auto i = 0; i != 4; ++i) {
+			window.requestFinished(500, kPartSize, 1000);
+		}
+		REQUIRE(window.queriesLimit() == Window::kMaxQueries / 2);
+
+		for (auto now = 2000; now < 25000; now += 6000) {
+			window.requestFinished(5000, kPartSize, now);
+		}
+		REQUIRE(window.queriesLimit() == Window::kMinQueries);
+	}
+	SECTION("measuring throughput each second") {
+		REQUIRE(!window.requestFinished(10, 1000, 500));
+		REQUIRE(window.requestFinished(10, 1000, 1000));
+		REQUIRE(window.bytesPerSecond() == 2000);
+	}
+}
@@ -72,6 +72,19 @@ File::Result File::open(
 		"Not way to encrypt the header.");
 }
 
+File::Result File::openMapped(
+		const QString &path,
+		const EncryptionKey &key) {
+	close();
+
+	_data.setFileName(QFileInfo(path).absoluteFilePath());
+	const auto result = attemptOpenMapped(key);
+	if (result != Result::Success) {
+		close();
+	}
+	return result;
+}
+
 File::Result File::attemptOpen(Mode mode, const EncryptionKey &key) {
 	switch (mode) {
 	case Mode::Read: return attemptOpenForRead(key);
@@ -106,6 +119,24 @@ File::Result File::attemptOpenForWrite(const EncryptionKey &key) {
 	return writeHeader(key) ? Result::Success : Result::Failed;
 }
 
+File::Result File::attemptOpenMapped(const EncryptionKey &key) {
+	if (!_data.open(QIODevice::ReadOnly)) {
+		return Result::Failed;
+	}
+	const auto size = _data.size();
+	if (size < FileLock::kSkipBytes + int64(sizeof(BasicHeader))) {
+		return Result::Failed;
+	}
+	const auto data = _data.map(0, size);
+	if (!data) {
+		return Result::Failed;
+	}
+	_mapped = bytes::const_span(
+		reinterpret_cast<const bytes::type*>(data),
+		size);
+	return readHeader(key);
+}
+
 bool File::writeHeader(const EncryptionKey &key) {
 	Expects(!_state.has_value());
 	Expects(_data.pos() == 0);
@@ -286,12 +317,49 @@ bool File::writeWithPadding(bytes::span bytes) {
 	return false;
 }
 
+size_type File::readMappedWithPadding(int64 offset, bytes::span bytes) {
+	Expects(!_mapped.empty());
+	Expects(_state.has_value());
+	Expects(offset >= 0 && (offset % kBlockSize) == 0);
+
+	const auto size = bytes.size();
+	const auto part = size % kBlockSize;
+	const auto good = size - part;
+	const auto padded = good + (part ? kBlockSize : 0);
+	if (offset + padded > _dataSize) {
+		return 0;
+	}
+	const auto encryptionOffset = int64(sizeof(BasicHeader))
+		- kSaltSize
+		+ offset;
+	const auto from = _mapped.subspan(
+		FileLock::kSkipBytes + kSaltSize + encryptionOffset,
+		padded);
+	if (good) {
+		_state->decrypt(
+			from.subspan(0, good),
+			bytes.subspan(0, good),
+			encryptionOffset);
+	}
+	if (part) {
+		auto storage = bytes::array<kBlockSize>();
+		const auto padding = bytes::make_span(storage);
+		_state->decrypt(
+			from.subspan(good),
+			padding,
+			encryptionOffset + good);
+		bytes::copy(bytes.subspan(good), padding.subspan(0, part));
+	}
+	return size;
+}
+
 bool File::flush() {
 	return _data.flush();
 }
 
 void File::close() {
 	_lock.unlock();
+	_mapped = bytes::const_span();
 	_data.close();
 	_data.setFileName(QString());
 	_dataSize = _encryptionOffset = 0;
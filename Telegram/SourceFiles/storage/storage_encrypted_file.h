@@ -29,12 +29,18 @@ public:
 	};
 	Result open(const QString &path, Mode mode, const EncryptionKey &key);
 
+	// Opens the file for reading and maps it to memory as a whole.
+	Result openMapped(const QString &path, const EncryptionKey &key);
+
 	size_type read(bytes::span bytes);
 	bool write(bytes::span bytes);
 
 	size_type readWithPadding(bytes::span bytes);
 	bool writeWithPadding(bytes::span bytes);
 
+	// Decrypts straight from the mapped memory, doesn't change offset().
+	size_type readMappedWithPadding(int64 offset, bytes::span bytes);
+
 	bool flush();
 
 	bool isOpen() const;
@@ -51,6 +57,7 @@ private:
 	Result attemptOpenForRead(const EncryptionKey &key);
 	Result attemptOpenForReadAppend(const EncryptionKey &key);
 	Result attemptOpenForWrite(const EncryptionKey &key);
+	Result attemptOpenMapped(const EncryptionKey &key);
 
 	bool writeHeader(const EncryptionKey &key);
 	Result readHeader(const EncryptionKey &key);
@@ -65,6 +72,7 @@ private:
 	FileLock _lock;
 	int64 _encryptionOffset = 0;
 	int64 _dataSize = 0;
+	bytes::const_span _mapped;
 
 	std::optional<CtrState> _state;
 
@@ -160,6 +160,26 @@ TEST_CASE("simple encrypted file", "[storage_encrypted_file]") {
 		REQUIRE(read == data.size());
 		REQUIRE(data == bytes::concatenate(Test1, Test1));
 	}
+	SECTION("reading mapped file") {
+		Storage::File file;
+
+		const auto result = file.openMapped(Name, Key);
+		REQUIRE(result == Storage::File::Result::Success);
+		REQUIRE(file.size() == 3 * Test1.size());
+
+		auto data = bytes::vector(32);
+		const auto read1 = file.readMappedWithPadding(0, data);
+		REQUIRE(read1 == data.size());
+		REQUIRE(data == bytes::concatenate(Test1, Test1));
+
+		auto padded = bytes::vector(20);
+		const auto read2 = file.readMappedWithPadding(16, padded);
+		REQUIRE(read2 == padded.size());
+		REQUIRE(padded == bytes::concatenate(Test1, Test1.subspan(0, 4)));
+
+		const auto read3 = file.readMappedWithPadding(32, padded);
+		REQUIRE(read3 == 0);
+	}
 	SECTION("moving file") {
 		const auto result = Storage::File::Move(Name, "other.file");
 		REQUIRE(result);
@@ -245,3 +265,33 @@ TEST_CASE("two process encrypted file", "[storage_encrypted_file]") {
 	}
 
 }
+
+TEST_CASE("ctr state", "[storage_encrypted_file]") {
+	SECTION("processing in parts matches processing at once") {
+		const auto key = bytes::make_vector(bytes::make_span(
+			Key.data()).subspan(0, Storage::CtrState::kKeySize));
+		for (const auto fill : { bytes::type(0x00), bytes::type(0xFF) }) {
+			// All 0xFF bytes make the counter carry over to the next byte.
+			auto iv = bytes::vector(Storage::CtrState::kIvSize, fill);
+			auto state = Storage::CtrState(key, iv);
+
+			auto data = bytes::vector(64 * Storage::CtrState::kBlockSize);
+			bytes::set_random(data);
+			auto whole = data;
+			state.encrypt(whole, 0);
+			REQUIRE(whole != data);
+
+			auto parts = data;
+			const auto span = bytes::make_span(parts);
+			const auto block = Storage::CtrState::kBlockSize;
+			state.encrypt(span.subspan(0, block), 0);
+			state.encrypt(span.subspan(block, 7 * block), block);
+			state.encrypt(span.subspan(8 * block), 8 * block);
+			REQUIRE(parts == whole);
+
+			auto decrypted = bytes::vector(whole.size());
+			state.decrypt(whole, decrypted, 0);
+			REQUIRE(decrypted == data);
+		}
+	}
+}
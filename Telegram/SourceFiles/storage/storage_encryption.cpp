@@ -8,6 +8,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 #include "storage/storage_encryption.h"
 
 #include "base/openssl_help.h"
+#include <openssl/evp.h>
 
 namespace Storage {
 
@@ -19,11 +20,75 @@ CtrState::CtrState(bytes::const_span key, bytes::const_span iv) {
 	bytes::copy(_iv, iv);
 }
 
-template <typename Method>
-void CtrState::process(bytes::span data, int64 offset, Method method) {
-	Expects((data.size() % kBlockSize) == 0);
+void CtrState::process(
+		bytes::const_span from,
+		bytes::span to,
+		int64 offset) {
+	Expects((from.size() % kBlockSize) == 0);
+	Expects(from.size() == to.size());
 	Expects((offset % kBlockSize) == 0);
 
+	if (from.empty()) {
+		return;
+	}
+	const auto iv = incrementedIv(offset / kBlockSize);
+	if (!processMultiBlock(from, to, iv)) {
+		processSingleBlock(from, to, iv);
+	}
+}
+
+bool CtrState::processMultiBlock(
+		bytes::const_span from,
+		bytes::span to,
+		const bytes::array<kIvSize> &iv) const {
+	// EVP chooses the CTR implementation for the current CPU at runtime:
+	// with AES-NI it encrypts several counter blocks in one pass through
+	// the pipeline, otherwise it uses the portable table implementation.
+	const auto context = EVP_CIPHER_CTX_new();
+	if (!context) {
+		return false;
+	}
+	const auto guard = gsl::finally([&] {
+		EVP_CIPHER_CTX_free(context);
+	});
+	const auto initialized = EVP_EncryptInit_ex(
+		context,
+		EVP_aes_256_ctr(),
+		nullptr,
+		reinterpret_cast<const uchar*>(_key.data()),
+		reinterpret_cast<const uchar*>(iv.data()));
+	if (initialized != 1) {
+		return false;
+	}
+
+	// EVP_EncryptUpdate accepts int lengths, the counter is continued
+	// by the context between the calls.
+	constexpr auto kMaxPart = size_type(1 << 30);
+	while (!from.empty()) {
+		const auto part = (from.size() > kMaxPart)
+			? kMaxPart
+			: size_type(from.size());
+		auto written = 0;
+		const auto updated = EVP_EncryptUpdate(
+			context,
+			reinterpret_cast<uchar*>(to.data()),
+			&written,
+			reinterpret_cast<const uchar*>(from.data()),
+			int(part));
+		if (updated != 1 || written != int(part)) {
+			// Part of the data may be processed in place already.
+			Unexpected("EVP_EncryptUpdate fail in CtrState::process.");
+		}
+		from = from.subspan(part);
+		to = to.subspan(part);
+	}
+	return true;
+}
+
+void CtrState::processSingleBlock(
+		bytes::const_span from,
+		bytes::span to,
+		bytes::array<kIvSize> iv) const {
 	AES_KEY aes;
 	AES_set_encrypt_key(
 		reinterpret_cast<const uchar*>(_key.data()),
@@ -32,18 +97,16 @@ void CtrState::process(bytes::span data, int64 offset, Method method) {
 
 	unsigned char ecountBuf[kBlockSize] = { 0 };
 	unsigned int offsetInBlock = 0;
-	const auto blockIndex = offset / kBlockSize;
-	auto iv = incrementedIv(blockIndex);
 
 	CRYPTO_ctr128_encrypt(
-		reinterpret_cast<const uchar*>(data.data()),
-		reinterpret_cast<uchar*>(data.data()),
-		data.size(),
+		reinterpret_cast<const uchar*>(from.data()),
+		reinterpret_cast<uchar*>(to.data()),
+		from.size(),
 		&aes,
 		reinterpret_cast<unsigned char*>(iv.data()),
 		ecountBuf,
 		&offsetInBlock,
-		(block128_f)method);
+		(block128_f)AES_encrypt);
 }
 
 auto CtrState::incrementedIv(int64 blockIndex)
@@ -66,11 +129,18 @@ auto CtrState::incrementedIv(int64 blockIndex)
 }
 
 void CtrState::encrypt(bytes::span data, int64 offset) {
-	return process(data, offset, AES_encrypt);
+	return process(data, data, offset);
 }
 
 void CtrState::decrypt(bytes::span data, int64 offset) {
-	return process(data, offset, AES_encrypt);
+	return process(data, data, offset);
+}
+
+void CtrState::decrypt(
+		bytes::const_span from,
+		bytes::span to,
+		int64 offset) {
+	return process(from, to, offset);
 }
 
 EncryptionKey::EncryptionKey(bytes::vector &&data)
@@ -23,10 +23,18 @@ public:
 
 	void encrypt(bytes::span data, int64 offset);
 	void decrypt(bytes::span data, int64 offset);
+	void decrypt(bytes::const_span from, bytes::span to, int64 offset);
 
 private:
-	template <typename Method>
-	void process(bytes::span data, int64 offset, Method method);
+	void process(bytes::const_span from, bytes::span to, int64 offset);
+	bool processMultiBlock(
+		bytes::const_span from,
+		bytes::span to,
+		const bytes::array<kIvSize> &iv) const;
+	void processSingleBlock(
+		bytes::const_span from,
+		bytes::span to,
+		bytes::array<kIvSize> iv) const;
 
 	bytes::array<kIvSize> incrementedIv(int64 blockIndex);
 
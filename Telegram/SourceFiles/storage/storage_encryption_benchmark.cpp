@@ -0,0 +1,103 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_encryption.h"
+#include "base/openssl_help.h"
+#include <chrono>
+
+namespace {
+
+constexpr auto kProcessPerMeasure = int64(256 * 1024 * 1024);
+
+const auto Key = Storage::EncryptionKey(bytes::make_vector(
+	bytes::make_span("\
+abcdefgh01234567abcdefgh01234567abcdefgh01234567abcdefgh01234567\
+abcdefgh01234567abcdefgh01234567abcdefgh01234567abcdefgh01234567\
+abcdefgh01234567abcdefgh01234567abcdefgh01234567abcdefgh01234567\
+abcdefgh01234567abcdefgh01234567abcdefgh01234567abcdefgh01234567\
+").subspan(0, Storage::EncryptionKey::kSize)));
+
+// Block by block processing, the way CtrState worked before.
+void SingleBlockDecrypt(
+		bytes::const_span key,
+		bytes::const_span iv,
+		bytes::span data) {
+	AES_KEY aes;
+	AES_set_encrypt_key(
+		reinterpret_cast<const uchar*>(key.data()),
+		key.size() * CHAR_BIT,
+		&aes);
+
+	auto counter = bytes::array<Storage::CtrState::kIvSize>();
+	bytes::copy(counter, iv);
+	unsigned char ecountBuf[Storage::CtrState::kBlockSize] = { 0 };
+	unsigned int offsetInBlock = 0;
+
+	CRYPTO_ctr128_encrypt(
+		reinterpret_cast<const uchar*>(data.data()),
+		reinterpret_cast<uchar*>(data.data()),
+		data.size(),
+		&aes,
+		reinterpret_cast<unsigned char*>(counter.data()),
+		ecountBuf,
+		&offsetInBlock,
+		(block128_f)AES_encrypt);
+}
+
+template <typename Method>
+double MeasureMegabytesPerSecond(bytes::span buffer, Method &&method) {
+	const auto iterations = std::max(
+		kProcessPerMeasure / int64(buffer.size()),
+		int64(1));
+	const auto start = std::chrono::steady_clock::now();
+	for (auto i = int64(); i != iterations; ++i) {
+		method(buffer, i * int64(buffer.size()));
+	}
+	const auto finish = std::chrono::steady_clock::now();
+	const auto seconds = std::chrono::duration<double>(
+		finish - start).count();
+	const auto megabytes = double(iterations * int64(buffer.size()))
+		/ (1024. * 1024.);
+	return megabytes / std::max(seconds, 1e-9);
+}
+
+} // namespace
+
+TEST_CASE("benchmark ctr decryption", "[storage_encryption]") {
+	auto salt = bytes::vector(Storage::kSaltSize);
+	bytes::set_random(salt);
+	auto state = Key.prepareCtrState(salt);
+
+	const auto key = bytes::make_vector(bytes::make_span(
+		Key.data()).subspan(0, Storage::CtrState::kKeySize));
+	const auto iv = bytes::make_vector(bytes::make_span(
+		salt).subspan(0, Storage::CtrState::kIvSize));
+
+	for (const auto size : { 4 * 1024, 128 * 1024, 8 * 1024 * 1024 }) {
+		auto buffer = bytes::vector(size);
+		bytes::set_random(buffer);
+
+		const auto multi = MeasureMegabytesPerSecond(buffer, [&](
+				bytes::span data,
+				int64 offset) {
+			state.decrypt(data, offset);
+		});
+		const auto single = MeasureMegabytesPerSecond(buffer, [&](
+				bytes::span data,
+				int64 offset) {
+			SingleBlockDecrypt(key, iv, data);
+		});
+		WARN((size / 1024)
+			<< " KB: CtrState "
+			<< int(multi)
+			<< " MB/s, single block "
+			<< int(single)
+			<< " MB/s");
+	}
+}
@@ -0,0 +1,242 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_file_sink.h"
+
+namespace Storage {
+
+QString PartialFilePath(const QString &path) {
+	return path + QString(".part");
+}
+
+bool MovePartialFile(const QString &from, const QString &to) {
+	if (QFile::exists(to) && !QFile::remove(to)) {
+		return false;
+	}
+	return QFile::rename(from, to);
+}
+
+FileSink::FileSink(const QString &fileName, int partSize)
+: _file(fileName)
+, _partSize(partSize) {
+	Expects(_partSize > 0);
+}
+
+void FileSink::setFileName(const QString &fileName) {
+	Expects(!isOpen());
+
+	_file.setFileName(fileName);
+}
+
+QString FileSink::fileName() const {
+	return _file.fileName();
+}
+
+bool FileSink::open(int64 expectedSize, bool reserve) {
+	Expects(!isOpen());
+	Expects(expectedSize >= 0);
+
+	clear();
+
+	// All the reads and writes are positional on the native handle,
+	// so the QFile buffer and position are never used.
+	const auto mode = QIODevice::ReadWrite
+		| QIODevice::Truncate
+		| QIODevice::Unbuffered;
+	if (!_file.open(mode)) {
+		return false;
+	} else if (reserve && expectedSize > 0 && !preallocate(expectedSize)) {
+		_file.close();
+		return false;
+	}
+	_partsCount = int((expectedSize + _partSize - 1) / _partSize);
+	_written.reserve(_partsCount);
+	return true;
+}
+
+bool FileSink::resume(
+		int64 expectedSize,
+		const QByteArray &writtenParts) {
+	Expects(!isOpen());
+	Expects(expectedSize > 0);
+
+	clear();
+
+	// The bitmap may end at the last written part, the rest are missing.
+	const auto count = int((expectedSize + _partSize - 1) / _partSize);
+	if (writtenParts.size() > (count + 7) / 8) {
+		return false;
+	}
+	const auto mode = QIODevice::ReadWrite | QIODevice::Unbuffered;
+	if (!_file.exists() || !_file.open(mode)) {
+		return false;
+	}
+
+	// The file is reserved for the expectedSize bytes or ends with
+	// the last written part, otherwise it is not the file we've left.
+	const auto size = _file.size();
+	if (size > expectedSize) {
+		_file.close();
+		return false;
+	}
+	_partsCount = count;
+	_written.reserve(count);
+	const auto known = std::min(count, int(writtenParts.size()) * 8);
+	for (auto index = 0; index != known; ++index) {
+		const auto byte = uchar(writtenParts[index / 8]);
+		if (byte & (1 << (index % 8))) {
+			const auto offset = int64(index) * _partSize;
+			const auto length = std::min(
+				int64(_partSize),
+				expectedSize - offset);
+			if (offset + length > size) {
+				_file.close();
+				clear();
+				return false;
+			}
+			markWritten(offset, length);
+		}
+	}
+	return true;
+}
+
+bool FileSink::isOpen() const {
+	return _file.isOpen();
+}
+
+bool FileSink::write(int64 offset, bytes::const_span data) {
+	Expects(isOpen());
+	Expects(offset >= 0 && !(offset % _partSize));
+
+	if (_writeFailed) {
+		return false;
+	} else if (data.empty()) {
+		return true;
+	}
+	const auto copy = QByteArray(
+		reinterpret_cast<const char*>(data.data()),
+		data.size());
+	_queue.async([=] {
+		if (!writeAt(offset, bytes::make_span(copy))) {
+			_writeFailed = true;
+		}
+	});
+	_writesQueued = true;
+	markWritten(offset, data.size());
+	return true;
+}
+
+bool FileSink::waitForWrites() const {
+	if (_writesQueued) {
+		_queue.sync([] {});
+		_writesQueued = false;
+	}
+	return !_writeFailed;
+}
+
+void FileSink::markWritten(int64 offset, int64 size) {
+	const auto till = offset + size;
+	const auto count = int((till + _partSize - 1) / _partSize);
+	if (int(_written.size()) < count) {
+		_written.resize(count, false);
+	}
+	for (auto index = int(offset / _partSize); index != count; ++index) {
+		if (!_written[index]) {
+			_written[index] = true;
+			const auto from = std::max(offset, int64(index) * _partSize);
+			_writtenBytes += std::min(till, from + _partSize) - from;
+		}
+	}
+	_till = std::max(_till, till);
+}
+
+bool FileSink::contains(int64 offset, int64 size) const {
+	Expects(offset >= 0 && size > 0);
+
+	if (offset + size > _till) {
+		return false;
+	}
+	const auto from = int(offset / _partSize);
+	const auto till = int((offset + size + _partSize - 1) / _partSize);
+	for (auto index = from; index != till; ++index) {
+		if (!_written[index]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+QByteArray FileSink::read(int64 offset, int size) const {
+	Expects(isOpen());
+
+	if (!contains(offset, size) || !waitForWrites()) {
+		return QByteArray();
+	}
+	auto result = QByteArray(size, Qt::Uninitialized);
+	return readAt(offset, bytes::make_detached_span(result))
+		? result
+		: QByteArray();
+}
+
+int64 FileSink::writtenBytes() const {
+	return _writtenBytes;
+}
+
+QByteArray FileSink::writtenParts() const {
+	// Only the parts that are already on the disk may be resumed.
+	waitForWrites();
+
+	const auto count = std::max(_partsCount, int(_written.size()));
+	auto result = QByteArray((count + 7) / 8, char(0));
+	for (auto index = 0, count = int(_written.size()); index != count; ++index) {
+		if (_written[index]) {
+			result[index / 8] = char(uchar(result[index / 8])
+				| (1 << (index % 8)));
+		}
+	}
+	return result;
+}
+
+bool FileSink::finish() {
+	Expects(isOpen());
+
+	if (!waitForWrites()) {
+		return false;
+	} else if (_file.size() != _till && !_file.resize(_till)) {
+		return false;
+	}
+	_file.close();
+	clear();
+	return true;
+}
+
+void FileSink::close() {
+	waitForWrites();
+	_file.close();
+	clear();
+}
+
+void FileSink::remove() {
+	waitForWrites();
+	_file.close();
+	_file.remove();
+	clear();
+}
+
+void FileSink::clear() {
+	_partsCount = 0;
+	_written.clear();
+	_writtenBytes = 0;
+	_till = 0;
+	_writeFailed = false;
+}
+
+FileSink::~FileSink() {
+	waitForWrites();
+}
+
+} // namespace Storage
@@ -0,0 +1,89 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "base/bytes.h"
+#include <QtCore/QFile>
+#include <crl/crl_queue.h>
+
+#include <atomic>
+
+namespace Storage {
+
+// Files are assembled at "<path>.part" and moved to the path when done.
+[[nodiscard]] QString PartialFilePath(const QString &path);
+[[nodiscard]] bool MovePartialFile(const QString &from, const QString &to);
+
+// Assembles a downloaded file from parts that arrive in any order.
+// Every part is written right to its place in the file
+// and the completed parts are tracked to read them back while loading.
+//
+// The writes are done on a background queue, so the caller's thread
+// doesn't wait for the disk. Reading a part back, writtenParts(),
+// finish(), close() and remove() wait for the queued writes first.
+class FileSink {
+public:
+	FileSink(const QString &fileName, int partSize);
+	FileSink(const FileSink &other) = delete;
+	FileSink &operator=(const FileSink &other) = delete;
+
+	void setFileName(const QString &fileName);
+	[[nodiscard]] QString fileName() const;
+
+	// Truncates the file and reserves space for expectedSize bytes.
+	// A file that may be left by close() for a later resume() is not
+	// reserved, so that it takes only the written parts on the disk.
+	[[nodiscard]] bool open(int64 expectedSize, bool reserve = true);
+
+	// Opens the file left by close() with the parts from writtenParts().
+	[[nodiscard]] bool resume(
+		int64 expectedSize,
+		const QByteArray &writtenParts);
+	[[nodiscard]] bool isOpen() const;
+
+	// Writes start at part boundaries, only the last part may be shorter.
+	// A failed background write is reported by the next call.
+	[[nodiscard]] bool write(int64 offset, bytes::const_span data);
+	[[nodiscard]] bool contains(int64 offset, int64 size) const;
+	[[nodiscard]] QByteArray read(int64 offset, int size) const;
+	[[nodiscard]] int64 writtenBytes() const;
+
+	// Bit for each part, packed to bytes, for the later resume().
+	[[nodiscard]] QByteArray writtenParts() const;
+
+	// Cuts the reserved space after the last written byte and closes.
+	[[nodiscard]] bool finish();
+
+	// Closes leaving the reserved space and the written parts as is.
+	void close();
+	void remove();
+
+	~FileSink();
+
+private:
+	[[nodiscard]] bool preallocate(int64 size);
+	[[nodiscard]] bool writeAt(int64 offset, bytes::const_span data);
+	[[nodiscard]] bool readAt(int64 offset, bytes::span buffer) const;
+	[[nodiscard]] bool waitForWrites() const;
+	void markWritten(int64 offset, int64 size);
+	void clear();
+
+	QFile _file;
+	const int _partSize = 0;
+	int _partsCount = 0;
+	std::vector<bool> _written;
+	int64 _writtenBytes = 0;
+	int64 _till = 0;
+
+	mutable crl::queue _queue;
+	mutable bool _writesQueued = false;
+	std::atomic<bool> _writeFailed = false;
+
+};
+
+} // namespace Storage
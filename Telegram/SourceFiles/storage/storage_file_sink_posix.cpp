@@ -0,0 +1,65 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_file_sink.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+namespace Storage {
+
+bool FileSink::preallocate(int64 size) {
+#ifdef Q_OS_LINUX
+	// Reserve real blocks, so that parts written out of order
+	// don't leave the file fragmented.
+	if (posix_fallocate(_file.handle(), 0, size) == 0) {
+		return true;
+	}
+#endif // Q_OS_LINUX
+	return _file.resize(size);
+}
+
+bool FileSink::writeAt(int64 offset, bytes::const_span data) {
+	const auto descriptor = _file.handle();
+	while (!data.empty()) {
+		const auto written = pwrite(
+			descriptor,
+			data.data(),
+			data.size(),
+			off_t(offset));
+		if (written < 0 && errno == EINTR) {
+			continue;
+		} else if (written <= 0) {
+			return false;
+		}
+		data = data.subspan(written);
+		offset += written;
+	}
+	return true;
+}
+
+bool FileSink::readAt(int64 offset, bytes::span buffer) const {
+	const auto descriptor = _file.handle();
+	while (!buffer.empty()) {
+		const auto read = pread(
+			descriptor,
+			buffer.data(),
+			buffer.size(),
+			off_t(offset));
+		if (read < 0 && errno == EINTR) {
+			continue;
+		} else if (read <= 0) {
+			return false;
+		}
+		buffer = buffer.subspan(read);
+		offset += read;
+	}
+	return true;
+}
+
+} // namespace Storage
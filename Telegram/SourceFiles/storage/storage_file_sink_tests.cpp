@@ -0,0 +1,174 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_file_sink.h"
+
+namespace {
+
+constexpr auto kPartSize = 16;
+
+const auto Name = QString("test.sink");
+
+const auto Part1 = bytes::make_span("testbytetestbyte").subspan(0, 16);
+const auto Part2 = bytes::make_span("bytetestbytetest").subspan(0, 16);
+const auto Tail = bytes::make_span("tail").subspan(0, 4);
+
+QByteArray ReadAll() {
+	auto file = QFile(Name);
+	return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+} // namespace
+
+TEST_CASE("file sink", "[storage_file_sink]") {
+	SECTION("writing parts out of order") {
+		auto sink = Storage::FileSink(Name, kPartSize);
+		REQUIRE(sink.open(2 * kPartSize + Tail.size()));
+		REQUIRE(sink.write(2 * kPartSize, Tail));
+		REQUIRE(sink.write(0, Part1));
+		REQUIRE(sink.writtenBytes() == kPartSize + Tail.size());
+		REQUIRE(sink.contains(0, kPartSize));
+		REQUIRE(!sink.contains(kPartSize, kPartSize));
+		REQUIRE(!sink.contains(0, 2 * kPartSize));
+		REQUIRE(sink.read(kPartSize, kPartSize).isEmpty());
+
+		const auto tail = sink.read(2 * kPartSize, Tail.size());
+		REQUIRE(bytes::make_span(tail) == Tail);
+
+		REQUIRE(sink.write(kPartSize, Part2));
+		REQUIRE(sink.write(kPartSize, Part2));
+		REQUIRE(sink.writtenBytes() == 2 * kPartSize + Tail.size());
+		const auto second = sink.read(kPartSize, kPartSize);
+		REQUIRE(bytes::make_span(second) == Part2);
+		REQUIRE(sink.finish());
+		REQUIRE(!sink.isOpen());
+
+		const auto all = ReadAll();
+		REQUIRE(all.size() == 2 * kPartSize + Tail.size());
+		const auto span = bytes::make_span(all);
+		REQUIRE(span.subspan(0, kPartSize) == Part1);
+		REQUIRE(span.subspan(kPartSize, kPartSize) == Part2);
+		REQUIRE(span.subspan(2 * kPartSize) == Tail);
+	}
+	SECTION("finishing with less data than expected") {
+		auto sink = Storage::FileSink(Name, kPartSize);
+		REQUIRE(sink.open(4 * kPartSize));
+		REQUIRE(sink.write(0, Part1));
+		REQUIRE(sink.write(kPartSize, Tail));
+		REQUIRE(sink.finish());
+		REQUIRE(ReadAll().size() == kPartSize + Tail.size());
+	}
+	SECTION("writing without expected size") {
+		auto sink = Storage::FileSink(Name, kPartSize);
+		REQUIRE(sink.open(0));
+		REQUIRE(sink.write(kPartSize, Part2));
+		REQUIRE(sink.write(0, Part1));
+		REQUIRE(sink.contains(0, 2 * kPartSize));
+		REQUIRE(sink.finish());
+		REQUIRE(ReadAll().size() == 2 * kPartSize);
+	}
+	SECTION("resuming after close") {
+		const auto size = 2 * kPartSize + Tail.size();
+		auto parts = QByteArray();
+		{
+			auto sink = Storage::FileSink(Name, kPartSize);
+			REQUIRE(sink.open(size));
+			REQUIRE(sink.write(2 * kPartSize, Tail));
+			parts = sink.writtenParts();
+			sink.close();
+			REQUIRE(QFile::exists(Name));
+		}
+		REQUIRE(parts.size() == 1);
+
+		auto sink = Storage::FileSink(Name, kPartSize);
+		REQUIRE(!sink.resume(size + 1, parts));
+		REQUIRE(!sink.resume(size, QByteArray(2, char(0))));
+		REQUIRE(sink.resume(size, parts));
+		REQUIRE(sink.writtenBytes() == Tail.size());
+		REQUIRE(sink.contains(2 * kPartSize, Tail.size()));
+		REQUIRE(!sink.contains(0, kPartSize));
+		REQUIRE(sink.write(0, Part1));
+		REQUIRE(sink.write(kPartSize, Part2));
+		REQUIRE(sink.finish());
+
+		const auto all = ReadAll();
+		REQUIRE(all.size() == size);
+		const auto span = bytes::make_span(all);
+		REQUIRE(span.subspan(0, kPartSize) == Part1);
+		REQUIRE(span.subspan(2 * kPartSize) == Tail);
+	}
+	SECTION("resuming a sequential load stopped partway") {
+		constexpr auto kParts = 20;
+		constexpr auto kWritten = 5;
+		const auto size = int64(kParts - 1) * kPartSize + Tail.size();
+		auto parts = QByteArray();
+		{
+			auto sink = Storage::FileSink(Name, kPartSize);
+			REQUIRE(sink.open(size));
+			for (auto i = 0; i != kWritten; ++i) {
+				REQUIRE(sink.write(i * kPartSize, (i % 2) ? Part2 : Part1));
+			}
+			parts = sink.writtenParts();
+			sink.close();
+		}
+		REQUIRE(parts.size() == (kParts + 7) / 8);
+
+		auto sink = Storage::FileSink(Name, kPartSize);
+		REQUIRE(sink.resume(size, parts));
+		REQUIRE(sink.writtenBytes() == kWritten * kPartSize);
+		REQUIRE(sink.contains(0, kWritten * kPartSize));
+		REQUIRE(!sink.contains(kWritten * kPartSize, kPartSize));
+		sink.close();
+
+		// A bitmap ending at the last written part is accepted as well.
+		REQUIRE(sink.resume(size, parts.mid(0, 1)));
+		REQUIRE(sink.writtenBytes() == kWritten * kPartSize);
+		for (auto i = kWritten; i != kParts - 1; ++i) {
+			REQUIRE(sink.write(i * kPartSize, Part1));
+		}
+		REQUIRE(sink.write((kParts - 1) * kPartSize, Tail));
+		REQUIRE(sink.finish());
+		REQUIRE(ReadAll().size() == size);
+	}
+	SECTION("resuming a file that was not reserved") {
+		const auto size = 2 * kPartSize + Tail.size();
+		auto parts = QByteArray();
+		{
+			auto sink = Storage::FileSink(Name, kPartSize);
+			REQUIRE(sink.open(size, false));
+			REQUIRE(sink.write(0, Part1));
+			parts = sink.writtenParts();
+			sink.close();
+		}
+		REQUIRE(QFile(Name).size() == kPartSize);
+
+		auto sink = Storage::FileSink(Name, kPartSize);
+		REQUIRE(!sink.resume(size, QByteArray(1, char(0x03))));
+		REQUIRE(sink.resume(size, parts));
+		REQUIRE(sink.writtenBytes() == kPartSize);
+		REQUIRE(sink.write(2 * kPartSize, Tail));
+		REQUIRE(sink.write(kPartSize, Part2));
+		REQUIRE(sink.finish());
+
+		const auto all = ReadAll();
+		REQUIRE(all.size() == size);
+		const auto span = bytes::make_span(all);
+		REQUIRE(span.subspan(0, kPartSize) == Part1);
+		REQUIRE(span.subspan(kPartSize, kPartSize) == Part2);
+		REQUIRE(span.subspan(2 * kPartSize) == Tail);
+	}
+	SECTION("removing the file") {
+		auto sink = Storage::FileSink(Name, kPartSize);
+		REQUIRE(sink.open(kPartSize));
+		REQUIRE(sink.write(0, Part1));
+		sink.remove();
+		REQUIRE(!sink.isOpen());
+		REQUIRE(!QFile::exists(Name));
+	}
+}
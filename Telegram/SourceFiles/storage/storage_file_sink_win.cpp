@@ -0,0 +1,82 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_file_sink.h"
+
+#include "base/platform/win/base_windows_h.h"
+
+#include <io.h>
+#include <fileapi.h>
+
+namespace Storage {
+namespace {
+
+constexpr auto kMaxChunk = int64(1024 * 1024 * 1024);
+
+OVERLAPPED PositionAt(int64 offset) {
+	auto result = OVERLAPPED();
+	result.Offset = DWORD(uint64(offset) & 0xFFFFFFFFULL);
+	result.OffsetHigh = DWORD(uint64(offset) >> 32);
+	return result;
+}
+
+} // namespace
+
+bool FileSink::preallocate(int64 size) {
+	// SetEndOfFile allocates the space for the whole file at once.
+	return _file.resize(size);
+}
+
+bool FileSink::writeAt(int64 offset, bytes::const_span data) {
+	const auto handle = HANDLE(_get_osfhandle(_file.handle()));
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	while (!data.empty()) {
+		const auto chunk = std::min(int64(data.size()), kMaxChunk);
+		auto position = PositionAt(offset);
+		auto written = DWORD();
+		const auto success = WriteFile(
+			handle,
+			data.data(),
+			DWORD(chunk),
+			&written,
+			&position);
+		if (!success || !written) {
+			return false;
+		}
+		data = data.subspan(written);
+		offset += written;
+	}
+	return true;
+}
+
+bool FileSink::readAt(int64 offset, bytes::span buffer) const {
+	const auto handle = HANDLE(_get_osfhandle(_file.handle()));
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	while (!buffer.empty()) {
+		const auto chunk = std::min(int64(buffer.size()), kMaxChunk);
+		auto position = PositionAt(offset);
+		auto read = DWORD();
+		const auto success = ReadFile(
+			handle,
+			buffer.data(),
+			DWORD(chunk),
+			&read,
+			&position);
+		if (!success || !read) {
+			return false;
+		}
+		buffer = buffer.subspan(read);
+		offset += read;
+	}
+	return true;
+}
+
+} // namespace Storage
@@ -0,0 +1,136 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_image_scale.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kChannelsMask = 0x00FF00FF00FF00FFULL;
+constexpr auto kRounding = 0x0002000200020002ULL;
+
+// 0xAARRGGBB -> 0x00AA00GG00RR00BB, every channel gets 16 bits,
+// so four pixels are summed channel by channel in one integer.
+inline uint64 Spread(uint32 pixel) {
+	return (uint64(pixel) | (uint64(pixel) << 24)) & kChannelsMask;
+}
+
+inline uint32 Pack(uint64 channels) {
+	return uint32(channels | (channels >> 24));
+}
+
+// Averaging of premultiplied colors is correct for transparent pixels.
+QImage PrepareSource(const QImage &image) {
+	const auto format = image.format();
+	if (format == QImage::Format_RGB32
+		|| format == QImage::Format_ARGB32_Premultiplied) {
+		return image;
+	}
+	return image.convertToFormat(image.hasAlphaChannel()
+		? QImage::Format_ARGB32_Premultiplied
+		: QImage::Format_RGB32);
+}
+
+} // namespace
+
+QImage HalveImage(const QImage &image) {
+	const auto width = image.width() / 2;
+	const auto height = image.height() / 2;
+	Expects(width > 0 && height > 0);
+
+	const auto source = PrepareSource(image);
+	auto result = QImage(width, height, source.format());
+	if (result.isNull()) {
+		return result;
+	}
+
+	// No branches and no floating point in the inner loop,
+	// so the compiler vectorizes it for the target instruction set.
+	for (auto y = 0; y != height; ++y) {
+		auto top = reinterpret_cast<const uint32*>(
+			source.constScanLine(y * 2));
+		auto bottom = reinterpret_cast<const uint32*>(
+			source.constScanLine(y * 2 + 1));
+		const auto to = reinterpret_cast<uint32*>(result.scanLine(y));
+		for (auto x = 0; x != width; ++x, top += 2, bottom += 2) {
+			const auto sum = Spread(top[0])
+				+ Spread(top[1])
+				+ Spread(bottom[0])
+				+ Spread(bottom[1])
+				+ kRounding;
+			to[x] = Pack((sum >> 2) & kChannelsMask);
+		}
+	}
+	return result;
+}
+
+ImageMipChain::ImageMipChain(QImage original) {
+	Expects(!original.isNull());
+
+	_levels.push_back(std::move(original));
+}
+
+QSize ImageMipChain::originalSize() const {
+	return _levels.front().size();
+}
+
+const QImage &ImageMipChain::original() const {
+	return _levels.front();
+}
+
+QImage ImageMipChain::fitted(int box) {
+	Expects(box > 0);
+
+	const auto size = originalSize();
+	if (size.width() <= box && size.height() <= box) {
+		return original();
+	}
+	return scaled(size.scaled(
+		box,
+		box,
+		Qt::KeepAspectRatio).expandedTo(QSize(1, 1)));
+}
+
+QImage ImageMipChain::scaled(QSize size) {
+	Expects(!size.isEmpty());
+
+	const auto &level = levelFor(size);
+	if (level.size() == size) {
+		return level;
+	}
+	return level.scaled(
+		size,
+		Qt::IgnoreAspectRatio,
+		Qt::SmoothTransformation);
+}
+
+const QImage &ImageMipChain::levelFor(QSize size) {
+	auto index = 0;
+	while (true) {
+		const auto halfWidth = _levels[index].width() / 2;
+		const auto halfHeight = _levels[index].height() / 2;
+		if (halfWidth < size.width() || halfHeight < size.height()) {
+			return _levels[index];
+		} else if (index + 1 == int(_levels.size())) {
+			auto half = HalveImage(_levels[index]);
+			if (half.isNull()) {
+				return _levels[index];
+			}
+			_levels.push_back(std::move(half));
+		}
+		++index;
+	}
+}
+
+QImage DownscaleImage(QImage original, QSize size) {
+	if (original.size() == size) {
+		return original;
+	}
+	return ImageMipChain(std::move(original)).scaled(size);
+}
+
+} // namespace Storage
@@ -0,0 +1,44 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <QtGui/QImage>
+
+namespace Storage {
+
+// Averages each 2x2 block of pixels, odd last row / column are dropped.
+// The result is RGB32 for opaque images, ARGB32_Premultiplied otherwise.
+[[nodiscard]] QImage HalveImage(const QImage &image);
+
+// Prepares several downscaled copies of one large image.
+// The original is halved by a box filter while the result is still
+// at least as large as the requested size, and only the last step from
+// the nearest level is done by the smooth QImage::scaled().
+// The levels are cached, so all sizes share the expensive first passes.
+class ImageMipChain {
+public:
+	explicit ImageMipChain(QImage original);
+
+	[[nodiscard]] QSize originalSize() const;
+	[[nodiscard]] const QImage &original() const;
+
+	// Images not larger than box x box are returned without scaling.
+	[[nodiscard]] QImage fitted(int box);
+	[[nodiscard]] QImage scaled(QSize size);
+
+private:
+	[[nodiscard]] const QImage &levelFor(QSize size);
+
+	std::vector<QImage> _levels;
+
+};
+
+// One time downscale through a temporary mip chain.
+[[nodiscard]] QImage DownscaleImage(QImage original, QSize size);
+
+} // namespace Storage
@@ -0,0 +1,64 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_image_scale.h"
+#include "core/benchmark_helpers.h"
+
+namespace {
+
+// Thumbnail sizes prepared for a sent photo and for a peer photo.
+const auto kBoxes = { 100, 160, 320, 1280 };
+
+QImage GenerateImage(int width, int height) {
+	auto result = QImage(width, height, QImage::Format_RGB32);
+	for (auto y = 0; y != height; ++y) {
+		const auto line = reinterpret_cast<uint32*>(result.scanLine(y));
+		for (auto x = 0; x != width; ++x) {
+			line[x] = 0xFF000000U | uint32(x * 7 + y * 13) * 2654435761U;
+		}
+	}
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("benchmark thumbnails scaling", "[storage_image_scale]") {
+	const auto sizes = {
+		QSize(4000, 3000), // 12 MP
+		QSize(6000, 4000), // 24 MP
+		QSize(8000, 6000), // 48 MP
+	};
+	for (const auto size : sizes) {
+		const auto image = GenerateImage(size.width(), size.height());
+
+		const auto qt = Core::MeasureMilliseconds([&] {
+			for (const auto box : kBoxes) {
+				const auto scaled = image.scaled(
+					box,
+					box,
+					Qt::KeepAspectRatio,
+					Qt::SmoothTransformation);
+				REQUIRE(!scaled.isNull());
+			}
+		});
+		const auto chain = Core::MeasureMilliseconds([&] {
+			auto chain = Storage::ImageMipChain(image);
+			for (const auto box : kBoxes) {
+				const auto scaled = chain.fitted(box);
+				REQUIRE(!scaled.isNull());
+			}
+		});
+		WARN((size.width() * size.height() / 1000000)
+			<< " MP: QImage::scaled "
+			<< int(qt)
+			<< " ms, mip chain "
+			<< int(chain)
+			<< " ms");
+	}
+}
@@ -0,0 +1,72 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_image_scale.h"
+
+namespace {
+
+QImage Checkers(int width, int height, QRgb first, QRgb second) {
+	auto result = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+	for (auto y = 0; y != height; ++y) {
+		const auto line = reinterpret_cast<QRgb*>(result.scanLine(y));
+		for (auto x = 0; x != width; ++x) {
+			line[x] = ((x + y) % 2) ? second : first;
+		}
+	}
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("image halving", "[storage_image_scale]") {
+	SECTION("averaging channels of 2x2 blocks") {
+		const auto image = Checkers(4, 2, 0xFF204060U, 0xFF406080U);
+		const auto half = Storage::HalveImage(image);
+		REQUIRE(half.size() == QSize(2, 1));
+		REQUIRE(half.pixel(0, 0) == 0xFF305070U);
+		REQUIRE(half.pixel(1, 0) == 0xFF305070U);
+	}
+	SECTION("rounding and full channel range") {
+		const auto image = Checkers(2, 2, 0xFFFFFFFFU, 0xFF000001U);
+		const auto half = Storage::HalveImage(image);
+		REQUIRE(half.pixel(0, 0) == 0xFF808080U);
+	}
+	SECTION("dropping odd last row and column") {
+		const auto image = Checkers(5, 3, 0xFF000000U, 0xFF000000U);
+		REQUIRE(Storage::HalveImage(image).size() == QSize(2, 1));
+	}
+	SECTION("keeping opaque images opaque") {
+		auto image = QImage(8, 8, QImage::Format_RGB888);
+		image.fill(Qt::red);
+		const auto half = Storage::HalveImage(image);
+		REQUIRE(half.format() == QImage::Format_RGB32);
+		REQUIRE(half.pixel(3, 3) == 0xFFFF0000U);
+	}
+}
+
+TEST_CASE("image mip chain", "[storage_image_scale]") {
+	auto chain = Storage::ImageMipChain(
+		Checkers(1000, 500, 0xFF000000U, 0xFFFFFFFFU));
+
+	SECTION("fitting into a box keeps aspect ratio") {
+		REQUIRE(chain.fitted(100).size() == QSize(100, 50));
+		REQUIRE(chain.fitted(320).size() == QSize(320, 160));
+		REQUIRE(chain.fitted(1280).size() == QSize(1000, 500));
+	}
+	SECTION("exact sizes") {
+		REQUIRE(chain.scaled(QSize(250, 125)).size() == QSize(250, 125));
+		REQUIRE(chain.scaled(QSize(33, 77)).size() == QSize(33, 77));
+	}
+	SECTION("box filter averages fine details") {
+		const auto small = chain.scaled(QSize(125, 125));
+		const auto gray = qGray(small.pixel(60, 60));
+		REQUIRE(gray > 120);
+		REQUIRE(gray < 136);
+	}
+}
@@ -9,6 +9,7 @@ https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
 
 #include "platform/platform_file_utilities.h"
 #include "storage/localimageloader.h"
+#include "storage/storage_image_scale.h"
 #include "core/mime_type.h"
 #include "ui/image/image_prepare.h"
 #include "app.h"
@@ -89,10 +90,16 @@ bool PrepareAlbumMediaIsWaiting(
 				&file.information->media)) {
 			if (ValidPhotoForAlbum(*image, file.mime)) {
 				file.shownDimensions = PrepareShownDimensions(image->data);
-				file.preview = Images::prepareOpaque(image->data.scaledToWidth(
-					std::min(previewWidth, style::ConvertScale(image->data.width()))
-						* cIntRetinaFactor(),
-					Qt::SmoothTransformation));
+				const auto width = std::min(
+					previewWidth,
+					style::ConvertScale(image->data.width())
+				) * cIntRetinaFactor();
+				const auto height = std::max(int(std::round(
+					image->data.height() * width
+						/ float64(image->data.width()))), 1);
+				file.preview = Images::prepareOpaque(DownscaleImage(
+					image->data,
+					QSize(width, height)));
 				Assert(!file.preview.isNull());
 				file.preview.setDevicePixelRatio(cRetinaFactor());
 				file.type = PreparedFile::AlbumType::Photo;
@@ -0,0 +1,234 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_task_queue.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+
+TaskQueue::TaskQueue(crl::time stopTimeoutMs, int workersCount)
+: _workersCount(std::max(workersCount, 1)) {
+	if (stopTimeoutMs > 0) {
+		_stopTimer = new QTimer(this);
+		connect(_stopTimer, &QTimer::timeout, this, [=] { stop(); });
+		_stopTimer->setSingleShot(true);
+		_stopTimer->setInterval(int(stopTimeoutMs));
+	}
+}
+
+TaskId TaskQueue::addTask(
+		std::unique_ptr<Task> &&task,
+		TaskPriority priority) {
+	const auto result = task->id();
+	_finishOrder.push_back(result);
+	{
+		QMutexLocker lock(&_tasksToProcessMutex);
+		enqueue(std::move(task), priority);
+	}
+
+	wakeThreads();
+
+	return result;
+}
+
+void TaskQueue::addTasks(
+		std::vector<std::unique_ptr<Task>> &&tasks,
+		TaskPriority priority) {
+	for (const auto &task : tasks) {
+		_finishOrder.push_back(task->id());
+	}
+	{
+		QMutexLocker lock(&_tasksToProcessMutex);
+		for (auto &task : tasks) {
+			enqueue(std::move(task), priority);
+		}
+	}
+
+	wakeThreads();
+}
+
+void TaskQueue::enqueue(std::unique_ptr<Task> &&task, TaskPriority priority) {
+	task->_priority = priority;
+
+	const auto lower = [&](const std::unique_ptr<Task> &queued) {
+		return queued->priority() < priority;
+	};
+	const auto i = ranges::find_if(_tasksToProcess, lower);
+	_tasksToProcess.insert(i, std::move(task));
+}
+
+void TaskQueue::wakeThreads() {
+	if (_threads.empty()) {
+		_threads.reserve(_workersCount);
+		_workers.reserve(_workersCount);
+		for (auto i = 0; i != _workersCount; ++i) {
+			const auto thread = new QThread();
+			const auto worker = new TaskQueueWorker(this);
+			worker->moveToThread(thread);
+
+			thread->start();
+			_threads.push_back(thread);
+			_workers.push_back(worker);
+		}
+	}
+	if (_stopTimer) _stopTimer->stop();
+	for (const auto worker : _workers) {
+		QTimer::singleShot(0, worker, [=] { worker->taskAdded(); });
+	}
+}
+
+void TaskQueue::cancelTask(TaskId id) {
+	const auto proj = [](const std::unique_ptr<Task> &task) {
+		return task->id();
+	};
+	const auto removeFrom = [&](std::deque<std::unique_ptr<Task>> &queue) {
+		auto i = ranges::find(queue, id, proj);
+		if (i != queue.end()) {
+			queue.erase(i);
+		}
+	};
+	{
+		QMutexLocker lock(&_tasksToProcessMutex);
+		removeFrom(_tasksToProcess);
+
+		// The worker owns the task while processing it, it will drop
+		// the result when it doesn't find the task in _tasksInProcess.
+		const auto i = ranges::find(_tasksInProcess, id, [](Task *task) {
+			return task->id();
+		});
+		if (i != _tasksInProcess.end()) {
+			(*i)->_cancelled = true;
+			_tasksInProcess.erase(i);
+		}
+	}
+	{
+		QMutexLocker lock(&_tasksToFinishMutex);
+		removeFrom(_tasksToFinish);
+	}
+	const auto i = ranges::find(_finishOrder, id);
+	if (i != _finishOrder.end()) {
+		_finishOrder.erase(i);
+	}
+}
+
+std::unique_ptr<Task> TaskQueue::takeTaskToFinish() {
+	if (_finishOrder.empty()) {
+		return nullptr;
+	}
+	const auto proj = [](const std::unique_ptr<Task> &task) {
+		return task->id();
+	};
+	auto result = std::unique_ptr<Task>();
+	{
+		QMutexLocker lock(&_tasksToFinishMutex);
+		const auto i = ranges::find(
+			_tasksToFinish,
+			_finishOrder.front(),
+			proj);
+		if (i == _tasksToFinish.end()) {
+			// The earliest added task is still in process.
+			return nullptr;
+		}
+		result = std::move(*i);
+		_tasksToFinish.erase(i);
+	}
+	_finishOrder.pop_front();
+	return result;
+}
+
+void TaskQueue::taskProcessed() {
+	while (auto task = takeTaskToFinish()) {
+		task->finish();
+	}
+
+	if (_stopTimer) {
+		QMutexLocker lock(&_tasksToProcessMutex);
+		if (_tasksToProcess.empty() && _tasksInProcess.empty()) {
+			_stopTimer->start();
+		}
+	}
+}
+
+void TaskQueue::stop() {
+	if (!_threads.empty()) {
+		{
+			QMutexLocker lock(&_tasksToProcessMutex);
+			for (const auto task : base::take(_tasksInProcess)) {
+				task->_cancelled = true;
+			}
+		}
+		for (const auto thread : _threads) {
+			thread->requestInterruption();
+			thread->quit();
+		}
+		DEBUG_LOG(("Waiting for taskThreads to finish"));
+		for (const auto thread : _threads) {
+			thread->wait();
+		}
+		for (const auto worker : base::take(_workers)) {
+			delete worker;
+		}
+		for (const auto thread : base::take(_threads)) {
+			delete thread;
+		}
+	}
+	_tasksToProcess.clear();
+	_tasksToFinish.clear();
+	_tasksInProcess.clear();
+	_finishOrder.clear();
+}
+
+TaskQueue::~TaskQueue() {
+	stop();
+	delete _stopTimer;
+}
+
+void TaskQueueWorker::taskAdded() {
+	if (_inTaskAdded) return;
+	_inTaskAdded = true;
+
+	bool someTasksLeft = false;
+	do {
+		auto task = std::unique_ptr<Task>();
+		{
+			QMutexLocker lock(&_queue->_tasksToProcessMutex);
+			if (!_queue->_tasksToProcess.empty()) {
+				task = std::move(_queue->_tasksToProcess.front());
+				_queue->_tasksToProcess.pop_front();
+				_queue->_tasksInProcess.push_back(task.get());
+			}
+		}
+
+		if (task) {
+			task->process();
+			bool notifyProcessed = false;
+			{
+				QMutexLocker lockToProcess(&_queue->_tasksToProcessMutex);
+				auto &inProcess = _queue->_tasksInProcess;
+				const auto i = ranges::find(inProcess, task.get());
+				if (i != inProcess.end()) {
+					inProcess.erase(i);
+
+					// Always notify, the previous processed task could be
+					// waiting in _tasksToFinish for this one to finish first.
+					QMutexLocker lockToFinish(&_queue->_tasksToFinishMutex);
+					_queue->_tasksToFinish.push_back(std::move(task));
+					notifyProcessed = true;
+				}
+				someTasksLeft = !_queue->_tasksToProcess.empty();
+			}
+			if (notifyProcessed) {
+				const auto queue = _queue;
+				QTimer::singleShot(0, queue, [=] { queue->taskProcessed(); });
+			}
+		}
+		QCoreApplication::processEvents();
+	} while (someTasksLeft && !thread()->isInterruptionRequested());
+
+	_inTaskAdded = false;
+}
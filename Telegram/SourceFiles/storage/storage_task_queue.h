@@ -0,0 +1,114 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <QtCore/QObject>
+#include <QtCore/QMutex>
+#include <crl/crl_time.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+
+class QThread;
+class QTimer;
+
+using TaskId = void*; // no interface, just id
+
+// Higher priority tasks are processed first, FIFO within one priority.
+// The priority doesn't change the order of finish() calls.
+enum class TaskPriority {
+	Background,
+	Normal,
+	High,
+};
+
+class Task {
+public:
+	virtual void process() = 0; // is executed in a separate thread
+	virtual void finish() = 0; // is executed in the same as TaskQueue thread
+	virtual ~Task() = default;
+
+	TaskId id() const {
+		return static_cast<TaskId>(const_cast<Task*>(this));
+	}
+	TaskPriority priority() const {
+		return _priority;
+	}
+
+	// May be checked from process() to stop the work of a cancelled task.
+	bool cancelled() const {
+		return _cancelled.load(std::memory_order_relaxed);
+	}
+
+private:
+	friend class TaskQueue;
+
+	TaskPriority _priority = TaskPriority::Normal;
+	std::atomic<bool> _cancelled = false;
+
+};
+
+class TaskQueueWorker;
+
+// All the methods are called on the thread that created the queue,
+// the workers only take tasks to process and return the processed ones.
+class TaskQueue : public QObject {
+public:
+	// stopTimeoutMs <= 0 - never stop workers.
+	explicit TaskQueue(crl::time stopTimeoutMs = 0, int workersCount = 1);
+
+	TaskId addTask(
+		std::unique_ptr<Task> &&task,
+		TaskPriority priority = TaskPriority::Normal);
+	void addTasks(
+		std::vector<std::unique_ptr<Task>> &&tasks,
+		TaskPriority priority = TaskPriority::Normal);
+	void cancelTask(TaskId id); // this task finish() won't be called
+
+	void stop();
+
+	~TaskQueue();
+
+private:
+	friend class TaskQueueWorker;
+
+	void enqueue(std::unique_ptr<Task> &&task, TaskPriority priority);
+	void wakeThreads();
+	void taskProcessed();
+	std::unique_ptr<Task> takeTaskToFinish();
+
+	// Priorities and several workers change the order of processing,
+	// but finish() is always called in the order of addTask() calls.
+	// The workers never access it, so it is used without locking.
+	std::deque<TaskId> _finishOrder;
+
+	std::deque<std::unique_ptr<Task>> _tasksToProcess;
+	std::deque<std::unique_ptr<Task>> _tasksToFinish;
+	std::vector<Task*> _tasksInProcess;
+	QMutex _tasksToProcessMutex, _tasksToFinishMutex;
+	int _workersCount = 1;
+	std::vector<QThread*> _threads;
+	std::vector<TaskQueueWorker*> _workers;
+	QTimer *_stopTimer = nullptr;
+
+};
+
+class TaskQueueWorker : public QObject {
+public:
+	TaskQueueWorker(TaskQueue *queue) : _queue(queue) {
+	}
+
+	void taskAdded();
+
+private:
+	TaskQueue *_queue;
+	bool _inTaskAdded = false;
+
+};
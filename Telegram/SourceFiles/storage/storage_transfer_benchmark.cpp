@@ -0,0 +1,413 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_download_sessions.h"
+#include "storage/storage_upload_sessions.h"
+#include "storage/storage_file_sink.h"
+#include "media/streaming/media_streaming_loader.h"
+#include "core/benchmark_helpers.h"
+#include <deque>
+#include <limits>
+#include <map>
+#include <random>
+#include <utility>
+
+namespace {
+
+using Media::Streaming::Loader;
+using Media::Streaming::PriorityQueue;
+
+// MTP::kDownloadSessionsCount and MTP::kUploadSessionsCount.
+constexpr auto kSessionsCount = 2;
+
+constexpr auto kPartSize = Loader::kPartSize;
+constexpr auto kFileSize = 64 * 1024 * 1024 + 1000;
+constexpr auto kLostRequestTimeout = crl::time(5000);
+
+// Uploader starts a document of that size with 128 KB parts
+// and sends a part each half second if the answers are slower.
+constexpr auto kUploadStartPartSize = 128 * 1024;
+constexpr auto kUploadMaxPartSize = 512 * 1024;
+constexpr auto kUploadRequestInterval = crl::time(500);
+
+const auto Name = QString("benchmark.download");
+
+struct Network {
+	const char *name = nullptr;
+	crl::time latency = 0; // One way.
+	int64 downloadBandwidth = 0; // Bytes per second.
+	int64 uploadBandwidth = 0;
+	int lossPercent = 0;
+	crl::time sessionSkew = 0; // Added latency of each next session.
+};
+
+struct Result {
+	crl::time duration = 0;
+	int requests = 0;
+	int64 peakInFlight = 0; // Bytes requested and not answered yet.
+	double handlingMilliseconds = 0.; // Scheduling and sink, measured.
+	crl::time seekLatency = 0;
+	int partSize = 0;
+};
+
+// Answers upload.getFile and upload.saveFilePart requests through one
+// pipe of a limited bandwidth in each direction, shared by the sessions,
+// so that too many parallel requests start to queue up.
+class FakeDc final {
+public:
+	explicit FakeDc(Network network) : _network(network) {
+	}
+
+	// Return the time when the answer comes back or zero if it is lost.
+	crl::time getFile(crl::time now, int index, int limit) {
+		if (lost()) {
+			return 0;
+		}
+		const auto latency = latencyFor(index);
+		const auto received = float64(now + latency);
+		const auto transfer = limit * 1000. / _network.downloadBandwidth;
+		_downloadFree = std::max(received, _downloadFree) + transfer;
+		return crl::time(std::ceil(_downloadFree)) + latency;
+	}
+	crl::time saveFilePart(crl::time now, int index, int size) {
+		if (lost()) {
+			return 0;
+		}
+		const auto transfer = size * 1000. / _network.uploadBandwidth;
+		_uploadFree = std::max(float64(now), _uploadFree) + transfer;
+		return crl::time(std::ceil(_uploadFree)) + 2 * latencyFor(index);
+	}
+
+private:
+	[[nodiscard]] bool lost() {
+		return (int(_random() % 100) < _network.lossPercent);
+	}
+	[[nodiscard]] crl::time latencyFor(int index) const {
+		return _network.latency + index * _network.sessionSkew;
+	}
+
+	Network _network;
+	float64 _downloadFree = 0.;
+	float64 _uploadFree = 0.;
+	std::mt19937 _random;
+
+};
+
+struct Request {
+	int offset = 0;
+	int index = 0;
+	crl::time sent = 0;
+	bool lost = false;
+};
+
+// Requests the parts in order the way mtpFileLoader does, keeping as many
+// of them in flight as the dc window allows, and writes them to a sink.
+Result DownloadFile(Network network) {
+	auto result = Result();
+	auto dc = FakeDc(network);
+	auto sessions = Storage::DownloadSessions(kSessionsCount, 0);
+	auto sink = Storage::FileSink(Name, kPartSize);
+	REQUIRE(sink.open(kFileSize));
+
+	auto part = QByteArray(kPartSize, Qt::Uninitialized);
+	for (auto i = 0; i != kPartSize; ++i) {
+		part[i] = char(i * 7);
+	}
+	const auto data = bytes::make_span(part);
+
+	auto now = crl::time(0);
+	auto nextOffset = 0;
+	auto resend = std::deque<int>();
+	auto events = std::multimap<crl::time, Request>();
+	const auto fill = [&] {
+		while (int(events.size()) < sessions.window().queriesLimit()) {
+			auto offset = nextOffset;
+			if (!resend.empty()) {
+				offset = resend.front();
+				resend.pop_front();
+			} else if (nextOffset < kFileSize) {
+				nextOffset += kPartSize;
+			} else {
+				break;
+			}
+			auto index = 0;
+			result.handlingMilliseconds += Core::MeasureMilliseconds([&] {
+				index = sessions.chooseIndex(kPartSize);
+				sessions.requestedAmountIncrement(index, kPartSize);
+			});
+			const auto limit = std::min(kPartSize, kFileSize - offset);
+			const auto answer = dc.getFile(now, index, limit);
+			const auto lost = !answer;
+			events.emplace(
+				lost ? (now + kLostRequestTimeout) : answer,
+				Request{ offset, index, now, lost });
+			++result.requests;
+		}
+		result.peakInFlight = std::max(
+			result.peakInFlight,
+			int64(events.size()) * kPartSize);
+	};
+
+	fill();
+	while (!events.empty()) {
+		const auto request = events.begin()->second;
+		now = events.begin()->first;
+		events.erase(events.begin());
+		result.handlingMilliseconds += Core::MeasureMilliseconds([&] {
+			sessions.requestedAmountIncrement(request.index, -kPartSize);
+			if (request.lost) {
+				return;
+			}
+			const auto offset = request.offset;
+			const auto limit = std::min(kPartSize, kFileSize - offset);
+			sessions.requestFinished(
+				request.index,
+				kPartSize,
+				now - request.sent,
+				now);
+			REQUIRE(sink.write(offset, data.subspan(0, limit)));
+		});
+		if (request.lost) {
+			resend.push_back(request.offset);
+		}
+		fill();
+	}
+	result.duration = now;
+
+	REQUIRE(sink.writtenBytes() == kFileSize);
+	sink.remove();
+	return result;
+}
+
+// Requests the parts from a queue the way LoaderMtproto does while
+// a video is played, the player seeks to the middle after a quarter.
+Result DownloadStreamed(Network network) {
+	auto result = Result();
+	auto dc = FakeDc(network);
+	auto sessions = Storage::DownloadSessions(kSessionsCount, 0);
+	auto queue = PriorityQueue();
+	for (auto offset = 0; offset < kFileSize; offset += kPartSize) {
+		queue.add(offset);
+	}
+
+	constexpr auto kSeekOffset = (kFileSize / 2) / kPartSize * kPartSize;
+	auto now = crl::time(0);
+	auto loaded = int64(0);
+	auto seekedAt = crl::time(-1);
+	auto received = base::flat_set<int>();
+	auto events = std::multimap<crl::time, Request>();
+	const auto sendNext = [&] {
+		while (int(events.size()) < Loader::kMaxConcurrentRequests) {
+			auto offset = 0;
+			auto index = 0;
+			auto taken = false;
+			result.handlingMilliseconds += Core::MeasureMilliseconds([&] {
+				if (const auto next = queue.take()) {
+					taken = true;
+					offset = *next;
+					index = sessions.chooseIndex(kPartSize);
+					sessions.requestedAmountIncrement(index, kPartSize);
+				}
+			});
+			if (!taken) {
+				break;
+			}
+			const auto limit = std::min(kPartSize, kFileSize - offset);
+			const auto answer = dc.getFile(now, index, limit);
+			const auto lost = !answer;
+			events.emplace(
+				lost ? (now + kLostRequestTimeout) : answer,
+				Request{ offset, index, now, lost });
+			++result.requests;
+		}
+	};
+
+	sendNext();
+	while (!events.empty()) {
+		const auto request = events.begin()->second;
+		now = events.begin()->first;
+		events.erase(events.begin());
+		result.handlingMilliseconds += Core::MeasureMilliseconds([&] {
+			sessions.requestedAmountIncrement(request.index, -kPartSize);
+			if (request.lost) {
+				queue.add(request.offset);
+				return;
+			}
+			sessions.requestFinished(
+				request.index,
+				kPartSize,
+				now - request.sent,
+				now);
+			received.emplace(request.offset);
+			loaded += std::min(kPartSize, kFileSize - request.offset);
+			if (seekedAt < 0 && loaded >= kFileSize / 4) {
+				seekedAt = now;
+				queue.increasePriority();
+				for (auto offset = kSeekOffset
+					; offset < kFileSize
+					; offset += kPartSize) {
+					if (!received.contains(offset)) {
+						queue.add(offset);
+					}
+				}
+			}
+		});
+		if (seekedAt >= 0
+			&& !result.seekLatency
+			&& received.contains(kSeekOffset)) {
+			result.seekLatency = std::max(now - seekedAt, crl::time(1));
+		}
+		sendNext();
+	}
+	result.duration = now;
+
+	REQUIRE(loaded == kFileSize);
+	return result;
+}
+
+// Sends the parts of a document the way Storage::Uploader does: a part
+// on each answer or each half second, while the sessions are not full.
+// Requests are upload.saveBigFilePart, as for all files above 10 MB.
+Result Upload(FakeDc &dc, Storage::UploadSessions &sessions, crl::time now) {
+	struct Part {
+		int index = 0;
+		int size = 0;
+		bool lost = false;
+	};
+
+	auto result = Result();
+	result.partSize = sessions.choosePartSize(
+		kUploadStartPartSize,
+		kUploadMaxPartSize,
+		kFileSize);
+	const auto partsCount = (kFileSize + result.partSize - 1)
+		/ result.partSize;
+	const auto started = now;
+	auto sentParts = 0;
+	auto inFlight = int64(0);
+	auto timerAt = crl::time(-1);
+	auto events = std::multimap<crl::time, Part>();
+	const auto sendNext = [&] {
+		auto index = -1;
+		result.handlingMilliseconds += Core::MeasureMilliseconds([&] {
+			if (!sessions.full() && sentParts < partsCount) {
+				index = sessions.chooseIndex();
+				sessions.partSent(index, result.partSize);
+			}
+		});
+		if (index < 0) {
+			return;
+		}
+		const auto size = (sentParts + 1 < partsCount)
+			? result.partSize
+			: (kFileSize - sentParts * result.partSize);
+		++sentParts;
+		++result.requests;
+		inFlight += result.partSize;
+		result.peakInFlight = std::max(result.peakInFlight, inFlight);
+
+		// MTP resends a lost request after a timeout.
+		const auto answer = dc.saveFilePart(now, index, size);
+		events.emplace(
+			answer ? answer : (now + kLostRequestTimeout),
+			Part{ index, result.partSize, !answer });
+		timerAt = now + kUploadRequestInterval;
+	};
+
+	sendNext();
+	while (sentParts < partsCount || inFlight > 0) {
+		const auto answer = events.empty()
+			? std::numeric_limits<crl::time>::max()
+			: events.begin()->first;
+		if (timerAt >= 0 && timerAt < answer) {
+			now = std::exchange(timerAt, -1);
+			sendNext();
+			continue;
+		}
+		const auto part = events.begin()->second;
+		now = answer;
+		events.erase(events.begin());
+		if (part.lost) {
+			const auto retry = dc.saveFilePart(now, part.index, part.size);
+			events.emplace(
+				retry ? retry : (now + kLostRequestTimeout),
+				Part{ part.index, part.size, !retry });
+			continue;
+		}
+		inFlight -= part.size;
+		result.handlingMilliseconds += Core::MeasureMilliseconds([&] {
+			sessions.partDone(part.index, part.size, now);
+		});
+		sendNext();
+	}
+	result.duration = now - started;
+	return result;
+}
+
+[[nodiscard]] double MegabytesPerSecond(const Result &result) {
+	const auto seconds = std::max(result.duration, crl::time(1)) / 1000.;
+	return kFileSize / seconds / (1024 * 1024);
+}
+
+const auto Networks = {
+	Network{ "local", 2, 100 * 1024 * 1024, 50 * 1024 * 1024, 0, 0 },
+	Network{ "broadband", 30, 10 * 1024 * 1024, 2 * 1024 * 1024, 0, 10 },
+	Network{ "mobile", 150, 1024 * 1024, 256 * 1024, 1, 40 },
+	Network{ "lossy", 80, 4 * 1024 * 1024, 1024 * 1024, 10, 0 },
+};
+
+} // namespace
+
+TEST_CASE("benchmark downloads with a simulated dc", "[storage_transfer]") {
+	for (const auto &network : Networks) {
+		const auto file = DownloadFile(network);
+		const auto streamed = DownloadStreamed(network);
+		WARN(network.name
+			<< ": file "
+			<< MegabytesPerSecond(file)
+			<< " simulated MB/s, "
+			<< file.requests
+			<< " requests, peak "
+			<< (file.peakInFlight / 1024)
+			<< " KB requested in flight, scheduling and sink "
+			<< int(file.handlingMilliseconds)
+			<< " ms; streamed "
+			<< MegabytesPerSecond(streamed)
+			<< " simulated MB/s, seek answered in "
+			<< streamed.seekLatency
+			<< " simulated ms, scheduling "
+			<< int(streamed.handlingMilliseconds)
+			<< " ms");
+	}
+}
+
+TEST_CASE("benchmark uploads with a simulated dc", "[storage_transfer]") {
+	for (const auto &network : Networks) {
+		// The second document uses the part size chosen by the speed
+		// measured while the first one was uploaded.
+		auto dc = FakeDc(network);
+		auto sessions = Storage::UploadSessions(kSessionsCount);
+		const auto first = Upload(dc, sessions, 0);
+		const auto second = Upload(dc, sessions, first.duration);
+		WARN(network.name
+			<< ": "
+			<< MegabytesPerSecond(first)
+			<< " simulated MB/s with "
+			<< (first.partSize / 1024)
+			<< " KB parts, then "
+			<< MegabytesPerSecond(second)
+			<< " simulated MB/s with "
+			<< (second.partSize / 1024)
+			<< " KB parts, "
+			<< (first.requests + second.requests)
+			<< " requests, scheduling "
+			<< int(first.handlingMilliseconds + second.handlingMilliseconds)
+			<< " ms");
+	}
+}
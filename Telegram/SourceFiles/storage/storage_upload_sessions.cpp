@@ -0,0 +1,84 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_upload_sessions.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kPartSendDuration = crl::time(200);
+constexpr auto kSpeedPeriod = crl::time(1000);
+
+} // namespace
+
+UploadSessions::UploadSessions(int count) : _sent(count, 0) {
+	Expects(count > 0);
+}
+
+bool UploadSessions::full() const {
+	return (_sentFull >= int64(_sent.size()) * kMaxSentPerSession);
+}
+
+int UploadSessions::chooseIndex() const {
+	return int(ranges::min_element(_sent) - begin(_sent));
+}
+
+void UploadSessions::partSent(int index, int size) {
+	Expects(index >= 0 && index < int(_sent.size()));
+
+	_sent[index] += size;
+	_sentFull += size;
+}
+
+void UploadSessions::partDone(int index, int size, crl::time now) {
+	Expects(index >= 0 && index < int(_sent.size()));
+
+	_sent[index] -= size;
+	_sentFull -= size;
+	updateSpeed(size, now);
+}
+
+void UploadSessions::clear() {
+	ranges::fill(_sent, 0);
+	_sentFull = 0;
+}
+
+int64 UploadSessions::bytesPerSecond() const {
+	return _bytesPerSecond;
+}
+
+int UploadSessions::choosePartSize(
+		int partSize,
+		int maxPartSize,
+		int64 fileSize) const {
+	Expects(partSize > 0);
+
+	const auto preferred = _bytesPerSecond
+		* kPartSendDuration
+		/ (crl::time(1000) * int64(_sent.size()));
+	while (partSize < maxPartSize
+		&& partSize * int64(2) <= preferred
+		&& partSize < fileSize) {
+		partSize *= 2;
+	}
+	return partSize;
+}
+
+void UploadSessions::updateSpeed(int size, crl::time now) {
+	const auto passed = now - _speedPeriodStart;
+	_speedPeriodBytes += size;
+	if (passed < kSpeedPeriod) {
+		return;
+	} else if (passed < 4 * kSpeedPeriod) {
+		// Longer periods include the time when nothing was uploaded.
+		_bytesPerSecond = _speedPeriodBytes * 1000 / passed;
+	}
+	_speedPeriodStart = now;
+	_speedPeriodBytes = 0;
+}
+
+} // namespace Storage
@@ -0,0 +1,50 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include <vector>
+
+namespace Storage {
+
+// Parts of the uploaded files sent to the upload sessions. A new part
+// goes to the session with the least bytes in flight, until there is
+// 512 KB in flight for each session. The measured speed chooses larger
+// parts on fast connections, so that each session sends a part in 200 ms.
+class UploadSessions final {
+public:
+	static constexpr auto kMaxSentPerSession = 512 * 1024;
+
+	explicit UploadSessions(int count);
+
+	[[nodiscard]] bool full() const;
+	[[nodiscard]] int chooseIndex() const;
+
+	void partSent(int index, int size);
+	void partDone(int index, int size, crl::time now);
+
+	// Forgets the parts in flight, the measured speed is kept.
+	void clear();
+
+	[[nodiscard]] int64 bytesPerSecond() const;
+	[[nodiscard]] int choosePartSize(
+		int partSize,
+		int maxPartSize,
+		int64 fileSize) const;
+
+private:
+	void updateSpeed(int size, crl::time now);
+
+	std::vector<int64> _sent;
+	int64 _sentFull = 0;
+	crl::time _speedPeriodStart = 0;
+	int64 _speedPeriodBytes = 0;
+	int64 _bytesPerSecond = 0;
+
+};
+
+} // namespace Storage
@@ -0,0 +1,62 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_upload_sessions.h"
+
+namespace {
+
+constexpr auto kPartSize = 128 * 1024;
+constexpr auto kMaxPartSize = 512 * 1024;
+constexpr auto kFileSize = 64 * 1024 * 1024;
+
+} // namespace
+
+TEST_CASE("upload sessions", "[storage_upload_sessions]") {
+	using Sessions = Storage::UploadSessions;
+
+	auto sessions = Sessions(2);
+
+	SECTION("sending parts to the least loaded session") {
+		REQUIRE(sessions.chooseIndex() == 0);
+		sessions.partSent(0, kPartSize);
+		REQUIRE(sessions.chooseIndex() == 1);
+		sessions.partSent(1, 2 * kPartSize);
+		REQUIRE(sessions.chooseIndex() == 0);
+		sessions.partDone(1, 2 * kPartSize, 100);
+		REQUIRE(sessions.chooseIndex() == 1);
+	}
+	SECTION("limiting the bytes in flight") {
+		const auto limit = 2 * Sessions::kMaxSentPerSession / kPartSize;
+		for (auto i = 0; i != limit; ++i) {
+			REQUIRE(!sessions.full());
+			sessions.partSent(sessions.chooseIndex(), kPartSize);
+		}
+		REQUIRE(sessions.full());
+		sessions.clear();
+		REQUIRE(!sessions.full());
+	}
+	SECTION("choosing larger parts on fast connections") {
+		REQUIRE(sessions.choosePartSize(kPartSize, kMaxPartSize, kFileSize)
+			== kPartSize);
+
+		// The first answer starts the speed measuring period.
+		sessions.partSent(0, kPartSize);
+		sessions.partDone(0, kPartSize, 10000);
+		for (auto i = 1; i <= 80; ++i) {
+			sessions.partSent(0, kPartSize);
+			sessions.partDone(0, kPartSize, 10000 + i * 25);
+		}
+		// Forty parts were answered in each of the two periods.
+		REQUIRE(sessions.bytesPerSecond() == 40 * int64(kPartSize));
+		REQUIRE(sessions.choosePartSize(kPartSize, kMaxPartSize, kFileSize)
+			== kMaxPartSize);
+		REQUIRE(sessions.choosePartSize(kPartSize, kMaxPartSize, kPartSize)
+			== kPartSize);
+	}
+}
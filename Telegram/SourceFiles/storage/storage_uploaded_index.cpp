@@ -0,0 +1,157 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_uploaded_index.h"
+
+#include "data/data_session.h"
+#include "data/data_document.h"
+#include "data/data_types.h"
+#include "storage/cache/storage_cache_database.h"
+#include "base/openssl_help.h"
+
+#include <QtCore/QDataStream>
+
+namespace Storage {
+namespace {
+
+// Smaller files are uploaded faster than the hash of them is checked.
+constexpr auto kMinIndexedSize = 1024 * 1024;
+constexpr auto kHashChunkSize = 1024 * 1024;
+constexpr auto kSerializeVersion = qint32(1);
+
+QByteArray Serialize(const MTPDinputDocument &data) {
+	auto result = QByteArray();
+	{
+		QDataStream stream(&result, QIODevice::WriteOnly);
+		stream.setVersion(QDataStream::Qt_5_1);
+		stream
+			<< kSerializeVersion
+			<< quint64(data.vid().v)
+			<< quint64(data.vaccess_hash().v)
+			<< data.vfile_reference().v;
+	}
+	return result;
+}
+
+std::optional<MTPInputDocument> Deserialize(const QByteArray &value) {
+	if (value.isEmpty()) {
+		return std::nullopt;
+	}
+	QDataStream stream(value);
+	stream.setVersion(QDataStream::Qt_5_1);
+
+	auto version = qint32();
+	auto id = quint64();
+	auto accessHash = quint64();
+	auto fileReference = QByteArray();
+	stream >> version >> id >> accessHash >> fileReference;
+	if (stream.status() != QDataStream::Ok
+		|| version != kSerializeVersion
+		|| !id) {
+		return std::nullopt;
+	}
+	return MTP_inputDocument(
+		MTP_long(id),
+		MTP_long(accessHash),
+		MTP_bytes(fileReference));
+}
+
+} // namespace
+
+std::optional<Cache::Key> ComputeUploadedFileKey(
+		const QFileInfo &info,
+		Fn<bool()> cancelled) {
+	const auto size = info.size();
+	if (size < kMinIndexedSize) {
+		return std::nullopt;
+	}
+	auto file = QFile(info.absoluteFilePath());
+	if (!file.open(QIODevice::ReadOnly)) {
+		return std::nullopt;
+	}
+
+	SHA256_CTX context;
+	SHA256_Init(&context);
+
+	const auto path = info.absoluteFilePath().toUtf8();
+	const auto modified = qint64(info.lastModified().toMSecsSinceEpoch());
+	SHA256_Update(&context, path.constData(), path.size());
+	SHA256_Update(&context, &size, sizeof(size));
+	SHA256_Update(&context, &modified, sizeof(modified));
+
+	auto buffer = bytes::vector(kHashChunkSize);
+	auto hashed = qint64(0);
+	while (hashed < size) {
+		if (cancelled()) {
+			return std::nullopt;
+		}
+		const auto read = file.read(
+			reinterpret_cast<char*>(buffer.data()),
+			buffer.size());
+		if (read <= 0) {
+			break;
+		}
+		SHA256_Update(&context, buffer.data(), read);
+		hashed += read;
+	}
+	if (hashed != size) {
+		// The file was changed while we were reading it.
+		return std::nullopt;
+	}
+	auto hash = bytes::vector(SHA256_DIGEST_LENGTH);
+	SHA256_Final(reinterpret_cast<uchar*>(hash.data()), &context);
+	return Data::UploadedFileCacheKey(hash);
+}
+
+UploadedIndex::UploadedIndex(not_null<Data::Session*> owner)
+: _owner(owner) {
+}
+
+void UploadedIndex::find(
+		const Cache::Key &key,
+		FnMut<void(std::optional<MTPInputDocument>)> done) {
+	_owner->cache().get(key, [done = std::move(done)](
+			QByteArray &&value) mutable {
+		crl::on_main([
+			done = std::move(done),
+			value = std::move(value)
+		]() mutable {
+			done(Deserialize(value));
+		});
+	});
+}
+
+void UploadedIndex::forget(const Cache::Key &key) {
+	_owner->cache().remove(key);
+}
+
+void UploadedIndex::expect(
+		not_null<DocumentData*> document,
+		const Cache::Key &key) {
+	_expected[document] = key;
+}
+
+void UploadedIndex::documentConverted(not_null<DocumentData*> document) {
+	const auto i = _expected.find(document);
+	if (i == end(_expected)) {
+		return;
+	}
+	const auto key = i->second;
+	_expected.erase(i);
+
+	const auto input = document->mtpInput();
+	if (input.type() == mtpc_inputDocument) {
+		_owner->cache().put(key, Serialize(input.c_inputDocument()));
+	}
+}
+
+bool UploadedIndex::IsReferenceError(const RPCError &error) {
+	return error.type().startsWith(qstr("FILE_REFERENCE_"))
+		|| (error.type() == qstr("MEDIA_EMPTY"));
+}
+
+} // namespace Storage
@@ -0,0 +1,51 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "storage/cache/storage_cache_types.h"
+
+class DocumentData;
+
+namespace Data {
+class Session;
+} // namespace Data
+
+namespace Storage {
+
+// Hashes the path, size, modification time and the whole content
+// of a local file, reading it by chunks. Small files are skipped.
+// Is executed in a separate thread, stops as soon as cancelled() is true.
+[[nodiscard]] std::optional<Cache::Key> ComputeUploadedFileKey(
+	const QFileInfo &info,
+	Fn<bool()> cancelled);
+
+// Remembers server references of the sent local files in the cache
+// database, so that the same file sent once more is not uploaded again.
+class UploadedIndex final {
+public:
+	explicit UploadedIndex(not_null<Data::Session*> owner);
+
+	// done() is called in the main thread with the saved reference.
+	void find(
+		const Cache::Key &key,
+		FnMut<void(std::optional<MTPInputDocument>)> done);
+	void forget(const Cache::Key &key);
+
+	// The key is saved when the server version of the document arrives.
+	void expect(not_null<DocumentData*> document, const Cache::Key &key);
+	void documentConverted(not_null<DocumentData*> document);
+
+	[[nodiscard]] static bool IsReferenceError(const RPCError &error);
+
+private:
+	const not_null<Data::Session*> _owner;
+	base::flat_map<not_null<DocumentData*>, Cache::Key> _expected;
+
+};
+
+} // namespace Storage
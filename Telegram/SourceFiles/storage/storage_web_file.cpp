@@ -0,0 +1,166 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "storage/storage_web_file.h"
+
+namespace Storage {
+
+WebFileWriter::WebFileWriter(const QString &path) : _path(path) {
+	Expects(!_path.isEmpty());
+
+	_ranges.reserve(kMaxRanges);
+	restart();
+}
+
+QString WebFileWriter::path() const {
+	return _path;
+}
+
+void WebFileWriter::restart() {
+	_ranges.clear();
+	_ranges.push_back(Range());
+}
+
+void WebFileWriter::setSize(int64 size) {
+	_size = std::max(size, int64(0));
+}
+
+int64 WebFileWriter::size() const {
+	return _size;
+}
+
+void WebFileWriter::setRangesSupported() {
+	_rangesSupported = true;
+}
+
+bool WebFileWriter::rangesSupported() const {
+	return _rangesSupported;
+}
+
+auto WebFileWriter::ranges() const -> const std::vector<Range>& {
+	return _ranges;
+}
+
+QByteArray WebFileWriter::rangeHeader(int index) const {
+	Expects(index >= 0 && index < int(_ranges.size()));
+
+	const auto &range = _ranges[index];
+	const auto from = range.offset + range.buffer.size();
+	auto result = "bytes=" + QByteArray::number(from) + "-";
+	if (range.till) {
+		result += QByteArray::number(range.till - 1);
+	}
+	return result;
+}
+
+bool WebFileWriter::retryRange(int index) {
+	Expects(index >= 0 && index < int(_ranges.size()));
+
+	auto &range = _ranges[index];
+	if (!_rangesSupported || range.done || range.retriesLeft <= 0) {
+		return false;
+	}
+	--range.retriesLeft;
+	return true;
+}
+
+bool WebFileWriter::splitToRanges() {
+	if (!_rangesSupported
+		|| _ranges.size() != 1
+		|| _ranges.front().till
+		|| received() > 0) {
+		return false;
+	}
+	const auto count = std::clamp(
+		int(_size / kMinRangeSize),
+		1,
+		kMaxRanges);
+	if (count < 2) {
+		return false;
+	}
+	const auto aligned = [&](int index) {
+		const auto offset = _size * index / count;
+		return offset - (offset % kPartSize);
+	};
+	for (auto index = 1; index != count; ++index) {
+		auto range = Range();
+		range.offset = aligned(index);
+		range.till = (index + 1 == count) ? _size : aligned(index + 1);
+		_ranges.push_back(std::move(range));
+	}
+	_ranges.front().till = _ranges[1].offset;
+	return true;
+}
+
+bool WebFileWriter::feed(int index, QByteArray data, bool complete) {
+	Expects(index >= 0 && index < int(_ranges.size()));
+
+	auto &range = _ranges[index];
+	if (range.till) {
+		const auto left = range.till - range.offset - range.buffer.size();
+		if (data.size() >= left) {
+			data.truncate(int(left));
+			complete = true;
+		}
+	}
+	range.buffer.append(data);
+	if (!_sink) {
+		_sink = std::make_unique<FileSink>(PartialFilePath(_path), kPartSize);
+	}
+	if (!_sink->isOpen() && !_sink->open(_size)) {
+		return false;
+	}
+	while (range.buffer.size() >= kPartSize
+		|| (complete && !range.buffer.isEmpty())) {
+		const auto size = std::min(range.buffer.size(), kPartSize);
+		const auto part = bytes::make_span(range.buffer).subspan(0, size);
+		if (!_sink->write(range.offset, part)) {
+			return false;
+		}
+		range.offset += size;
+		range.buffer.remove(0, size);
+	}
+	range.done = complete;
+	return true;
+}
+
+int64 WebFileWriter::received() const {
+	auto result = _sink ? _sink->writtenBytes() : int64(0);
+	for (const auto &range : _ranges) {
+		result += range.buffer.size();
+	}
+	return result;
+}
+
+bool WebFileWriter::complete() const {
+	return (_size > 0)
+		&& _sink
+		&& (_sink->writtenBytes() >= _size)
+		&& ranges::all_of(_ranges, &Range::done);
+}
+
+bool WebFileWriter::finish() {
+	Expects(complete());
+
+	const auto partial = _sink->fileName();
+	if (!_sink->finish()) {
+		return false;
+	} else if (!MovePartialFile(partial, _path)) {
+		QFile::remove(partial);
+		return false;
+	}
+	_finished = true;
+	return true;
+}
+
+WebFileWriter::~WebFileWriter() {
+	if (_sink && !_finished) {
+		_sink->remove();
+	}
+}
+
+} // namespace Storage
@@ -0,0 +1,90 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#pragma once
+
+#include "storage/storage_file_sink.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include <memory>
+#include <vector>
+
+namespace Storage {
+
+// Writes a web file that is received in one or several HTTP ranges to
+// the "<path>.part" file and moves it to the path when all are done.
+// Each range keeps less than a part of not written data in memory.
+//
+// An interrupted range is requested again from its last received byte,
+// but only while the writer lives: the partial file is removed if it
+// was not finished, so a download is never resumed after a restart.
+class WebFileWriter final {
+public:
+	static constexpr auto kPartSize = 64 * 1024;
+	static constexpr auto kMaxRanges = 4;
+	static constexpr auto kMinRangeSize = 2 * 1024 * 1024;
+	static constexpr auto kMaxRangeRetries = 3;
+
+	struct Range {
+		int64 offset = 0; // Where the not written buffer starts.
+		int64 till = 0; // Zero for the open ended first range.
+		QByteArray buffer;
+		int retriesLeft = kMaxRangeRetries;
+		bool done = false;
+	};
+
+	explicit WebFileWriter(const QString &path);
+	WebFileWriter(const WebFileWriter &other) = delete;
+	WebFileWriter &operator=(const WebFileWriter &other) = delete;
+
+	[[nodiscard]] QString path() const;
+
+	// Starts again with a single open ended range from the beginning.
+	void restart();
+
+	void setSize(int64 size);
+	[[nodiscard]] int64 size() const;
+	void setRangesSupported();
+	[[nodiscard]] bool rangesSupported() const;
+
+	[[nodiscard]] const std::vector<Range> &ranges() const;
+
+	// Value for the "Range" header to request the rest of the range.
+	[[nodiscard]] QByteArray rangeHeader(int index) const;
+
+	// Returns false if the range should not be requested again.
+	[[nodiscard]] bool retryRange(int index);
+
+	// Leaves the beginning of a large file to the first range and
+	// returns true if the rest should be requested in other ranges.
+	[[nodiscard]] bool splitToRanges();
+
+	// Writes full parts of the received data, the rest is kept in
+	// the range buffer until more data comes or the range is complete.
+	[[nodiscard]] bool feed(int index, QByteArray data, bool complete);
+
+	[[nodiscard]] int64 received() const;
+	[[nodiscard]] bool complete() const;
+
+	// Moves the completed partial file to the path.
+	[[nodiscard]] bool finish();
+
+	~WebFileWriter();
+
+private:
+	QString _path;
+	int64 _size = 0;
+	bool _rangesSupported = false;
+	bool _finished = false;
+	std::vector<Range> _ranges;
+	std::unique_ptr<FileSink> _sink;
+
+};
+
+} // namespace Storage
@@ -0,0 +1,345 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop application for the Telegram messaging service.
+
+For license and copyright information please follow this link:
+https://github.com/telegramdesktop/tdesktop/blob/master/LEGAL
+*/
+#include "catch.hpp"
+
+#include "storage/storage_web_file.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QEventLoop>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QTimer>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+#include <functional>
+#include <map>
+
+namespace {
+
+using Storage::WebFileWriter;
+
+constexpr auto kLoadTimeout = 30 * 1000;
+
+const auto Name = QString("test.web");
+
+QByteArray Content(int size) {
+	auto result = QByteArray(size, Qt::Uninitialized);
+	for (auto i = 0; i != size; ++i) {
+		result[i] = char((i * 7 + i / 4093) & 0xFF);
+	}
+	return result;
+}
+
+QByteArray ReadAll(const QString &name) {
+	auto file = QFile(name);
+	return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+
+void EnsureApplication() {
+	if (!QCoreApplication::instance()) {
+		static auto argc = 0;
+		static QCoreApplication application(argc, nullptr);
+	}
+}
+
+// Serves the content over HTTP the way a web server does it.
+// With ranges supported it answers with "206 Partial Content",
+// otherwise the whole content is sent in each answer.
+class RangedServer final {
+public:
+	RangedServer(QByteArray content, bool rangesSupported)
+	: _content(std::move(content))
+	, _rangesSupported(rangesSupported) {
+		QObject::connect(&_server, &QTcpServer::newConnection, [=] {
+			accept();
+		});
+		_server.listen(QHostAddress::LocalHost);
+	}
+
+	// Next answers to the not first ranges are cut in the middle.
+	void dropAnswers(int count) {
+		_dropsLeft = count;
+	}
+
+	[[nodiscard]] QUrl url() const {
+		return QUrl(QString("http://127.0.0.1:%1/file").arg(
+			_server.serverPort()));
+	}
+	[[nodiscard]] int requests() const {
+		return _requests;
+	}
+	[[nodiscard]] int dropped() const {
+		return _dropped;
+	}
+
+private:
+	void accept() {
+		while (const auto socket = _server.nextPendingConnection()) {
+			QObject::connect(socket, &QTcpSocket::readyRead, [=] {
+				read(socket);
+			});
+			QObject::connect(
+				socket,
+				&QTcpSocket::disconnected,
+				socket,
+				&QObject::deleteLater);
+		}
+	}
+
+	void read(QTcpSocket *socket) {
+		auto &request = _incoming[socket];
+		request.append(socket->readAll());
+		if (!request.contains("\r\n\r\n")) {
+			return;
+		}
+		const auto range = QRegularExpression(
+			"Range: bytes=(\\d+)-(\\d*)",
+			QRegularExpression::CaseInsensitiveOption
+		).match(QString::fromLatin1(request));
+		_incoming.erase(socket);
+		answer(socket, range);
+	}
+
+	void answer(
+			QTcpSocket *socket,
+			const QRegularExpressionMatch &range) {
+		++_requests;
+
+		const auto size = int64(_content.size());
+		const auto from = (_rangesSupported && range.hasMatch())
+			? range.captured(1).toLongLong()
+			: int64(0);
+		const auto till = (_rangesSupported
+			&& range.hasMatch()
+			&& !range.captured(2).isEmpty())
+			? std::min(range.captured(2).toLongLong() + 1, size)
+			: size;
+		const auto length = till - from;
+		auto header = QByteArray();
+		if (_rangesSupported) {
+			header = "HTTP/1.1 206 Partial Content\r\n"
+				"Content-Range: bytes "
+				+ QByteArray::number(from)
+				+ '-'
+				+ QByteArray::number(till - 1)
+				+ '/'
+				+ QByteArray::number(size)
+				+ "\r\n";
+		} else {
+			header = "HTTP/1.1 200 OK\r\n";
+		}
+		header += "Content-Length: "
+			+ QByteArray::number(length)
+			+ "\r\nConnection: close\r\n\r\n";
+		socket->write(header);
+
+		// The connection is closed before all the promised data is sent.
+		const auto drop = (from > 0) && (_dropsLeft > 0);
+		if (drop) {
+			--_dropsLeft;
+			++_dropped;
+		}
+		socket->write(_content.mid(
+			int(from),
+			int(drop ? (length / 2) : length)));
+		socket->disconnectFromHost();
+	}
+
+	QTcpServer _server;
+	QByteArray _content;
+	bool _rangesSupported = false;
+	std::map<QTcpSocket*, QByteArray> _incoming;
+	int _dropsLeft = 0;
+	int _dropped = 0;
+	int _requests = 0;
+
+};
+
+struct LoadResult {
+	bool finished = false;
+	int replies = 0;
+	int64 maxBuffer = 0;
+};
+
+// Receives the file the way WebLoadManager does it for the files
+// saved right to the disk: the first reply tells the size and the
+// rest of a large file is requested in parallel ranges.
+LoadResult Load(const QUrl &url, WebFileWriter &writer) {
+	auto result = LoadResult();
+	auto loop = QEventLoop();
+	auto send = std::function<void(int)>();
+	const auto received = [&](int index, QByteArray data, bool complete) {
+		if (!writer.feed(index, std::move(data), complete)) {
+			loop.quit();
+			return;
+		}
+		for (const auto &range : writer.ranges()) {
+			result.maxBuffer = std::max(
+				result.maxBuffer,
+				int64(range.buffer.size()));
+		}
+		if (writer.complete()) {
+			result.finished = writer.finish();
+			loop.quit();
+		}
+	};
+	const auto meta = [&](QNetworkReply *reply) {
+		const auto total = QRegularExpression("/(\\d+)$").match(
+			QString::fromLatin1(reply->rawHeader("Content-Range")));
+		if (!total.hasMatch()) {
+			return;
+		}
+		writer.setSize(total.captured(1).toLongLong());
+		writer.setRangesSupported();
+		if (writer.splitToRanges()) {
+			const auto count = int(writer.ranges().size());
+			for (auto index = 1; index != count; ++index) {
+				send(index);
+			}
+		}
+	};
+
+	// Destroyed first, so that no reply outlives the callbacks.
+	auto manager = QNetworkAccessManager();
+	send = [&](int index) {
+		++result.replies;
+		auto request = QNetworkRequest(url);
+		request.setRawHeader("Range", writer.rangeHeader(index));
+		const auto reply = manager.get(request);
+		QObject::connect(reply, &QNetworkReply::metaDataChanged, [&, reply, index] {
+			if (!index) {
+				meta(reply);
+			}
+		});
+		QObject::connect(reply, &QNetworkReply::readyRead, [&, reply, index] {
+			if (writer.ranges()[index].done) {
+				return;
+			}
+			received(index, reply->readAll(), false);
+			if (writer.ranges()[index].done) {
+				reply->abort();
+			}
+		});
+		QObject::connect(reply, &QNetworkReply::finished, [&, reply, index] {
+			reply->deleteLater();
+			if (writer.ranges()[index].done) {
+				return;
+			} else if (reply->error() != QNetworkReply::NoError) {
+				if (writer.retryRange(index)) {
+					send(index);
+				} else {
+					loop.quit();
+				}
+				return;
+			}
+			if (!writer.size()) {
+				writer.setSize(reply->header(
+					QNetworkRequest::ContentLengthHeader).toLongLong());
+			}
+			received(index, reply->readAll(), true);
+		});
+	};
+	send(0);
+	QTimer::singleShot(kLoadTimeout, &loop, [&] { loop.quit(); });
+	loop.exec();
+	return result;
+}
+
+} // namespace
+
+TEST_CASE("web file writer", "[storage_web_file]") {
+	EnsureApplication();
+	QFile::remove(Name);
+	QFile::remove(Storage::PartialFilePath(Name));
+
+	SECTION("splitting a large file to aligned ranges") {
+		const auto size = int64(9 * 1024 * 1024 + 123);
+		auto writer = WebFileWriter(Name);
+		REQUIRE(writer.rangeHeader(0) == "bytes=0-");
+		writer.setSize(size);
+		REQUIRE(!writer.splitToRanges());
+		writer.setRangesSupported();
+		REQUIRE(writer.splitToRanges());
+
+		const auto &ranges = writer.ranges();
+		REQUIRE(int(ranges.size()) == WebFileWriter::kMaxRanges);
+		for (auto i = 1; i != int(ranges.size()); ++i) {
+			REQUIRE(ranges[i].offset % WebFileWriter::kPartSize == 0);
+			REQUIRE(ranges[i - 1].till == ranges[i].offset);
+		}
+		REQUIRE(ranges.back().till == size);
+		REQUIRE(writer.rangeHeader(0)
+			== "bytes=0-" + QByteArray::number(ranges[0].till - 1));
+		REQUIRE(!writer.splitToRanges());
+	}
+	SECTION("keeping small files in one range") {
+		auto writer = WebFileWriter(Name);
+		writer.setSize(WebFileWriter::kMinRangeSize + 1);
+		writer.setRangesSupported();
+		REQUIRE(!writer.splitToRanges());
+		REQUIRE(writer.ranges().size() == 1);
+	}
+	SECTION("loading ranges from a local server") {
+		const auto content = Content(9 * 1024 * 1024 + 123);
+		auto server = RangedServer(content, true);
+		{
+			auto writer = WebFileWriter(Name);
+			const auto result = Load(server.url(), writer);
+			REQUIRE(result.finished);
+			REQUIRE(result.replies == WebFileWriter::kMaxRanges);
+			REQUIRE(result.maxBuffer < WebFileWriter::kPartSize);
+		}
+		REQUIRE(server.requests() == WebFileWriter::kMaxRanges);
+		REQUIRE(ReadAll(Name) == content);
+		REQUIRE(!QFile::exists(Storage::PartialFilePath(Name)));
+	}
+	SECTION("requesting interrupted ranges from the last received byte") {
+		const auto content = Content(5 * 1024 * 1024 + 777);
+		auto server = RangedServer(content, true);
+		server.dropAnswers(2);
+		{
+			auto writer = WebFileWriter(Name);
+			const auto result = Load(server.url(), writer);
+			REQUIRE(result.finished);
+			REQUIRE(result.replies == 2 + 2);
+		}
+		REQUIRE(server.dropped() == 2);
+		REQUIRE(ReadAll(Name) == content);
+	}
+	SECTION("failing after the retries are exhausted") {
+		const auto content = Content(5 * 1024 * 1024 + 777);
+		auto server = RangedServer(content, true);
+		server.dropAnswers(WebFileWriter::kMaxRangeRetries + 1);
+		{
+			auto writer = WebFileWriter(Name);
+			const auto result = Load(server.url(), writer);
+			REQUIRE(!result.finished);
+			REQUIRE(QFile::exists(Storage::PartialFilePath(Name)));
+		}
+
+		// The partial file is not kept for a later session.
+		REQUIRE(!QFile::exists(Storage::PartialFilePath(Name)));
+		REQUIRE(!QFile::exists(Name));
+	}
+	SECTION("loading from a server without ranges") {
+		const auto content = Content(5 * 1024 * 1024 + 777);
+		auto server = RangedServer(content, false);
+		{
+			auto writer = WebFileWriter(Name);
+			const auto result = Load(server.url(), writer);
+			REQUIRE(result.finished);
+			REQUIRE(result.replies == 1);
+			REQUIRE(result.maxBuffer < WebFileWriter::kPartSize);
+		}
+		REQUIRE(ReadAll(Name) == content);
+	}
+	QFile::remove(Name);
+}
@@ -112,6 +112,8 @@ void StreamedFileDownloader::cancelRequests() {
 bool StreamedFileDownloader::loadPart() {
 	if (_finished || _nextPartIndex >= _partsCount) {
 		return false;
+	} else if (!_partsSaved && currentOffset() > 0) {
+		restoreResumedParts();
 	}
 	const auto index = std::find(
 		begin(_partIsSaved) + _nextPartIndex,
@@ -131,6 +133,15 @@ bool StreamedFileDownloader::loadPart() {
 	return true;
 }
 
+void StreamedFileDownloader::restoreResumedParts() {
+	for (auto index = 0; index != _partsCount; ++index) {
+		if (!_partIsSaved[index] && partLoadedAlready(index * kPartSize)) {
+			_partIsSaved[index] = true;
+			++_partsSaved;
+		}
+	}
+}
+
 void StreamedFileDownloader::savePart(const LoadedPart &part) {
 	Expects(part.offset >= 0 && part.offset < _reader->size());
 	Expects(part.offset % kPartSize == 0);
@@ -51,6 +51,7 @@ private:
 	void cancelRequests() override;
 	bool loadPart() override;
 
+	void restoreResumedParts();
 	void savePart(const Media::Streaming::LoadedPart &part);
 
 	uint64 _objectId = 0;
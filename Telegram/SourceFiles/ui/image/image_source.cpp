@@ -749,6 +749,7 @@ std::unique_ptr<FileLoader> WebUrlSource::createLoader(
 	return std::make_unique<webFileLoader>(
 		_url,
 		QString(),
+		LoadToCacheAsWell,
 		fromCloud,
 		autoLoading,
 		Data::kImageCacheTag);
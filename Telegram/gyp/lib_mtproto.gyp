@@ -32,10 +32,16 @@
     ],
     'include_dirs': [
       '<(src_loc)',
+      '<(libs_loc)/zlib',
     ],
     'sources': [
       '<(src_loc)/mtproto/mtp_abstract_socket.cpp',
       '<(src_loc)/mtproto/mtp_abstract_socket.h',
+      '<(src_loc)/mtproto/mtp_gzip.cpp',
+      '<(src_loc)/mtproto/mtp_gzip.h',
+      '<(src_loc)/mtproto/mtp_mpsc_queue.h',
+      '<(src_loc)/mtproto/mtp_msg_ids.h',
+      '<(src_loc)/mtproto/mtp_sharded_map.h',
       '<(src_loc)/mtproto/mtp_tcp_socket.cpp',
       '<(src_loc)/mtproto/mtp_tcp_socket.h',
       '<(src_loc)/mtproto/mtp_tls_socket.cpp',
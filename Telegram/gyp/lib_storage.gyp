@@ -42,6 +42,10 @@
       '<(src_loc)/storage/storage_clear_legacy.h',
       '<(src_loc)/storage/storage_databases.cpp',
       '<(src_loc)/storage/storage_databases.h',
+      '<(src_loc)/storage/storage_download_sessions.cpp',
+      '<(src_loc)/storage/storage_download_sessions.h',
+      '<(src_loc)/storage/storage_download_window.cpp',
+      '<(src_loc)/storage/storage_download_window.h',
       '<(src_loc)/storage/storage_encryption.cpp',
       '<(src_loc)/storage/storage_encryption.h',
       '<(src_loc)/storage/storage_encrypted_file.cpp',
@@ -49,6 +53,18 @@
       '<(src_loc)/storage/storage_file_lock_posix.cpp',
       '<(src_loc)/storage/storage_file_lock_win.cpp',
       '<(src_loc)/storage/storage_file_lock.h',
+      '<(src_loc)/storage/storage_file_sink.cpp',
+      '<(src_loc)/storage/storage_file_sink_posix.cpp',
+      '<(src_loc)/storage/storage_file_sink_win.cpp',
+      '<(src_loc)/storage/storage_file_sink.h',
+      '<(src_loc)/storage/storage_image_scale.cpp',
+      '<(src_loc)/storage/storage_image_scale.h',
+      '<(src_loc)/storage/storage_task_queue.cpp',
+      '<(src_loc)/storage/storage_task_queue.h',
+      '<(src_loc)/storage/storage_upload_sessions.cpp',
+      '<(src_loc)/storage/storage_upload_sessions.h',
+      '<(src_loc)/storage/storage_web_file.cpp',
+      '<(src_loc)/storage/storage_web_file.h',
       '<(src_loc)/storage/cache/storage_cache_binlog_reader.cpp',
       '<(src_loc)/storage/cache/storage_cache_binlog_reader.h',
       '<(src_loc)/storage/cache/storage_cache_cleaner.cpp',
@@ -59,6 +75,7 @@
       '<(src_loc)/storage/cache/storage_cache_database.h',
       '<(src_loc)/storage/cache/storage_cache_database_object.cpp',
       '<(src_loc)/storage/cache/storage_cache_database_object.h',
+      '<(src_loc)/storage/cache/storage_cache_key_map.h',
       '<(src_loc)/storage/cache/storage_cache_types.cpp',
       '<(src_loc)/storage/cache/storage_cache_types.h',
     ],
@@ -66,11 +83,13 @@
       'sources!': [
         '<(src_loc)/storage/storage_clear_legacy_posix.cpp',
         '<(src_loc)/storage/storage_file_lock_posix.cpp',
+        '<(src_loc)/storage/storage_file_sink_posix.cpp',
       ],
     }, {
       'sources!': [
         '<(src_loc)/storage/storage_clear_legacy_win.cpp',
         '<(src_loc)/storage/storage_file_lock_win.cpp',
+        '<(src_loc)/storage/storage_file_sink_win.cpp',
       ],
     }]],
   }],
@@ -23,6 +23,7 @@
     ],
     'dependencies': [
       '<!@(<(list_tests_command))',
+      'tests_mtproto',
       'tests_storage',
     ],
     'sources': [
@@ -79,6 +80,39 @@
       '<(base_loc)/base/flat_set.h',
       '<(base_loc)/base/flat_set_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_mtproto',
+    'includes': [
+      'common_test.gypi',
+      'zlib_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/mtproto/mtp_gzip.cpp',
+      '<(src_loc)/mtproto/mtp_gzip.h',
+      '<(src_loc)/mtproto/mtp_gzip_tests.cpp',
+      '<(src_loc)/mtproto/mtp_mpsc_queue.h',
+      '<(src_loc)/mtproto/mtp_mpsc_queue_tests.cpp',
+      '<(src_loc)/mtproto/mtp_msg_ids.h',
+      '<(src_loc)/mtproto/mtp_msg_ids_tests.cpp',
+      '<(src_loc)/mtproto/mtp_sharded_map.h',
+      '<(src_loc)/mtproto/mtp_sharded_map_tests.cpp',
+    ],
+  }, {
+    'target_name': 'benchmark_mtproto',
+    'includes': [
+      'common_test.gypi',
+      'zlib_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/core/benchmark_helpers.h',
+      '<(src_loc)/mtproto/mtp_gzip.cpp',
+      '<(src_loc)/mtproto/mtp_gzip.h',
+      '<(src_loc)/mtproto/mtp_gzip_benchmark.cpp',
+      '<(src_loc)/mtproto/mtp_msg_ids.h',
+      '<(src_loc)/mtproto/mtp_msg_ids_benchmark.cpp',
+      '<(src_loc)/mtproto/mtp_sharded_map.h',
+      '<(src_loc)/mtproto/mtp_sharded_map_benchmark.cpp',
+    ],
   }, {
     'target_name': 'tests_rpl',
     'includes': [
@@ -128,8 +162,15 @@
       '../lib_storage.gyp:lib_storage',
     ],
     'sources': [
+      '<(src_loc)/storage/storage_download_sessions_tests.cpp',
+      '<(src_loc)/storage/storage_download_window_tests.cpp',
       '<(src_loc)/storage/storage_encrypted_file_tests.cpp',
+      '<(src_loc)/storage/storage_file_sink_tests.cpp',
+      '<(src_loc)/storage/storage_image_scale_tests.cpp',
+      '<(src_loc)/storage/storage_upload_sessions_tests.cpp',
+      '<(src_loc)/storage/storage_web_file_tests.cpp',
       '<(src_loc)/storage/cache/storage_cache_database_tests.cpp',
+      '<(src_loc)/storage/cache/storage_cache_key_map_tests.cpp',
       '<(src_loc)/platform/win/windows_dlls.cpp',
       '<(src_loc)/platform/win/windows_dlls.h',
     ],
@@ -144,5 +185,29 @@
         '<(linux_lib_crypto)',
       ],
     }]],
+  }, {
+    'target_name': 'benchmark_storage',
+    'includes': [
+      'common_test.gypi',
+      '../helpers/modules/openssl.gypi',
+    ],
+    'dependencies': [
+      '../lib_storage.gyp:lib_storage',
+    ],
+    'sources': [
+      '<(src_loc)/core/benchmark_helpers.h',
+      '<(src_loc)/media/streaming/media_streaming_loader.cpp',
+      '<(src_loc)/media/streaming/media_streaming_loader.h',
+      '<(src_loc)/storage/storage_album_prepare_benchmark.cpp',
+      '<(src_loc)/storage/storage_encryption_benchmark.cpp',
+      '<(src_loc)/storage/storage_image_scale_benchmark.cpp',
+      '<(src_loc)/storage/storage_transfer_benchmark.cpp',
+    ],
+    'conditions': [[ 'build_linux', {
+      'libraries': [
+        '<(linux_lib_ssl)',
+        '<(linux_lib_crypto)',
+      ],
+    }]],
   }],
 }